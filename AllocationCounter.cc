@@ -0,0 +1,72 @@
+#include "AllocationCounter.hh"
+
+#include <cstdlib>
+#include <new>
+#include <atomic>
+
+namespace {
+  std::atomic<size_t> gAllocations(0);
+  thread_local bool gExcluded = false;
+
+  inline void Count() {
+    if(!gExcluded) {
+      gAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+#ifdef COUNT_ALLOCATIONS
+void* operator new(std::size_t size) {
+  Count();
+  void* result = std::malloc(size == 0 ? 1 : size);
+  if(result == nullptr) {
+    throw std::bad_alloc();
+  }
+  return result;
+}
+
+void* operator new[](std::size_t size) {
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+  Count();
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, const std::nothrow_t&) noexcept {
+  std::free(pointer);
+}
+
+void operator delete[](void* pointer, const std::nothrow_t&) noexcept {
+  std::free(pointer);
+}
+
+bool AllocationCounter::Enabled() {
+  return true;
+}
+#else
+bool AllocationCounter::Enabled() {
+  return false;
+}
+#endif
+
+size_t AllocationCounter::Allocations() {
+  return gAllocations.load(std::memory_order_relaxed);
+}
+
+void AllocationCounter::ExcludeThread() {
+  gExcluded = true;
+}
@@ -0,0 +1,18 @@
+#ifndef __ALLOCATION_COUNTER_HH
+#define __ALLOCATION_COUNTER_HH
+
+#include <cstddef>
+
+//counts the heap allocations of all threads in one global counter, threads that aren't part of what is measured (e.g. the decoding
+//or a status thread) can exclude themselves; threads started by libraries (thread pools, ROOT) are always counted
+//only active if compiled with COUNT_ALLOCATIONS defined (make COUNT_ALLOCATIONS=1), this replaces the global operator new
+class AllocationCounter {
+public:
+  static bool Enabled();
+  //number of allocations of all counted threads so far
+  static size_t Allocations();
+  //the allocations of the calling thread aren't counted from now on
+  static void ExcludeThread();
+};
+
+#endif
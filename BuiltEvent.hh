@@ -0,0 +1,152 @@
+#ifndef __BUILT_EVENT_HH
+#define __BUILT_EVENT_HH
+
+#include <vector>
+#include <array>
+#include <utility>
+#include <algorithm>
+#include <iterator>
+
+#include "Hit.hh"
+
+//group of coincident hits as produced by the event builder
+//events are recycled: Clear() keeps the storage of the hits, so refilling an event doesn't allocate memory
+//the event keeps its own copy of the FIFO event records of its hits, so it doesn't depend on the builder's tables
+class BuiltEvent {
+public:
+  BuiltEvent() {
+    fMultiplicity.fill(0);
+  }
+  ~BuiltEvent(){};
+  //moving is cheap (the hits aren't copied), copying should not be necessary
+  BuiltEvent(BuiltEvent&&) = default;
+  BuiltEvent& operator=(BuiltEvent&&) = default;
+  BuiltEvent(const BuiltEvent&) = delete;
+  BuiltEvent& operator=(const BuiltEvent&) = delete;
+
+  void Clear() {
+    fHits.clear();
+    fRecords.Clear();
+    fSources.clear();
+    fMultiplicity.fill(0);
+  }
+  //adds the hit and copies its record from the source table (once per record, hits of the same FIFO event are usually close together)
+  void Add(const Hit& hit, const FifoRecords& source) {
+    fHits.push_back(hit);
+    auto found = std::find(fSources.rbegin(), fSources.rend(), hit.fFifoRecord);
+    if(found != fSources.rend()) {
+      fHits.back().fFifoRecord = std::distance(found, fSources.rend()) - 1;
+    } else {
+      fHits.back().fFifoRecord = fRecords.Copy(source, hit.fFifoRecord);
+      fSources.push_back(hit.fFifoRecord);
+    }
+    if(hit.fDetectorType < NOF_DETECTOR_TYPES) {
+      ++fMultiplicity[hit.fDetectorType];
+    }
+  }
+
+  //exchange the contents (including the storage) of the two events
+  void Swap(BuiltEvent& rh) {
+    fHits.swap(rh.fHits);
+    fRecords.Swap(rh.fRecords);
+    fSources.swap(rh.fSources);
+    fMultiplicity.swap(rh.fMultiplicity);
+  }
+
+  size_t NofHits() const {
+    return fHits.size();
+  }
+  const std::vector<Hit>& Hits() const {
+    return fHits;
+  }
+  const Hit& GetHit(size_t index) const {
+    return fHits[index];
+  }
+  const FifoRecords& Records() const {
+    return fRecords;
+  }
+
+  int Multiplicity(const EDetectorType& detectorType) const {
+    return fMultiplicity[static_cast<size_t>(detectorType)];
+  }
+
+private:
+  std::vector<Hit> fHits;
+  FifoRecords fRecords;
+  //index of each record in the source table
+  std::vector<uint32_t> fSources;
+  std::array<uint16_t, NOF_DETECTOR_TYPES> fMultiplicity;
+};
+
+//ring of recycled event slots: popping an event only advances the read position, the slot (and its storage) is reused by the next push
+//not thread-safe, access needs to be guarded by the user
+class BuiltEventBuffer {
+public:
+  BuiltEventBuffer(size_t capacity = 0) {
+    fSlots.resize(capacity);
+    fFront = 0;
+    fSize = 0;
+  }
+  ~BuiltEventBuffer(){};
+
+  size_t Capacity() const {
+    return fSlots.size();
+  }
+  size_t Size() const {
+    return fSize;
+  }
+  bool Empty() const {
+    return fSize == 0;
+  }
+  bool Full() const {
+    return fSize == fSlots.size();
+  }
+
+  //exchange the contents (including the storage) of the two buffers
+  void Swap(BuiltEventBuffer& rh) {
+    fSlots.swap(rh.fSlots);
+    std::swap(fFront, rh.fFront);
+    std::swap(fSize, rh.fSize);
+  }
+
+  //increase the number of slots (keeps the order of the stored events)
+  void Grow(size_t nofSlots) {
+    std::vector<BuiltEvent> slots(fSlots.size() + nofSlots);
+    for(size_t i = 0; i < fSlots.size(); ++i) {
+      slots[i].Swap(fSlots[(fFront + i)%fSlots.size()]);
+    }
+    fSlots.swap(slots);
+    fFront = 0;
+  }
+
+  //swaps the event into the next free slot, the event gets the (cleared) storage of the slot in return
+  //returns false if the buffer is full
+  bool Push(BuiltEvent& event) {
+    if(Full()) {
+      return false;
+    }
+    BuiltEvent& slot = fSlots[(fFront + fSize)%fSlots.size()];
+    slot.Swap(event);
+    event.Clear();
+    ++fSize;
+    return true;
+  }
+
+  BuiltEvent& Front() {
+    return fSlots[fFront];
+  }
+  void Pop() {
+    if(fSize == 0) {
+      return;
+    }
+    fFront = (fFront + 1)%fSlots.size();
+    --fSize;
+  }
+
+private:
+  std::vector<BuiltEvent> fSlots;
+  size_t fFront;
+  size_t fSize;
+};
+
+#endif
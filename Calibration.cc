@@ -1,5 +1,8 @@
 #include "Calibration.hh"
 
+#include <vector>
+#include <memory>
+
 #include "TList.h"
 #include "TF1.h"
 #include "TSpectrum.h"
@@ -7,11 +10,16 @@
 
 #include "TextAttributes.hh"
 
+#include "PeakFinder.hh"
+#include "LineMatcher.hh"
+
 //numeric_limits<uint16_t>::min(),numeric_limits<uint16_t>::max()
 
 Calibration::Calibration(Settings* settings)
-  : fSettings(settings) {
-  std::cout<<"got settings sigma "<<fSettings->Sigma()<<std::endl;
+  : fSettings(settings), fCache(nullptr), fPath(ECalibrationPath::kNone) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<"got settings sigma "<<fSettings->Sigma()<<std::endl;
+  }
 }
 
 double Calibration::operator()(double* x, double* p) {
@@ -23,54 +31,243 @@ TGraph Calibration::Calibrate(const uint8_t& detectorType, const uint16_t& detec
   double minX = histogram->GetBinLowEdge(1);
   double maxX = histogram->GetBinLowEdge(nofBins+1);
 
+  fPath = ECalibrationPath::kNone;
+
+  std::vector<float> data(nofBins);
+  for(int i = 0; i < nofBins; ++i) {
+    data[i] = histogram->GetBinContent(i+1);
+  }
+
+  //a function read from file can't be evaluated anymore (it uses this class as functor), so we only keep its parameters
+  //and replace it with a new one
+  bool calibrated = false;
+  double previousGain = 0.;
+  double previousOffset = 0.;
   TF1* calibration = histogram->GetFunction("Calibration");
-  if(calibration == nullptr) {
-    //if this is the first time calibrating, we need to create a new calibration function
-    //and try to find the peaks based on the settings provided
-    calibration = new TF1("Calibration",this,minX,maxX,2);
-    TGraph peaks = FindPeaks(detectorType, detectorNumber, histogram);
+  if(calibration != nullptr) {
+    calibrated = true;
+    previousGain = calibration->GetParameter(0);
+    previousOffset = calibration->GetParameter(1);
+    histogram->GetListOfFunctions()->Remove(calibration);
+    delete calibration;
+  }
+  calibration = new TF1("Calibration",this,minX,maxX,2);
+  calibration->SetParNames("gain","offset");
+
+  uint64_t fingerprint = 0;
+  CalibrationCacheEntry cached;
+  if(fCache != nullptr) {
+    fingerprint = fCache->Fingerprint(detectorType, detectorNumber, data);
+    //an unchanged histogram doesn't need to be fitted again
+    if(fCache->Find(fingerprint, cached)) {
+      histogram->GetListOfFunctions()->Add(calibration);
+      calibration->SetParameters(cached.fGain, cached.fOffset);
+      calibration->SetChisquare(cached.fChiSquare);
+      calibration->SetNDF(cached.fNdf);
+      TGraph peaks;
+      for(const auto& peak : cached.fPeaks) {
+	peaks.SetPoint(peaks.GetN(), peak.first, peak.second);
+      }
+      fPath = ECalibrationPath::kCache;
+      return peaks;
+    }
+  }
+
+  //if we calibrated before (this histogram or the same detector in the cache), we should only have a small shift in the calibration,
+  //so we look for the peaks close to where the previous calibration puts them
+  //(not for detectors without peaks in the settings, the matching searches the whole spectrum anyway and weak source lines close
+  //to strong ones would be assigned the wrong peak within the maximum shift)
+  TGraph peaks;
+  double gain = 1.;
+  double offset = 1.;
+  bool matchLines = (fSettings->NofPeaks(detectorType, detectorNumber) == 0);
+  if(calibrated && !matchLines) {
+    peaks = FindShiftedPeaks(detectorType, detectorNumber, data, previousGain, previousOffset);
+    gain = previousGain;
+    offset = previousOffset;
+  } else if(!matchLines && fCache != nullptr && fCache->Newest(detectorType, detectorNumber, cached)) {
+    peaks = FindShiftedPeaks(detectorType, detectorNumber, data, cached.fGain, cached.fOffset);
+    gain = cached.fGain;
+    offset = cached.fOffset;
+  }
+  if(peaks.GetN() >= 2) {
+    fPath = ECalibrationPath::kShift;
+  } else if(matchLines) {
+    peaks = MatchLines(detectorType, detectorNumber, data);
+    if(peaks.GetN() < 2) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to match the source lines to the peaks in histogram '"<<histogram->GetName()<<"'"<<Attribs::Reset<<std::endl;
+      delete calibration;
+      return TGraph();
+    }
+    fPath = ECalibrationPath::kMatch;
+  } else {
+    //if this is the first time calibrating (or the shift was too large), we try to find the peaks based on the settings provided
+    peaks = FindPeaks(detectorType, detectorNumber, histogram, fSettings->PeakFinder());
     if(peaks.GetN() < 2) {
       std::cerr<<Attribs::Bright<<Foreground::Red<<"Found only "<<peaks.GetN()<<" peaks in histogram '"<<histogram->GetName()<<"'"<<Attribs::Reset<<std::endl;
+      delete calibration;
       return TGraph();
     }
-    //now we can fit the peaks with the new calibration function
-    calibration->SetParNames("gain","offset");
-    calibration->SetParameters(1.,1.);
-    peaks.Fit(calibration);
-    histogram->GetListOfFunctions()->Add(calibration);
+    gain = 1.;
+    offset = 1.;
+    fPath = ECalibrationPath::kSearch;
+  }
+
+  //now we can fit the peaks with the calibration function (quietly, several detectors might be fitted at the same time)
+  calibration->SetParameters(gain, offset);
+  peaks.Fit(calibration, fSettings->VerbosityLevel() > 1 ? "" : "Q");
+  histogram->GetListOfFunctions()->Add(calibration);
+
+  if(fCache != nullptr) {
+    CalibrationCacheEntry entry;
+    entry.fFingerprint = fingerprint;
+    entry.fDetectorType = detectorType;
+    entry.fDetectorNumber = detectorNumber;
+    entry.fGain = calibration->GetParameter(0);
+    entry.fOffset = calibration->GetParameter(1);
+    entry.fChiSquare = calibration->GetChisquare();
+    entry.fNdf = calibration->GetNDF();
+    for(int i = 0; i < peaks.GetN(); ++i) {
+      entry.fPeaks.push_back(std::make_pair(peaks.GetX()[i], peaks.GetY()[i]));
+    }
+    fCache->Add(entry);
+  }
+
+  return peaks;
+}
+
+//energy = gain*(channel - offset), so each peak is expected at energy/gain + offset
+TGraph Calibration::FindShiftedPeaks(const uint8_t& detectorType, const uint16_t& detectorNumber, const std::vector<float>& data, double gain, double offset) {
+  TGraph peaks;
+  if(gain <= 0.) {
+    return peaks;
+  }
+  PeakFinder peakFinder(fSettings->Sigma(), fSettings->PeakFinderRebin(), fSettings->PeakFinderMinSignificance());
+  FoundPeak peak;
+  for(int i = 0; i < fSettings->NofPeaks(detectorType, detectorNumber); ++i) {
+    double expected = fSettings->Energy(detectorType, detectorNumber, i)/gain + offset;
+    if(peakFinder.Find(data, static_cast<int>(expected) - fSettings->CalibrationMaxShift(), static_cast<int>(expected) + fSettings->CalibrationMaxShift(), peak)) {
+      peaks.SetPoint(peaks.GetN(),peak.fPosition,fSettings->Energy(detectorType, detectorNumber, i));
+    }
+  }
+  if(fSettings->VerbosityLevel() > 2) {
+    std::cout<<"found "<<peaks.GetN()<<" of "<<fSettings->NofPeaks(detectorType, detectorNumber)<<" peaks within "<<fSettings->CalibrationMaxShift()<<" channels of the previous calibration"<<std::endl;
+  }
+
+  return peaks;
+}
+
+TGraph Calibration::MatchLines(const uint8_t& detectorType, const uint16_t& detectorNumber, const std::vector<float>& data) {
+  TGraph peaks;
+  LineMatcher matcher(fSettings);
+  std::vector<std::string> sources = fSettings->CalibrationSources(detectorType);
+  if(!matcher.Sources(sources)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Unknown calibration source in";
+    for(const auto& source : sources) {
+      std::cerr<<" "<<source;
+    }
+    std::cerr<<", known sources are";
+    for(const auto& source : LineMatcher::KnownSources()) {
+      std::cerr<<" "<<source;
+    }
+    std::cerr<<Attribs::Reset<<std::endl;
+    return peaks;
+  }
+
+  PeakFinder peakFinder(fSettings->Sigma(), fSettings->PeakFinderRebin(), fSettings->PeakFinderMinSignificance());
+  std::vector<FoundPeak> found;
+  peakFinder.FindAll(data, fSettings->MatchMinChannel(), data.size() - 1, fSettings->MatchMaxPeaks(), found);
+  LineMatch match;
+  if(!matcher.Match(found, match)) {
+    if(fSettings->VerbosityLevel() > 1) {
+      std::cout<<"failed to match "<<matcher.Lines().size()<<" lines to "<<found.size()<<" peaks of detector "<<detectorNumber<<std::endl;
+    }
     return peaks;
   }
-  //we calibrated before, so we should only have a small shift in the calibration
+  for(const auto& peak : match.fPeaks) {
+    if(fSettings->VerbosityLevel() > 3) {
+      std::cout<<"peak at "<<peak.first<<" matched to "<<peak.second<<" keV"<<std::endl;
+    }
+    peaks.SetPoint(peaks.GetN(),peak.first,peak.second);
+  }
+
+  return peaks;
+}
 
-  return TGraph();  
+void Calibration::Write(std::ostream& output, const uint8_t& detectorType, const uint16_t& detectorNumber, TH1I* histogram) {
+  TF1* calibration = histogram->GetFunction("Calibration");
+  if(calibration == nullptr) {
+    return;
+  }
+  const char* names[] = { "Germanium", "Plastic", "Silicon", "BaF2" };
+  if(detectorType >= sizeof(names)/sizeof(names[0])) {
+    return;
+  }
+  //same parameters as operator(): energy = gain*(channel - offset)
+  output<<names[detectorType]<<"."<<detectorNumber<<".Gain:\t"<<calibration->GetParameter(0)<<std::endl
+	<<names[detectorType]<<"."<<detectorNumber<<".Offset:\t"<<calibration->GetParameter(1)<<std::endl;
 }
 
-TGraph Calibration::FindPeaks(const uint8_t& detectorType, const uint16_t& detectorNumber, TH1I* histogram) {
+TGraph Calibration::FindPeaks(const uint8_t& detectorType, const uint16_t& detectorNumber, TH1I* histogram, EPeakFinder peakFinder) {
+  if(peakFinder == EPeakFinder::kFast) {
+    return FastSearch(detectorType, detectorNumber, histogram);
+  }
+  return SearchHighRes(detectorType, detectorNumber, histogram);
+}
+
+//only the rough windows are searched, each for its strongest peak
+TGraph Calibration::FastSearch(const uint8_t& detectorType, const uint16_t& detectorNumber, TH1I* histogram) {
+  int nofBins = histogram->GetNbinsX();
+  std::vector<float> data(nofBins);
+  for(int i = 0; i < nofBins; ++i) {
+    data[i] = histogram->GetBinContent(i+1);
+  }
+
+  PeakFinder peakFinder(fSettings->Sigma(), fSettings->PeakFinderRebin(), fSettings->PeakFinderMinSignificance());
+  FoundPeak peak;
+  TGraph peaks;
+  for(int i = 0; i < fSettings->NofPeaks(detectorType, detectorNumber); ++i) {
+    std::pair<uint16_t, uint16_t> window = fSettings->RoughWindow(detectorType, detectorNumber, i);
+    if(!peakFinder.Find(data, window.first, window.second, peak)) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to find peak for window "<<i<<": "<<std::flush<<fSettings->PrintWindow(detectorType, detectorNumber, i)<<Attribs::Reset<<std::endl;
+      continue;
+    }
+    if(fSettings->VerbosityLevel() > 3) {
+      std::cout<<"window "<<i<<": peak at "<<peak.fPosition<<" (amplitude "<<peak.fAmplitude<<", sigma "<<peak.fSigma<<", significance "<<peak.fSignificance<<(peak.fFitted ? "" : ", centroid")<<")"<<std::endl;
+    }
+    peaks.SetPoint(peaks.GetN(),peak.fPosition,fSettings->Energy(detectorType, detectorNumber, i));
+  }
+
+  return peaks;
+}
+
+TGraph Calibration::SearchHighRes(const uint8_t& detectorType, const uint16_t& detectorNumber, TH1I* histogram) {
   int nofBins = histogram->GetNbinsX();
   double minX = histogram->GetBinLowEdge(1);
   double maxX = histogram->GetBinLowEdge(nofBins+1);
 
-  //get the data from the histogram, since we need these to be doubles, we can't use GetArray()
-  float* data = new float[nofBins];
+  //get the data from the histogram, since we need these to be floats, we can't use GetArray()
+  std::vector<float> data(nofBins);
   for(int i = 0; i < nofBins; ++i) {
     data[i] = histogram->GetBinContent(i+1);
   }
-  float* deconv = new float[nofBins];
+  std::vector<float> deconv(nofBins);
 
   //find the peaks
   TSpectrum spectrum;
   if(fSettings->VerbosityLevel() > 3) {
     std::cout<<"Starting SearchHighRes(data, deconv, "<<nofBins<<", "<<fSettings->Sigma()<<", "<<fSettings->PeakThreshold()<<", false, "<<fSettings->NofDeconvIterations()<<",false,0)"<<std::endl;
   }
-  Int_t nofPeaks = spectrum.SearchHighRes(data,deconv,nofBins,fSettings->Sigma(),fSettings->PeakThreshold(),false,fSettings->NofDeconvIterations(),false,0);
+  Int_t nofPeaks = spectrum.SearchHighRes(data.data(),deconv.data(),nofBins,fSettings->Sigma(),fSettings->PeakThreshold(),false,fSettings->NofDeconvIterations(),false,0);
   if(nofPeaks <= 0) {
     std::cout<<Attribs::Bright<<Foreground::Red<<"SearchHighRes(data, deconv, "<<nofBins<<", "<<fSettings->Sigma()<<", "<<fSettings->PeakThreshold()<<", false, "<<fSettings->NofDeconvIterations()<<",false,0) failed!"<<Attribs::Reset<<std::endl;
     return TGraph();
   }
   float* posX = spectrum.GetPositionX();
-  float* posY = new float[nofPeaks];
-  Bool_t* fixPosition = new Bool_t[nofPeaks];
-  Bool_t* fixAmplitude = new Bool_t[nofPeaks];
+  std::vector<float> posY(nofPeaks);
+  //std::vector<bool> has no data(), so the flags are kept in plain arrays
+  std::unique_ptr<Bool_t[]> fixPosition(new Bool_t[nofPeaks]);
+  std::unique_ptr<Bool_t[]> fixAmplitude(new Bool_t[nofPeaks]);
   for(int i = 0; i < nofPeaks; ++i) {
     posY[i] = histogram->GetBinContent(1+Int_t(posX[i]+0.5));
     fixPosition[i] = true;
@@ -82,8 +279,8 @@ TGraph Calibration::FindPeaks(const uint8_t& detectorType, const uint16_t& detec
   //min. x, max. x, # iterations, convergence coeff., statistics type, convergence algorithm optim., powers, oder of Taylor expans.
   spectrumFit.SetFitParameters(minX, maxX, fSettings->NofFitIterations(), fSettings->FitConvergenceCoeff(), spectrumFit.kFitOptimChiFuncValues, spectrumFit.kFitAlphaHalving, spectrumFit.kFitPower2, spectrumFit.kFitTaylorOrderFirst);  
   //sigma, fix sigma?, init. pos., fix position (array)?, init. ampl., fix ampl. (array)?
-  spectrumFit.SetPeakParameters(fSettings->Sigma(), false, posX, fixPosition, posY, fixAmplitude);  
-  spectrumFit.FitAwmi(data);
+  spectrumFit.SetPeakParameters(fSettings->Sigma(), false, posX, fixPosition.get(), posY.data(), fixAmplitude.get());  
+  spectrumFit.FitAwmi(data.data());
   Double_t* fitPos = spectrumFit.GetPositions();
   Double_t* fitAmp = spectrumFit.GetAmplitudes();
   
@@ -112,13 +309,11 @@ TGraph Calibration::FindPeaks(const uint8_t& detectorType, const uint16_t& detec
       }
     }
   }
-  TGraph peaks(peakPos.size());
-  for(size_t i = 0; i < peakPos.size();) {
+  //windows without a peak are skipped
+  TGraph peaks;
+  for(size_t i = 0; i < peakPos.size(); ++i) {
     if(peakPos[i] >= 0) {
-      peaks.SetPoint(i,fitPos[peakPos[i]],fSettings->Energy(detectorType, detectorNumber, i));
-      ++i;
-    } else {
-      peaks.RemovePoint(i);
+      peaks.SetPoint(peaks.GetN(),fitPos[peakPos[i]],fSettings->Energy(detectorType, detectorNumber, i));
     }
   }
 
@@ -1,28 +1,59 @@
 #ifndef __CALIBRATION_HH
 #define __CALIBRATION_HH
 
+#include <ostream>
+
 #include "TGraph.h"
 #include "TH1I.h"
 
 #include "Settings.hh"
+#include "CalibrationCache.hh"
+
+//how the last calibration was obtained
+enum class ECalibrationPath : uint8_t {
+  kNone,//failed
+  kCache,//unchanged histogram, taken from the cache
+  kShift,//peaks found close to the previous calibration
+  kSearch,//peaks found in the rough windows
+  kMatch//peaks of the whole spectrum matched to the lines of the calibration sources
+};
 
 class Calibration {
 public:
   Calibration(Settings*);
-  Calibration(){};
+  Calibration()
+    : fSettings(nullptr), fCache(nullptr), fPath(ECalibrationPath::kNone) {};
   ~Calibration(){};
 
   double operator()(double*, double*);
   TGraph Calibrate(const uint8_t&, const uint16_t&, TH1I*);
+  //writes the calibration of the histogram in the format read by EnergyCalibration (applied to the hits by the unpacker)
+  void Write(std::ostream&, const uint8_t&, const uint16_t&, TH1I*);
+  //positions of the peaks in the rough windows vs. their energies (windows without a peak are skipped)
+  TGraph FindPeaks(const uint8_t&, const uint16_t&, TH1I*, EPeakFinder);
 
   void SetSettings(Settings* settings) {
     fSettings = settings;
   }
+  //the cache can be shared by several calibrations
+  void SetCache(CalibrationCache* cache) {
+    fCache = cache;
+  }
+  ECalibrationPath Path() {
+    return fPath;
+  }
 
 private:
-  TGraph FindPeaks(const uint8_t&, const uint16_t&, TH1I*);
+  TGraph SearchHighRes(const uint8_t&, const uint16_t&, TH1I*);
+  TGraph FastSearch(const uint8_t&, const uint16_t&, TH1I*);
+  //searches the peaks around the positions given by gain and offset
+  TGraph FindShiftedPeaks(const uint8_t&, const uint16_t&, const std::vector<float>&, double, double);
+  //finds the strongest peaks of the whole spectrum and matches them to the lines of the calibration sources (no rough windows needed)
+  TGraph MatchLines(const uint8_t&, const uint16_t&, const std::vector<float>&);
 
   Settings* fSettings;
+  CalibrationCache* fCache;
+  ECalibrationPath fPath;
 };
 
 #endif
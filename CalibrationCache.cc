@@ -0,0 +1,184 @@
+#include "CalibrationCache.hh"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm>
+
+namespace {
+  const uint64_t kFnvOffset = 14695981039346656037ULL;
+  const uint64_t kFnvPrime = 1099511628211ULL;
+
+  template<class T> void Hash(uint64_t& hash, const T& value) {
+    unsigned char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    for(size_t i = 0; i < sizeof(T); ++i) {
+      hash ^= bytes[i];
+      hash *= kFnvPrime;
+    }
+  }
+}
+
+CalibrationCache::CalibrationCache(Settings* settings) {
+  fSettings = settings;
+  fDepth = std::max(settings->CalibrationCacheDepth(), 1);
+  fNofHits = 0;
+}
+
+//each line: fingerprint (hex), detector type, detector number, gain, offset, chi-square, ndf, number of peaks, and their positions and energies
+bool CalibrationCache::Read(const std::string& fileName) {
+  std::ifstream file(fileName.c_str());
+  if(!file.is_open()) {
+    if(fSettings->VerbosityLevel() > 0) {
+      std::cout<<"No calibration cache '"<<fileName<<"' yet"<<std::endl;
+    }
+    return true;
+  }
+
+  std::lock_guard<std::mutex> lock(fMutex);
+  std::string line;
+  while(std::getline(file, line)) {
+    line = line.substr(0, line.find('#'));
+    if(line.find_first_not_of(" \t\r") == std::string::npos) {
+      continue;
+    }
+    std::istringstream stream(line);
+    CalibrationCacheEntry entry;
+    int detectorType;
+    size_t nofPeaks;
+    stream>>std::hex>>entry.fFingerprint>>std::dec>>detectorType>>entry.fDetectorNumber>>entry.fGain>>entry.fOffset>>entry.fChiSquare>>entry.fNdf>>nofPeaks;
+    entry.fDetectorType = detectorType;
+    entry.fPeaks.resize(nofPeaks);
+    for(auto& peak : entry.fPeaks) {
+      stream>>peak.first>>peak.second;
+    }
+    if(stream.fail()) {
+      std::cerr<<"Failed to read calibration cache entry '"<<line<<"' from '"<<fileName<<"'"<<std::endl;
+      return false;
+    }
+    fEntries.push_back(entry);
+  }
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Read "<<fEntries.size()<<" entries from calibration cache '"<<fileName<<"'"<<std::endl;
+  }
+
+  return true;
+}
+
+bool CalibrationCache::Write(const std::string& fileName) {
+  std::ofstream file(fileName.c_str());
+  if(!file.is_open()) {
+    std::cerr<<"Failed to open calibration cache '"<<fileName<<"' for writing"<<std::endl;
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(fMutex);
+  file<<"# fingerprint type detector gain offset chi2 ndf nofPeaks (position energy)..."<<std::endl
+      <<std::setprecision(17);
+  for(const auto& entry : fEntries) {
+    file<<std::hex<<entry.fFingerprint<<std::dec<<" "<<(int)entry.fDetectorType<<" "<<entry.fDetectorNumber<<" "<<entry.fGain<<" "<<entry.fOffset<<" "
+	<<entry.fChiSquare<<" "<<entry.fNdf<<" "<<entry.fPeaks.size();
+    for(const auto& peak : entry.fPeaks) {
+      file<<" "<<peak.first<<" "<<peak.second;
+    }
+    file<<std::endl;
+  }
+
+  return file.good();
+}
+
+uint64_t CalibrationCache::Fingerprint(uint8_t detectorType, uint16_t detectorNumber, const std::vector<float>& data) {
+  uint64_t hash = kFnvOffset;
+  Hash(hash, detectorType);
+  Hash(hash, detectorNumber);
+  for(auto content : data) {
+    Hash(hash, content);
+  }
+
+  //everything that changes the result of the calibration
+  Hash(hash, fSettings->PeakFinder());
+  Hash(hash, fSettings->Sigma());
+  Hash(hash, fSettings->PeakThreshold());
+  Hash(hash, fSettings->NofDeconvIterations());
+  Hash(hash, fSettings->NofFitIterations());
+  Hash(hash, fSettings->FitConvergenceCoeff());
+  Hash(hash, fSettings->PeakFinderRebin());
+  Hash(hash, fSettings->PeakFinderMinSignificance());
+  int nofPeaks = fSettings->NofPeaks(detectorType, detectorNumber);
+  Hash(hash, nofPeaks);
+  for(int i = 0; i < nofPeaks; ++i) {
+    Hash(hash, fSettings->RoughWindow(detectorType, detectorNumber, i));
+    Hash(hash, fSettings->Energy(detectorType, detectorNumber, i));
+  }
+  //detectors without peaks are calibrated by matching the source lines
+  if(nofPeaks == 0) {
+    for(const auto& source : fSettings->CalibrationSources(detectorType)) {
+      for(auto character : source) {
+	Hash(hash, character);
+      }
+      Hash(hash, ' ');
+    }
+    Hash(hash, fSettings->MatchTolerance());
+    Hash(hash, fSettings->MatchMinGain());
+    Hash(hash, fSettings->MatchMaxGain());
+    Hash(hash, fSettings->MatchMinLines());
+    Hash(hash, fSettings->MatchMaxPeaks());
+    Hash(hash, fSettings->MatchMinChannel());
+    Hash(hash, fSettings->MatchMinIntensity());
+  }
+
+  return hash;
+}
+
+bool CalibrationCache::Find(uint64_t fingerprint, CalibrationCacheEntry& entry) {
+  std::lock_guard<std::mutex> lock(fMutex);
+  for(auto it = fEntries.rbegin(); it != fEntries.rend(); ++it) {
+    if(it->fFingerprint == fingerprint) {
+      entry = *it;
+      ++fNofHits;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool CalibrationCache::Newest(uint8_t detectorType, uint16_t detectorNumber, CalibrationCacheEntry& entry) {
+  std::lock_guard<std::mutex> lock(fMutex);
+  for(auto it = fEntries.rbegin(); it != fEntries.rend(); ++it) {
+    if(it->fDetectorType == detectorType && it->fDetectorNumber == detectorNumber) {
+      entry = *it;
+      return true;
+    }
+  }
+  return false;
+}
+
+void CalibrationCache::Add(const CalibrationCacheEntry& entry) {
+  std::lock_guard<std::mutex> lock(fMutex);
+  for(auto it = fEntries.begin(); it != fEntries.end(); ++it) {
+    if(it->fFingerprint == entry.fFingerprint) {
+      fEntries.erase(it);
+      break;
+    }
+  }
+  fEntries.push_back(entry);
+
+  //remove the oldest entries of this detector
+  size_t nofEntries = 0;
+  for(auto it = fEntries.rbegin(); it != fEntries.rend(); ++it) {
+    if(it->fDetectorType == entry.fDetectorType && it->fDetectorNumber == entry.fDetectorNumber) {
+      ++nofEntries;
+    }
+  }
+  for(auto it = fEntries.begin(); it != fEntries.end() && nofEntries > fDepth;) {
+    if(it->fDetectorType == entry.fDetectorType && it->fDetectorNumber == entry.fDetectorNumber) {
+      it = fEntries.erase(it);
+      --nofEntries;
+    } else {
+      ++it;
+    }
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef __CALIBRATION_CACHE_HH
+#define __CALIBRATION_CACHE_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <stdint.h>
+
+#include "Settings.hh"
+
+//calibration of one detector as stored in the cache
+struct CalibrationCacheEntry {
+  uint64_t fFingerprint;
+  uint8_t fDetectorType;
+  uint16_t fDetectorNumber;
+  double fGain;
+  double fOffset;
+  double fChiSquare;
+  int fNdf;
+  std::vector<std::pair<double, double> > fPeaks;//position and energy
+};
+
+//on-disk cache of calibrations, keyed by a fingerprint of the histogram contents and the calibration settings
+//of the detector: a histogram with a known fingerprint doesn't need to be fitted again, and the newest calibration of a detector
+//is the starting point for the next one
+//the file is a text file with one calibration per line, the newest last, and only the newest entries of each detector are kept
+//all methods can be called from several threads
+class CalibrationCache {
+public:
+  CalibrationCache(Settings*);
+  ~CalibrationCache(){};
+
+  //a missing file is an empty cache
+  bool Read(const std::string&);
+  bool Write(const std::string&);
+
+  //hash (FNV-1a) of the bin contents and of the calibration settings of the detector
+  uint64_t Fingerprint(uint8_t, uint16_t, const std::vector<float>&);
+
+  //calibration with this fingerprint
+  bool Find(uint64_t, CalibrationCacheEntry&);
+  //newest calibration of the detector
+  bool Newest(uint8_t, uint16_t, CalibrationCacheEntry&);
+  //replaces an entry with the same fingerprint, the oldest entries of the detector are removed beyond the depth of the cache
+  void Add(const CalibrationCacheEntry&);
+
+  size_t NofEntries() {
+    return fEntries.size();
+  }
+  size_t NofHits() {
+    return fNofHits;
+  }
+
+private:
+  Settings* fSettings;
+  size_t fDepth;
+  std::mutex fMutex;
+  //ordered from oldest to newest
+  std::vector<CalibrationCacheEntry> fEntries;
+  size_t fNofHits;
+};
+
+#endif
@@ -0,0 +1,291 @@
+#include "CalibrationDriver.hh"
+
+#include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <future>
+#include <algorithm>
+
+#include "TF1.h"
+#include "TROOT.h"
+#include "Math/MinimizerOptions.h"
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+#include "ThreadPool.hh"
+
+namespace {
+  const char* gDetectorTypeNames[] = { "Germanium", "Plastic", "Silicon", "BaF2" };
+
+  //the workers only use their own ROOT objects, but ROOT still needs to protect its global state
+  void PrepareThreads() {
+    ROOT::EnableThreadSafety();
+    TF1::DefaultAddToGlobalList(false);
+    ROOT::Math::MinimizerOptions::SetDefaultMinimizer("Minuit2");
+  }
+
+  double Seconds(std::chrono::high_resolution_clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::duration<double> >(duration).count();
+  }
+}
+
+CalibrationDriver::CalibrationDriver(Settings* settings)
+  : fCache(settings) {
+  fSettings = settings;
+  fWallTime = std::chrono::high_resolution_clock::duration::zero();
+}
+
+CalibrationDriver::~CalibrationDriver() {
+  for(auto histogram : fHistograms) {
+    delete histogram;
+  }
+}
+
+size_t CalibrationDriver::Read(TFile* file) {
+  std::vector<int> nofDetectors = { fSettings->NofGermaniumDetectors(), fSettings->NofPlasticDetectors(), fSettings->NofSiliconDetectors(), fSettings->NofBaF2Detectors() };
+  for(size_t type = 0; type < nofDetectors.size(); ++type) {
+    for(int det = 0; det < nofDetectors[type]; ++det) {
+      if(!fSettings->Active(static_cast<EDetectorType>(type), det)) {
+	continue;
+      }
+      TH1I* histogram = dynamic_cast<TH1I*>(file->Get(Form("raw%s_%d",gDetectorTypeNames[type],det)));
+      if(histogram == nullptr) {
+	if(fSettings->VerbosityLevel() > 0) {
+	  std::cout<<"Failed to find histogram 'raw"<<gDetectorTypeNames[type]<<"_"<<det<<"' in "<<file->GetName()<<std::endl;
+	}
+	continue;
+      }
+      //the histograms belong to the driver, not the file, so that the file isn't accessed from the workers
+      histogram->SetDirectory(nullptr);
+      fHistograms.push_back(histogram);
+      fResults.emplace_back();
+      fResults.back().fDetectorType = type;
+      fResults.back().fDetectorNumber = det;
+    }
+  }
+  fCalibrations.resize(fHistograms.size());
+
+  return fHistograms.size();
+}
+
+void CalibrationDriver::Run() {
+  bool useCache = !fSettings->CalibrationCacheFileName().empty();
+  if(useCache) {
+    fCache.Read(fSettings->CalibrationCacheFileName());
+  }
+  PrepareThreads();
+
+  auto start = std::chrono::high_resolution_clock::now();
+  {
+    ThreadPool pool(fSettings->NofCalibrationThreads());
+    std::vector<std::future<void> > jobs;
+    for(size_t i = 0; i < fHistograms.size(); ++i) {
+      jobs.push_back(pool.Enqueue([this, i]() { Calibrate(i); }));
+    }
+    for(auto& job : jobs) {
+      job.get();
+    }
+  }
+  fWallTime = std::chrono::high_resolution_clock::now() - start;
+
+  if(useCache) {
+    fCache.Write(fSettings->CalibrationCacheFileName());
+  }
+}
+
+void CalibrationDriver::Benchmark(std::ostream& output) {
+  struct Comparison {
+    double fTSpectrumTime;
+    double fFastTime;
+    int fTSpectrumPeaks;
+    int fFastPeaks;
+    int fNofMatched;
+    double fMaxDifference;//largest difference of the positions of the same peak (bins)
+  };
+  std::vector<Comparison> comparisons(fHistograms.size());
+
+  PrepareThreads();
+  auto start = std::chrono::high_resolution_clock::now();
+  {
+    ThreadPool pool(fSettings->NofCalibrationThreads());
+    std::vector<std::future<void> > jobs;
+    for(size_t i = 0; i < fHistograms.size(); ++i) {
+      jobs.push_back(pool.Enqueue([this, i, &comparisons]() {
+	    uint8_t detectorType = fResults[i].fDetectorType;
+	    uint16_t detectorNumber = fResults[i].fDetectorNumber;
+	    Comparison& comparison = comparisons[i];
+	    comparison = Comparison();
+	    if(fSettings->NofPeaks(detectorType, detectorNumber) == 0) {
+	      return;
+	    }
+	    fCalibrations[i].SetSettings(fSettings);
+
+	    auto begin = std::chrono::high_resolution_clock::now();
+	    TGraph tspectrum = fCalibrations[i].FindPeaks(detectorType, detectorNumber, fHistograms[i], EPeakFinder::kTSpectrum);
+	    auto middle = std::chrono::high_resolution_clock::now();
+	    TGraph fast = fCalibrations[i].FindPeaks(detectorType, detectorNumber, fHistograms[i], EPeakFinder::kFast);
+	    auto end = std::chrono::high_resolution_clock::now();
+
+	    comparison.fTSpectrumTime = Seconds(middle - begin);
+	    comparison.fFastTime = Seconds(end - middle);
+	    comparison.fTSpectrumPeaks = tspectrum.GetN();
+	    comparison.fFastPeaks = fast.GetN();
+	    //the same peak has the same energy in both graphs
+	    for(int first = 0; first < tspectrum.GetN(); ++first) {
+	      for(int second = 0; second < fast.GetN(); ++second) {
+		if(tspectrum.GetY()[first] == fast.GetY()[second]) {
+		  ++comparison.fNofMatched;
+		  comparison.fMaxDifference = std::max(comparison.fMaxDifference, std::fabs(tspectrum.GetX()[first] - fast.GetX()[second]));
+		}
+	      }
+	    }
+	  }));
+    }
+    for(auto& job : jobs) {
+      job.get();
+    }
+  }
+  fWallTime = std::chrono::high_resolution_clock::now() - start;
+
+  double tspectrumTime = 0.;
+  double fastTime = 0.;
+  double maxDifference = 0.;
+  output<<std::setw(10)<<"detector"<<std::setw(4)<<"#"<<std::setw(14)<<"TSpec. peaks"<<std::setw(12)<<"fast peaks"<<std::setw(10)<<"matched"
+	<<std::setw(16)<<"max. diff. [bin]"<<std::setw(14)<<"TSpec. [s]"<<std::setw(12)<<"fast [s]"<<std::endl;
+  for(size_t i = 0; i < comparisons.size(); ++i) {
+    const Comparison& comparison = comparisons[i];
+    tspectrumTime += comparison.fTSpectrumTime;
+    fastTime += comparison.fFastTime;
+    maxDifference = std::max(maxDifference, comparison.fMaxDifference);
+    output<<std::setw(10)<<gDetectorTypeNames[fResults[i].fDetectorType]<<std::setw(4)<<fResults[i].fDetectorNumber
+	  <<std::setw(14)<<comparison.fTSpectrumPeaks<<std::setw(12)<<comparison.fFastPeaks<<std::setw(10)<<comparison.fNofMatched
+	  <<std::setw(16)<<comparison.fMaxDifference<<std::setw(14)<<comparison.fTSpectrumTime<<std::setw(12)<<comparison.fFastTime<<std::endl;
+  }
+  output<<"TSpectrum: "<<tspectrumTime<<" s, fast: "<<fastTime<<" s";
+  if(fastTime > 0.) {
+    output<<" (speed-up "<<tspectrumTime/fastTime<<")";
+  }
+  output<<", largest position difference "<<maxDifference<<" bins, "<<Seconds(fWallTime)<<" s with "<<fSettings->NofCalibrationThreads()<<" thread(s)"<<std::endl;
+}
+
+void CalibrationDriver::Calibrate(size_t index) {
+  auto start = std::chrono::high_resolution_clock::now();
+  CalibrationResult& result = fResults[index];
+  TH1I* histogram = fHistograms[index];
+
+  result.fSuccess = false;
+  result.fNofExpectedPeaks = fSettings->NofPeaks(result.fDetectorType, result.fDetectorNumber);
+  result.fGain = 0.;
+  result.fOffset = 0.;
+  result.fChiSquare = 0.;
+  result.fNdf = 0;
+  result.fMaxResidual = 0.;
+
+  if(histogram->GetEntries() < fSettings->MinimumCounts(result.fDetectorType)) {
+    result.fMessage = "too few counts";
+  } else if(result.fNofExpectedPeaks == 0 && fSettings->CalibrationSources(result.fDetectorType).empty()) {
+    result.fMessage = "no peaks or sources defined";
+  } else if(result.fNofExpectedPeaks == 1) {
+    result.fMessage = "less than two peaks defined";
+  } else {
+    fCalibrations[index].SetSettings(fSettings);
+    if(!fSettings->CalibrationCacheFileName().empty()) {
+      fCalibrations[index].SetCache(&fCache);
+    }
+    result.fPeaks = fCalibrations[index].Calibrate(result.fDetectorType, result.fDetectorNumber, histogram);
+    TF1* calibration = histogram->GetFunction("Calibration");
+    if(calibration == nullptr) {
+      result.fMessage = "peak search failed";
+    } else {
+      result.fSuccess = true;
+      result.fGain = calibration->GetParameter(0);
+      result.fOffset = calibration->GetParameter(1);
+      result.fChiSquare = calibration->GetChisquare();
+      result.fNdf = calibration->GetNDF();
+      for(int point = 0; point < result.fPeaks.GetN(); ++point) {
+	double residual = std::fabs(calibration->Eval(result.fPeaks.GetX()[point]) - result.fPeaks.GetY()[point]);
+	if(residual > result.fMaxResidual) {
+	  result.fMaxResidual = residual;
+	}
+      }
+      if(result.fPeaks.GetN() < result.fNofExpectedPeaks) {
+	result.fMessage = "missing peaks";
+      } else if(fCalibrations[index].Path() == ECalibrationPath::kCache) {
+	result.fMessage = "cached";
+      } else if(fCalibrations[index].Path() == ECalibrationPath::kShift) {
+	result.fMessage = "small shift";
+      } else if(fCalibrations[index].Path() == ECalibrationPath::kMatch) {
+	result.fMessage = "matched source lines";
+      }
+    }
+  }
+
+  result.fTime = std::chrono::high_resolution_clock::now() - start;
+}
+
+size_t CalibrationDriver::Write(std::ostream& output) {
+  size_t nofCalibrations = 0;
+  for(size_t i = 0; i < fHistograms.size(); ++i) {
+    if(fResults[i].fSuccess) {
+      fCalibrations[i].Write(output, fResults[i].fDetectorType, fResults[i].fDetectorNumber, fHistograms[i]);
+      ++nofCalibrations;
+    }
+  }
+
+  return nofCalibrations;
+}
+
+void CalibrationDriver::Write(TFile* file) {
+  file->cd();
+  for(size_t i = 0; i < fHistograms.size(); ++i) {
+    fHistograms[i]->Write();
+    if(fResults[i].fPeaks.GetN() > 0) {
+      fResults[i].fPeaks.SetName(Form("peaks%s_%d",gDetectorTypeNames[fResults[i].fDetectorType],(int)fResults[i].fDetectorNumber));
+      fResults[i].fPeaks.Write();
+    }
+  }
+}
+
+void CalibrationDriver::Print(std::ostream& output) {
+  std::chrono::high_resolution_clock::duration totalTime = std::chrono::high_resolution_clock::duration::zero();
+  size_t nofSuccesses = 0;
+
+  output<<std::setw(10)<<"detector"<<std::setw(4)<<"#"<<std::setw(8)<<"peaks"<<std::setw(12)<<"gain"<<std::setw(12)<<"offset"
+	<<std::setw(12)<<"chi2/ndf"<<std::setw(16)<<"max. res. [keV]"<<std::setw(10)<<"time [s]"<<std::endl;
+  for(const auto& result : fResults) {
+    totalTime += result.fTime;
+    output<<std::setw(10)<<gDetectorTypeNames[result.fDetectorType]<<std::setw(4)<<result.fDetectorNumber
+	  <<std::setw(5)<<result.fPeaks.GetN()<<"/"<<std::left<<std::setw(2)<<result.fNofExpectedPeaks<<std::right;
+    if(result.fSuccess) {
+      ++nofSuccesses;
+      output<<std::setw(12)<<result.fGain<<std::setw(12)<<result.fOffset;
+      if(result.fNdf > 0) {
+	output<<std::setw(12)<<result.fChiSquare/result.fNdf;
+      } else {
+	output<<std::setw(12)<<"-";
+      }
+      output<<std::setw(16)<<result.fMaxResidual;
+    } else {
+      output<<std::setw(52)<<" ";
+    }
+    output<<std::setw(10)<<Seconds(result.fTime);
+    if(!result.fSuccess) {
+      output<<Show(Attribs::Bright(),Foreground::Red()," ",result.fMessage,Attribs::Reset());
+    } else if(!result.fMessage.empty()) {
+      output<<" "<<result.fMessage;
+    }
+    output<<std::endl;
+  }
+
+  double wallTime = Seconds(fWallTime);
+  double cpuTime = Seconds(totalTime);
+  output<<"calibrated "<<nofSuccesses<<" of "<<fResults.size()<<" detectors in "<<wallTime<<" s with "<<fSettings->NofCalibrationThreads()<<" thread(s)";
+  if(wallTime > 0.) {
+    output<<" ("<<cpuTime/wallTime<<" detectors in parallel on average)";
+  }
+  output<<std::endl;
+  if(!fSettings->CalibrationCacheFileName().empty()) {
+    output<<fCache.NofHits()<<" calibrations taken from the cache '"<<fSettings->CalibrationCacheFileName()<<"' ("<<fCache.NofEntries()<<" entries)"<<std::endl;
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef __CALIBRATION_DRIVER_HH
+#define __CALIBRATION_DRIVER_HH
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <ostream>
+
+#include "TFile.h"
+#include "TGraph.h"
+#include "TH1I.h"
+
+#include "Settings.hh"
+#include "Calibration.hh"
+#include "CalibrationCache.hh"
+
+//result of the calibration of one detector
+struct CalibrationResult {
+  uint8_t fDetectorType;
+  uint16_t fDetectorNumber;
+  bool fSuccess;
+  std::string fMessage;
+  TGraph fPeaks;//fitted peak positions vs. energies
+  int fNofExpectedPeaks;
+  double fGain;
+  double fOffset;
+  double fChiSquare;
+  int fNdf;
+  double fMaxResidual;//largest deviation of a peak from its energy (keV)
+  std::chrono::high_resolution_clock::duration fTime;
+};
+
+//calibrates the raw energy histograms of all active detectors, one detector per thread
+//each thread works on its own histogram and Calibration object, ROOT is only used thread-safe:
+//the histograms are read and written by the calling thread, fit functions are not added to the global list of functions,
+//and the fits use Minuit2 (TMinuit keeps a global instance)
+class CalibrationDriver {
+public:
+  CalibrationDriver(Settings*);
+  ~CalibrationDriver();
+
+  //reads the raw energy histograms (rawGermanium_0, ...) of the active detectors, returns the number of histograms found
+  size_t Read(TFile*);
+
+  //calibrates all histograms that have been read (reading and updating the cache if there is one)
+  void Run();
+  //compares the peaks found by the fast peak finder and TSpectrum for all histograms (position differences and times)
+  void Benchmark(std::ostream&);
+
+  //writes the calibrations in the format read by EnergyCalibration, returns the number of calibrations written
+  size_t Write(std::ostream&);
+  //writes the histograms (with their calibration function) and the graphs of the fitted peaks
+  void Write(TFile*);
+
+  //fit quality and time per detector
+  void Print(std::ostream&);
+
+  const std::vector<CalibrationResult>& Results() {
+    return fResults;
+  }
+
+private:
+  //runs in the worker threads, only touches the histogram, calibration, and result with the given index
+  void Calibrate(size_t);
+
+  Settings* fSettings;
+  std::vector<TH1I*> fHistograms;
+  //the calibration functions keep a pointer to their Calibration, so they have to stay alive as long as the histograms
+  std::vector<Calibration> fCalibrations;
+  std::vector<CalibrationResult> fResults;
+  CalibrationCache fCache;
+  std::chrono::high_resolution_clock::duration fWallTime;
+};
+
+#endif
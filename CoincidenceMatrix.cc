@@ -0,0 +1,159 @@
+#include "CoincidenceMatrix.hh"
+
+#include <algorithm>
+#include <cmath>
+
+CoincidenceMatrix::CoincidenceMatrix(double maxX, double binWidthX, double maxY, double binWidthY, size_t blockSize) {
+  fBinWidthX = (binWidthX > 0.) ? binWidthX : 1.;
+  fBinWidthY = (binWidthY > 0.) ? binWidthY : 1.;
+  fBlockSize = std::max(blockSize, (size_t) 1);
+  fNofBinsX = std::max(static_cast<size_t>(std::ceil(maxX/fBinWidthX)), (size_t) 1);
+  fNofBinsY = std::max(static_cast<size_t>(std::ceil(maxY/fBinWidthY)), (size_t) 1);
+  fNofBlocksX = (fNofBinsX + fBlockSize - 1)/fBlockSize;
+  fNofBlocksY = (fNofBinsY + fBlockSize - 1)/fBlockSize;
+  fBlocks.resize(fNofBlocksX*fNofBlocksY);
+  fEntries = 0;
+  fOverflow = 0;
+}
+
+void CoincidenceMatrix::Add(const CoincidenceMatrix& rh) {
+  if(rh.fNofBinsX != fNofBinsX || rh.fNofBinsY != fNofBinsY || rh.fBlockSize != fBlockSize) {
+    return;
+  }
+  for(size_t i = 0; i < fBlocks.size(); ++i) {
+    if(rh.fBlocks[i].empty()) {
+      continue;
+    }
+    if(fBlocks[i].empty()) {
+      fBlocks[i] = rh.fBlocks[i];
+      continue;
+    }
+    for(size_t bin = 0; bin < fBlocks[i].size(); ++bin) {
+      fBlocks[i][bin] += rh.fBlocks[i][bin];
+    }
+  }
+  fEntries += rh.fEntries;
+  fOverflow += rh.fOverflow;
+}
+
+//frees the memory of the blocks as well
+void CoincidenceMatrix::Reset() {
+  for(auto& block : fBlocks) {
+    std::vector<uint32_t>().swap(block);
+  }
+  fEntries = 0;
+  fOverflow = 0;
+}
+
+void CoincidenceMatrix::ForEach(const std::function<void(size_t, size_t, uint32_t)>& function) const {
+  for(size_t blockY = 0; blockY < fNofBlocksY; ++blockY) {
+    for(size_t blockX = 0; blockX < fNofBlocksX; ++blockX) {
+      const std::vector<uint32_t>& block = fBlocks[blockY*fNofBlocksX + blockX];
+      if(block.empty()) {
+	continue;
+      }
+      for(size_t bin = 0; bin < block.size(); ++bin) {
+	if(block[bin] > 0) {
+	  function(blockX*fBlockSize + bin%fBlockSize, blockY*fBlockSize + bin/fBlockSize, block[bin]);
+	}
+      }
+    }
+  }
+}
+
+size_t CoincidenceMatrix::NofAllocatedBlocks() const {
+  return std::count_if(fBlocks.begin(), fBlocks.end(), [](const std::vector<uint32_t>& block) { return !block.empty(); });
+}
+
+//----------------------------------------
+
+CoincidenceMatrices::CoincidenceMatrices(Settings* settings, bool calibrated) {
+  fCalibrated = calibrated;
+  fTimeGates = settings->MatrixTimeGates();
+  //the gates are in ns, the timestamps in ps
+  fPromptLow = std::llround(std::max(settings->MatrixPromptLow(), 0.)*1000.);
+  fPromptHigh = std::llround(std::max(settings->MatrixPromptHigh(), 0.)*1000.);
+  fRandomLow = std::llround(std::max(settings->MatrixRandomLow(), 0.)*1000.);
+  fRandomHigh = std::llround(std::max(settings->MatrixRandomHigh(), 0.)*1000.);
+
+  size_t blockSize = settings->MatrixBlockSize();
+  if(fCalibrated) {
+    double maxEnergy = settings->MatrixMaxEnergy();
+    double germanium = settings->MatrixKeVPerBin(EDetectorType::kGermanium);
+    double baf2 = settings->MatrixKeVPerBin(EDetectorType::kBaF2);
+    double plastic = settings->MatrixKeVPerBin(EDetectorType::kPlastic);
+    fPrompt[static_cast<size_t>(EMatrix::kGermaniumGermanium)] = CoincidenceMatrix(maxEnergy, germanium, maxEnergy, germanium, blockSize);
+    fPrompt[static_cast<size_t>(EMatrix::kGermaniumBaF2)] = CoincidenceMatrix(maxEnergy, germanium, maxEnergy, baf2, blockSize);
+    fPrompt[static_cast<size_t>(EMatrix::kGermaniumPlastic)] = CoincidenceMatrix(maxEnergy, germanium, maxEnergy, plastic, blockSize);
+  } else {
+    double germanium = settings->MatrixRebin(EDetectorType::kGermanium);
+    double baf2 = settings->MatrixRebin(EDetectorType::kBaF2);
+    double plastic = settings->MatrixRebin(EDetectorType::kPlastic);
+    fPrompt[static_cast<size_t>(EMatrix::kGermaniumGermanium)] = CoincidenceMatrix(settings->MaxGermaniumChannel(), germanium, settings->MaxGermaniumChannel(), germanium, blockSize);
+    fPrompt[static_cast<size_t>(EMatrix::kGermaniumBaF2)] = CoincidenceMatrix(settings->MaxGermaniumChannel(), germanium, settings->MaxBaF2Channel(), baf2, blockSize);
+    fPrompt[static_cast<size_t>(EMatrix::kGermaniumPlastic)] = CoincidenceMatrix(settings->MaxGermaniumChannel(), germanium, settings->MaxPlasticChannel(), plastic, blockSize);
+  }
+  //without time gates the random matrices stay empty
+  fRandom = fPrompt;
+}
+
+//germanium-germanium pairs are filled both ways round, so the matrix is symmetric
+void CoincidenceMatrices::Fill(const BuiltEvent& event) {
+  if(event.Multiplicity(EDetectorType::kGermanium) == 0 || event.NofHits() < 2) {
+    return;
+  }
+  const std::vector<Hit>& hits = event.Hits();
+  for(size_t first = 0; first < hits.size(); ++first) {
+    if(hits[first].fDetectorType != static_cast<uint8_t>(EDetectorType::kGermanium)) {
+      continue;
+    }
+    for(size_t second = 0; second < hits.size(); ++second) {
+      if(second == first) {
+	continue;
+      }
+      switch(static_cast<EDetectorType>(hits[second].fDetectorType)) {
+      case EDetectorType::kGermanium:
+	Fill(EMatrix::kGermaniumGermanium, hits[first], hits[second]);
+	break;
+      case EDetectorType::kBaF2:
+	Fill(EMatrix::kGermaniumBaF2, hits[first], hits[second]);
+	break;
+      case EDetectorType::kPlastic:
+	Fill(EMatrix::kGermaniumPlastic, hits[first], hits[second]);
+	break;
+      default:
+	break;
+      }
+    }
+  }
+}
+
+void CoincidenceMatrices::Fill(EMatrix matrix, const Hit& first, const Hit& second) {
+  size_t index = static_cast<size_t>(matrix);
+  double x = fCalibrated ? first.fEnergy : first.fRawEnergy;
+  double y = fCalibrated ? second.fEnergy : second.fRawEnergy;
+  if(!fTimeGates) {
+    fPrompt[index].Fill(x, y);
+    return;
+  }
+  uint64_t difference = (first.fTimestamp > second.fTimestamp) ? first.fTimestamp - second.fTimestamp : second.fTimestamp - first.fTimestamp;
+  if(fPromptLow <= difference && difference <= fPromptHigh) {
+    fPrompt[index].Fill(x, y);
+  } else if(fRandomLow <= difference && difference <= fRandomHigh) {
+    fRandom[index].Fill(x, y);
+  }
+}
+
+void CoincidenceMatrices::Add(const CoincidenceMatrices& rh) {
+  for(size_t matrix = 0; matrix < NOF_MATRICES; ++matrix) {
+    fPrompt[matrix].Add(rh.fPrompt[matrix]);
+    fRandom[matrix].Add(rh.fRandom[matrix]);
+  }
+}
+
+void CoincidenceMatrices::Reset() {
+  for(size_t matrix = 0; matrix < NOF_MATRICES; ++matrix) {
+    fPrompt[matrix].Reset();
+    fRandom[matrix].Reset();
+  }
+}
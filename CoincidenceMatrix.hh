@@ -0,0 +1,134 @@
+#ifndef __COINCIDENCE_MATRIX_HH
+#define __COINCIDENCE_MATRIX_HH
+
+#include <vector>
+#include <array>
+#include <functional>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "Hit.hh"
+#include "BuiltEvent.hh"
+
+//two-dimensional histogram with bins of equal width (channels or keV) starting at zero, stored in square blocks that are only
+//allocated once they are filled
+//not thread-safe, use one matrix per thread and Add() them up
+class CoincidenceMatrix {
+public:
+  CoincidenceMatrix(double maxX = 1., double binWidthX = 1., double maxY = 1., double binWidthY = 1., size_t blockSize = 64);
+  ~CoincidenceMatrix(){};
+
+  //fill the values (not the bins), negative values count as overflow
+  void Fill(double x, double y) {
+    ++fEntries;
+    if(x < 0. || y < 0.) {
+      ++fOverflow;
+      return;
+    }
+    size_t binX = static_cast<size_t>(x/fBinWidthX);
+    size_t binY = static_cast<size_t>(y/fBinWidthY);
+    if(binX >= fNofBinsX || binY >= fNofBinsY) {
+      ++fOverflow;
+      return;
+    }
+    std::vector<uint32_t>& block = fBlocks[(binY/fBlockSize)*fNofBlocksX + binX/fBlockSize];
+    if(block.empty()) {
+      block.resize(fBlockSize*fBlockSize, 0);
+    }
+    ++block[(binY%fBlockSize)*fBlockSize + binX%fBlockSize];
+  }
+
+  //add the other matrix (needs to have the same binning)
+  void Add(const CoincidenceMatrix&);
+  void Reset();
+
+  //calls the function with x-bin, y-bin, and content of all non-empty bins
+  void ForEach(const std::function<void(size_t, size_t, uint32_t)>&) const;
+
+  size_t NofBinsX() const {
+    return fNofBinsX;
+  }
+  size_t NofBinsY() const {
+    return fNofBinsY;
+  }
+  double BinWidthX() const {
+    return fBinWidthX;
+  }
+  double BinWidthY() const {
+    return fBinWidthY;
+  }
+  uint64_t Entries() const {
+    return fEntries;
+  }
+  uint64_t Overflow() const {
+    return fOverflow;
+  }
+  //number of blocks that are allocated and the memory they use
+  size_t NofAllocatedBlocks() const;
+  size_t AllocatedBytes() const {
+    return NofAllocatedBlocks()*fBlockSize*fBlockSize*sizeof(uint32_t);
+  }
+
+private:
+  size_t fNofBinsX;
+  size_t fNofBinsY;
+  double fBinWidthX;
+  double fBinWidthY;
+  size_t fBlockSize;
+  size_t fNofBlocksX;
+  size_t fNofBlocksY;
+  //blocks of fBlockSize x fBlockSize bins, empty until the first fill
+  std::vector<std::vector<uint32_t> > fBlocks;
+  uint64_t fEntries;
+  uint64_t fOverflow;
+};
+
+enum class EMatrix : uint8_t {
+  kGermaniumGermanium,
+  kGermaniumBaF2,
+  kGermaniumPlastic
+};
+
+#define NOF_MATRICES 3
+
+//germanium-germanium (symmetrised), germanium-BaF2, and germanium-plastic energy matrices of the built events
+//the matrices are filled with the calibrated energies in keV, the raw energies of different detectors aren't gain-matched
+//and are only used if no energy calibration is loaded
+//with optional time gates each matrix has a prompt and a random version, otherwise all pairs are filled into the prompt one
+class CoincidenceMatrices {
+public:
+  CoincidenceMatrices(Settings*, bool calibrated);
+  ~CoincidenceMatrices(){};
+
+  void Fill(const BuiltEvent&);
+
+  void Add(const CoincidenceMatrices&);
+  void Reset();
+
+  const CoincidenceMatrix& Prompt(EMatrix matrix) const {
+    return fPrompt[static_cast<size_t>(matrix)];
+  }
+  const CoincidenceMatrix& Random(EMatrix matrix) const {
+    return fRandom[static_cast<size_t>(matrix)];
+  }
+  bool Calibrated() const {
+    return fCalibrated;
+  }
+
+private:
+  //fills the pair into the prompt or random matrix (or neither) depending on their time difference
+  void Fill(EMatrix, const Hit&, const Hit&);
+
+  bool fCalibrated;
+  bool fTimeGates;
+  //ps
+  uint64_t fPromptLow;
+  uint64_t fPromptHigh;
+  uint64_t fRandomLow;
+  uint64_t fRandomHigh;
+
+  std::array<CoincidenceMatrix, NOF_MATRICES> fPrompt;
+  std::array<CoincidenceMatrix, NOF_MATRICES> fRandom;
+};
+
+#endif
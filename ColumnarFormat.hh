@@ -0,0 +1,113 @@
+#ifndef __COLUMNAR_FORMAT_HH
+#define __COLUMNAR_FORMAT_HH
+
+#include <stdint.h>
+#include <cstring>
+
+//layout of the columnar output files (native byte order, i.e. little endian)
+//
+//file header                   ColumnarFileHeader incl. the description of the columns
+//blocks                        each consisting of:
+//  block header                ColumnarBlockHeader
+//  event offsets               (nofEvents+1) x uint32_t, hits of event i are [offset[i], offset[i+1])
+//  one column per hit field    nofHits x size of the column, in the order of the column descriptions
+//  tdc times                   nofTdcTimes x uint16_t, the additional TDC times of all hits (NofTdcTimes of hit i follow the ones of hit i-1)
+//block index                   nofBlocks x ColumnarIndexEntry
+//trailer                       ColumnarTrailer
+//
+//all parts start at multiples of 8 bytes, so the columns of a memory-mapped file can be used directly
+
+#define COLUMNAR_MAGIC "EPICOLMN"
+#define COLUMNAR_VERSION 3
+#define COLUMNAR_ALIGNMENT 8
+
+enum class EColumn : uint8_t {
+  kType,
+  kNumber,
+  kRawEnergy,
+  kEnergy,
+  kTime,
+  kClock,
+  kTimestamp,
+  kNofTdcTimes,
+  kNofColumns
+};
+
+struct ColumnDescription {
+  char fName[14];
+  char fType;//'u' = unsigned integer, 'f' = floating point
+  uint8_t fSize;//bytes per entry
+};
+
+struct ColumnarFileHeader {
+  char fMagic[8];
+  uint32_t fVersion;
+  uint32_t fNofColumns;
+  ColumnDescription fColumns[static_cast<size_t>(EColumn::kNofColumns)];
+
+  void Set() {
+    memcpy(fMagic, COLUMNAR_MAGIC, 8);
+    fVersion = COLUMNAR_VERSION;
+    fNofColumns = static_cast<uint32_t>(EColumn::kNofColumns);
+    memset(fColumns, 0, sizeof(fColumns));
+    Describe(EColumn::kType, "Type", 'u', sizeof(uint8_t));
+    Describe(EColumn::kNumber, "Number", 'u', sizeof(uint16_t));
+    Describe(EColumn::kRawEnergy, "RawEnergy", 'u', sizeof(uint16_t));
+    Describe(EColumn::kEnergy, "Energy", 'f', sizeof(float));
+    Describe(EColumn::kTime, "Time", 'u', sizeof(uint16_t));
+    Describe(EColumn::kClock, "Clock", 'u', sizeof(uint64_t));
+    Describe(EColumn::kTimestamp, "Timestamp", 'u', sizeof(uint64_t));
+    Describe(EColumn::kNofTdcTimes, "NofTdcTimes", 'u', sizeof(uint8_t));
+  }
+  bool Valid() const {
+    return memcmp(fMagic, COLUMNAR_MAGIC, 8) == 0 && fVersion == COLUMNAR_VERSION && fNofColumns == static_cast<uint32_t>(EColumn::kNofColumns);
+  }
+
+private:
+  void Describe(EColumn column, const char* name, char type, uint8_t size) {
+    ColumnDescription& description = fColumns[static_cast<size_t>(column)];
+    strncpy(description.fName, name, sizeof(description.fName)-1);
+    description.fType = type;
+    description.fSize = size;
+  }
+};
+
+struct ColumnarBlockHeader {
+  uint64_t fFirstClock;
+  uint64_t fLastClock;
+  uint64_t fFirstEvent;
+  uint64_t fSize;//bytes of the whole block incl. this header
+  uint32_t fNofEvents;
+  uint32_t fNofHits;
+  uint32_t fNofTdcTimes;
+  uint32_t fReserved;
+};
+
+struct ColumnarIndexEntry {
+  uint64_t fOffset;//position of the block header in the file
+  uint64_t fFirstClock;
+  uint64_t fLastClock;
+  uint64_t fFirstEvent;
+  uint32_t fNofEvents;
+  uint32_t fNofHits;
+};
+
+struct ColumnarTrailer {
+  uint64_t fIndexOffset;
+  uint64_t fNofBlocks;
+  uint64_t fNofEvents;
+  uint64_t fNofHits;
+  char fMagic[8];
+};
+
+static_assert(sizeof(ColumnarFileHeader)%COLUMNAR_ALIGNMENT == 0, "columnar file header needs to be aligned");
+static_assert(sizeof(ColumnarBlockHeader)%COLUMNAR_ALIGNMENT == 0, "columnar block header needs to be aligned");
+static_assert(sizeof(ColumnarIndexEntry)%COLUMNAR_ALIGNMENT == 0, "columnar index entry needs to be aligned");
+static_assert(sizeof(ColumnarTrailer)%COLUMNAR_ALIGNMENT == 0, "columnar trailer needs to be aligned");
+
+//size of n entries of the given size padded to the alignment
+inline uint64_t ColumnarPadded(uint64_t nofEntries, uint64_t size) {
+  return ((nofEntries*size + COLUMNAR_ALIGNMENT - 1)/COLUMNAR_ALIGNMENT)*COLUMNAR_ALIGNMENT;
+}
+
+#endif
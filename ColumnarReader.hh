@@ -0,0 +1,262 @@
+#ifndef __COLUMNAR_READER_HH
+#define __COLUMNAR_READER_HH
+
+//header-only reader for the columnar files written by the unpacker (see ColumnarFormat.hh)
+//the file is memory-mapped, all accessors return pointers into the mapped file (no copies)
+//
+//usage:
+//  ColumnarFile file("run.col");
+//  for(size_t b : file.BlocksInRange(low, high)) {
+//    ColumnarBlock block = file.Block(b);
+//    for(uint32_t e = 0; e < block.NofEvents(); ++e) {
+//      for(uint32_t h = block.EventBegin(e); h < block.EventEnd(e); ++h) {
+//        ... block.RawEnergy()[h], block.Clock()[h], block.Timestamp()[h] ...
+//the additional TDC times (multi-hit TDC selections) are packed, the NofTdcTimes()[h] times of hit h follow the ones of hit h-1:
+//    const uint16_t* tdcTimes = block.TdcTimes();
+//    for(uint32_t h = 0; h < block.NofHits(); ++h) {
+//      ... tdcTimes[0] - tdcTimes[block.NofTdcTimes()[h]-1] ...
+//      tdcTimes += block.NofTdcTimes()[h];
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ColumnarFormat.hh"
+
+//view of one block of events
+class ColumnarBlock {
+public:
+  ColumnarBlock(const char* begin = nullptr) {
+    fHeader = reinterpret_cast<const ColumnarBlockHeader*>(begin);
+    if(fHeader == nullptr) {
+      return;
+    }
+    const char* position = begin + sizeof(ColumnarBlockHeader);
+    fEventOffsets = reinterpret_cast<const uint32_t*>(position);
+    position += ColumnarPadded(fHeader->fNofEvents + 1, sizeof(uint32_t));
+    fType = reinterpret_cast<const uint8_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint8_t));
+    fNumber = reinterpret_cast<const uint16_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint16_t));
+    fRawEnergy = reinterpret_cast<const uint16_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint16_t));
+    fEnergy = reinterpret_cast<const float*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(float));
+    fTime = reinterpret_cast<const uint16_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint16_t));
+    fClock = reinterpret_cast<const uint64_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint64_t));
+    fTimestamp = reinterpret_cast<const uint64_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint64_t));
+    fNofTdcTimes = reinterpret_cast<const uint8_t*>(position);
+    position += ColumnarPadded(fHeader->fNofHits, sizeof(uint8_t));
+    fTdcTimes = reinterpret_cast<const uint16_t*>(position);
+  }
+
+  uint32_t NofEvents() const {
+    return fHeader->fNofEvents;
+  }
+  uint32_t NofHits() const {
+    return fHeader->fNofHits;
+  }
+  uint64_t FirstEvent() const {
+    return fHeader->fFirstEvent;
+  }
+  uint64_t FirstClock() const {
+    return fHeader->fFirstClock;
+  }
+  uint64_t LastClock() const {
+    return fHeader->fLastClock;
+  }
+
+  //hits of event i are [EventBegin(i), EventEnd(i))
+  uint32_t EventBegin(uint32_t event) const {
+    return fEventOffsets[event];
+  }
+  uint32_t EventEnd(uint32_t event) const {
+    return fEventOffsets[event+1];
+  }
+  uint32_t Multiplicity(uint32_t event) const {
+    return fEventOffsets[event+1] - fEventOffsets[event];
+  }
+
+  //the columns, indexed by hit
+  const uint8_t* Type() const {
+    return fType;
+  }
+  const uint16_t* Number() const {
+    return fNumber;
+  }
+  const uint16_t* RawEnergy() const {
+    return fRawEnergy;
+  }
+  const float* Energy() const {
+    return fEnergy;
+  }
+  const uint16_t* Time() const {
+    return fTime;
+  }
+  const uint64_t* Clock() const {
+    return fClock;
+  }
+  //ps, the ulm clock refined by the calibrated TDC time
+  const uint64_t* Timestamp() const {
+    return fTimestamp;
+  }
+  const uint8_t* NofTdcTimes() const {
+    return fNofTdcTimes;
+  }
+  //all additional TDC times of the block
+  uint32_t TotalTdcTimes() const {
+    return fHeader->fNofTdcTimes;
+  }
+  const uint16_t* TdcTimes() const {
+    return fTdcTimes;
+  }
+
+private:
+  const ColumnarBlockHeader* fHeader;
+  const uint32_t* fEventOffsets;
+  const uint8_t* fType;
+  const uint16_t* fNumber;
+  const uint16_t* fRawEnergy;
+  const float* fEnergy;
+  const uint16_t* fTime;
+  const uint64_t* fClock;
+  const uint64_t* fTimestamp;
+  const uint8_t* fNofTdcTimes;
+  const uint16_t* fTdcTimes;
+};
+
+//memory-mapped columnar file
+class ColumnarFile {
+public:
+  ColumnarFile(const std::string& fileName) {
+    fData = nullptr;
+    fSize = 0;
+    fTrailer = nullptr;
+    fIndex = nullptr;
+    fSorted = false;
+
+    int descriptor = open(fileName.c_str(), O_RDONLY);
+    if(descriptor < 0) {
+      return;
+    }
+    struct stat status;
+    if(fstat(descriptor, &status) != 0 || (size_t) status.st_size < sizeof(ColumnarFileHeader) + sizeof(ColumnarTrailer)) {
+      close(descriptor);
+      return;
+    }
+    void* data = mmap(nullptr, status.st_size, PROT_READ, MAP_SHARED, descriptor, 0);
+    close(descriptor);
+    if(data == MAP_FAILED) {
+      return;
+    }
+    fData = static_cast<const char*>(data);
+    fSize = status.st_size;
+
+    //check header and trailer
+    const ColumnarFileHeader* header = reinterpret_cast<const ColumnarFileHeader*>(fData);
+    fTrailer = reinterpret_cast<const ColumnarTrailer*>(fData + fSize - sizeof(ColumnarTrailer));
+    if(!header->Valid() || memcmp(fTrailer->fMagic, COLUMNAR_MAGIC, 8) != 0 ||
+       fTrailer->fIndexOffset + fTrailer->fNofBlocks*sizeof(ColumnarIndexEntry) + sizeof(ColumnarTrailer) != fSize) {
+      Unmap();
+      return;
+    }
+    fIndex = reinterpret_cast<const ColumnarIndexEntry*>(fData + fTrailer->fIndexOffset);
+    //the events are written in time order, so the index is sorted unless the clock restarted
+    fSorted = std::is_sorted(fIndex, fIndex + NofBlocks(), [](const ColumnarIndexEntry& lh, const ColumnarIndexEntry& rh) { return lh.fFirstClock < rh.fFirstClock; }) &&
+      std::is_sorted(fIndex, fIndex + NofBlocks(), [](const ColumnarIndexEntry& lh, const ColumnarIndexEntry& rh) { return lh.fLastClock < rh.fLastClock; });
+  }
+  ~ColumnarFile() {
+    Unmap();
+  }
+  ColumnarFile(const ColumnarFile&) = delete;
+  ColumnarFile& operator=(const ColumnarFile&) = delete;
+
+  bool IsOpen() const {
+    return fData != nullptr;
+  }
+  const ColumnarFileHeader& Header() const {
+    return *reinterpret_cast<const ColumnarFileHeader*>(fData);
+  }
+
+  uint64_t NofBlocks() const {
+    return fTrailer->fNofBlocks;
+  }
+  uint64_t NofEvents() const {
+    return fTrailer->fNofEvents;
+  }
+  uint64_t NofHits() const {
+    return fTrailer->fNofHits;
+  }
+  const ColumnarIndexEntry& IndexEntry(size_t block) const {
+    return fIndex[block];
+  }
+
+  ColumnarBlock Block(size_t block) const {
+    return ColumnarBlock(fData + fIndex[block].fOffset);
+  }
+
+  //blocks containing hits with clocks in [low, high], found by a binary search of the clock index
+  //(all blocks are checked if the index isn't sorted because the clock restarted)
+  std::vector<size_t> BlocksInRange(uint64_t low, uint64_t high) const {
+    std::vector<size_t> result;
+    if(!fSorted) {
+      for(size_t block = 0; block < NofBlocks(); ++block) {
+	if(fIndex[block].fLastClock >= low && fIndex[block].fFirstClock <= high) {
+	  result.push_back(block);
+	}
+      }
+      return result;
+    }
+    //first block that ends at or after low, first block that starts after high
+    const ColumnarIndexEntry* first = std::lower_bound(fIndex, fIndex + NofBlocks(), low, [](const ColumnarIndexEntry& entry, uint64_t clock) { return entry.fLastClock < clock; });
+    const ColumnarIndexEntry* last = std::upper_bound(fIndex, fIndex + NofBlocks(), high, [](uint64_t clock, const ColumnarIndexEntry& entry) { return clock < entry.fFirstClock; });
+    for(const ColumnarIndexEntry* entry = first; entry < last; ++entry) {
+      result.push_back(entry - fIndex);
+    }
+    return result;
+  }
+
+  //block containing the given event number (NofBlocks() if the event is out of range)
+  size_t BlockOfEvent(uint64_t event) const {
+    size_t low = 0;
+    size_t high = NofBlocks();
+    while(low < high) {
+      size_t middle = (low + high)/2;
+      if(fIndex[middle].fFirstEvent + fIndex[middle].fNofEvents <= event) {
+	low = middle + 1;
+      } else {
+	high = middle;
+      }
+    }
+    return low;
+  }
+
+private:
+  void Unmap() {
+    if(fData != nullptr) {
+      munmap(const_cast<char*>(fData), fSize);
+    }
+    fData = nullptr;
+    fSize = 0;
+    fTrailer = nullptr;
+    fIndex = nullptr;
+    fSorted = false;
+  }
+
+  const char* fData;
+  size_t fSize;
+  const ColumnarTrailer* fTrailer;
+  const ColumnarIndexEntry* fIndex;
+  bool fSorted;
+};
+
+#endif
@@ -0,0 +1,154 @@
+#include "ColumnarWriter.hh"
+
+#include <algorithm>
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+ColumnarWriter::ColumnarWriter(Settings* settings) {
+  fSettings = settings;
+  fPosition = 0;
+  fNofEvents = 0;
+  fNofHits = 0;
+  fFirstClock = 0;
+  fLastClock = 0;
+}
+
+ColumnarWriter::~ColumnarWriter() {
+  Close();
+}
+
+bool ColumnarWriter::Open(const std::string& fileName) {
+  Close();
+  fFile.open(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if(!fFile.is_open()) {
+    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to open columnar output file '",fileName,"'",Attribs::Reset())<<std::endl;
+    return false;
+  }
+  ColumnarFileHeader header;
+  header.Set();
+  fFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  fPosition = sizeof(header);
+  fNofEvents = 0;
+  fNofHits = 0;
+  fIndex.clear();
+  fEventOffsets.assign(1, 0);
+
+  return true;
+}
+
+void ColumnarWriter::Add(const BuiltEvent& event) {
+  if(!IsOpen()) {
+    return;
+  }
+  const FifoRecords& records = event.Records();
+  for(const auto& hit : event.Hits()) {
+    uint64_t clock = records.Record(hit).fClock;
+    if(fType.empty()) {
+      fFirstClock = clock;
+      fLastClock = clock;
+    }
+    fFirstClock = std::min(fFirstClock, clock);
+    fLastClock = std::max(fLastClock, clock);
+    fType.push_back(hit.fDetectorType);
+    fNumber.push_back(hit.fDetectorNumber);
+    fRawEnergy.push_back(hit.fRawEnergy);
+    fEnergy.push_back(hit.fEnergy);
+    fTime.push_back(hit.fTime);
+    fClock.push_back(clock);
+    fTimestamp.push_back(hit.fTimestamp);
+    fNofTdcTimes.push_back(hit.fNofTdcTimes);
+    fTdcTimes.insert(fTdcTimes.end(), records.TdcTimes(hit), records.TdcTimes(hit) + hit.fNofTdcTimes);
+  }
+  fEventOffsets.push_back(fType.size());
+
+  if(fEventOffsets.size() > (size_t) fSettings->ColumnarBlockSize()) {
+    WriteBlock();
+  }
+}
+
+template<class T> void ColumnarWriter::WriteColumn(const std::vector<T>& column) {
+  static const char padding[COLUMNAR_ALIGNMENT] = { 0 };
+  fFile.write(reinterpret_cast<const char*>(column.data()), column.size()*sizeof(T));
+  uint64_t padded = ColumnarPadded(column.size(), sizeof(T));
+  fFile.write(padding, padded - column.size()*sizeof(T));
+}
+
+void ColumnarWriter::WriteBlock() {
+  if(fEventOffsets.size() < 2) {
+    return;
+  }
+  ColumnarBlockHeader header;
+  header.fFirstClock = fFirstClock;
+  header.fLastClock = fLastClock;
+  header.fFirstEvent = fNofEvents;
+  header.fNofEvents = fEventOffsets.size() - 1;
+  header.fNofHits = fType.size();
+  header.fNofTdcTimes = fTdcTimes.size();
+  header.fReserved = 0;
+  header.fSize = sizeof(header) + ColumnarPadded(fEventOffsets.size(), sizeof(uint32_t)) +
+    ColumnarPadded(fType.size(), sizeof(uint8_t)) + ColumnarPadded(fNumber.size(), sizeof(uint16_t)) +
+    ColumnarPadded(fRawEnergy.size(), sizeof(uint16_t)) + ColumnarPadded(fEnergy.size(), sizeof(float)) +
+    ColumnarPadded(fTime.size(), sizeof(uint16_t)) + ColumnarPadded(fClock.size(), sizeof(uint64_t)) +
+    ColumnarPadded(fTimestamp.size(), sizeof(uint64_t)) +
+    ColumnarPadded(fNofTdcTimes.size(), sizeof(uint8_t)) + ColumnarPadded(fTdcTimes.size(), sizeof(uint16_t));
+
+  ColumnarIndexEntry entry;
+  entry.fOffset = fPosition;
+  entry.fFirstClock = header.fFirstClock;
+  entry.fLastClock = header.fLastClock;
+  entry.fFirstEvent = header.fFirstEvent;
+  entry.fNofEvents = header.fNofEvents;
+  entry.fNofHits = header.fNofHits;
+  fIndex.push_back(entry);
+
+  //the columns are written in the order of EColumn
+  fFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  WriteColumn(fEventOffsets);
+  WriteColumn(fType);
+  WriteColumn(fNumber);
+  WriteColumn(fRawEnergy);
+  WriteColumn(fEnergy);
+  WriteColumn(fTime);
+  WriteColumn(fClock);
+  WriteColumn(fTimestamp);
+  WriteColumn(fNofTdcTimes);
+  WriteColumn(fTdcTimes);
+
+  fPosition += header.fSize;
+  fNofEvents += header.fNofEvents;
+  fNofHits += header.fNofHits;
+
+  //clearing keeps the memory for the next block
+  fEventOffsets.assign(1, 0);
+  fType.clear();
+  fNumber.clear();
+  fRawEnergy.clear();
+  fEnergy.clear();
+  fTime.clear();
+  fClock.clear();
+  fTimestamp.clear();
+  fNofTdcTimes.clear();
+  fTdcTimes.clear();
+}
+
+void ColumnarWriter::Close() {
+  if(!IsOpen()) {
+    return;
+  }
+  WriteBlock();
+
+  ColumnarTrailer trailer;
+  trailer.fIndexOffset = fPosition;
+  trailer.fNofBlocks = fIndex.size();
+  trailer.fNofEvents = fNofEvents;
+  trailer.fNofHits = fNofHits;
+  memcpy(trailer.fMagic, COLUMNAR_MAGIC, 8);
+  fFile.write(reinterpret_cast<const char*>(fIndex.data()), fIndex.size()*sizeof(ColumnarIndexEntry));
+  fFile.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+  fFile.close();
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Wrote "<<fNofEvents<<" events with "<<fNofHits<<" hits in "<<fIndex.size()<<" blocks to columnar file"<<std::endl;
+  }
+}
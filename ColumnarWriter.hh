@@ -0,0 +1,60 @@
+#ifndef __COLUMNAR_WRITER_HH
+#define __COLUMNAR_WRITER_HH
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "Settings.hh"
+#include "BuiltEvent.hh"
+#include "ColumnarFormat.hh"
+
+//writes the built events in the columnar format described in ColumnarFormat.hh
+//events are collected into blocks of fSettings->ColumnarBlockSize() events, the block index is written on Close()
+class ColumnarWriter {
+public:
+  ColumnarWriter(Settings*);
+  ~ColumnarWriter();
+
+  bool Open(const std::string&);
+  bool IsOpen() {
+    return fFile.is_open();
+  }
+  void Add(const BuiltEvent&);
+  void Close();
+
+  uint64_t NofEvents() {
+    return fNofEvents;
+  }
+  uint64_t NofBlocks() {
+    return fIndex.size();
+  }
+
+private:
+  void WriteBlock();
+  template<class T> void WriteColumn(const std::vector<T>&);
+
+  Settings* fSettings;
+  std::ofstream fFile;
+  uint64_t fPosition;
+  uint64_t fNofEvents;
+  uint64_t fNofHits;
+
+  //current block
+  std::vector<uint32_t> fEventOffsets;
+  std::vector<uint8_t> fType;
+  std::vector<uint16_t> fNumber;
+  std::vector<uint16_t> fRawEnergy;
+  std::vector<float> fEnergy;
+  std::vector<uint16_t> fTime;
+  std::vector<uint64_t> fClock;
+  std::vector<uint64_t> fTimestamp;
+  std::vector<uint8_t> fNofTdcTimes;
+  std::vector<uint16_t> fTdcTimes;
+  uint64_t fFirstClock;
+  uint64_t fLastClock;
+
+  std::vector<ColumnarIndexEntry> fIndex;
+};
+
+#endif
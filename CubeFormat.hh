@@ -0,0 +1,105 @@
+#ifndef __CUBE_FORMAT_HH
+#define __CUBE_FORMAT_HH
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+
+//layout of the gamma-gamma-gamma cube files (native byte order, i.e. little endian)
+//
+//file header                   CubeFileHeader
+//blocks                        compressed blocks of blockSize^3 bins
+//block index                   nofBlocks x CubeIndexEntry (only the non-empty blocks, ordered by block coordinates)
+//trailer                       CubeTrailer
+//
+//the cube is symmetric, so only the bins with x <= y <= z are stored (and only blocks with x <= y <= z)
+//the bins of a block are ordered with z running fastest, a block is compressed as pairs of varints:
+//number of empty bins before the next non-empty bin and its content
+//
+//the axes are the calibrated energies in bins of fKeVPerBin keV, or the raw energies in bins of fRebin channels if the energies
+//weren't calibrated (fKeVPerBin = 0); version 1 only had raw energies (with 0 in place of fKeVPerBin)
+
+#define CUBE_MAGIC "EPICUBE1"
+#define CUBE_VERSION 2
+
+struct CubeFileHeader {
+  char fMagic[8];
+  uint32_t fVersion;
+  uint32_t fNofBins;//per axis
+  uint32_t fRebin;//channels per bin (raw energies)
+  uint32_t fBlockSize;//bins per axis and block
+  uint32_t fNofBlocks;//per axis
+  float fKeVPerBin;//calibrated energies, 0 for raw energies
+
+  void Set(uint32_t nofBins, uint32_t rebin, float keVPerBin, uint32_t blockSize) {
+    memcpy(fMagic, CUBE_MAGIC, 8);
+    fVersion = CUBE_VERSION;
+    fNofBins = nofBins;
+    fRebin = rebin;
+    fBlockSize = blockSize;
+    fNofBlocks = (nofBins + blockSize - 1)/blockSize;
+    fKeVPerBin = keVPerBin;
+  }
+  bool Valid() const {
+    return memcmp(fMagic, CUBE_MAGIC, 8) == 0 && fVersion >= 1 && fVersion <= CUBE_VERSION && fBlockSize > 0;
+  }
+  bool Calibrated() const {
+    return fKeVPerBin > 0.f;
+  }
+  //width of a bin in keV or channels
+  double BinWidth() const {
+    return Calibrated() ? fKeVPerBin : fRebin;
+  }
+};
+
+struct CubeIndexEntry {
+  uint64_t fOffset;//position of the compressed block in the file
+  uint32_t fSize;//bytes of the compressed block
+  uint16_t fBlockX;
+  uint16_t fBlockY;
+  uint16_t fBlockZ;
+  uint16_t fSpare;
+  uint32_t fNofBins;//number of non-empty bins
+};
+
+struct CubeTrailer {
+  uint64_t fIndexOffset;
+  uint64_t fNofBlocks;
+  uint64_t fEntries;//number of triples (each triple is stored once)
+  uint64_t fOverflow;//triples with a channel beyond the cube
+  char fMagic[8];
+};
+
+static_assert(sizeof(CubeFileHeader)%8 == 0, "cube file header needs to be aligned");
+static_assert(sizeof(CubeIndexEntry)%8 == 0, "cube index entry needs to be aligned");
+static_assert(sizeof(CubeTrailer)%8 == 0, "cube trailer needs to be aligned");
+
+//key of a bin with x <= y <= z, ordered by block and by position within the block
+inline uint64_t CubeKey(uint64_t x, uint64_t y, uint64_t z, uint64_t blockSize, uint64_t nofBlocks) {
+  uint64_t block = ((x/blockSize)*nofBlocks + y/blockSize)*nofBlocks + z/blockSize;
+  return ((block*blockSize + x%blockSize)*blockSize + y%blockSize)*blockSize + z%blockSize;
+}
+
+//unsigned LEB128 varints
+inline void CubeWriteVarint(uint64_t value, std::vector<uint8_t>& buffer) {
+  while(value >= 0x80) {
+    buffer.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<uint8_t>(value));
+}
+
+//returns false if the buffer ended in the middle of the varint
+inline bool CubeReadVarint(const uint8_t*& position, const uint8_t* end, uint64_t& value) {
+  value = 0;
+  for(int shift = 0; position < end && shift < 64; shift += 7) {
+    uint8_t byte = *(position++);
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif
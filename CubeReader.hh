@@ -0,0 +1,149 @@
+#ifndef __CUBE_READER_HH
+#define __CUBE_READER_HH
+
+//header-only reader for the cube files written by the unpacker (see CubeFormat.hh)
+//only the index is kept in memory, blocks are read and decompressed when they are needed
+//
+//usage:
+//  CubeFile cube("run.cub");
+//  std::vector<uint64_t> spectrum = cube.Project(gateLow, gateHigh);//gate on one axis, projection of the other two
+//  std::vector<uint64_t> spectrum = cube.Project(gateLow, gateHigh, secondLow, secondHigh);//double gate
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <stdint.h>
+
+#include "CubeFormat.hh"
+
+class CubeFile {
+public:
+  CubeFile(const std::string& fileName) {
+    fValid = false;
+    fFile.open(fileName.c_str(), std::ios::binary);
+    if(!fFile.is_open()) {
+      return;
+    }
+    fFile.read(reinterpret_cast<char*>(&fHeader), sizeof(fHeader));
+    if(!fFile.good() || !fHeader.Valid()) {
+      return;
+    }
+    fFile.seekg(0, std::ios::end);
+    uint64_t size = fFile.tellg();
+    if(size < sizeof(fHeader) + sizeof(fTrailer)) {
+      return;
+    }
+    fFile.seekg(size - sizeof(fTrailer));
+    fFile.read(reinterpret_cast<char*>(&fTrailer), sizeof(fTrailer));
+    if(!fFile.good() || memcmp(fTrailer.fMagic, CUBE_MAGIC, 8) != 0) {
+      return;
+    }
+    fIndex.resize(fTrailer.fNofBlocks);
+    fFile.seekg(fTrailer.fIndexOffset);
+    fFile.read(reinterpret_cast<char*>(fIndex.data()), fIndex.size()*sizeof(CubeIndexEntry));
+    fValid = fFile.good();
+  }
+
+  bool IsValid() const {
+    return fValid;
+  }
+  uint32_t NofBins() const {
+    return fHeader.fNofBins;
+  }
+  uint32_t Rebin() const {
+    return fHeader.fRebin;
+  }
+  //the axes are calibrated energies (keV) or raw energies (channels)
+  bool Calibrated() const {
+    return fHeader.Calibrated();
+  }
+  double BinWidth() const {
+    return fHeader.BinWidth();
+  }
+  uint64_t NofEntries() const {
+    return fTrailer.fEntries;
+  }
+  uint64_t NofOverflows() const {
+    return fTrailer.fOverflow;
+  }
+  size_t NofBlocks() const {
+    return fIndex.size();
+  }
+
+  //projection onto one axis of all bins with one other axis in the first gate and the last axis in the second gate (gates are in bins, inclusive)
+  //negative gates are open, without gates this is the total projection
+  std::vector<uint64_t> Project(int low = -1, int high = -1, int secondLow = -1, int secondHigh = -1) {
+    std::vector<uint64_t> spectrum(fHeader.fNofBins, 0);
+    Gate first(low, high, fHeader.fNofBins);
+    Gate second(secondLow, secondHigh, fHeader.fNofBins);
+    std::vector<uint8_t> buffer;
+    uint32_t blockSize = fHeader.fBlockSize;
+
+    for(const auto& entry : fIndex) {
+      //skip blocks that can't have any bin inside the gates
+      uint32_t begin[3] = { entry.fBlockX*blockSize, entry.fBlockY*blockSize, entry.fBlockZ*blockSize };
+      if(!first.Overlaps(begin, blockSize) || !second.Overlaps(begin, blockSize)) {
+	continue;
+      }
+      buffer.resize(entry.fSize);
+      fFile.seekg(entry.fOffset);
+      fFile.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+      const uint8_t* position = buffer.data();
+      const uint8_t* end = position + buffer.size();
+      uint64_t bin = 0;
+      uint64_t emptyBins;
+      uint64_t content;
+      while(CubeReadVarint(position, end, emptyBins) && CubeReadVarint(position, end, content)) {
+	bin += emptyBins;
+	uint32_t x = begin[0] + bin/blockSize/blockSize;
+	uint32_t y = begin[1] + (bin/blockSize)%blockSize;
+	uint32_t z = begin[2] + bin%blockSize;
+	AddPermutations(x, y, z, content, first, second, spectrum);
+	++bin;
+      }
+    }
+
+    return spectrum;
+  }
+
+private:
+  struct Gate {
+    Gate(int low, int high, uint32_t nofBins) {
+      fLow = (low < 0) ? 0 : low;
+      fHigh = (high < 0) ? nofBins : high;
+    }
+    bool Contains(uint32_t bin) const {
+      return fLow <= bin && bin <= fHigh;
+    }
+    bool Overlaps(const uint32_t* begin, uint32_t size) const {
+      for(int axis = 0; axis < 3; ++axis) {
+	if(begin[axis] <= fHigh && fLow < begin[axis] + size) {
+	  return true;
+	}
+      }
+      return false;
+    }
+    uint32_t fLow;
+    uint32_t fHigh;
+  };
+
+  //the stored bin (x <= y <= z) stands for all six permutations of the triple in the full cube
+  //(same as incrementing each ordering of the three hits, so a triple with two equal bins counts twice in that bin)
+  void AddPermutations(uint32_t x, uint32_t y, uint32_t z, uint64_t content, const Gate& first, const Gate& second, std::vector<uint64_t>& spectrum) {
+    const uint32_t permutations[6][3] = { { x, y, z }, { x, z, y }, { y, x, z }, { y, z, x }, { z, x, y }, { z, y, x } };
+    for(const auto& permutation : permutations) {
+      if(first.Contains(permutation[0]) && second.Contains(permutation[1])) {
+	spectrum[permutation[2]] += content;
+      }
+    }
+  }
+
+  bool fValid;
+  std::ifstream fFile;
+  CubeFileHeader fHeader;
+  CubeTrailer fTrailer;
+  std::vector<CubeIndexEntry> fIndex;
+};
+
+#endif
@@ -0,0 +1,63 @@
+#include <iostream>
+#include <fstream>
+#include <chrono>
+
+#include "CommandLineInterface.hh"
+#include "TextAttributes.hh"
+
+#include "CubeReader.hh"
+
+//projects the gamma-gamma-gamma cube written by the unpacker with one or two gates and writes the spectrum as text (energy counts)
+//the gates and the energies are in keV, or in channels if the cube was filled with the raw energies
+int main(int argc, char** argv) {
+  CommandLineInterface interface;
+  std::string cubeFileName;
+  interface.Add("-if","cube file name (required)",&cubeFileName);
+  std::string outputFileName;
+  interface.Add("-of","output file name (optional, default = std-out)",&outputFileName);
+  int gateLow = -1;
+  interface.Add("-gl","low edge of the first gate in keV (channels for raw cubes) (optional, default = no gate)",&gateLow);
+  int gateHigh = -1;
+  interface.Add("-gh","high edge of the first gate in keV (channels for raw cubes) (optional)",&gateHigh);
+  int secondLow = -1;
+  interface.Add("-sl","low edge of the second gate in keV (channels for raw cubes) (optional, default = no second gate)",&secondLow);
+  int secondHigh = -1;
+  interface.Add("-sh","high edge of the second gate in keV (channels for raw cubes) (optional)",&secondHigh);
+
+  interface.CheckFlags(argc, argv);
+
+  if(cubeFileName.empty()) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"I need the name of the cube file!"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+
+  CubeFile cube(cubeFileName);
+  if(!cube.IsValid()) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to read cube file '"<<cubeFileName<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  std::cerr<<"Cube '"<<cubeFileName<<"': "<<cube.NofBins()<<" bins of "<<cube.BinWidth()<<(cube.Calibrated() ? " keV, " : " channels, ")<<cube.NofEntries()<<" triples ("<<cube.NofOverflows()<<" overflows) in "<<cube.NofBlocks()<<" blocks"<<std::endl;
+
+  //the gates are given in keV (or channels), the cube has bins
+  auto toBin = [&cube](int value) -> int { return value < 0 ? -1 : static_cast<int>(value/cube.BinWidth()); };
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<uint64_t> spectrum = cube.Project(toBin(gateLow), toBin(gateHigh), toBin(secondLow), toBin(secondHigh));
+  auto end = std::chrono::high_resolution_clock::now();
+  std::cerr<<"Projection took "<<std::chrono::duration_cast<std::chrono::milliseconds>(end-start).count()<<" ms"<<std::endl;
+
+  std::ofstream outputFile;
+  if(!outputFileName.empty()) {
+    outputFile.open(outputFileName.c_str());
+    if(!outputFile.is_open()) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to open output file '"<<outputFileName<<"'"<<Attribs::Reset<<std::endl;
+      return 1;
+    }
+  }
+  std::ostream& output = outputFileName.empty() ? std::cout : outputFile;
+  for(size_t bin = 0; bin < spectrum.size(); ++bin) {
+    output<<bin*cube.BinWidth()<<" "<<spectrum[bin]<<std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,259 @@
+#include "CubeWriter.hh"
+
+#include <algorithm>
+#include <queue>
+#include <functional>
+#include <cstdio>
+#include <cmath>
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+CubeWriter::CubeWriter(Settings* settings) {
+  fSettings = settings;
+  fRebin = std::max(fSettings->CubeRebin(), 1);
+  fKeVPerBin = (fSettings->CubeKeVPerBin() > 0.) ? fSettings->CubeKeVPerBin() : 1.f;
+  fBlockSize = std::max(fSettings->CubeBlockSize(), 1);
+  CalibratedEnergies(false);
+  fBufferSize = std::max(fSettings->CubeBufferSize(), 1);
+  fRunPosition = 0;
+  fNofEntries = 0;
+  fNofOverflows = 0;
+}
+
+CubeWriter::~CubeWriter() {
+  //an unfinished cube only leaves the runs behind, so we remove them
+  if(fRunFile.is_open()) {
+    fRunFile.close();
+    std::remove((fFileName + ".runs").c_str());
+  }
+}
+
+void CubeWriter::Open(const std::string& fileName) {
+  fFileName = fileName;
+  fRuns.clear();
+  fRunPosition = 0;
+  fNofEntries = 0;
+  fNofOverflows = 0;
+}
+
+void CubeWriter::CalibratedEnergies(bool calibrated) {
+  fCalibrated = calibrated;
+  if(fCalibrated) {
+    fNofBins = std::max(static_cast<uint32_t>(std::ceil(fSettings->CubeMaxEnergy()/fKeVPerBin)), (uint32_t) 1);
+  } else {
+    fNofBins = (fSettings->MaxGermaniumChannel() + fRebin - 1)/fRebin;
+  }
+  fNofBlocks = (fNofBins + fBlockSize - 1)/fBlockSize;
+}
+
+//each combination of three germanium hits is one triple, sorted so that x <= y <= z
+void CubeWriter::Fill(const BuiltEvent& event, std::vector<uint64_t>& keys) {
+  if(event.Multiplicity(EDetectorType::kGermanium) < 3) {
+    return;
+  }
+  const std::vector<Hit>& hits = event.Hits();
+  uint8_t germanium = static_cast<uint8_t>(EDetectorType::kGermanium);
+  for(size_t first = 0; first < hits.size(); ++first) {
+    if(hits[first].fDetectorType != germanium) {
+      continue;
+    }
+    for(size_t second = first+1; second < hits.size(); ++second) {
+      if(hits[second].fDetectorType != germanium) {
+	continue;
+      }
+      for(size_t third = second+1; third < hits.size(); ++third) {
+	if(hits[third].fDetectorType != germanium) {
+	  continue;
+	}
+	uint32_t bins[3];
+	if(fCalibrated) {
+	  //negative energies end up as overflows as well
+	  if(hits[first].fEnergy < 0.f || hits[second].fEnergy < 0.f || hits[third].fEnergy < 0.f) {
+	    ++fNofOverflows;
+	    continue;
+	  }
+	  bins[0] = std::min(hits[first].fEnergy/fKeVPerBin, (float) fNofBins);
+	  bins[1] = std::min(hits[second].fEnergy/fKeVPerBin, (float) fNofBins);
+	  bins[2] = std::min(hits[third].fEnergy/fKeVPerBin, (float) fNofBins);
+	} else {
+	  bins[0] = hits[first].fRawEnergy/fRebin;
+	  bins[1] = hits[second].fRawEnergy/fRebin;
+	  bins[2] = hits[third].fRawEnergy/fRebin;
+	}
+	if(bins[0] >= fNofBins || bins[1] >= fNofBins || bins[2] >= fNofBins) {
+	  ++fNofOverflows;
+	  continue;
+	}
+	std::sort(bins, bins+3);
+	keys.push_back(CubeKey(bins[0], bins[1], bins[2], fBlockSize, fNofBlocks));
+      }
+    }
+  }
+  if(keys.size() >= fBufferSize) {
+    WriteRun(keys);
+  }
+}
+
+//the sorting is done by the calling thread, only writing the run needs the lock
+void CubeWriter::WriteRun(std::vector<uint64_t>& keys) {
+  if(keys.empty()) {
+    return;
+  }
+  std::sort(keys.begin(), keys.end());
+  std::vector<std::pair<uint64_t, uint64_t> > run;
+  for(auto key : keys) {
+    if(!run.empty() && run.back().first == key) {
+      ++(run.back().second);
+    } else {
+      run.push_back(std::make_pair(key, (uint64_t) 1));
+    }
+  }
+  fNofEntries += keys.size();
+  keys.clear();
+
+  std::lock_guard<std::mutex> lock(fRunMutex);
+  if(!fRunFile.is_open()) {
+    fRunFile.open((fFileName + ".runs").c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary);
+    if(!fRunFile.is_open()) {
+      std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to open temporary file '",fFileName,".runs' for the cube, dropping ",run.size()," bins",Attribs::Reset())<<std::endl;
+      return;
+    }
+  }
+  fRunFile.seekp(fRunPosition);
+  fRunFile.write(reinterpret_cast<const char*>(run.data()), run.size()*sizeof(run[0]));
+  fRuns.push_back(std::make_pair(fRunPosition, (uint64_t) run.size()));
+  fRunPosition += run.size()*sizeof(run[0]);
+  if(fSettings->VerbosityLevel() > 1) {
+    std::cout<<Show("Wrote cube run ",fRuns.size()," with ",run.size()," bins")<<std::endl;
+  }
+}
+
+void CubeWriter::Close() {
+  if(!IsOpen()) {
+    return;
+  }
+
+  std::ofstream file(fFileName.c_str(), std::ios::binary | std::ios::trunc);
+  if(!file.is_open()) {
+    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to open cube file '",fFileName,"'",Attribs::Reset())<<std::endl;
+    return;
+  }
+  CubeFileHeader header;
+  header.Set(fNofBins, fRebin, fCalibrated ? fKeVPerBin : 0.f, fBlockSize);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t position = sizeof(header);
+  fIndex.clear();
+
+  //k-way merge of the runs, each run is read in chunks
+  typedef std::pair<uint64_t, uint64_t> Bin;
+  const size_t chunkSize = 4096;
+  std::vector<std::vector<Bin> > chunks(fRuns.size());
+  std::vector<size_t> next(fRuns.size(), 0);
+  std::vector<uint64_t> read(fRuns.size(), 0);
+  auto refill = [&](size_t run) -> bool {
+    uint64_t nofBins = std::min((uint64_t) chunkSize, fRuns[run].second - read[run]);
+    if(nofBins == 0) {
+      return false;
+    }
+    chunks[run].resize(nofBins);
+    fRunFile.seekg(fRuns[run].first + read[run]*sizeof(Bin));
+    fRunFile.read(reinterpret_cast<char*>(chunks[run].data()), nofBins*sizeof(Bin));
+    read[run] += nofBins;
+    next[run] = 0;
+    return true;
+  };
+
+  //smallest key on top
+  std::priority_queue<std::pair<uint64_t, size_t>, std::vector<std::pair<uint64_t, size_t> >, std::greater<std::pair<uint64_t, size_t> > > queue;
+  if(fRunFile.is_open()) {
+    fRunFile.flush();
+    for(size_t run = 0; run < fRuns.size(); ++run) {
+      if(refill(run)) {
+	queue.push(std::make_pair(chunks[run][0].first, run));
+      }
+    }
+  }
+
+  uint64_t binsPerBlock = (uint64_t) fBlockSize*fBlockSize*fBlockSize;
+  std::vector<uint64_t> block(binsPerBlock, 0);
+  std::vector<uint8_t> buffer;
+  uint64_t currentBlock = 0;
+  bool empty = true;
+  while(!queue.empty()) {
+    size_t run = queue.top().second;
+    queue.pop();
+    const Bin& bin = chunks[run][next[run]];
+    if(!empty && bin.first/binsPerBlock != currentBlock) {
+      WriteBlock(file, currentBlock, block, buffer);
+      fIndex.back().fOffset = position;
+      position += fIndex.back().fSize;
+      std::fill(block.begin(), block.end(), 0);
+    }
+    currentBlock = bin.first/binsPerBlock;
+    empty = false;
+    block[bin.first%binsPerBlock] += bin.second;
+    if(++next[run] < chunks[run].size() || refill(run)) {
+      queue.push(std::make_pair(chunks[run][next[run]].first, run));
+    }
+  }
+  if(!empty) {
+    WriteBlock(file, currentBlock, block, buffer);
+    fIndex.back().fOffset = position;
+    position += fIndex.back().fSize;
+  }
+
+  //the index starts at a multiple of 8 bytes
+  const char padding[8] = { 0 };
+  file.write(padding, (8 - position%8)%8);
+  position += (8 - position%8)%8;
+  file.write(reinterpret_cast<const char*>(fIndex.data()), fIndex.size()*sizeof(CubeIndexEntry));
+
+  CubeTrailer trailer;
+  trailer.fIndexOffset = position;
+  trailer.fNofBlocks = fIndex.size();
+  trailer.fEntries = fNofEntries;
+  trailer.fOverflow = fNofOverflows;
+  memcpy(trailer.fMagic, CUBE_MAGIC, 8);
+  file.write(reinterpret_cast<const char*>(&trailer), sizeof(trailer));
+  file.close();
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Wrote cube '"<<fFileName<<"' with "<<fNofEntries<<" triples ("<<fNofOverflows<<" overflows) in "<<fIndex.size()<<" blocks = "
+	     <<position + fIndex.size()*sizeof(CubeIndexEntry) + sizeof(trailer)<<" bytes, merged from "<<fRuns.size()<<" runs"<<std::endl;
+  }
+
+  if(fRunFile.is_open()) {
+    fRunFile.close();
+    std::remove((fFileName + ".runs").c_str());
+  }
+  fFileName.clear();
+}
+
+//compress the block and add it to the index (the offset is set by the caller)
+void CubeWriter::WriteBlock(std::ofstream& file, uint64_t blockNumber, const std::vector<uint64_t>& block, std::vector<uint8_t>& buffer) {
+  buffer.clear();
+  uint64_t emptyBins = 0;
+  uint32_t nofBins = 0;
+  for(auto content : block) {
+    if(content == 0) {
+      ++emptyBins;
+      continue;
+    }
+    CubeWriteVarint(emptyBins, buffer);
+    CubeWriteVarint(content, buffer);
+    emptyBins = 0;
+    ++nofBins;
+  }
+  file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+
+  CubeIndexEntry entry;
+  entry.fOffset = 0;
+  entry.fSize = buffer.size();
+  entry.fBlockX = blockNumber/fNofBlocks/fNofBlocks;
+  entry.fBlockY = (blockNumber/fNofBlocks)%fNofBlocks;
+  entry.fBlockZ = blockNumber%fNofBlocks;
+  entry.fSpare = 0;
+  entry.fNofBins = nofBins;
+  fIndex.push_back(entry);
+}
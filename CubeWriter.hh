@@ -0,0 +1,74 @@
+#ifndef __CUBE_WRITER_HH
+#define __CUBE_WRITER_HH
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+
+#include "Settings.hh"
+#include "BuiltEvent.hh"
+#include "CubeFormat.hh"
+
+//fills the symmetrised germanium triples of the built events into a cube written in the format described in CubeFormat.hh
+//the axes are the calibrated energies, the raw energies of different detectors aren't gain-matched and are only used if no energy
+//calibration is loaded
+//each thread collects the keys of its triples in its own buffer, full buffers are sorted and written as a run to a temporary file,
+//on Close() all runs are merged into the compressed blocks of the cube file
+class CubeWriter {
+public:
+  CubeWriter(Settings*);
+  ~CubeWriter();
+
+  //the runs are written to <file name>.runs until Close() is called
+  void Open(const std::string&);
+  //whether the hits have calibrated energies (has to be called before the first fill)
+  void CalibratedEnergies(bool);
+  bool IsOpen() {
+    return !fFileName.empty();
+  }
+
+  //adds the triples of the event to the buffer and writes the buffer as a run once it's full (can be called from several threads with different buffers)
+  void Fill(const BuiltEvent&, std::vector<uint64_t>&);
+  //sorts the keys in the buffer and writes them as a run (the buffer is emptied)
+  void WriteRun(std::vector<uint64_t>&);
+
+  //merges the runs into the cube file (all buffers need to be written beforehand)
+  void Close();
+
+  uint64_t NofEntries() {
+    return fNofEntries;
+  }
+  uint64_t NofOverflows() {
+    return fNofOverflows;
+  }
+  size_t NofRuns() {
+    return fRuns.size();
+  }
+
+private:
+  void WriteBlock(std::ofstream&, uint64_t, const std::vector<uint64_t>&, std::vector<uint8_t>&);
+
+  Settings* fSettings;
+  std::string fFileName;
+  uint32_t fNofBins;
+  uint32_t fRebin;
+  bool fCalibrated;
+  float fKeVPerBin;
+  uint32_t fBlockSize;
+  uint32_t fNofBlocks;
+  size_t fBufferSize;
+
+  //temporary file with the runs of sorted (key, count) pairs
+  std::mutex fRunMutex;
+  std::fstream fRunFile;
+  std::vector<std::pair<uint64_t, uint64_t> > fRuns;//offset and number of pairs
+  uint64_t fRunPosition;
+  std::atomic<uint64_t> fNofEntries;
+  std::atomic<uint64_t> fNofOverflows;
+
+  std::vector<CubeIndexEntry> fIndex;
+};
+
+#endif
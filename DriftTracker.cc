@@ -0,0 +1,150 @@
+#include "DriftTracker.hh"
+
+#include <cmath>
+#include <algorithm>
+
+DriftTracker::DriftTracker(Settings* settings) {
+  fSettings = settings;
+  fReferenceEnergy = settings->DriftEnergy();
+  fBinWidth = (settings->DriftBinWidth() > 0.) ? settings->DriftBinWidth() : 1.;
+  fNofBins = std::max(static_cast<size_t>(std::ceil(2.*settings->DriftWindow()/fBinWidth)), (size_t) 8);
+  fLow = fReferenceEnergy - fNofBins*fBinWidth/2.;
+  fMinCounts = settings->DriftMinCounts();
+  fSliceLength = static_cast<uint64_t>(settings->DriftSliceLength())*ULM_CLOCK_IN_SECONDS;
+
+  fSpectra.resize(settings->NofGermaniumDetectors()*fNofBins, 0);
+  fFactor.resize(settings->NofGermaniumDetectors(), 1.f);
+
+  fSliceStart = 0;
+  fSliceEnd = 0;
+  fNofHitsInSlice = 0;
+  fTemperatureSum = 0.;
+  fNofTemperatures = 0;
+  fLastTemperature = std::nanf("");
+}
+
+void DriftTracker::Add(std::vector<Hit>& hits) {
+  for(auto& hit : hits) {
+    if(hit.fDetectorType != static_cast<uint8_t>(EDetectorType::kGermanium) || hit.fDetectorNumber >= fFactor.size()) {
+      continue;
+    }
+    if(fSliceLength > 0 && fNofHitsInSlice > 0 && hit.Clock() >= fSliceStart + fSliceLength) {
+      EndOfSlice();
+    }
+    if(fNofHitsInSlice == 0) {
+      fSliceStart = hit.Clock();
+      fSliceEnd = hit.Clock();
+    } else {
+      fSliceStart = std::min(fSliceStart, hit.Clock());
+      fSliceEnd = std::max(fSliceEnd, hit.Clock());
+    }
+    ++fNofHitsInSlice;
+
+    //uncalibrated hits have an energy of 0
+    if(hit.fEnergy <= 0.f) {
+      continue;
+    }
+    hit.fEnergy *= fFactor[hit.fDetectorNumber];
+    double bin = (hit.fEnergy - fLow)/fBinWidth;
+    if(bin >= 0. && bin < fNofBins) {
+      ++fSpectra[hit.fDetectorNumber*fNofBins + static_cast<size_t>(bin)];
+    }
+  }
+}
+
+void DriftTracker::Temperature(float temperature) {
+  fTemperatureSum += temperature;
+  ++fNofTemperatures;
+  fLastTemperature = temperature;
+}
+
+//the background under the line is a straight line through the mean of the outer quarters of the spectrum,
+//the centroid is calculated from the background-subtracted inner half
+void DriftTracker::EndOfSlice() {
+  if(fNofHitsInSlice == 0) {
+    return;
+  }
+
+  DriftSlice slice;
+  slice.fStart = fSliceStart;
+  slice.fEnd = fSliceEnd;
+  slice.fNofTemperatures = fNofTemperatures;
+  slice.fTemperature = (fNofTemperatures > 0) ? fTemperatureSum/fNofTemperatures : fLastTemperature;
+  slice.fCentroid.resize(fFactor.size(), 0.f);
+  slice.fCounts.resize(fFactor.size(), 0);
+
+  size_t side = std::max(fNofBins/4, (size_t) 1);
+  for(size_t det = 0; det < fFactor.size(); ++det) {
+    uint32_t* spectrum = &fSpectra[det*fNofBins];
+    double left = 0.;
+    double right = 0.;
+    for(size_t bin = 0; bin < side; ++bin) {
+      left += spectrum[bin];
+      right += spectrum[fNofBins - 1 - bin];
+    }
+    left /= side;
+    right /= side;
+    double slope = (right - left)/(fNofBins - side);//per bin, between the centers of the outer quarters
+
+    double sum = 0.;
+    double weightedSum = 0.;
+    for(size_t bin = side; bin < fNofBins - side; ++bin) {
+      double net = spectrum[bin] - (left + slope*(bin - (side - 1)/2.));
+      sum += net;
+      weightedSum += net*(fLow + (bin + 0.5)*fBinWidth);
+    }
+    if(sum > 0.) {
+      slice.fCounts[det] = static_cast<uint32_t>(sum);
+    }
+    if(sum > 0. && sum >= fMinCounts) {
+      slice.fCentroid[det] = weightedSum/sum;
+      fFactor[det] *= fReferenceEnergy/slice.fCentroid[det];
+    }
+  }
+  slice.fFactor = fFactor;
+  fSlices.push_back(slice);
+
+  std::fill(fSpectra.begin(), fSpectra.end(), 0);
+  fNofHitsInSlice = 0;
+  fTemperatureSum = 0.;
+  fNofTemperatures = 0;
+}
+
+DriftCorrelation DriftTracker::Correlation(uint16_t detectorNumber) {
+  DriftCorrelation result = { 0., 0., 0., 0 };
+  double sumX = 0.;
+  double sumY = 0.;
+  double sumXX = 0.;
+  double sumXY = 0.;
+  double sumYY = 0.;
+  for(const auto& slice : fSlices) {
+    //only slices with a measured centroid and a known temperature
+    if(detectorNumber >= slice.fCentroid.size() || slice.fCentroid[detectorNumber] <= 0.f || std::isnan(slice.fTemperature)) {
+      continue;
+    }
+    double x = slice.fTemperature;
+    double y = slice.fFactor[detectorNumber];
+    sumX += x;
+    sumY += y;
+    sumXX += x*x;
+    sumXY += x*y;
+    sumYY += y*y;
+    ++result.fNofSlices;
+  }
+  if(result.fNofSlices < 2) {
+    return result;
+  }
+  double n = result.fNofSlices;
+  double varianceX = n*sumXX - sumX*sumX;
+  double varianceY = n*sumYY - sumY*sumY;
+  if(varianceX <= 0.) {
+    return result;
+  }
+  result.fSlope = (n*sumXY - sumX*sumY)/varianceX;
+  result.fIntercept = (sumY - result.fSlope*sumX)/n;
+  if(varianceY > 0.) {
+    result.fCorrelation = (n*sumXY - sumX*sumY)/std::sqrt(varianceX*varianceY);
+  }
+
+  return result;
+}
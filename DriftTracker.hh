@@ -0,0 +1,84 @@
+#ifndef __DRIFT_TRACKER_HH
+#define __DRIFT_TRACKER_HH
+
+#include <vector>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "Hit.hh"
+
+//one time slice of the drift tracking
+struct DriftSlice {
+  uint64_t fStart;//clock of the first and last hit in the slice (100 ns)
+  uint64_t fEnd;
+  float fTemperature;//mean of the temperatures read during the slice (or the last one before it)
+  uint32_t fNofTemperatures;
+  //per germanium detector
+  std::vector<float> fCentroid;//of the reference line in the corrected energies (keV, 0 if there weren't enough counts)
+  std::vector<uint32_t> fCounts;//net counts in the reference line
+  std::vector<float> fFactor;//gain correction applied from the end of this slice on
+};
+
+//linear regression of the gain correction of one detector vs. temperature
+struct DriftCorrelation {
+  double fSlope;//per degree
+  double fIntercept;
+  double fCorrelation;//Pearson's r
+  size_t fNofSlices;
+};
+
+//tracks the gain drift of the germanium detectors with a reference line in the calibrated energies:
+//each detector has a small spectrum around the line that is filled with the corrected energies of the current slice (a tape cycle or
+//a fixed time), so the window follows the line; at the end of the slice the background-subtracted centroid of the line updates the
+//correction factor (factor *= reference/centroid), which is applied to all following hits, i.e. the correction lags one slice behind
+class DriftTracker {
+public:
+  DriftTracker(Settings*);
+  ~DriftTracker(){};
+
+  //applies the current correction to the germanium hits and fills the spectra with the corrected energies
+  void Add(std::vector<Hit>&);
+  //temperature read from an epics event
+  void Temperature(float);
+  //calculates the centroids and new factors (does nothing if there were no hits since the last slice)
+  void EndOfSlice();
+
+  //slices end with each tape cycle if no slice length is given
+  bool SliceByCycle() {
+    return fSliceLength == 0;
+  }
+
+  const std::vector<DriftSlice>& Slices() {
+    return fSlices;
+  }
+  size_t NofDetectors() {
+    return fFactor.size();
+  }
+  float Factor(uint16_t detectorNumber) {
+    return fFactor[detectorNumber];
+  }
+  DriftCorrelation Correlation(uint16_t);
+
+private:
+  Settings* fSettings;
+  double fReferenceEnergy;
+  double fLow;//lower edge of the spectra (keV)
+  double fBinWidth;
+  size_t fNofBins;
+  uint32_t fMinCounts;
+  uint64_t fSliceLength;//100 ns
+
+  //one row of fNofBins per detector, reset at the end of each slice
+  std::vector<uint32_t> fSpectra;
+  std::vector<float> fFactor;
+
+  uint64_t fSliceStart;
+  uint64_t fSliceEnd;
+  size_t fNofHitsInSlice;
+  double fTemperatureSum;
+  uint32_t fNofTemperatures;
+  float fLastTemperature;
+  std::vector<DriftSlice> fSlices;
+};
+
+#endif
@@ -0,0 +1,132 @@
+#include <iostream>
+#include <fstream>
+
+#include "TFile.h"
+#include "TH1.h"
+
+#include "CommandLineInterface.hh"
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+#include "Settings.hh"
+#include "CalibrationDriver.hh"
+
+//calibrates the raw energy histograms written by the unpacker and writes the calibration file read by the unpacker (Calibration.FileName)
+
+void exitFunction() {
+  //reset the text attributes of std-out and -err
+  std::cout<<Attribs::Reset<<std::flush;
+  std::cerr<<Attribs::Reset<<std::flush;
+}
+
+int main(int argc, char** argv) {
+  atexit(exitFunction);
+
+  CommandLineInterface interface;
+  std::string inputFileName;
+  interface.Add("-if","root file with the raw energy histograms (required)",&inputFileName);
+  std::string calibrationFileName;
+  interface.Add("-of","calibration file name (optional, default = replacing extension with .cal)",&calibrationFileName);
+  std::string rootFileName;
+  interface.Add("-rf","root file for the fitted histograms and peaks (optional)",&rootFileName);
+  std::string settingsFileName = "Settings.dat";
+  interface.Add("-sf","settings file name (optional, default = 'Settings.dat'",&settingsFileName);
+  int nofThreads = 0;
+  interface.Add("-nt","number of detectors calibrated in parallel (optional, overrides Calibration.NofThreads)",&nofThreads);
+  std::string peakFinder;
+  interface.Add("-pf","peak finder Fast or TSpectrum (optional, overrides Calibration.PeakFinder)",&peakFinder);
+  std::string sources;
+  interface.Add("-src","calibration sources matched for detectors without peaks, e.g. \"152Eu 60Co\" (optional, overrides Calibration.Sources)",&sources);
+  std::string cacheFileName;
+  interface.Add("-cc","calibration cache file name (optional, overrides Calibration.Cache.FileName)",&cacheFileName);
+  bool benchmark = false;
+  interface.Add("-bm","compare the fast peak finder with TSpectrum instead of calibrating",&benchmark);
+  int verbosityLevel = 0;
+  interface.Add("-vl","level of verbosity (optional, default = 0)",&verbosityLevel);
+
+  //-------------------- check flags and arguments --------------------
+  interface.CheckFlags(argc, argv);
+
+  if(inputFileName.empty()) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"I need the name of the root file!"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+
+  if(calibrationFileName.empty()) {
+    size_t extension = inputFileName.rfind('.');
+
+    if(extension == std::string::npos) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to find extension of root file name, please provide calibration file name."<<Attribs::Reset<<std::endl;
+      return 1;
+    }
+    calibrationFileName = inputFileName.substr(0,extension);
+    calibrationFileName.append(".cal");
+    if(verbosityLevel > 0) {
+      std::cout<<"created calibration file name '"<<calibrationFileName<<"' from root file name '"<<inputFileName<<"'"<<std::endl;
+    }
+  }
+
+  if(!FileExists(settingsFileName)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to find settings file '"<<settingsFileName<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  Settings settings(settingsFileName, verbosityLevel);
+  if(nofThreads > 0) {
+    settings.NofCalibrationThreads(nofThreads);
+  }
+  if(!cacheFileName.empty()) {
+    settings.CalibrationCacheFileName(cacheFileName);
+  }
+  if(!sources.empty()) {
+    settings.CalibrationSources(sources);
+  }
+  if(!peakFinder.empty() && !settings.PeakFinder(peakFinder)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Unknown peak finder '"<<peakFinder<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+
+  //-------------------- read the histograms --------------------
+  TH1::AddDirectory(false);
+  TFile inputFile(inputFileName.c_str());
+  if(!inputFile.IsOpen()) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to open root file '"<<inputFileName<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  CalibrationDriver driver(&settings);
+  if(driver.Read(&inputFile) == 0) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to find any raw energy histograms in '"<<inputFileName<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  inputFile.Close();
+
+  if(benchmark) {
+    driver.Benchmark(std::cout);
+    return 0;
+  }
+
+  //-------------------- calibrate and write the results --------------------
+  driver.Run();
+  driver.Print(std::cout);
+
+  std::ofstream calibrationFile(calibrationFileName.c_str());
+  if(!calibrationFile.is_open()) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to open calibration file '"<<calibrationFileName<<"' for writing"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  calibrationFile<<"# calibration of "<<inputFileName<<": energy = gain*(channel - offset)"<<std::endl;
+  size_t nofCalibrations = driver.Write(calibrationFile);
+  calibrationFile.close();
+  std::cout<<"wrote "<<nofCalibrations<<" calibrations to '"<<calibrationFileName<<"'"<<std::endl;
+
+  if(!rootFileName.empty()) {
+    TFile rootFile(rootFileName.c_str(),"recreate");
+    if(!rootFile.IsOpen()) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to open root file '"<<rootFileName<<"' for writing"<<Attribs::Reset<<std::endl;
+      return 1;
+    }
+    driver.Write(&rootFile);
+    rootFile.Close();
+  }
+
+  return 0;
+}
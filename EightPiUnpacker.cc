@@ -4,6 +4,7 @@
 #include "TFile.h"
 #include "TTree.h"
 #include "TStopwatch.h"
+#include "TROOT.h"
 
 #include "CommandLineInterface.hh"
 #include "Utilities.hh"
@@ -12,6 +13,10 @@
 #include "MidasFileManager.hh"
 #include "MidasEventProcessor.hh"
 #include "Settings.hh"
+#include "SettingsManager.hh"
+#include "FeraDecoder.hh"
+#include "EventBuilder.hh"
+#include "OutputBenchmark.hh"
 
 void exitFunction() {
   //reset the text attributes of std-out and -err
@@ -19,6 +24,53 @@ void exitFunction() {
   std::cerr<<Attribs::Reset<<std::flush;
 }
 
+//decode and build the first events of the midas file and write them with different compression settings
+int Benchmark(const std::string& midasFileName, const std::string& rootFileName, Settings& settings, size_t nofEvents) {
+  MidasFileManager fileManager(midasFileName, &settings);
+  MidasEvent currentEvent;
+  FeraDecoder decoder(&settings);
+  EventBuilder builder(&settings);
+  OutputBenchmark benchmark(&settings, nofEvents);
+  std::vector<Hit> hits;
+  FifoRecords records;
+
+  auto output = [&benchmark](BuiltEvent& event) { benchmark.Add(event); };
+  auto endOfCycle = [](size_t) {};
+
+  fileManager.ReadHeader();
+  while(fileManager.Status() != MidasFileManager::kEoF && !benchmark.Full()) {
+    currentEvent.Zero();
+    if(!fileManager.Read(currentEvent)) {
+      continue;
+    }
+    switch(currentEvent.Type()) {
+    case FIFOEVENT:
+      if(decoder.FifoEvent(currentEvent, hits, records)) {
+	builder.Add(hits, records);
+	builder.Build(false, output, endOfCycle);
+      }
+      break;
+    case CAMACSCALEREVENT:
+      decoder.CamacScalerEvent(currentEvent);
+      decoder.EndOfCycle(currentEvent.Time());
+      builder.EndOfCycle();
+      break;
+    default:
+      break;
+    }
+  }
+  builder.Build(true, output, endOfCycle);
+  fileManager.Close();
+
+  if(benchmark.NofEvents() < nofEvents) {
+    std::cout<<"Only got "<<benchmark.NofEvents()<<" out of "<<nofEvents<<" events from '"<<midasFileName<<"'"<<std::endl;
+  }
+
+  benchmark.Run(rootFileName);
+
+  return 0;
+}
+
 int main(int argc, char** argv) {
   atexit(exitFunction);
   
@@ -35,6 +87,44 @@ int main(int argc, char** argv) {
   interface.Add("-su","activate status update",&statusUpdate);
   size_t nofEvents = 0;
   interface.Add("-ne","maximum number of events to be processed",&nofEvents);
+  bool flatTree = false;
+  interface.Add("-flat","write the flat tree schema (overrides Output.Schema of the settings file)",&flatTree);
+  int nofOutputThreads = 0;
+  interface.Add("-nt","number of threads compressing the output tree (optional, overrides Output.NofThreads of the settings file)",&nofOutputThreads);
+  std::string compressionAlgorithm;
+  interface.Add("-ca","compression algorithm ZLIB, LZMA, LZ4, or ZSTD (optional, overrides Output.Compression)",&compressionAlgorithm);
+  int compressionLevel = -1;
+  interface.Add("-cl","compression level (optional, overrides Output.CompressionLevel)",&compressionLevel);
+  int basketSize = 0;
+  interface.Add("-bs","basket size in bytes (optional, overrides Output.BasketSize)",&basketSize);
+  int autoFlush = 0;
+  interface.Add("-af","auto-flush, positive = entries, negative = bytes (optional, overrides Output.AutoFlush)",&autoFlush);
+  std::string columnarFileName;
+  interface.Add("-cf","columnar output file name (optional, overrides Output.Columnar.FileName)",&columnarFileName);
+  size_t rolloverEvents = 0;
+  interface.Add("-re","start a new output file after this many events (optional, overrides Output.Rollover.Events)",&rolloverEvents);
+  int rolloverMegaBytes = 0;
+  interface.Add("-rb","start a new output file after this many MB (optional, overrides Output.Rollover.MegaBytes)",&rolloverMegaBytes);
+  bool rolloverCycle = false;
+  interface.Add("-rc","start a new output file at each cycle end",&rolloverCycle);
+  size_t benchmarkEvents = 0;
+  interface.Add("-bm","benchmark the output compression with this many thousand events, the root file is used as scratch file",&benchmarkEvents);
+  bool histogramsOnly = false;
+  interface.Add("-ho","only fill the histograms, no event building and no tree (overrides Histograms.Only)",&histogramsOnly);
+  bool matrices = false;
+  interface.Add("-mat","fill the coincidence matrices of the built events (overrides Matrix.Active)",&matrices);
+  std::string cubeFileName;
+  interface.Add("-cub","gamma-gamma-gamma cube file name (optional, overrides Cube.FileName)",&cubeFileName);
+  std::string calibrationFileName;
+  interface.Add("-cal","calibration file name (optional, overrides Calibration.FileName)",&calibrationFileName);
+  bool trackDrift = false;
+  interface.Add("-drift","track and correct the gain drift of the germanium detectors (overrides Drift.Active)",&trackDrift);
+  std::string timingFileName;
+  interface.Add("-tim","timing calibration file name for the fine timestamps (optional, overrides Timing.FileName)",&timingFileName);
+  std::string tdcSelection;
+  interface.Add("-tdc","TDC selection LastInWindow, FirstInWindow, AllInWindow, or All (optional, overrides Tdc.Selection)",&tdcSelection);
+  bool hotReload = false;
+  interface.Add("-hr","reload the settings file when it changes (overrides Reload.Active)",&hotReload);
   int verbosityLevel = 0;
   interface.Add("-vl","level of verbosity (optional, default = 0)",&verbosityLevel);
   
@@ -70,28 +160,116 @@ int main(int argc, char** argv) {
     std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to find midas file '"<<settingsFileName<<"'"<<Attribs::Reset<<std::endl;
     return 1;
   }
+  //the command line overrides the settings file, also for each reload of the file
+  auto overrides = [&](Settings& settings) {
+    if(flatTree) {
+      settings.TreeSchema(ETreeSchema::kFlat);
+    }
+    if(nofOutputThreads > 0) {
+      settings.NofOutputThreads(nofOutputThreads);
+    }
+    if(!compressionAlgorithm.empty()) {
+      settings.CompressionAlgorithm(compressionAlgorithm);
+    }
+    if(compressionLevel >= 0) {
+      settings.CompressionLevel(compressionLevel);
+    }
+    if(basketSize > 0) {
+      settings.BasketSize(basketSize);
+    }
+    if(autoFlush != 0) {
+      settings.AutoFlush(autoFlush);
+    }
+    if(rolloverEvents > 0) {
+      settings.RolloverEvents(rolloverEvents);
+    }
+    if(rolloverMegaBytes > 0) {
+      settings.RolloverBytes(rolloverMegaBytes*1048576LL);
+    }
+    if(rolloverCycle) {
+      settings.RolloverCycle(true);
+    }
+    if(!columnarFileName.empty()) {
+      settings.ColumnarFileName(columnarFileName);
+    }
+    if(histogramsOnly) {
+      settings.HistogramsOnly(true);
+    }
+    if(matrices) {
+      settings.Matrices(true);
+    }
+    if(!cubeFileName.empty()) {
+      settings.CubeFileName(cubeFileName);
+    }
+    if(!calibrationFileName.empty()) {
+      settings.CalibrationFileName(calibrationFileName);
+    }
+    if(trackDrift) {
+      settings.TrackDrift(true);
+    }
+    if(!timingFileName.empty()) {
+      settings.TimingFileName(timingFileName);
+    }
+    if(!tdcSelection.empty()) {
+      settings.TdcSelection(tdcSelection);
+    }
+    if(hotReload) {
+      settings.HotReload(true);
+    }
+  };
   Settings settings(settingsFileName, verbosityLevel);
+  if(!compressionAlgorithm.empty() && !settings.CompressionAlgorithm(compressionAlgorithm)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Unknown compression algorithm '"<<compressionAlgorithm<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  if(!tdcSelection.empty() && !settings.TdcSelection(tdcSelection)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Unknown TDC selection '"<<tdcSelection<<"'"<<Attribs::Reset<<std::endl;
+    return 1;
+  }
+  overrides(settings);
+
+  //-------------------- implicit multithreading for the output --------------------
+  //the baskets of the different branches are compressed in parallel when the tree is filled
+  if(settings.NofOutputThreads() > 1) {
+#ifdef R__USE_IMT
+    ROOT::EnableImplicitMT(settings.NofOutputThreads());
+#else
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"ROOT was built without implicit multithreading, writing the tree with one thread"<<Attribs::Reset<<std::endl;
+    settings.NofOutputThreads(1);
+#endif
+  }
+
+  //-------------------- benchmark of the output --------------------
+  if(benchmarkEvents > 0) {
+    return Benchmark(midasFileName, rootFileName, settings, benchmarkEvents*1000);
+  }
 
   //-------------------- open root file and tree --------------------
   TFile rootFile(rootFileName.c_str(),"recreate");
+  rootFile.SetCompressionSettings(settings.CompressionSettings());
 
   if(!rootFile.IsOpen()) {
     std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to open root file '"<<rootFileName<<"' for writing"<<Attribs::Reset<<std::endl;
     return 1;
   }
 
-  TTree tree("tree","gsort tree");
-
   //-------------------- variables needed --------------------
   TStopwatch watch;
   size_t totalEvents = 0;
   size_t oldPosition = 0;
   MidasFileManager fileManager(midasFileName, &settings);
   MidasEvent currentEvent;
-  MidasEventProcessor eventProcessor(&settings, &rootFile, &tree, statisticsFile, statusUpdate);
+  //the settings manager has to outlive the event processor
+  std::unique_ptr<SettingsManager> settingsManager;
+  if(settings.HotReload()) {
+    settingsManager.reset(new SettingsManager(&settings, settingsFileName, overrides));
+    settingsManager->Watch(settings.ReloadInterval());
+  }
+  MidasEventProcessor eventProcessor(&settings, &rootFile, statisticsFile, statusUpdate, settingsManager.get());
 
   //-------------------- get the file header --------------------
   MidasFileHeader fileHeader = fileManager.ReadHeader();
+  eventProcessor.Run(fileHeader.RunNumber());
   if(verbosityLevel > 0) {
     std::cout<<"Run number: "<<fileHeader.RunNumber()<<std::endl
 	     <<"Start time: "<<hex<<fileHeader.StartTime()<<dec<<std::endl
@@ -140,7 +318,6 @@ int main(int argc, char** argv) {
     //}
 
   fileManager.Close();
-  tree.Write();
   rootFile.Close();
   
   return 0;
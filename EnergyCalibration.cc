@@ -0,0 +1,101 @@
+#include "EnergyCalibration.hh"
+
+#include <cstdio>
+#include <algorithm>
+
+#include "EnvFile.hh"
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+EnergyCalibration::EnergyCalibration(Settings* settings) {
+  fSettings = settings;
+  fDither = fSettings->CalibrationDither();
+  fRandom = 2463534242;
+
+  std::array<int, NOF_DETECTOR_TYPES> nofDetectors = {{ fSettings->NofGermaniumDetectors(), fSettings->NofPlasticDetectors(), fSettings->NofSiliconDetectors(), fSettings->NofBaF2Detectors(), 0 }};
+  std::array<int, NOF_DETECTOR_TYPES> maxChannel = {{ fSettings->MaxGermaniumChannel(), fSettings->MaxPlasticChannel(), fSettings->MaxSiliconChannel(), fSettings->MaxBaF2Channel(), 0 }};
+  for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+    fNofChannels[type] = maxChannel[type];
+    fTables[type].resize(nofDetectors[type]*(maxChannel[type]+1), 0.);
+    fRows[type].resize(nofDetectors[type], nullptr);
+  }
+}
+
+std::string EnergyCalibration::FileName(const std::string& pattern, int runNumber) {
+  if(pattern.find('%') == std::string::npos) {
+    return pattern;
+  }
+  std::vector<char> fileName(pattern.size() + 32);
+  snprintf(fileName.data(), fileName.size(), pattern.c_str(), runNumber);
+  return std::string(fileName.data());
+}
+
+bool EnergyCalibration::Load(const std::string& fileName) {
+  for(auto& rows : fRows) {
+    std::fill(rows.begin(), rows.end(), nullptr);
+  }
+
+  EnvFile env;
+  if(!env.ReadFile(fileName)) {
+    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to read calibration file '",fileName,"', energies won't be calibrated",Attribs::Reset())<<std::endl;
+    return false;
+  }
+
+  const char* names[NOF_DETECTOR_TYPES] = { "Germanium", "Plastic", "Silicon", "BaF2", "Unknown" };
+  for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+    size_t nofChannels = fNofChannels[type];
+    for(size_t det = 0; det < fRows[type].size(); ++det) {
+      std::string prefix = std::string(names[type]) + "." + std::to_string(det);
+      if(!env.Defined(prefix + ".Gain")) {
+	continue;
+      }
+      double gain = env.GetValue(prefix + ".Gain", 1.);
+      double offset = env.GetValue(prefix + ".Offset", 0.);
+      double quadratic = env.GetValue(prefix + ".Quadratic", 0.);
+      float* row = fTables[type].data() + det*(nofChannels+1);
+      for(size_t channel = 0; channel <= nofChannels; ++channel) {
+	double x = channel - offset;
+	row[channel] = gain*x + quadratic*x*x;
+      }
+      fRows[type][det] = row;
+    }
+  }
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Read calibration of "<<NofCalibrated()<<" detectors from '"<<fileName<<"'"<<(fDither ? " (with dithering)" : "")<<std::endl;
+  }
+
+  return true;
+}
+
+//a table lookup per hit, with dithering the energy is interpolated randomly within the channel
+//raw energies beyond the range all get the upper edge of the last channel (not dithered), so they stay in the overflow
+void EnergyCalibration::Apply(std::vector<Hit>& hits) {
+  for(auto& hit : hits) {
+    const float* row = Row(hit.fDetectorType, hit.fDetectorNumber);
+    if(row == nullptr) {
+      continue;
+    }
+    size_t nofChannels = fNofChannels[hit.fDetectorType];
+    size_t channel = hit.fRawEnergy;
+    if(channel >= nofChannels) {
+      hit.fEnergy = row[nofChannels];
+    } else if(fDither) {
+      hit.fEnergy = row[channel] + Uniform()*(row[channel+1] - row[channel]);
+    } else {
+      hit.fEnergy = row[channel];
+    }
+  }
+}
+
+size_t EnergyCalibration::NofCalibrated() const {
+  size_t result = 0;
+  for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+    for(size_t det = 0; det < fRows[type].size(); ++det) {
+      if(Calibrated(type, det)) {
+	++result;
+      }
+    }
+  }
+  return result;
+}
@@ -0,0 +1,65 @@
+#ifndef __ENERGY_CALIBRATION_HH
+#define __ENERGY_CALIBRATION_HH
+
+#include <string>
+#include <vector>
+#include <array>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "Hit.hh"
+
+//applies the energy calibration of each detector to the decoded hits via lookup tables
+//the calibration files use the TEnv format and the convention of the Calibration class, E = gain*(channel - offset) + quadratic*(channel - offset)^2:
+//  Germanium.0.Gain:       0.5
+//  Germanium.0.Offset:     1.2
+//  Germanium.0.Quadratic:  0.
+//detectors without a gain in the file keep an energy of 0
+class EnergyCalibration {
+public:
+  EnergyCalibration(Settings*);
+  ~EnergyCalibration(){};
+
+  //reads the calibration file and rebuilds the tables, can be called again at any time (e.g. for each run)
+  //returns false if the file couldn't be read, in which case nothing is calibrated
+  bool Load(const std::string&);
+  //the file name can contain a printf-style format for the run number, e.g. "calibration_%05d.dat"
+  static std::string FileName(const std::string&, int);
+
+  //sets the energy of all hits of the batch
+  void Apply(std::vector<Hit>&);
+
+  bool Calibrated(uint8_t detectorType, uint16_t detectorNumber) const {
+    return Row(detectorType, detectorNumber) != nullptr;
+  }
+  size_t NofCalibrated() const;
+
+private:
+  //row of the lookup table of the detector, nullptr if it doesn't exist or isn't calibrated
+  const float* Row(uint8_t detectorType, uint16_t detectorNumber) const {
+    if(detectorType >= NOF_DETECTOR_TYPES || detectorNumber >= fRows[detectorType].size()) {
+      return nullptr;
+    }
+    return fRows[detectorType][detectorNumber];
+  }
+
+  //fast uniform random numbers in [0,1) for the dithering (xorshift)
+  float Uniform() {
+    fRandom ^= fRandom << 13;
+    fRandom ^= fRandom >> 17;
+    fRandom ^= fRandom << 5;
+    return (fRandom >> 8)*(1.f/16777216.f);
+  }
+
+  Settings* fSettings;
+  bool fDither;
+  uint32_t fRandom;
+
+  //for each detector type one row per detector with the energies of the channels 0 - fNofChannels (incl. the upper edge of the last channel),
+  //the tables belong to the calibration and not to the settings, so they stay the same when the settings are reloaded
+  std::array<size_t, NOF_DETECTOR_TYPES> fNofChannels;
+  std::array<std::vector<float>, NOF_DETECTOR_TYPES> fTables;
+  std::array<std::vector<const float*>, NOF_DETECTOR_TYPES> fRows;
+};
+
+#endif
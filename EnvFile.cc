@@ -0,0 +1,96 @@
+#include "EnvFile.hh"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+
+bool EnvFile::ReadFile(const std::string& fileName) {
+  std::ifstream file(fileName.c_str());
+  if(!file.is_open()) {
+    std::cerr<<"Failed to open settings file '"<<fileName<<"'"<<std::endl;
+    return false;
+  }
+
+  std::string line;
+  while(std::getline(file, line)) {
+    //strip comments and skip empty lines
+    line = line.substr(0, line.find('#'));
+    size_t colon = line.find(':');
+    if(colon == std::string::npos) {
+      continue;
+    }
+    std::string name = line.substr(0, colon);
+    std::string value = line.substr(colon+1);
+    //trim white space from both
+    name.erase(0, name.find_first_not_of(" \t"));
+    name.erase(name.find_last_not_of(" \t\r")+1);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t\r")+1);
+    if(name.empty()) {
+      continue;
+    }
+    //same as TEnv, later entries overwrite earlier ones
+    fValues[name] = value;
+  }
+
+  return true;
+}
+
+int EnvFile::GetValue(const std::string& name, int defaultValue) const {
+  auto it = fValues.find(name);
+  if(it == fValues.end() || it->second.empty()) {
+    return defaultValue;
+  }
+  //TEnv also accepts booleans for integer values
+  std::string value = it->second;
+  std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+  if(value == "true" || value == "yes" || value == "on") {
+    return 1;
+  }
+  if(value == "false" || value == "no" || value == "off") {
+    return 0;
+  }
+  return std::strtol(value.c_str(), nullptr, 0);
+}
+
+double EnvFile::GetValue(const std::string& name, double defaultValue) const {
+  auto it = fValues.find(name);
+  if(it == fValues.end() || it->second.empty()) {
+    return defaultValue;
+  }
+  return std::strtod(it->second.c_str(), nullptr);
+}
+
+bool EnvFile::GetValue(const std::string& name, bool defaultValue) const {
+  return GetValue(name, defaultValue ? 1 : 0) != 0;
+}
+
+std::string EnvFile::GetValue(const std::string& name, const char* defaultValue) const {
+  auto it = fValues.find(name);
+  if(it == fValues.end()) {
+    return std::string(defaultValue);
+  }
+  return it->second;
+}
+
+std::string EnvFile::GetValue(const std::string& name, const std::string& defaultValue) const {
+  return GetValue(name, defaultValue.c_str());
+}
+
+std::vector<std::string> EnvFile::Changed(const EnvFile& other) const {
+  std::vector<std::string> result;
+  for(const auto& entry : fValues) {
+    auto it = other.fValues.find(entry.first);
+    if(it == other.fValues.end() || it->second != entry.second) {
+      result.push_back(entry.first);
+    }
+  }
+  for(const auto& entry : other.fValues) {
+    if(fValues.find(entry.first) == fValues.end()) {
+      result.push_back(entry.first);
+    }
+  }
+  return result;
+}
@@ -0,0 +1,36 @@
+#ifndef __ENV_FILE_HH
+#define __ENV_FILE_HH
+
+#include <string>
+#include <vector>
+#include <map>
+
+//ROOT-free reader for settings files in the TEnv format, i.e. lines of "Name: value" with '#' starting a comment
+class EnvFile {
+public:
+  EnvFile(){};
+  EnvFile(const std::string& fileName) {
+    ReadFile(fileName);
+  }
+  ~EnvFile(){};
+
+  bool ReadFile(const std::string&);
+
+  bool Defined(const std::string& name) const {
+    return fValues.find(name) != fValues.end();
+  }
+
+  int GetValue(const std::string&, int) const;
+  double GetValue(const std::string&, double) const;
+  bool GetValue(const std::string&, bool) const;
+  std::string GetValue(const std::string&, const char*) const;
+  std::string GetValue(const std::string&, const std::string&) const;
+
+  //names of the entries that are different in the other file (changed, added, or removed)
+  std::vector<std::string> Changed(const EnvFile&) const;
+
+private:
+  std::map<std::string, std::string> fValues;
+};
+
+#endif
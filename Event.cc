@@ -1,6 +1,9 @@
 #include "Event.hh"
 
 #include <sstream>
+#include <algorithm>
+
+#include "Hit.hh"
 
 ClassImp(Ulm)
 ClassImp(Detector)
@@ -17,8 +20,75 @@ ClassImp(Event)
 Detector::Detector(uint32_t eventTime, uint32_t eventNumber,  uint8_t detectorType, std::pair<uint16_t, uint16_t> rawEnergy, Ulm ulm) 
   : fEventTime(eventTime), fEventNumber(eventNumber), fDetectorType(detectorType), fDetectorNumber(rawEnergy.first), fRawEnergy(rawEnergy.second), fUlm(ulm) {
   fTime = 0;
+  fTimestamp = fUlm.Clock()*ULM_CLOCK_IN_PS;
   fTdcHits = 0;
   fTdcHitsInWindow = 0;
+  fNofTdcTimes = 0;
+  fTdcTimes = nullptr;
+}
+
+Ulm::Ulm(const FifoRecord& record) {
+  Header(record.fUlmHeader);
+  fClock = record.fClock;
+  fLiveClock = record.fLiveClock;
+  fMasterCount = record.fMasterCount;
+}
+
+Detector::Detector(const Hit& hit, const FifoRecords& records)
+  : fEventTime(records.Record(hit).fEventTime), fEventNumber(records.Record(hit).fEventNumber), fDetectorType(hit.fDetectorType), fDetectorNumber(hit.fDetectorNumber), fRawEnergy(hit.fRawEnergy), fEnergy(hit.fEnergy), fUlm(records.Record(hit)) {
+  fTime = hit.fTime;
+  fTimestamp = hit.fTimestamp;
+  fTdcHits = hit.fTdcHits;
+  fTdcHitsInWindow = hit.fTdcHitsInWindow;
+  fNofTdcTimes = hit.fNofTdcTimes;
+  fTdcTimes = nullptr;
+  if(fNofTdcTimes > 0) {
+    fTdcTimes = new uint16_t[fNofTdcTimes];
+    std::copy(records.TdcTimes(hit), records.TdcTimes(hit) + fNofTdcTimes, fTdcTimes);
+  }
+}
+
+Detector::Detector(const Detector& rh)
+  : TObject(rh), fEventTime(rh.fEventTime), fEventNumber(rh.fEventNumber), fDetectorType(rh.fDetectorType), fDetectorNumber(rh.fDetectorNumber), fRawEnergy(rh.fRawEnergy), fEnergy(rh.fEnergy),
+    fTime(rh.fTime), fTimestamp(rh.fTimestamp), fTdcHits(rh.fTdcHits), fTdcHitsInWindow(rh.fTdcHitsInWindow), fNofTdcTimes(rh.fNofTdcTimes), fTdcTimes(nullptr), fUlm(rh.fUlm) {
+  if(fNofTdcTimes > 0) {
+    fTdcTimes = new uint16_t[fNofTdcTimes];
+    std::copy(rh.fTdcTimes, rh.fTdcTimes + fNofTdcTimes, fTdcTimes);
+  }
+}
+
+//takes the TDC times of the other detector (the vector of detectors moves them when it grows)
+Detector::Detector(Detector&& rh) noexcept
+  : TObject(rh), fEventTime(rh.fEventTime), fEventNumber(rh.fEventNumber), fDetectorType(rh.fDetectorType), fDetectorNumber(rh.fDetectorNumber), fRawEnergy(rh.fRawEnergy), fEnergy(rh.fEnergy),
+    fTime(rh.fTime), fTimestamp(rh.fTimestamp), fTdcHits(rh.fTdcHits), fTdcHitsInWindow(rh.fTdcHitsInWindow), fNofTdcTimes(rh.fNofTdcTimes), fTdcTimes(rh.fTdcTimes), fUlm(rh.fUlm) {
+  rh.fNofTdcTimes = 0;
+  rh.fTdcTimes = nullptr;
+}
+
+Detector& Detector::operator=(const Detector& rh) {
+  if(this == &rh) {
+    return *this;
+  }
+  TObject::operator=(rh);
+  fEventTime = rh.fEventTime;
+  fEventNumber = rh.fEventNumber;
+  fDetectorType = rh.fDetectorType;
+  fDetectorNumber = rh.fDetectorNumber;
+  fRawEnergy = rh.fRawEnergy;
+  fEnergy = rh.fEnergy;
+  fTime = rh.fTime;
+  fTimestamp = rh.fTimestamp;
+  fTdcHits = rh.fTdcHits;
+  fTdcHitsInWindow = rh.fTdcHitsInWindow;
+  fUlm = rh.fUlm;
+  if(fNofTdcTimes != rh.fNofTdcTimes) {
+    delete[] fTdcTimes;
+    fTdcTimes = (rh.fNofTdcTimes > 0) ? new uint16_t[rh.fNofTdcTimes] : nullptr;
+    fNofTdcTimes = rh.fNofTdcTimes;
+  }
+  std::copy(rh.fTdcTimes, rh.fTdcTimes + fNofTdcTimes, fTdcTimes);
+
+  return *this;
 }
 
 std::string Detector::Print() const {
@@ -48,7 +118,26 @@ std::string Detector::Print() const {
 
 Event::Event(const std::vector<Detector>& detectors)
   : fDetector(detectors) {
+  for(int i = 0; i < NOF_DETECTOR_TYPES; ++i) {
+    fMultiplicity[i] = 0;
+  }
   for(auto& detector : fDetector) {
-    ++fMultiplicity[detector.DetectorType()];
+    if(detector.DetectorType() < NOF_DETECTOR_TYPES) {
+      ++fMultiplicity[detector.DetectorType()];
+    }
+  }
+}
+
+Event::Event(const std::vector<Hit>& hits, const FifoRecords& records) {
+  Set(hits, records);
+}
+
+void Event::Set(const std::vector<Hit>& hits, const FifoRecords& records) {
+  Clear();
+  for(const auto& hit : hits) {
+    fDetector.emplace_back(hit, records);
+    if(hit.fDetectorType < NOF_DETECTOR_TYPES) {
+      ++fMultiplicity[hit.fDetectorType];
+    }
   }
 }
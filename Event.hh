@@ -10,6 +10,11 @@
 
 #include "Settings.hh"
 
+//the hits (and the records of their FIFO events) are only converted to the classes below when writing the tree
+struct Hit;
+struct FifoRecord;
+class FifoRecords;
+
 class Ulm : public TObject {
 public:
   Ulm() {
@@ -20,6 +25,9 @@ public:
     fLiveClock = 0;
     fMasterCount = 0;
   }
+#ifndef __CINT__
+  Ulm(const FifoRecord&);
+#endif
   ~Ulm(){};
 
   friend bool operator<(const Ulm& lh, const Ulm& rh) {
@@ -85,8 +93,20 @@ private:
 class Detector : public TObject {
 public:
   Detector(uint32_t eventTime, uint32_t eventNumber, uint8_t detectorType, std::pair<uint16_t, uint16_t> energy, Ulm ulm);
-  Detector(){};
-  ~Detector(){};
+  Detector() {
+    fNofTdcTimes = 0;
+    fTdcTimes = nullptr;
+  }
+#ifndef __CINT__
+  Detector(const Hit&, const FifoRecords&);
+  Detector(Detector&&) noexcept;
+#endif
+  //the additional TDC times are owned by the detector
+  Detector(const Detector&);
+  Detector& operator=(const Detector&);
+  ~Detector() {
+    delete[] fTdcTimes;
+  }
 
   friend bool operator<(const Detector& lh, const Detector& rh) {
     return lh.fUlm < rh.fUlm;
@@ -127,12 +147,23 @@ public:
   uint16_t Time() const {
     return fTime;
   }
+  //ps, the ulm clock refined by the calibrated TDC time
+  uint64_t Timestamp() const {
+    return fTimestamp;
+  }
   size_t TdcHits() const {
     return fTdcHits;
   }
   size_t TdcHitsInWindow() const {
     return fTdcHitsInWindow;
   }
+  //additional TDC times of the multi-hit TDC selections in readout order
+  size_t NofTdcTimes() const {
+    return fNofTdcTimes;
+  }
+  uint16_t TdcTime(size_t index) const {
+    return fTdcTimes[index];
+  }
   const Ulm& GetUlm() const {
     return fUlm;
   }
@@ -149,20 +180,42 @@ private:
   float fEnergy;
 
   uint16_t fTime;
+  uint64_t fTimestamp;//ps
   size_t fTdcHits;
   size_t fTdcHitsInWindow;
+  Int_t fNofTdcTimes;
+  uint16_t* fTdcTimes;//[fNofTdcTimes]
 
   Ulm fUlm;
 
-  ClassDef(Detector,1);
+  ClassDef(Detector,4);
 };
 
 class Event : public TObject {
 public:
   Event(const std::vector<Detector>&);
-  Event(){};
+  Event() {
+    Clear();
+  }
+#ifndef __CINT__
+  Event(const std::vector<Hit>&, const FifoRecords&);
+  //refill this event from the hits (re-uses the storage of the detectors)
+  void Set(const std::vector<Hit>&, const FifoRecords&);
+#endif
   ~Event(){};
 
+  //overrides TObject::Clear, so that ROOT containers calling Clear("C") reset the event as well
+#ifndef __CINT__
+  void Clear(Option_t* = "") override {
+#else
+  void Clear(Option_t* = "") {
+#endif
+    fDetector.clear();
+    for(int i = 0; i < NOF_DETECTOR_TYPES; ++i) {
+      fMultiplicity[i] = 0;
+    }
+  }
+
   size_t NofDetectors() {
     return fDetector.size();
   }
@@ -171,7 +224,8 @@ public:
   }
 
   int Multiplicity(const uint8_t& detector) {
-    if(fMultiplicity.find(detector) == fMultiplicity.end()) {
+    //detector types without any hits return -1
+    if(detector >= NOF_DETECTOR_TYPES || fMultiplicity[detector] == 0) {
       return -1;
     }
     return fMultiplicity[detector];
@@ -179,8 +233,8 @@ public:
 
 private:
   std::vector<Detector> fDetector;
-  std::map<uint8_t,int> fMultiplicity;
-  ClassDef(Event,1);
+  int fMultiplicity[NOF_DETECTOR_TYPES];
+  ClassDef(Event,2);
 };
 
 #endif
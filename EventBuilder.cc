@@ -0,0 +1,283 @@
+#include "EventBuilder.hh"
+
+#include <algorithm>
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+EventBuilder::EventBuilder(Settings* settings) {
+  fSettings = settings;
+  fNofWaitingHits = 0;
+  fNofAddedHits = 0;
+  fEventsInCycle = 0;
+  fCalibratedEnergies = false;
+
+  fNewestClock.fill(0);
+  fLateness.resize(NOF_DETECTOR_TYPES, FixedHistogram(fSettings->LatenessBins(), 0, fSettings->LatenessRange()));
+  fTimeDifference = FixedHistogram(fSettings->TimeDifferenceBins(), 0, fSettings->TimeDifferenceRange());
+
+  if(!fSettings->CubeFileName().empty()) {
+    fCube.reset(new CubeWriter(fSettings));
+    fCube->Open(fSettings->CubeFileName());
+  }
+
+  //the workers that build the time slices concurrently
+  if(fSettings->NofBuildThreads() > 1) {
+    fPool.reset(new ThreadPool(fSettings->NofBuildThreads()));
+  }
+}
+
+void EventBuilder::Add(std::vector<Hit>& hits, FifoRecords& records) {
+  std::lock_guard<std::mutex> lock(fIncomingMutex);
+  if(fSettings->BuildDiagnostics()) {
+    for(const auto& hit : hits) {
+      if(hit.fDetectorType >= fLateness.size()) {
+	continue;
+      }
+      uint64_t& newest = fNewestClock[hit.fDetectorType];
+      if(hit.Clock() > newest) {
+	newest = hit.Clock();
+      }
+      fLateness[hit.fDetectorType].Fill(newest - hit.Clock());
+    }
+  }
+  fIncomingRecords.Append(records, hits.begin(), hits.end());
+  fIncoming.insert(fIncoming.end(), hits.begin(), hits.end());
+  fNofWaitingHits.store(fNofWaitingHits.load(std::memory_order_relaxed) + hits.size(), std::memory_order_relaxed);
+  fNofAddedHits.store(fNofAddedHits.load(std::memory_order_relaxed) + hits.size(), std::memory_order_relaxed);
+  hits.clear();
+  records.Clear();
+}
+
+//Add reads the settings as well, so the switch has to wait for it
+void EventBuilder::SetSettings(Settings* settings) {
+  std::lock_guard<std::mutex> lock(fIncomingMutex);
+  fSettings = settings;
+}
+
+void EventBuilder::CalibratedEnergies(bool calibrated) {
+  fCalibratedEnergies = calibrated;
+  if(fCube != nullptr) {
+    fCube->CalibratedEnergies(calibrated);
+  }
+}
+
+void EventBuilder::EndOfCycle() {
+  std::lock_guard<std::mutex> lock(fIncomingMutex);
+  fCycleEnds.push_back(fIncoming.size());
+  //the next cycle starts fresh
+  fNewestClock.fill(0);
+}
+
+size_t EventBuilder::Build(bool flush, const std::function<void(BuiltEvent&)>& output, const std::function<void(size_t)>& endOfCycle) {
+  //take the new hits (and the positions of the cycle ends among them)
+  fIncomingMutex.lock();
+  fSorting.swap(fIncoming);
+  fSortingRecords.Swap(fIncomingRecords);
+  fSortingCycleEnds.swap(fCycleEnds);
+  fIncomingMutex.unlock();
+
+  //the new hits refer to the waiting records from now on
+  fWaitingRecords.Append(fSortingRecords, fSorting.begin(), fSorting.end());
+  fSortingRecords.Clear();
+
+  size_t nofBuilt = 0;
+
+  //hits can't be coincident across the end of a cycle, so all hits of the finished cycle are built right away
+  //and the next cycle starts with an empty waiting window
+  size_t begin = 0;
+  for(auto cycleEnd : fSortingCycleEnds) {
+    Merge(begin, cycleEnd);
+    begin = cycleEnd;
+    nofBuilt += fWaiting.size();
+    fEventsInCycle += BuildSlices(fWaiting.begin(), fWaiting.end(), output);
+    fWaiting.clear();
+    if(fSettings->VerbosityLevel() > 1) {
+      std::cout<<Show("End of cycle ",fEventsPerCycle.size(),": built ",fEventsInCycle," events")<<std::endl;
+    }
+    fEventsPerCycle.push_back(fEventsInCycle);
+    endOfCycle(fEventsInCycle);
+    fEventsInCycle = 0;
+  }
+  Merge(begin, fSorting.size());
+  fSorting.clear();
+  fSortingCycleEnds.clear();
+
+  size_t cut = FindCut(flush);
+  if(cut > 0) {
+    fEventsInCycle += BuildSlices(fWaiting.begin(), fWaiting.begin() + cut, output);
+    fWaiting.erase(fWaiting.begin(), fWaiting.begin() + cut);
+  }
+
+  //drop the records of the built hits once they make up most of the table
+  if(fWaiting.empty()) {
+    fWaitingRecords.Clear();
+  } else if(fWaitingRecords.Size() > 2*fWaiting.size() + 1024) {
+    fWaitingRecords.Compact(fWaiting, fScratchRecords, fRecordMap);
+  }
+
+  //the hits added in the mean time are still incoming
+  fIncomingMutex.lock();
+  fNofWaitingHits.store(fWaiting.size() + fIncoming.size(), std::memory_order_relaxed);
+  fIncomingMutex.unlock();
+
+  return nofBuilt + cut;
+}
+
+//sort the new hits in the range and merge them into the waiting hits
+//stable sorting and merging keeps hits with the same timestamp in the order they were added (same as the multiset we used before)
+void EventBuilder::Merge(size_t begin, size_t end) {
+  if(begin >= end) {
+    return;
+  }
+  std::stable_sort(fSorting.begin() + begin, fSorting.begin() + end);
+  size_t middle = fWaiting.size();
+  fWaiting.insert(fWaiting.end(), fSorting.begin() + begin, fSorting.begin() + end);
+  std::inplace_merge(fWaiting.begin(), fWaiting.begin() + middle, fWaiting.end());
+}
+
+//a coincidence group only contains hits within the coincidence window of its first hit, so we can only cut at a gap
+//of at least one coincidence window between two consecutive hits, everything before such a gap is independent of what comes after it
+//returns the number of hits before the last such gap among the hits outside the waiting window of the newest hit
+size_t EventBuilder::FindCut(bool flush) {
+  if(flush || fWaiting.empty()) {
+    return fWaiting.size();
+  }
+
+  uint64_t newest = fWaiting.back().fTimestamp;
+  size_t cut = 0;
+  for(size_t i = 0; i + 1 < fWaiting.size(); ++i) {
+    if(fSettings->InWaitingWindow(fWaiting[i].fTimestamp, newest)) {
+      break;
+    }
+    if(fWaiting[i+1].fTimestamp - fWaiting[i].fTimestamp >= fSettings->CoincidenceWindowPs()) {
+      cut = i+1;
+    }
+  }
+
+  return cut;
+}
+
+//serial event building of a time ordered range of hits: the first hit and all hits within the coincidence window form an event
+//the events in the vector are re-used, returns the number of events built
+size_t EventBuilder::BuildSlice(std::vector<Hit>::const_iterator begin, std::vector<Hit>::const_iterator end, std::vector<BuiltEvent>& events, FixedHistogram& timeDifference, CoincidenceMatrices* matrices, std::vector<uint64_t>* cubeKeys) {
+  size_t nofEvents = 0;
+  while(begin != end) {
+    if(nofEvents == events.size()) {
+      events.emplace_back();
+    }
+    BuiltEvent& event = events[nofEvents++];
+    event.Clear();
+    auto iterator = begin;
+    event.Add(*iterator, fWaitingRecords);
+    //now we want to find all that are in coincidence with that hit
+    //the range is ordered, so if this hit is outside the coincidence window all followings will be outside as well
+    for(++iterator; iterator != end && fSettings->Coincidence(begin->fTimestamp, iterator->fTimestamp); ++iterator) {
+      event.Add(*iterator, fWaitingRecords);
+    }
+    if(fSettings->BuildDiagnostics()) {
+      //also look beyond the coincidence window to see where the prompt peak ends (in ns)
+      for(auto partner = std::next(begin); partner != end && (partner->fTimestamp - begin->fTimestamp)/1000 < timeDifference.High(); ++partner) {
+	timeDifference.Fill((partner->fTimestamp - begin->fTimestamp)/1000);
+      }
+    }
+    if(matrices != nullptr) {
+      matrices->Fill(event);
+    }
+    if(cubeKeys != nullptr) {
+      fCube->Fill(event, *cubeKeys);
+    }
+    begin = iterator;
+  }
+
+  return nofEvents;
+}
+
+//cut the hits at gaps longer than the coincidence window into slices of at least fSettings->MinSliceSize() hits,
+//build these slices concurrently and pass the built events in their original order to the output
+//returns the number of events built
+size_t EventBuilder::BuildSlices(std::vector<Hit>::const_iterator begin, std::vector<Hit>::const_iterator end, const std::function<void(BuiltEvent&)>& output) {
+  size_t nofHits = std::distance(begin, end);
+  size_t nofSlices = 1;
+  if(fPool != nullptr && fSettings->MinSliceSize() > 0) {
+    nofSlices = std::min(fPool->NofThreads(), nofHits/fSettings->MinSliceSize());
+  }
+  if(nofSlices < 1) {
+    nofSlices = 1;
+  }
+  if(fSliceEvents.size() < nofSlices) {
+    fSliceEvents.resize(nofSlices);
+    fSliceTimeDifference.resize(nofSlices, fTimeDifference);
+    if(fSettings->Matrices()) {
+      fSliceMatrices.resize(nofSlices, CoincidenceMatrices(fSettings, fCalibratedEnergies));
+    }
+    if(fCube != nullptr) {
+      fSliceCubeKeys.resize(nofSlices);
+    }
+  }
+
+  if(nofSlices == 1) {
+    size_t nofEvents = BuildSlice(begin, end, fSliceEvents[0], fTimeDifference, fSliceMatrices.empty() ? nullptr : &(fSliceMatrices[0]), fSliceCubeKeys.empty() ? nullptr : &(fSliceCubeKeys[0]));
+    for(size_t i = 0; i < nofEvents; ++i) {
+      output(fSliceEvents[0][i]);
+    }
+    return nofEvents;
+  }
+
+  //find the boundaries: start at the nominal size of each slice and move forward to the next gap
+  fBoundaries.clear();
+  fBoundaries.push_back(begin);
+  for(size_t slice = 1; slice < nofSlices; ++slice) {
+    auto it = std::max(begin + slice*nofHits/nofSlices, fBoundaries.back());
+    while(it != end && it != begin && it->fTimestamp - std::prev(it)->fTimestamp < fSettings->CoincidenceWindowPs()) {
+      ++it;
+    }
+    fBoundaries.push_back(it);
+  }
+  fBoundaries.push_back(end);
+
+  fSlices.clear();
+  for(size_t slice = 0; slice + 1 < fBoundaries.size(); ++slice) {
+    auto sliceBegin = fBoundaries[slice];
+    auto sliceEnd = fBoundaries[slice+1];
+    std::vector<BuiltEvent>* events = &(fSliceEvents[slice]);
+    FixedHistogram* timeDifference = &(fSliceTimeDifference[slice]);
+    timeDifference->Reset();
+    CoincidenceMatrices* matrices = fSliceMatrices.empty() ? nullptr : &(fSliceMatrices[slice]);
+    std::vector<uint64_t>* cubeKeys = fSliceCubeKeys.empty() ? nullptr : &(fSliceCubeKeys[slice]);
+    fSlices.push_back(fPool->Enqueue([this, sliceBegin, sliceEnd, events, timeDifference, matrices, cubeKeys]() { return BuildSlice(sliceBegin, sliceEnd, *events, *timeDifference, matrices, cubeKeys); }));
+  }
+
+  //emit the events in order
+  size_t totalEvents = 0;
+  for(size_t slice = 0; slice < fSlices.size(); ++slice) {
+    size_t nofEvents = fSlices[slice].get();
+    for(size_t i = 0; i < nofEvents; ++i) {
+      output(fSliceEvents[slice][i]);
+    }
+    totalEvents += nofEvents;
+    fTimeDifference.Add(fSliceTimeDifference[slice]);
+  }
+
+  if(fSettings->VerbosityLevel() > 2) {
+    std::cout<<Show("Built ",nofHits," hits in ",fSlices.size()," slices")<<std::endl;
+  }
+
+  return totalEvents;
+}
+
+void EventBuilder::AddMatrices(CoincidenceMatrices& matrices) {
+  for(const auto& slice : fSliceMatrices) {
+    matrices.Add(slice);
+  }
+}
+
+void EventBuilder::CloseCube() {
+  if(fCube == nullptr) {
+    return;
+  }
+  for(auto& keys : fSliceCubeKeys) {
+    fCube->WriteRun(keys);
+  }
+  fCube->Close();
+}
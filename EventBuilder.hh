@@ -0,0 +1,122 @@
+#ifndef __EVENT_BUILDER_HH
+#define __EVENT_BUILDER_HH
+
+#include <vector>
+#include <array>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+#include "Settings.hh"
+#include "Hit.hh"
+#include "BuiltEvent.hh"
+#include "ThreadPool.hh"
+#include "FixedHistogram.hh"
+#include "CoincidenceMatrix.hh"
+#include "CubeWriter.hh"
+
+//combines the time ordered hits into events of coincident hits
+class EventBuilder {
+public:
+  EventBuilder(Settings*);
+  ~EventBuilder(){};
+
+  //add hits (and the records they refer to) to the builder, both are emptied (can be called from a different thread than Build)
+  void Add(std::vector<Hit>&, FifoRecords&);
+
+  //marks the end of a tape cycle after the hits added so far (can be called from a different thread than Build)
+  void EndOfCycle();
+
+  //switches to a new snapshot of the settings (waiting and coincidence window), has to be called from the thread calling Build
+  void SetSettings(Settings*);
+
+  //whether the hits have calibrated energies, which are then used for the matrices and the cube (has to be called before the first hits are added)
+  void CalibratedEnergies(bool);
+
+  //build all hits that can't get new coincidence partners anymore (or all hits if we're flushing) and pass the events in order to the output
+  //the events passed to the output are recycled afterwards, so the output should swap them out (BuiltEventBuffer::Push) instead of copying them
+  //at the end of each cycle all its hits are built and the second function is called with the number of events built in that cycle
+  //returns the number of hits built
+  size_t Build(bool, const std::function<void(BuiltEvent&)>&, const std::function<void(size_t)>&);
+
+  //can be read from any thread (the counters are updated under the lock of the incoming hits)
+  size_t NofWaitingHits() const {
+    return fNofWaitingHits.load(std::memory_order_relaxed);
+  }
+  size_t NofAddedHits() const {
+    return fNofAddedHits.load(std::memory_order_relaxed);
+  }
+  //diagnostics: lateness of the arriving hits behind the newest hit of the same detector type (each type is a separate stream)
+  //and time differences between the first hit of an event and the following hits
+  const FixedHistogram& Lateness(size_t detectorType) {
+    return fLateness[detectorType];
+  }
+  const FixedHistogram& TimeDifference() {
+    return fTimeDifference;
+  }
+
+  //coincidence matrices of the built events, filled separately by each slice and only added up here
+  //(only call once the building has finished)
+  void AddMatrices(CoincidenceMatrices&);
+  //writes the remaining triples of all slices and the cube file (only call once the building has finished)
+  void CloseCube();
+
+  //number of events built in each finished cycle
+  const std::vector<size_t>& EventsPerCycle() {
+    return fEventsPerCycle;
+  }
+
+private:
+  void Merge(size_t, size_t);
+  size_t FindCut(bool);
+  size_t BuildSlice(std::vector<Hit>::const_iterator, std::vector<Hit>::const_iterator, std::vector<BuiltEvent>&, FixedHistogram&, CoincidenceMatrices*, std::vector<uint64_t>*);
+  size_t BuildSlices(std::vector<Hit>::const_iterator, std::vector<Hit>::const_iterator, const std::function<void(BuiltEvent&)>&);
+
+  Settings* fSettings;
+
+  //hits added since the last call of Build
+  std::vector<Hit> fIncoming;
+  std::vector<Hit> fSorting;
+  FifoRecords fIncomingRecords;
+  FifoRecords fSortingRecords;
+  std::mutex fIncomingMutex;
+  //positions in the incoming hits at which a cycle ended
+  std::vector<size_t> fCycleEnds;
+  std::vector<size_t> fSortingCycleEnds;
+  //time ordered hits waiting to be built
+  std::vector<Hit> fWaiting;
+  //records of the waiting hits (and of hits already built, until they are compacted away), with scratch space for the compaction
+  FifoRecords fWaitingRecords;
+  FifoRecords fScratchRecords;
+  std::vector<uint32_t> fRecordMap;
+
+  //incoming and waiting hits, and all hits added so far
+  std::atomic<size_t> fNofWaitingHits;
+  std::atomic<size_t> fNofAddedHits;
+  size_t fEventsInCycle;
+  std::vector<size_t> fEventsPerCycle;
+
+  //recycled events of each slice (only grow, never shrink)
+  std::vector<std::vector<BuiltEvent> > fSliceEvents;
+  std::vector<std::vector<Hit>::const_iterator> fBoundaries;
+  std::vector<std::future<size_t> > fSlices;
+
+  //diagnostics (the time differences are filled per slice and added up afterwards)
+  std::array<uint64_t, NOF_DETECTOR_TYPES> fNewestClock;
+  std::vector<FixedHistogram> fLateness;
+  FixedHistogram fTimeDifference;
+  std::vector<FixedHistogram> fSliceTimeDifference;
+
+  //coincidence matrices of each slice (empty if the matrices are turned off)
+  bool fCalibratedEnergies;
+  std::vector<CoincidenceMatrices> fSliceMatrices;
+  //cube of the germanium triples and the triples collected by each slice (empty if no cube is written)
+  std::unique_ptr<CubeWriter> fCube;
+  std::vector<std::vector<uint64_t> > fSliceCubeKeys;
+
+  //workers building the independent time slices
+  std::unique_ptr<ThreadPool> fPool;
+};
+
+#endif
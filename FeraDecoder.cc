@@ -0,0 +1,987 @@
+#include "FeraDecoder.hh"
+
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+FeraDecoder::FeraDecoder(Settings* settings) {
+  fSettings = settings;
+
+  fLastEventNumber = 0;
+  fLastEventTime = 0;
+  fLastCycle = 0;
+  fEventsInCycle = 0;
+
+  fTemperatureFile.open(fSettings->TemperatureFile());
+  fTemperature = 0.f;
+  fNofTemperatures = 0;
+  fNofDroppedTdcTimes = 0;
+
+  if(fSettings->VerbosityLevel() > 2) {
+    fDataFile.open("Data.dat");
+  }
+}
+
+FeraDecoder::~FeraDecoder() {
+  fTemperatureFile.close();
+  if(fDataFile.is_open()) {
+    fDataFile.close();
+  }
+}
+
+//---------------------------------------- different midas event types ----------------------------------------
+bool FeraDecoder::FifoEvent(MidasEvent& event, std::vector<Hit>& hits, FifoRecords& records) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Found FIFO event in midas event ",event.Number())<<std::endl;
+  }
+  uint32_t fifoStatus = 0;
+  uint32_t feraWords = 0;
+  uint32_t fifoSerial = 0;
+
+  size_t feraEnd = 0;
+
+  size_t currentFeraStart;
+
+  if(fSettings->VerbosityLevel() > 1) {
+    //check for missed events
+    if(event.Number() != (fLastEventNumber + 1)) {
+      std::cerr<<Show(Foreground::Red(),"Missed ",event.Number() - fLastEventNumber - 1," FIFO data events, between events ",fLastEventNumber," and ",event.Number(),Attribs::Reset())<<std::endl;
+    }
+
+    //Check if events are ordered by time
+    if(event.Time() < fLastEventTime) {
+      std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"FIFO event ",event.Number()," occured before the last event ",fLastEventNumber," (",event.Time()," < ",fLastEventTime,")",Attribs::Reset())<<std::endl;
+    }
+  }
+
+  fLastEventNumber = event.Number();
+  fLastEventTime = event.Time();
+
+  //loop over banks
+  for(auto bank : event.Banks()) {
+    if(bank.Size() == 0) {
+      continue;
+    }
+
+    while(bank.GotData()) {
+      //Note: If there's multiple ferastreams in the bank, then this loop will run both of them.
+      //Further, in that case it will call the same event type multiple times, as the event type is in the bank header.
+      currentFeraStart = bank.ReadPoint();
+
+      //Check if it's a good FIFO event
+      bank.Get(fifoStatus);
+
+      //Check if this FIFO event is valid
+      if((fifoStatus != GOODFIFO1) && (fifoStatus != GOODFIFO2)) {
+	if(fSettings->VerbosityLevel() > 0) {
+	  std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid FIFO status ",std::hex,std::setw(8),std::setfill('0'),fifoStatus,std::dec," in event ",event.Number(),Attribs::Reset())<<std::endl;
+	}
+	//just continue???
+	continue;
+      }
+
+      bank.Get(feraWords);
+
+      //Check timeout and overflow bit in ferawords.
+      if(feraWords & 0x0000C000) {
+	if(fSettings->VerbosityLevel() > 1) {
+	  std::cerr<<Show(Foreground::Red(),"Event ",event.Number(),", bank ",bank.Number(),": FIFO overflow bit or timeout bit set: ",((feraWords>>14) & 0x3),Attribs::Reset())<<std::endl;
+	}
+      }
+
+      //get the number of fera words
+      feraWords = feraWords & FERAWORDS;
+
+      //Set feraEnd, need to account for the header words and the (not yet read) fifo serial
+      feraEnd = bank.ReadPoint()+2*feraWords + 4;
+
+      //Check if feraWords will fit in the buffer.
+      //feraEnd and readpoint count bytes, whereas size counts 32bit words!
+      if(feraEnd  > 2*bank.Size()) {
+	//Not enough room for ferawords in bankbuffer.
+	bank.SetReadPoint(2*bank.Size());
+	continue;
+      }
+
+      //Get fifoserial
+      bank.Get(fifoSerial);
+
+      //only the last byte contains information
+      fifoSerial = fifoSerial & 0xFF;
+
+      //increase counter and check serial for all banks
+      ++(fBankCounter[bank.IntName()]);
+      if(fifoSerial != ((fLastFifoSerial[bank.IntName()]+1) & 0xff)) {
+	if(fSettings->VerbosityLevel() > 0) {
+	  std::cerr<<Show(Foreground::Red(),"Missed a ",fSettings->DetectorType(bank.IntName())," FIFO serial in Event ",event.Number(),", Bank ",bank.Number(),", FIFO serial ",fifoSerial,", last FIFO serial ",fLastFifoSerial[bank.IntName()],Attribs::Reset())<<std::endl;
+	}
+      }
+      fLastFifoSerial[bank.IntName()] = fifoSerial;
+
+      //Now, do different things depending on the type of detector triggered.
+      switch(bank.IntName()) {
+      case FME_ZERO:
+	GermaniumEvent(bank, feraEnd, event.Time(), event.Number(), hits, records);
+	break;
+
+      case FME_ONE:
+	PlasticEvent(bank, feraEnd, event.Time(), event.Number(), hits, records);
+	break;
+
+      case FME_TWO:
+	BaF2Event(bank, feraEnd, event.Time(), event.Number(), hits, records);
+	break;
+
+      case FME_THREE:
+	SiliconEvent(bank, feraEnd, event.Time(), event.Number(), hits, records);
+	break;
+
+      default:
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Unknown bank name 0x",std::hex,bank.IntName(),std::dec," for bank ",bank.Number()," in midas event ",event.Number(),Attribs::Reset())<<std::endl;
+	break;
+      }
+
+      //Make sure that the readpoint is at the end of the fera data
+      //Readpoint should be offset by 12 bytes for the fera header, and 2 bytes per each fera word.
+      //If the number of fera words is odd, pad with an additional word.
+      bank.SetReadPoint(currentFeraStart + 2*(feraWords + (feraWords%2)) + 12);
+
+      //If we're at the end of the bank, increment ferawords by 2 to bypass the junk.
+      if(bank.ReadPoint() == (bank.Size() - 2)) {
+	bank.SetReadPoint(bank.Size());
+      }
+    }//while(bank.GotData())
+  }//loop over banks
+
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<"FIFO event done"<<std::endl;
+  }
+
+  return true;
+}
+
+bool FeraDecoder::CamacScalerEvent(MidasEvent& event) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Found Scaler event in midas event ",event.Number())<<std::endl;
+  }
+  uint32_t tmp;
+  //loop over banks
+  for(auto bank : event.Banks()) {
+    if(bank.IsBank("MCS0")) {
+      //reset mcs
+      fMcs.resize(NOF_MCS_CHANNELS,std::vector<uint16_t>());
+      for(int i = 0; bank.GotBytes(2); ++i) {
+	bank.Get(tmp);
+	//tmp = ((tmp<<16)&0xffff0000) | ((tmp>>16)&0xffff);
+	fMcs[i%NOF_MCS_CHANNELS].push_back(tmp);
+      }
+      //done (there shouldn't be another scaler bank)???
+      break;
+    }
+  }
+
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<"Scaler event done"<<std::endl;
+  }
+
+  return true;
+}
+
+bool FeraDecoder::EpicsEvent(MidasEvent& event) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Found epics event in midas event ",event.Number())<<std::endl;
+  }
+  float tmp;
+
+  //loop over banks or just get the right bank?
+  //for(auto& bank : event.Banks()) {
+  Bank bank = event.Banks()[1];
+  for(int j = 0; bank.GotData(); ++j) {
+    bank.Get(tmp);
+    //tmp = ((tmp<<16)&0xffff0000) | ((tmp>>16)&0xffff);
+    if(j==14) {
+      fTemperatureFile<<tmp<<std::endl;
+      fTemperature = tmp;
+      ++fNofTemperatures;
+      break;
+    }
+  }
+  //}
+
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<"Epics event done"<<std::endl;
+  }
+
+  return true;
+}
+
+//---------------------------------------- different detector types ----------------------------------------
+
+void FeraDecoder::GermaniumEvent(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber, std::vector<Hit>& hits, FifoRecords& records) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Starting on germanium event ",eventNumber)<<std::endl;
+  }
+
+  uint16_t header;
+  uint16_t vsn;
+  uint16_t feraType;
+  uint16_t tmpEnergy;
+  std::vector<std::pair<uint16_t, uint16_t> > energy;
+  std::map<uint16_t, std::vector<uint16_t> > time;
+  UlmData ulm;
+
+  while(bank.ReadPoint() < feraEnd) {
+    bank.Get(header);
+
+    //skip all zeros
+    while(header == 0 && bank.ReadPoint() < feraEnd) {
+      //increment counter and get next word
+      ++fNofZeros[bank.IntName()];
+      bank.Get(header);
+    }
+
+    //get the module number
+    vsn = header & VHNMASK;
+
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA number = ",vsn)<<std::endl;
+    }
+
+    //get the module type (high bit has to be set)
+    if((header & 0x8000) != 0) {
+      feraType = header & VHTMASK;
+    } else {
+      feraType = BADFERA;
+    }
+
+    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
+    }
+
+    switch(feraType) {
+    case VHAD1141:
+      //Process the ADC, and check if it's followed immediately by a TDC
+      if(vsn >= fSettings->NofGermaniumDetectors()) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid detector number (",vsn,") in Event ",bank.EventNumber(),", Bank ",bank.Number(),Attribs::Reset())<<std::endl;
+      }
+      
+      if(GetAdc114(bank, feraEnd, tmpEnergy)) {
+	GetTdc3377(bank, feraEnd, time);
+	++fCounter[VH3377];
+      }
+      energy.push_back(std::make_pair(vsn, tmpEnergy));
+      ++fCounter[VHAD1141];
+      break;
+
+    case VHAD1142:
+      //Process the ADC, and check if it's followed immediately by a TDC
+      if((vsn + 16) >= fSettings->NofGermaniumDetectors()) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid detector number (",(vsn + 16),") in Event ",bank.EventNumber(),", Bank ",bank.Number(),Attribs::Reset())<<std::endl;
+      }
+
+      if(GetAdc114(bank, feraEnd, tmpEnergy)) {
+	GetTdc3377(bank, feraEnd, time);
+	++fCounter[VH3377];
+      }
+      energy.push_back(std::make_pair(vsn + 16, tmpEnergy));
+      ++fCounter[VHAD1142];
+      break;
+
+    case VH3377: /* 3377 TDC */
+      GetTdc3377(bank, feraEnd, time);
+      ++fCounter[VH3377];
+      break;
+
+    case VHFULM:  /* Universal Logic Module end of event marking, clocks, etc.. */
+      GetUlm(bank, ulm);
+      ++fCounter[VHFULM];
+      if(ulm.CycleNumber() != fLastCycle && fLastCycle != 0) {
+	if(fSettings->VerbosityLevel() > 0) {
+	  std::cout<<Show(ulm.CycleNumber(),". cycle: ",fEventsInCycle," events in last cycle")<<std::endl;
+	}
+	fEventsInCycle = 0;
+      } else {
+	++fEventsInCycle;
+      }
+      fLastCycle = ulm.CycleNumber();
+      break;
+
+    case BADFERA:
+      if(fSettings->VerbosityLevel() > 1) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Bad germanium fera",Attribs::Reset())<<std::endl;
+      }
+      ++fCounter[BADFERA];
+      bank.SetReadPoint(feraEnd);
+      break;
+
+    default: /* Unrecognized header */
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in germanium midas event ",eventNumber,", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
+      }
+      ++fNofUnkownFera[bank.IntName()];
+      //try and find the next header
+      bank.Get(header);
+      //skip all words until we find one with the high bit set
+      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
+	//increment counter and get next word
+	bank.Get(header);
+      }
+      //un-read the header (will be read again in the next iteration of the while-loop_
+      bank.ChangeReadPoint(-1);
+      break;
+    }
+  }
+
+  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
+    ConstructEvents(eventTime, eventNumber, EDetectorType::kGermanium, energy, time, ulm, hits, records);
+  } else if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
+  }
+}
+
+void FeraDecoder::PlasticEvent(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber, std::vector<Hit>& hits, FifoRecords& records) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Starting on plastic event ",eventNumber)<<std::endl;
+  }
+
+  uint16_t header;
+  uint16_t vsn;
+  uint16_t feraType;
+  std::vector<std::pair<uint16_t, uint16_t> > energy;
+  std::map<uint16_t, std::vector<uint16_t> > time;
+  UlmData ulm;
+
+  while(bank.ReadPoint() < feraEnd) {
+    bank.Get(header);
+
+    //skip all zeros
+    while(header == 0 && bank.ReadPoint() < feraEnd) {
+      //increment counter and get next word
+      ++fNofZeros[bank.IntName()];
+      bank.Get(header);
+    }
+
+    //get the module number
+    vsn = header & VHNMASK;
+
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA number = ",vsn)<<std::endl;
+    }
+
+    //get the module type (high bit has to be set)
+    if((header & 0x8000) != 0) {
+      feraType = header & VHTMASK;
+    } else {
+      feraType = BADFERA;
+    }
+
+    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
+    }
+
+    switch(feraType) {
+    case VH4300: //SCEPTAR ENERGY FERA
+      GetAdc4300(bank, header, vsn, energy);
+      ++fCounter[VH4300];
+      break;		    
+
+    case VH3377: // 3377 TDC
+      GetTdc3377(bank, feraEnd, time);
+      ++fCounter[VH3377];
+      break;
+
+    case VHFULM:  // Universal Logic Module end of event marking, clocks, etc..
+      GetUlm(bank, ulm);
+      ++fCounter[VHFULM];
+      break;
+
+    case BADFERA:
+      if(fSettings->VerbosityLevel() > 1) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Found bad fera event in plastic data stream",Attribs::Reset())<<std::endl;
+      }
+      ++fCounter[BADFERA];
+      bank.SetReadPoint(feraEnd);
+      break;
+
+    default: // Unrecognized header
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in plastic midas event ",bank.EventNumber(),", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
+      }
+      ++fNofUnkownFera[bank.IntName()];
+      //try and find the next header
+      bank.Get(header);
+      //skip all words until we find one with the high bit set
+      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
+	//increment counter and get next word
+	bank.Get(header);
+      }
+      //un-read the header (will be read again in the next iteration of the while-loop_
+      bank.ChangeReadPoint(-1);
+      break;
+    }
+  }
+
+  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
+    ConstructEvents(eventTime, eventNumber, EDetectorType::kPlastic, energy, time, ulm, hits, records);
+  } else if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
+  }
+}
+
+void FeraDecoder::SiliconEvent(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber, std::vector<Hit>& hits, FifoRecords& records) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Starting on silicon event ",eventNumber)<<std::endl;
+  }
+
+  uint16_t header;
+  uint16_t vsn;
+  uint16_t feraType;
+  int nofAdcs = 0;
+  uint16_t tmpEnergy;
+  std::vector<std::pair<uint16_t, uint16_t> > energy;
+  std::map<uint16_t, std::vector<uint16_t> > time;
+  UlmData ulm;
+
+  while(bank.ReadPoint() < feraEnd) {
+    bank.Get(header);
+
+    //skip all zeros
+    while(header == 0 && bank.ReadPoint() < feraEnd) {
+      //increment counter and get next word
+      ++fNofZeros[bank.IntName()];
+      bank.Get(header);
+    }
+
+    //get the module number
+    vsn = header & VHNMASK;
+
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA number = ",vsn)<<std::endl;
+    }
+
+    //get the module type (high bit has to be set)
+    if((header & 0x8000) != 0) {
+      feraType = header & VHTMASK;
+    } else {
+      feraType = BADFERA;
+    }
+
+    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
+    }
+
+    switch(feraType) {
+    case VHAD413:
+      //vsn is 0xD or 0xE (13 or 14), so to get the module number we subtract 13
+      if(!GetAdc413(bank, vsn-13, (header&VHAD413_NUMBER_OF_DATA_WORDS_MASK)>>VHAD413_DATA_WORDS_OFFSET, energy)) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Same problem with something immediately after ADC 413 data in silicon data stream",Attribs::Reset())<<std::endl;
+      }
+      ++fCounter[VHAD413];
+      ++nofAdcs;
+      break;	
+    case VHAD114Si:
+      //Process the ADC, and check if it's followed immediately by a TDC
+      if(vsn > fSettings->NofSiliconDetectors()) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid detector number (",vsn,") in Event ",bank.EventNumber(),", Bank ",bank.Number(),Attribs::Reset())<<std::endl;
+      }
+
+      if(GetAdc114(bank, feraEnd, tmpEnergy)) {
+	GetTdc3377(bank, feraEnd, time);
+	++fCounter[VH3377];
+      }
+      energy.push_back(std::make_pair(vsn, tmpEnergy));
+      ++fCounter[VHAD114Si];
+      break;		    
+
+    case VH3377:
+      GetTdc3377(bank, feraEnd, time);
+      ++fCounter[VH3377];
+      break;
+
+    case VHFULM:  /* Universal Logic Module end of event marking, clocks, etc.. */
+      GetUlm(bank, ulm);
+      ++fCounter[VHFULM];
+      break;
+
+    case BADFERA:
+      if(fSettings->VerbosityLevel() > 1) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Found bad fera event in silicon data stream",Attribs::Reset())<<std::endl;
+      }
+      ++fCounter[BADFERA];
+      bank.SetReadPoint(feraEnd);
+      break;
+		    
+    default: // Unrecognized header
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in silicon midas event ",bank.EventNumber(),", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
+      }
+      ++fNofUnkownFera[bank.IntName()];
+      //try and find the next header
+      bank.Get(header);
+      //skip all words until we find one with the high bit set
+      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
+	//increment counter and get next word
+	bank.Get(header);
+      }
+      //un-read the header (will be read again in the next iteration of the while-loop_
+      bank.ChangeReadPoint(-1);
+      break;
+    }//switch
+  }
+
+  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
+    ConstructEvents(eventTime, eventNumber, EDetectorType::kSilicon, energy, time, ulm, hits, records);
+  } else if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
+  }
+}
+
+void FeraDecoder::BaF2Event(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber, std::vector<Hit>& hits, FifoRecords& records) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Starting on barium fluoride event ",eventNumber)<<std::endl;
+  }
+
+  uint16_t header;
+  uint16_t vsn;
+  uint16_t feraType;
+  std::vector<std::pair<uint16_t, uint16_t> > energy;
+  std::map<uint16_t, std::vector<uint16_t> > time;
+  UlmData ulm;
+
+  while(bank.ReadPoint() < feraEnd) {
+    bank.Get(header);
+
+    //skip all zeros
+    while(header == 0 && bank.ReadPoint() < feraEnd) {
+      //increment counter and get next word
+      ++fNofZeros[bank.IntName()];
+      bank.Get(header);
+    }
+
+    //get the module number
+    vsn = header & VHNMASK;
+
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA number = ",vsn)<<std::endl;
+    }
+
+    //get the module type (high bit has to be set)
+    if((header & 0x8000) != 0) {
+      feraType = header & VHTMASK;
+    } else {
+      feraType = BADFERA;
+    }
+
+    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
+    if(fSettings->VerbosityLevel() > 4) {
+      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
+    }
+
+    switch(feraType) {
+    case VHAD413:
+      //vsn is 0-4
+      if(!GetAdc413(bank, vsn, (header&VHAD413_NUMBER_OF_DATA_WORDS_MASK)>>VHAD413_DATA_WORDS_OFFSET, energy)) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Same problem with something immediately after ADC 413 data in barium fluoride data stream",Attribs::Reset())<<std::endl;
+      }
+      ++fCounter[VHAD413];
+      break;	
+	
+    case VH3377:
+      GetTdc3377(bank, feraEnd, time);
+      ++fCounter[VH3377];
+      break;
+
+    case VHFULM:  /* Universal Logic Module end of event marking, clocks, etc.. */
+      GetUlm(bank, ulm);
+      ++fCounter[VHFULM];
+      break;
+
+    case BADFERA:
+      if(fSettings->VerbosityLevel() > 1) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Found bad fera event in barium fluoride data stream",Attribs::Reset())<<std::endl;
+      }
+      ++fCounter[BADFERA];
+      bank.SetReadPoint(feraEnd);
+      break;
+		    
+    default: // Unrecognized header
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in barium fluoride midas event ",bank.EventNumber(),", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
+      }
+      ++fNofUnkownFera[bank.IntName()];
+      //try and find the next header
+      bank.Get(header);
+      //skip all words until we find one with the high bit set
+      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
+	//increment counter and get next word
+	bank.Get(header);
+      }
+      //un-read the header (will be read again in the next iteration of the while-loop_
+      bank.ChangeReadPoint(-1);
+      break;
+    }
+  }
+
+  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
+    ConstructEvents(eventTime, eventNumber, EDetectorType::kBaF2, energy, time, ulm, hits, records);
+  } else if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
+  }
+}
+
+
+//---------------------------------------- different electronics modules ----------------------------------------
+
+//get energy from an Adc 114
+bool FeraDecoder::GetAdc114(Bank& bank, uint32_t feraEnd, uint16_t& energy) {
+  uint16_t tdc;
+
+  bank.Get(energy);
+
+  if(energy > VHAD114_ENERGY_MASK) {
+    std::cerr<<Show(Foreground::Red(),"ADC 114 energy ",energy," > ",VHAD114_ENERGY_MASK,Attribs::Reset())<<std::endl;
+  }
+
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("Got Adc114 energy: 0x",std::hex,energy," = ",std::dec,energy)<<std::endl;
+  }
+
+  if(bank.ReadPoint() < feraEnd) {
+    //check whether we have a tdc following this adc
+    bank.Peek(tdc);
+    if((tdc & 0x8000) == 0) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+//get energy from an Adc 413
+bool FeraDecoder::GetAdc413(Bank& bank, uint16_t module, uint16_t nofDataWords, std::vector<std::pair<uint16_t, uint16_t> >& energy) {
+  uint16_t data;
+  uint16_t subAddress;
+
+  //Header is followed by 1 to 4 data records, each with the following format:
+  //B16 	B15 . . . B14 	B13 . . . . . . . . . . . . . . . . . .  . . B1
+  //0 	SUBADDR 	DATA
+
+  for(uint16_t i = 0; i < nofDataWords; ++i) {
+    bank.Get(data);
+		
+    subAddress = (data&VHAD413_SUBADDRESS_MASK)>>VHAD413_SUBADDRESS_OFFSET;
+    if(subAddress > 3) {
+      return false;
+    }
+    energy.push_back(std::make_pair(module*4 + subAddress, data&VHAD413_ENERGY_MASK));
+  }
+
+  return true;
+}
+
+//read high and low word from tdc (extracting time and sub-address) until no more tdc data is left
+bool FeraDecoder::GetTdc3377(Bank& bank, uint32_t feraEnd, std::map<uint16_t, std::vector<uint16_t> >& time) {
+  uint16_t highWord;
+  uint16_t lowWord;
+  uint16_t subAddress;
+
+  while(bank.ReadPoint() < feraEnd) {//???
+    if(!bank.Get(highWord)) {
+      return false;
+    }
+    if(!bank.Get(lowWord)) {
+      return false;
+    }
+    
+    if((highWord & 0x8000) || (lowWord & 0x8000)) {
+      bank.ChangeReadPoint(-2);
+      return false;
+    }
+    
+    if((highWord&TDC3377_IDENTIFIER) != (lowWord&TDC3377_IDENTIFIER)) {
+      //two words from two different tdcs? output error message
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Tdc identifier mismatch, event ",bank.EventNumber(),", bank ",bank.Number(),": ",(highWord&TDC3377_IDENTIFIER)," != ",(lowWord&TDC3377_IDENTIFIER),Attribs::Reset())<<std::endl;
+      }
+      return false;
+    }
+
+    subAddress = (highWord&TDC3377_IDENTIFIER) >> 10;
+    time[subAddress].push_back(((highWord&TDC3377_TIME) << 8) | (lowWord&TDC3377_TIME));
+    ++fSubAddress[subAddress];
+    if(fSettings->VerbosityLevel() > 3) {
+      std::cout<<Show("Got two tdc words: 0x",std::hex,highWord,", 0x",lowWord,std::dec)<<std::endl;
+    }
+  }
+
+  return true;
+}
+
+bool FeraDecoder::GetAdc4300(Bank& bank, uint16_t header, uint16_t vsn, std::vector<std::pair<uint16_t, uint16_t> >& energy) {
+  uint16_t tmp;
+  uint16_t subAddress;
+  uint16_t nofAdcWords = (header&PLASTIC_ADC_WORDS) >> PLASTIC_ADC_WORDS_OFFSET;
+
+  if(nofAdcWords == 0) {
+    //all channels fired.
+    nofAdcWords = PLASTIC_CHANNELS;
+  }
+
+  for(uint16_t i = 0; i < nofAdcWords; ++i) {
+    bank.Get(tmp);
+    
+    if((tmp & 0x8000) != 0) {
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"reached premature end of adc 4300 data: i = ",i,", # adc words = ",nofAdcWords,Attribs::Reset())<<std::endl;
+      }
+      bank.ChangeReadPoint(-1);
+      break;
+    }
+
+    subAddress = (tmp&PLASTIC_IDENTIFIER) >> PLASTIC_IDENTIFIER_OFFSET;
+
+    if(vsn*PLASTIC_CHANNELS + subAddress >= fSettings->NofPlasticDetectors()) {
+      if(fSettings->VerbosityLevel() > 1) {
+	std::cout<<Show("Found plastic detector #",vsn*PLASTIC_CHANNELS + subAddress," in event ",bank.EventNumber(),", bank ",bank.Number(),", but there should only be ",fSettings->NofPlasticDetectors())<<std::endl;
+      }
+      continue;
+    }
+
+    energy.push_back(std::make_pair(vsn*PLASTIC_CHANNELS + subAddress, tmp&PLASTIC_ENERGY));
+  }
+  return true;
+}
+
+bool FeraDecoder::GetUlm(Bank& bank, UlmData& ulm) {
+  uint16_t header;
+  if(!bank.Get(header)) {
+    return false;
+  }
+
+  ulm.Header(header);
+
+  uint32_t tmp;
+  if(!bank.Get(tmp)) {
+    return false;
+  }
+  ulm.Clock(tmp);
+  if(!bank.Get(tmp)) {
+    return false;
+  }
+  ulm.LiveClock(tmp);
+  if(!bank.Get(tmp)) {
+    return false;
+  }
+  ulm.MasterCount(tmp);
+
+  if(fSettings->VerbosityLevel() > 3) {  
+    std::cout<<Show("Got ulm with header 0x",std::hex,header,", clock 0x",ulm.Clock(),", live clock 0x",ulm.LiveClock(),", and master count 0x",tmp,std::dec)<<std::endl;
+  }
+
+  return true;
+}
+
+//----------------------------------------
+
+void FeraDecoder::ConstructEvents(const uint32_t& eventTime, const uint32_t& eventNumber, const EDetectorType& detectorType, std::vector<std::pair<uint16_t, uint16_t> >& energy, std::map<uint16_t, std::vector<uint16_t> >& time, UlmData& ulm, std::vector<Hit>& hits, FifoRecords& records) {
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("starting to construct events from ",energy.size()," detectors with ",time.size()," times")<<std::endl;
+  }
+  size_t nofEvents = 0;
+
+  //check that this is a known detector
+  if(detectorType == EDetectorType::kUnknown) {
+    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),energy.size()," unknown detectors passed on to ",__PRETTY_FUNCTION__,Attribs::Reset())<<std::endl;
+    return;
+  }
+
+  //drop all deactivated adcs
+  energy.erase(std::remove_if(energy.begin(), energy.end(), [&](const std::pair<uint16_t, uint16_t> en) -> bool {return !fSettings->Active(detectorType,en.first);}),energy.end());
+
+  //drop all deactivated tdcs (this is a map, so we can't use remove_if)
+  auto it = time.begin();
+  while(it != time.end()) {
+    if(!fSettings->Active(detectorType, it->first)) {
+      time.erase(it++);//delete this map entry and then go to the next entry (post-increment)
+    } else {
+      ++it;//just go to the next entry
+    }
+  }
+
+  //stop if all detectors were deactivated
+  if(energy.size() == 0) {
+    if(time.size() != 0) {
+      if(fSettings->VerbosityLevel() > 0) {
+	std::cout<<Show(Foreground::Red(),"No active adcs, but ",time.size()," active tdcs",Attribs::Reset())<<std::endl;
+      }
+    } else if(fSettings->VerbosityLevel() > 2) {
+      std::cout<<Show(Foreground::Red(),"No active adcs and no active tdcs",Attribs::Reset())<<std::endl;      
+    }
+    return;
+  }
+
+  //need to take care of: clockstate, ulm overflows, live clock overflows, dead times
+  //correct ulm overflows
+  fClockState.CorrectOverflow(detectorType, eventTime, ulm);
+
+  //if the ulm is still zero, we need to check the ulm cycle number (might be screwed up)
+  if(ulm.Clock() == 0) {
+    if(ulm.CycleNumber() > fLastCycle && ulm.CycleNumber()-fLastCycle > 0xff) {
+      std::cout<<Show(Foreground::Red(),"ulm clock 0 and cycle number ",ulm.CycleNumber()," with last cycle number ",fLastCycle,": dropping detector",Attribs::Reset())<<std::endl;
+      return;
+    }
+  }
+
+  //now loop over all detectors, create the event, fill the detector number and energy, find the corresponding times, and fill them too
+  //(the event time and number and the ulm data are shared by all hits in the record of this FIFO event)
+  uint32_t record = records.Add(eventTime, eventNumber, ulm);
+  for(auto& en : energy) {
+    if(ulm.Clock() == 0) {
+      std::cout<<Show(Foreground::Red(),"Detector (type ",static_cast<uint16_t>(detectorType),", number ",en.first,") with ulm clock 0!",Attribs::Reset())<<std::endl;
+    } else if(fSettings->VerbosityLevel() > 3) {
+      std::cout<<Foreground::Green<<Show("Detector with ulm clock ",ulm.Clock(),Attribs::Reset())<<std::endl;
+    }
+    hits.push_back(Hit());
+    Hit& hit = hits.back();
+    hit.Set(record, detectorType, en, ulm);
+    if(fDataFile.is_open()) {
+      fDataFile<<eventNumber<<" "<<eventTime<<" "<<static_cast<uint16_t>(detectorType)<<" "<<en.first<<" "<<en.second<<" "<<ulm.Clock()<<" "<<ulm.LiveClock()<<std::endl;
+    }
+    ++nofEvents;
+    //check that we have any times for this detector
+    auto times = time.find(en.first);
+    if(times != time.end() && !times->second.empty()) {
+      SelectTdcHits(detectorType, en.first, times->second, hit, records);
+    } else {
+      //no tdc hits found for this detector
+      if(fSettings->VerbosityLevel() > 2) {
+	std::cerr<<Show(Foreground::Red(),"Found no tdc hits for detector type ",std::hex,static_cast<uint16_t>(detectorType),std::dec,", number ",en.first,Attribs::Reset())<<std::endl;
+      }
+    }
+  }//for detector
+
+  if(fSettings->VerbosityLevel() > 3) {
+    std::cout<<Show("done with creation of ",nofEvents," events")<<std::endl;
+  }
+}
+
+//find the right tdc hit
+//since any good tdc hit creates a deadtime w/o anymore tdc hits, we want the last one
+//the tdcs are LIFO, so the last hit is the first coming out
+//however in Greg's FIFO.c he uses the last time found within the coarse window or (if none is found) the very first time
+//the multi-hit selections keep the other times (within the window) in readout order as well
+void FeraDecoder::SelectTdcHits(const EDetectorType& detectorType, const uint16_t& detectorNumber, const std::vector<uint16_t>& times, Hit& hit, FifoRecords& records) {
+  ETdcSelection selection = fSettings->TdcSelection();
+  size_t nofTimes = times.size();
+  size_t selected = nofTimes;
+  size_t nofInWindow = 0;
+  for(size_t i = 0; i < nofTimes; ++i) {
+    if(fSettings->CoarseTdcWindow(detectorType, detectorNumber, times[i])) {
+      if(selected == nofTimes || selection != ETdcSelection::kFirstInWindow) {
+	selected = i;
+      }
+      ++nofInWindow;
+    }
+  }
+  if(selected == nofTimes) {
+    selected = 0;
+  }
+  hit.TdcHits(nofTimes);
+  hit.TdcHitsInWindow(nofInWindow);
+  hit.Time(times[selected]);
+
+  if(!fSettings->MultiHitTdc()) {
+    return;
+  }
+  for(size_t i = 0; i < nofTimes; ++i) {
+    if(i != selected && (selection == ETdcSelection::kAll || fSettings->CoarseTdcWindow(detectorType, detectorNumber, times[i]))) {
+      if(!records.AddTdcTime(hit, times[i])) {
+	++fNofDroppedTdcTimes;
+      }
+    }
+  }
+}
+
+void FeraDecoder::Print() {
+  std::cout<<"Zeros skipped:"<<std::endl;
+  for(auto it : fNofZeros) {
+    std::cout<<Show(it.first,": \t",std::setw(7),it.second)<<std::endl;
+  }
+
+  std::cout<<"Unknown FERA header:"<<std::endl;
+  for(auto it : fNofUnkownFera) {
+    std::cout<<Show(it.first,": \t",std::setw(7),it.second)<<std::endl;
+  }
+
+  if(fNofDroppedTdcTimes > 0) {
+    std::cout<<Show(Attribs::Bright(),Foreground::Red(),"Dropped ",fNofDroppedTdcTimes," TDC times beyond the ",MAX_TDC_TIMES," additional times per hit (or 65535 per FIFO event)",Attribs::Reset())<<std::endl;
+  }
+}
+
+ClockState::ClockState(uint32_t startTime) {
+  fCycleStartTime = startTime;
+  fNofStoredCycles = 0;
+}
+
+void ClockState::Update(uint32_t time) {
+  //increment stored cycles
+  ++fNofStoredCycles;
+
+  //  //loop over all
+  //  for(i = 0; i < NUMBER_OF_DETECTOR_TYPES; i++) {
+  //
+  //    clockstate->firsteventtime[i] = 0;
+  //    clockstate->firsteventtimeset[i] = 0;
+  //
+  //    clockstate->cyclecorruptdeadtimes[i] = realloc(clockstate->cyclecorruptdeadtimes[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
+  //    clockstate->cycleulmclocks[i] = realloc(clockstate->cycleulmclocks[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
+  //    clockstate->cyclelivetimes[i] = realloc(clockstate->cyclelivetimes[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
+  //    clockstate->cycledeadtimes[i] = realloc(clockstate->cycledeadtimes[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
+  //
+  //    if(clockstate->cyclelivetimes[i] == 0 || clockstate->cycledeadtimes[i] == 0) {
+  //      printf("Memory allocation error in updateClockStateForNewCycle()");
+  //      exit(-1);
+  //    }
+  //
+  //    clockstate->cyclecorruptdeadtimes[i][clockstate->numberofstoredcycles - 1] = clockstate->corruptdeadtime[i];
+  //    clockstate->cycleulmclocks[i][clockstate->numberofstoredcycles - 1] = clockstate->lastulmclock[i];
+  //    clockstate->cyclelivetimes[i][clockstate->numberofstoredcycles - 1] = clockstate->lastlivetime[i];
+  //    clockstate->cycledeadtimes[i][clockstate->numberofstoredcycles - 1] = clockstate->lastdeadtime[i];
+  //  }
+  //
+  //  clockstate->cyclestarttime = cyclestarttime;
+  //
+  //  //Reset the clock state.
+  //  for(i = 0; i < NUMBER_OF_DETECTOR_TYPES; i++) {
+  //    clockstate->corruptdeadtime[i] = 0;
+  //    clockstate->lastlivetime[i] = 0;
+  //    clockstate->numberoflivetimeoverflows[i] = 0;
+  //    clockstate->lastdeadtime[i] = 0;
+  //    clockstate->lastulmclock[i] = 0;
+  //  }
+}
+
+void ClockState::CorrectOverflow(const EDetectorType& detectorType, const uint32_t& eventTime, UlmData& ulm) {
+  uint8_t detType = static_cast<uint8_t>(detectorType);
+  if(fFirstEventTime.find(detType) == fFirstEventTime.end()) {
+    fFirstEventTime[detType] = eventTime - ulm.Clock()/ULM_CLOCK_IN_SECONDS;//all in seconds
+    return;
+  }
+  
+  uint32_t nofOverflows;
+  if(ulm.Clock() > ULM_CLOCK_OVERFLOW/2) {
+    nofOverflows = (uint32_t)(float(eventTime - fFirstEventTime[detType] - ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4)/(float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)));
+    std::cout<<"cyle number = "<<ulm.CycleNumber()<<", nofOverflows = (uint32_t)(float("<<eventTime<<" - "<<fFirstEventTime[detType]<<" - "<<ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<" = "<<eventTime - fFirstEventTime[detType] - ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<")/("<<float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)<<")) = "<<nofOverflows<<", ulm = "<<ulm.Clock()<<std::endl;
+  } else {
+    nofOverflows = (uint32_t)(float(eventTime - fFirstEventTime[detType] + ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4)/(float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)));
+    std::cout<<"cyle number = "<<ulm.CycleNumber()<<", nofOverflows = (uint32_t)(float("<<eventTime<<" - "<<fFirstEventTime[detType]<<" + "<<ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<" = "<<eventTime - fFirstEventTime[detType] + ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<")/("<<float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)<<")) = "<<nofOverflows<<", ulm = "<<ulm.Clock()<<std::endl;
+  }
+  
+  ulm.ClockOverflow(nofOverflows);
+}
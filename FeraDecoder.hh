@@ -0,0 +1,121 @@
+#ifndef __FERA_DECODER_HH
+#define __FERA_DECODER_HH
+
+#include <map>
+#include <vector>
+#include <fstream>
+
+#include "MidasEvent.hh"
+#include "Settings.hh"
+#include "Hit.hh"
+
+class ClockState {
+public:
+  ClockState(uint32_t startTime = 0);
+  ~ClockState(){};
+
+  void Update(uint32_t);
+
+  uint32_t NofStoredCycles() {
+    return fNofStoredCycles;
+  }
+
+  void CorrectOverflow(const EDetectorType&, const uint32_t&, UlmData&);
+
+private:
+  uint32_t fCycleStartTime;
+  uint32_t fNofStoredCycles;
+  std::map<uint32_t,uint32_t> fFirstEventTime;
+  std::map<uint32_t,uint32_t> fLastUlmClock;
+  std::map<uint32_t,uint32_t> fLastDeadTime;
+  std::map<uint32_t,uint32_t> fLastLiveTime;
+  std::map<uint32_t,uint32_t> fNofLiveTimeOverflows;
+};
+
+//decodes the fera streams of the midas events into hits
+class FeraDecoder {
+public:
+  FeraDecoder(Settings*);
+  ~FeraDecoder();
+
+  //process the different midas event types, FIFO events add the decoded hits to the vector
+  bool FifoEvent(MidasEvent&, std::vector<Hit>&, FifoRecords&);
+  bool CamacScalerEvent(MidasEvent&);
+  bool EpicsEvent(MidasEvent&);
+
+  //switches to a new snapshot of the settings (active detectors and TDC windows)
+  void SetSettings(Settings* settings) {
+    fSettings = settings;
+  }
+
+  //last temperature read from an epics event, and how many have been read so far
+  float Temperature() {
+    return fTemperature;
+  }
+  size_t NofTemperatures() {
+    return fNofTemperatures;
+  }
+
+  void EndOfCycle(uint32_t time) {
+    fClockState.Update(time);
+  }
+
+  uint32_t NofStoredCycles() {
+    return fClockState.NofStoredCycles();
+  }
+
+  void Print();
+
+private:
+  //process the different detector types
+  void GermaniumEvent(Bank&, size_t, uint32_t, uint32_t, std::vector<Hit>&, FifoRecords&);
+  void PlasticEvent(Bank&, size_t, uint32_t, uint32_t, std::vector<Hit>&, FifoRecords&);
+  void SiliconEvent(Bank&, size_t, uint32_t, uint32_t, std::vector<Hit>&, FifoRecords&);
+  void BaF2Event(Bank&, size_t, uint32_t, uint32_t, std::vector<Hit>&, FifoRecords&);
+
+  //process the different electronic modules
+  bool GetAdc114(Bank&, uint32_t, uint16_t&);
+  bool GetAdc413(Bank&, uint16_t, uint16_t, std::vector<std::pair<uint16_t, uint16_t> >&);
+  bool GetTdc3377(Bank&, uint32_t, std::map<uint16_t, std::vector<uint16_t> >&);
+  bool GetAdc4300(Bank&, uint16_t, uint16_t, std::vector<std::pair<uint16_t, uint16_t> >&);
+  bool GetUlm(Bank&, UlmData&);
+
+  //selects the time(s) of the hit from the TDC hits of its detector according to the TDC selection of the settings
+  void SelectTdcHits(const EDetectorType&, const uint16_t&, const std::vector<uint16_t>&, Hit&, FifoRecords&);
+  void ConstructEvents(const uint32_t&, const uint32_t&, const EDetectorType&, std::vector<std::pair<uint16_t, uint16_t> >&, std::map<uint16_t, std::vector<uint16_t> >&, UlmData&, std::vector<Hit>&, FifoRecords&);
+
+private:
+  Settings* fSettings;
+
+  //keep track how often a bank has appeared in the data
+  std::map<uint32_t, uint32_t> fBankCounter;
+  //keep track how often a fera type has appeared in the data
+  std::map<uint16_t, uint32_t> fCounter;
+  //keep track how often a tdc sub-address has appeared in the data
+  std::map<uint16_t, uint32_t> fSubAddress;
+  //scaler data
+  std::vector<std::vector<uint16_t> > fMcs;
+
+  //variables to keep track of last event
+  uint32_t fLastEventNumber;
+  uint32_t fLastEventTime;
+  std::map<uint32_t,uint32_t> fLastFifoSerial;
+  std::map<uint32_t,uint32_t> fNofZeros;
+  std::map<uint32_t,uint32_t> fNofUnkownFera;
+  //additional TDC times that didn't fit into the hits (multi-hit TDC selections)
+  size_t fNofDroppedTdcTimes;
+  //clock state
+  ClockState fClockState;
+
+  //cycle statistics
+  uint16_t fLastCycle;
+  size_t fEventsInCycle;
+
+  //temperature output file and other files
+  float fTemperature;
+  size_t fNofTemperatures;
+  std::ofstream fTemperatureFile;
+  std::ofstream fDataFile;
+};
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef __FIXED_HISTOGRAM_HH
+#define __FIXED_HISTOGRAM_HH
+
+#include <vector>
+#include <algorithm>
+#include <stdint.h>
+
+//cheap histogram of integer values with fixed, equal sized bins
+//not thread-safe, use one histogram per thread and Add() them up
+class FixedHistogram {
+public:
+  FixedHistogram(size_t nofBins = 1, uint64_t low = 0, uint64_t high = 1) {
+    if(nofBins == 0) {
+      nofBins = 1;
+    }
+    if(high <= low) {
+      high = low + 1;
+    }
+    fBins.resize(nofBins, 0);
+    fLow = low;
+    fHigh = high;
+    fUnderflow = 0;
+    fOverflow = 0;
+    fMaximum = 0;
+    fEntries = 0;
+  }
+  ~FixedHistogram(){};
+
+  void Fill(uint64_t value) {
+    ++fEntries;
+    if(value > fMaximum) {
+      fMaximum = value;
+    }
+    if(value < fLow) {
+      ++fUnderflow;
+    } else if(value >= fHigh) {
+      ++fOverflow;
+    } else {
+      ++fBins[(value - fLow)*fBins.size()/(fHigh - fLow)];
+    }
+  }
+
+  //add the other histogram (needs to have the same binning)
+  void Add(const FixedHistogram& rh) {
+    if(rh.fBins.size() != fBins.size() || rh.fLow != fLow || rh.fHigh != fHigh) {
+      return;
+    }
+    for(size_t i = 0; i < fBins.size(); ++i) {
+      fBins[i] += rh.fBins[i];
+    }
+    fUnderflow += rh.fUnderflow;
+    fOverflow += rh.fOverflow;
+    fEntries += rh.fEntries;
+    if(rh.fMaximum > fMaximum) {
+      fMaximum = rh.fMaximum;
+    }
+  }
+
+  void Reset() {
+    std::fill(fBins.begin(), fBins.end(), 0);
+    fUnderflow = 0;
+    fOverflow = 0;
+    fMaximum = 0;
+    fEntries = 0;
+  }
+
+  size_t NofBins() const {
+    return fBins.size();
+  }
+  uint64_t Low() const {
+    return fLow;
+  }
+  uint64_t High() const {
+    return fHigh;
+  }
+  uint64_t BinLow(size_t bin) const {
+    return fLow + bin*(fHigh - fLow)/fBins.size();
+  }
+  uint64_t Bin(size_t bin) const {
+    return fBins[bin];
+  }
+  uint64_t Underflow() const {
+    return fUnderflow;
+  }
+  uint64_t Overflow() const {
+    return fOverflow;
+  }
+  uint64_t Entries() const {
+    return fEntries;
+  }
+  //largest value filled (including overflows)
+  uint64_t Maximum() const {
+    return fMaximum;
+  }
+
+  //upper edge of the bin below which the given fraction of all entries lies (the maximum if that is in the overflow)
+  uint64_t Quantile(double fraction) const {
+    uint64_t threshold = fraction*fEntries;
+    uint64_t sum = fUnderflow;
+    if(sum >= threshold) {
+      return fLow;
+    }
+    for(size_t i = 0; i < fBins.size(); ++i) {
+      sum += fBins[i];
+      if(sum >= threshold) {
+	return BinLow(i+1);
+      }
+    }
+    return fMaximum;
+  }
+
+private:
+  std::vector<uint64_t> fBins;
+  uint64_t fLow;
+  uint64_t fHigh;
+  uint64_t fUnderflow;
+  uint64_t fOverflow;
+  uint64_t fMaximum;
+  uint64_t fEntries;
+};
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef __HIT_HH
+#define __HIT_HH
+
+#include <stdint.h>
+#include <vector>
+#include <type_traits>
+
+#include "Settings.hh"
+
+//ROOT-free version of the ulm information read from the fera stream
+class UlmData {
+public:
+  UlmData() {
+    fHeader = 0;
+    fClock = 0;
+    fLiveClock = 0;
+    fMasterCount = 0;
+  }
+
+  void Header(uint16_t header) {
+    fHeader = header;
+  }
+  void Clock(uint32_t clock) {
+    fClock = (uint64_t)clock;
+  }
+  void ClockOverflow(uint32_t overflow) {
+    fClock = fClock | ((uint64_t)overflow)<<32;
+  }
+  void LiveClock(uint32_t liveClock) {
+    fLiveClock = liveClock;
+  }
+  void MasterCount(uint32_t masterCount) {
+    fMasterCount = masterCount;
+  }
+
+  uint16_t Header() const {
+    return fHeader;
+  }
+  uint16_t CycleNumber() const {
+    return fHeader&ULM_CYCLE;
+  }
+  uint64_t Clock() const {
+    return fClock;
+  }
+  uint32_t LiveClock() const {
+    return fLiveClock;
+  }
+  uint32_t MasterCount() const {
+    return fMasterCount;
+  }
+
+private:
+  uint16_t fHeader;
+  uint64_t fClock;//counts in 100ns steps
+  uint32_t fLiveClock;
+  uint32_t fMasterCount;
+};
+
+//data shared by all hits of one FIFO event of a detector type: the event time and number, the ulm data, and the additional TDC
+//times of its hits; it is kept out of the hits in a side table (FifoRecords) and the hits only store the index of their record
+struct FifoRecord {
+  uint64_t fClock;//ulm clock in 100ns steps (including overflows)
+  uint32_t fEventTime;
+  uint32_t fEventNumber;
+  uint32_t fLiveClock;
+  uint32_t fMasterCount;
+  uint32_t fFirstTdcTime;//position of the additional TDC times of the hits in the table
+  uint16_t fNofTdcTimes;
+  uint16_t fUlmHeader;//cycle number, beam status, and trigger mask
+
+  uint16_t CycleNumber() const {
+    return fUlmHeader&ULM_CYCLE;
+  }
+};
+
+static_assert(sizeof(FifoRecord) == 32, "FifoRecord is expected to be a packed 32 byte record");
+
+//packed hit record used throughout the processing pipeline (no ROOT, no vtable, no padding)
+//conversion to the Detector/Event classes only happens when writing the tree
+//32 bytes, two hits per cache line: everything that is the same for all hits of a FIFO event is in its FifoRecord, and the
+//ulm clock is the timestamp in 100 ns steps
+struct Hit {
+  uint64_t fTimestamp;//ps, the ulm clock refined by the calibrated TDC time (only the ulm clock without a timing calibration)
+  float fEnergy;
+  uint32_t fFifoRecord;//index of the record of the FIFO event in the side table the hit belongs to
+  uint16_t fRawEnergy;
+  uint16_t fTime;
+  uint16_t fDetectorNumber;
+  uint16_t fFirstTdcTime;//position of the additional TDC times among the ones of the FIFO event
+  uint8_t fDetectorType;
+  uint8_t fTdcHits;//saturates at 255
+  uint8_t fTdcHitsInWindow;//saturates at 255
+  uint8_t fNofTdcTimes;//number of the additional TDC times (only filled by the multi-hit TDC selections)
+
+  void Set(uint32_t fifoRecord, EDetectorType detectorType, const std::pair<uint16_t, uint16_t>& energy, const UlmData& ulm) {
+    fTimestamp = ulm.Clock()*ULM_CLOCK_IN_PS;
+    fEnergy = 0.;
+    fFifoRecord = fifoRecord;
+    fRawEnergy = energy.second;
+    fTime = 0;
+    fDetectorNumber = energy.first;
+    fFirstTdcTime = 0;
+    fDetectorType = static_cast<uint8_t>(detectorType);
+    fTdcHits = 0;
+    fTdcHitsInWindow = 0;
+    fNofTdcTimes = 0;
+  }
+
+  void TdcHits(size_t tdcHits) {
+    fTdcHits = tdcHits > 0xff ? 0xff : tdcHits;
+  }
+  void Time(uint16_t time) {
+    fTime = time;
+  }
+  void TdcHitsInWindow(size_t tdcHits) {
+    fTdcHitsInWindow = tdcHits > 0xff ? 0xff : tdcHits;
+  }
+
+  //ulm clock of the timestamp (the ulm clock itself without a timing calibration)
+  uint64_t Clock() const {
+    return fTimestamp/ULM_CLOCK_IN_PS;
+  }
+
+  friend bool operator<(const Hit& lh, const Hit& rh) {
+    return lh.fTimestamp < rh.fTimestamp;
+  }
+};
+
+static_assert(sizeof(Hit) == 32, "Hit is expected to be a packed 32 byte record");
+static_assert(std::is_trivially_copyable<Hit>::value, "Hit needs to be trivially copyable");
+
+//side table of the FIFO event records and the additional TDC times of a batch of hits (or of a built event)
+//the tables are recycled like the hits: Clear() keeps the storage
+class FifoRecords {
+public:
+  FifoRecords(){};
+  ~FifoRecords(){};
+
+  void Clear() {
+    fRecords.clear();
+    fTdcTimes.clear();
+  }
+  size_t Size() const {
+    return fRecords.size();
+  }
+  void Swap(FifoRecords& rh) {
+    fRecords.swap(rh.fRecords);
+    fTdcTimes.swap(rh.fTdcTimes);
+  }
+
+  const FifoRecord& Record(const Hit& hit) const {
+    return fRecords[hit.fFifoRecord];
+  }
+  //the additional TDC times of the hit (hit.fNofTdcTimes of them)
+  const uint16_t* TdcTimes(const Hit& hit) const {
+    return fTdcTimes.data() + fRecords[hit.fFifoRecord].fFirstTdcTime + hit.fFirstTdcTime;
+  }
+
+  //starts the record of a new FIFO event, returns its index
+  uint32_t Add(uint32_t eventTime, uint32_t eventNumber, const UlmData& ulm) {
+    FifoRecord record;
+    record.fClock = ulm.Clock();
+    record.fEventTime = eventTime;
+    record.fEventNumber = eventNumber;
+    record.fLiveClock = ulm.LiveClock();
+    record.fMasterCount = ulm.MasterCount();
+    record.fFirstTdcTime = fTdcTimes.size();
+    record.fNofTdcTimes = 0;
+    record.fUlmHeader = ulm.Header();
+    fRecords.push_back(record);
+    return fRecords.size() - 1;
+  }
+  //adds an additional TDC time to the hit, which has to belong to the newest record and get all its times before the next hit does
+  //returns false if the time was dropped because the hit (MAX_TDC_TIMES) or the record (65535) is full
+  bool AddTdcTime(Hit& hit, uint16_t time) {
+    FifoRecord& record = fRecords.back();
+    if(hit.fNofTdcTimes >= MAX_TDC_TIMES || record.fNofTdcTimes == 0xffff) {
+      return false;
+    }
+    if(hit.fNofTdcTimes == 0) {
+      hit.fFirstTdcTime = record.fNofTdcTimes;
+    }
+    fTdcTimes.push_back(time);
+    ++record.fNofTdcTimes;
+    ++hit.fNofTdcTimes;
+    return true;
+  }
+
+  //copies a record (and its TDC times) of the other table, returns the index of the copy
+  uint32_t Copy(const FifoRecords& other, uint32_t index) {
+    const FifoRecord& record = other.fRecords[index];
+    fRecords.push_back(record);
+    fRecords.back().fFirstTdcTime = fTdcTimes.size();
+    fTdcTimes.insert(fTdcTimes.end(), other.fTdcTimes.begin() + record.fFirstTdcTime, other.fTdcTimes.begin() + record.fFirstTdcTime + record.fNofTdcTimes);
+    return fRecords.size() - 1;
+  }
+  //appends all records of the other table and moves the given hits (which belong to the other table) over to this one
+  template<class Iterator>
+  void Append(const FifoRecords& other, Iterator begin, Iterator end) {
+    uint32_t firstRecord = fRecords.size();
+    uint32_t firstTdcTime = fTdcTimes.size();
+    fRecords.insert(fRecords.end(), other.fRecords.begin(), other.fRecords.end());
+    for(size_t i = firstRecord; i < fRecords.size(); ++i) {
+      fRecords[i].fFirstTdcTime += firstTdcTime;
+    }
+    fTdcTimes.insert(fTdcTimes.end(), other.fTdcTimes.begin(), other.fTdcTimes.end());
+    for(auto hit = begin; hit != end; ++hit) {
+      hit->fFifoRecord += firstRecord;
+    }
+  }
+  //keeps only the records of the given hits (in the order they are first used) and re-indexes the hits,
+  //the second table and the index map are scratch space (kept by the caller, so that they don't need to be allocated again)
+  void Compact(std::vector<Hit>& hits, FifoRecords& scratch, std::vector<uint32_t>& map) {
+    scratch.Clear();
+    map.assign(fRecords.size(), UINT32_MAX);
+    for(auto& hit : hits) {
+      if(map[hit.fFifoRecord] == UINT32_MAX) {
+	map[hit.fFifoRecord] = scratch.Copy(*this, hit.fFifoRecord);
+      }
+      hit.fFifoRecord = map[hit.fFifoRecord];
+    }
+    Swap(scratch);
+  }
+
+private:
+  std::vector<FifoRecord> fRecords;
+  std::vector<uint16_t> fTdcTimes;
+};
+
+#endif
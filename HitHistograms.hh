@@ -0,0 +1,131 @@
+#ifndef __HIT_HISTOGRAMS_HH
+#define __HIT_HISTOGRAMS_HH
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "Hit.hh"
+
+//one row of counts per detector, indexed directly by the channel
+//the last bin of each row counts all channels beyond the range
+class ChannelCounts {
+public:
+  ChannelCounts(size_t nofRows = 0, size_t nofBins = 0) {
+    fNofRows = nofRows;
+    fNofBins = nofBins;
+    fCounts.resize(nofRows*(nofBins+1), 0);
+  }
+  ~ChannelCounts(){};
+
+  void Fill(size_t row, size_t channel) {
+    ++fCounts[row*(fNofBins+1) + std::min(channel, fNofBins)];
+  }
+
+  void Reset() {
+    std::fill(fCounts.begin(), fCounts.end(), 0);
+  }
+
+  size_t NofRows() const {
+    return fNofRows;
+  }
+  size_t NofBins() const {
+    return fNofBins;
+  }
+  //counts of one row, NofBins() bins followed by the overflow
+  const uint32_t* Row(size_t row) const {
+    return fCounts.data() + row*(fNofBins+1);
+  }
+
+private:
+  size_t fNofRows;
+  size_t fNofBins;
+  std::vector<uint32_t> fCounts;
+};
+
+//raw energy, tdc time, hit pattern, and multiplicity counts of the decoded hits for all detector types
+//filled by the decoding thread and converted to ROOT histograms at the end, only the number of hits can be read by other threads
+class HitHistograms {
+public:
+  HitHistograms(Settings* settings) {
+    std::array<int, NOF_DETECTOR_TYPES> nofDetectors = {{ settings->NofGermaniumDetectors(), settings->NofPlasticDetectors(), settings->NofSiliconDetectors(), settings->NofBaF2Detectors(), 0 }};
+    std::array<int, NOF_DETECTOR_TYPES> maxChannel = {{ settings->MaxGermaniumChannel(), settings->MaxPlasticChannel(), settings->MaxSiliconChannel(), settings->MaxBaF2Channel(), 0 }};
+    for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+      fEnergy[type] = ChannelCounts(nofDetectors[type], maxChannel[type]);
+      fTime[type] = ChannelCounts(nofDetectors[type], settings->MaxTdcChannel());
+      //hit pattern and multiplicity only have one row
+      fHitPattern[type] = ChannelCounts(1, nofDetectors[type]);
+      fMultiplicity[type] = ChannelCounts(1, nofDetectors[type]+1);
+    }
+    fNofHits = 0;
+  }
+  ~HitHistograms(){};
+
+  //fill the hits of one FIFO event
+  void Fill(const std::vector<Hit>& hits) {
+    std::array<size_t, NOF_DETECTOR_TYPES> multiplicity;
+    multiplicity.fill(0);
+
+    for(const auto& hit : hits) {
+      if(hit.fDetectorType >= NOF_DETECTOR_TYPES || hit.fDetectorNumber >= fEnergy[hit.fDetectorType].NofRows()) {
+	continue;
+      }
+      fEnergy[hit.fDetectorType].Fill(hit.fDetectorNumber, hit.fRawEnergy);
+      //hits without tdc information have no time
+      if(hit.fTdcHits > 0) {
+	fTime[hit.fDetectorType].Fill(hit.fDetectorNumber, hit.fTime);
+      }
+      fHitPattern[hit.fDetectorType].Fill(0, hit.fDetectorNumber);
+      ++multiplicity[hit.fDetectorType];
+    }
+
+    //only detector types present in this FIFO event are counted (each bank holds one detector type)
+    for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+      if(multiplicity[type] > 0) {
+	fMultiplicity[type].Fill(0, multiplicity[type]);
+      }
+    }
+
+    //only this thread writes the number of hits, so it doesn't need an atomic increment
+    fNofHits.store(fNofHits.load(std::memory_order_relaxed) + hits.size(), std::memory_order_relaxed);
+  }
+
+  void Reset() {
+    for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+      fEnergy[type].Reset();
+      fTime[type].Reset();
+      fHitPattern[type].Reset();
+      fMultiplicity[type].Reset();
+    }
+    fNofHits.store(0, std::memory_order_relaxed);
+  }
+
+  const ChannelCounts& Energy(size_t type) const {
+    return fEnergy[type];
+  }
+  const ChannelCounts& Time(size_t type) const {
+    return fTime[type];
+  }
+  const ChannelCounts& HitPattern(size_t type) const {
+    return fHitPattern[type];
+  }
+  const ChannelCounts& Multiplicity(size_t type) const {
+    return fMultiplicity[type];
+  }
+  //can be read while another thread fills the counts (e.g. for status updates)
+  size_t NofHits() const {
+    return fNofHits.load(std::memory_order_relaxed);
+  }
+
+private:
+  std::array<ChannelCounts, NOF_DETECTOR_TYPES> fEnergy;
+  std::array<ChannelCounts, NOF_DETECTOR_TYPES> fTime;
+  std::array<ChannelCounts, NOF_DETECTOR_TYPES> fHitPattern;
+  std::array<ChannelCounts, NOF_DETECTOR_TYPES> fMultiplicity;
+  std::atomic<size_t> fNofHits;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "LineMatcher.hh"
+
+#include <iostream>
+#include <cmath>
+#include <map>
+#include <algorithm>
+
+#include "LinearSystem.hh"
+
+namespace {
+  //energies (keV) and intensities (per 100 decays) from ENSDF, only lines above 1 %
+  const std::map<std::string, std::vector<SourceLine> > gSources = {
+    { "22Na", { { 511., 180.7 }, { 1274.537, 99.94 } } },
+    { "57Co", { { 14.413, 9.16 }, { 122.061, 85.60 }, { 136.474, 10.68 } } },
+    { "60Co", { { 1173.228, 99.85 }, { 1332.492, 99.98 } } },
+    { "88Y", { { 898.042, 93.7 }, { 1836.063, 99.2 } } },
+    { "133Ba", { { 53.162, 2.14 }, { 79.614, 2.65 }, { 80.998, 32.9 }, { 276.399, 7.16 }, { 302.851, 18.34 }, { 356.013, 62.05 }, { 383.849, 8.94 } } },
+    { "137Cs", { { 661.657, 85.10 } } },
+    { "152Eu", { { 121.782, 28.53 }, { 244.697, 7.55 }, { 344.279, 26.59 }, { 411.117, 2.24 }, { 443.961, 2.83 }, { 778.905, 12.93 }, { 867.380, 4.23 },
+		 { 964.057, 14.51 }, { 1085.837, 10.11 }, { 1112.076, 13.67 }, { 1212.948, 1.42 }, { 1299.142, 1.63 }, { 1408.013, 20.87 } } },
+    { "207Bi", { { 569.698, 97.75 }, { 1063.656, 74.5 }, { 1770.228, 6.87 } } },
+    { "241Am", { { 26.345, 2.31 }, { 59.541, 35.9 } } },
+    { "56Co", { { 846.770, 99.94 }, { 977.372, 1.42 }, { 1037.843, 14.05 }, { 1175.101, 2.25 }, { 1238.288, 66.46 }, { 1360.212, 4.28 }, { 1771.357, 15.41 },
+		{ 2015.215, 3.02 }, { 2034.791, 7.77 }, { 2598.500, 16.97 }, { 3009.645, 1.04 }, { 3201.954, 3.21 }, { 3253.503, 7.93 }, { 3272.990, 1.88 } } },
+    //room background
+    { "40K", { { 1460.820, 10.66 } } },
+    { "208Tl", { { 510.77, 22.6 }, { 583.187, 85.0 }, { 860.557, 12.5 }, { 2614.511, 99.75 } } }
+  };
+
+  //case-insensitive lookup
+  std::map<std::string, std::vector<SourceLine> >::const_iterator FindSource(const std::string& name) {
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for(auto it = gSources.begin(); it != gSources.end(); ++it) {
+      std::string key = it->first;
+      std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+      if(key == lower) {
+	return it;
+      }
+    }
+    return gSources.end();
+  }
+
+  double Evaluate(const std::vector<double>& coefficients, double x) {
+    double result = 0.;
+    for(size_t i = coefficients.size(); i > 0; --i) {
+      result = result*x + coefficients[i-1];
+    }
+    return result;
+  }
+
+  double Derivative(const std::vector<double>& coefficients, double x) {
+    double result = 0.;
+    for(size_t i = coefficients.size(); i > 1; --i) {
+      result = result*x + (i-1)*coefficients[i-1];
+    }
+    return result;
+  }
+}
+
+LineMatcher::LineMatcher(Settings* settings) {
+  fSettings = settings;
+  fTolerance = settings->MatchTolerance();
+  fMinGain = settings->MatchMinGain();
+  fMaxGain = settings->MatchMaxGain();
+  fMinLines = std::max(settings->MatchMinLines(), 2);
+}
+
+bool LineMatcher::SourceLines(const std::string& name, std::vector<SourceLine>& lines) {
+  auto source = FindSource(name);
+  if(source == gSources.end()) {
+    return false;
+  }
+  lines = source->second;
+  return true;
+}
+
+std::vector<std::string> LineMatcher::KnownSources() {
+  std::vector<std::string> result;
+  for(const auto& source : gSources) {
+    result.push_back(source.first);
+  }
+  return result;
+}
+
+bool LineMatcher::Sources(const std::vector<std::string>& sources) {
+  fLines.clear();
+  std::vector<SourceLine> lines;
+  for(const auto& source : sources) {
+    if(!SourceLines(source, lines)) {
+      return false;
+    }
+    for(const auto& line : lines) {
+      if(line.fIntensity >= fSettings->MatchMinIntensity()) {
+	fLines.push_back(line);
+      }
+    }
+  }
+  std::sort(fLines.begin(), fLines.end(), [](const SourceLine& a, const SourceLine& b) { return a.fEnergy < b.fEnergy; });
+  //lines of different sources at the same energy (e.g. 511 keV) are only matched once
+  fLines.erase(std::unique(fLines.begin(), fLines.end(), [](const SourceLine& a, const SourceLine& b) { return std::fabs(a.fEnergy - b.fEnergy) < 0.5; }), fLines.end());
+
+  return true;
+}
+
+bool LineMatcher::Match(const std::vector<FoundPeak>& peaks, LineMatch& match) {
+  match.fCoefficients.clear();
+  match.fPeaks.clear();
+  match.fResidual = 0.;
+  match.fNofHypotheses = 0;
+
+  std::vector<double> positions;
+  for(const auto& peak : peaks) {
+    positions.push_back(peak.fPosition);
+  }
+  std::sort(positions.begin(), positions.end());
+  if(positions.size() < fMinLines || fLines.size() < fMinLines) {
+    return false;
+  }
+
+  //each pair of peaks and pair of lines defines a mapping (the order has to be the same, the gain is positive)
+  size_t bestScore = 0;
+  double bestSquares = 0.;
+  double bestGain = 0.;
+  double bestPosition = 0.;
+  double bestEnergy = 0.;
+  for(size_t first = 0; first < positions.size(); ++first) {
+    for(size_t second = first + 1; second < positions.size(); ++second) {
+      double distance = positions[second] - positions[first];
+      if(distance <= 0.) {
+	continue;
+      }
+      for(size_t low = 0; low < fLines.size(); ++low) {
+	for(size_t high = low + 1; high < fLines.size(); ++high) {
+	  double gain = (fLines[high].fEnergy - fLines[low].fEnergy)/distance;
+	  //the lines are ordered, so the gain only gets larger
+	  if(gain > fMaxGain) {
+	    break;
+	  }
+	  if(gain < fMinGain) {
+	    continue;
+	  }
+	  ++match.fNofHypotheses;
+	  double squares;
+	  size_t score = Score(positions, positions[first], fLines[low].fEnergy, gain, squares);
+	  if(score > bestScore || (score == bestScore && squares < bestSquares)) {
+	    bestScore = score;
+	    bestSquares = squares;
+	    bestGain = gain;
+	    bestPosition = positions[first];
+	    bestEnergy = fLines[low].fEnergy;
+	  }
+	}
+      }
+    }
+  }
+  if(bestScore < fMinLines) {
+    if(fSettings->VerbosityLevel() > 2) {
+      std::cout<<"best of "<<match.fNofHypotheses<<" mappings matches only "<<bestScore<<" lines"<<std::endl;
+    }
+    return false;
+  }
+
+  //refine the mapping with all matched peaks until the matches don't change anymore
+  match.fCoefficients = { bestEnergy - bestGain*bestPosition, bestGain };
+  size_t nofMatched = Collect(positions, match);
+  for(int iteration = 0; iteration < 5; ++iteration) {
+    std::vector<std::pair<double, double> > previous = match.fPeaks;
+    if(!Fit(match)) {
+      return false;
+    }
+    nofMatched = Collect(positions, match);
+    if(match.fPeaks == previous) {
+      break;
+    }
+  }
+  if(fSettings->VerbosityLevel() > 2) {
+    std::cout<<"matched "<<nofMatched<<" of "<<fLines.size()<<" lines to "<<positions.size()<<" peaks ("<<match.fNofHypotheses<<" mappings, rms "<<match.fResidual<<" channels)"<<std::endl;
+  }
+
+  return nofMatched >= fMinLines;
+}
+
+size_t LineMatcher::Score(const std::vector<double>& positions, double position, double energy, double gain, double& squares) {
+  size_t score = 0;
+  squares = 0.;
+  for(const auto& line : fLines) {
+    double expected = position + (line.fEnergy - energy)/gain;
+    //closest peak
+    auto it = std::lower_bound(positions.begin(), positions.end(), expected);
+    double difference = fTolerance;
+    if(it != positions.end()) {
+      difference = std::min(difference, *it - expected);
+    }
+    if(it != positions.begin()) {
+      difference = std::min(difference, expected - *(it - 1));
+    }
+    if(difference < fTolerance) {
+      ++score;
+      squares += difference*difference;
+    }
+  }
+
+  return score;
+}
+
+size_t LineMatcher::Collect(const std::vector<double>& positions, LineMatch& match) {
+  //closest line for each peak, the tolerance is in channels so the energy difference is divided by the local gain
+  std::vector<int> line(positions.size(), -1);
+  std::vector<double> difference(positions.size(), fTolerance);
+  for(size_t peak = 0; peak < positions.size(); ++peak) {
+    double energy = Evaluate(match.fCoefficients, positions[peak]);
+    double gain = Derivative(match.fCoefficients, positions[peak]);
+    if(gain <= 0.) {
+      continue;
+    }
+    for(size_t i = 0; i < fLines.size(); ++i) {
+      double distance = std::fabs(fLines[i].fEnergy - energy)/gain;
+      if(distance < difference[peak]) {
+	difference[peak] = distance;
+	line[peak] = i;
+      }
+    }
+  }
+  //of several peaks close to the same line only the closest one is kept
+  for(size_t peak = 0; peak < positions.size(); ++peak) {
+    for(size_t other = 0; other < positions.size() && line[peak] >= 0; ++other) {
+      if(other != peak && line[other] == line[peak] && (difference[other] < difference[peak] || (difference[other] == difference[peak] && other < peak))) {
+	line[peak] = -1;
+      }
+    }
+  }
+
+  match.fPeaks.clear();
+  double squares = 0.;
+  for(size_t peak = 0; peak < positions.size(); ++peak) {
+    if(line[peak] >= 0) {
+      match.fPeaks.push_back(std::make_pair(positions[peak], fLines[line[peak]].fEnergy));
+      squares += difference[peak]*difference[peak];
+    }
+  }
+  match.fResidual = match.fPeaks.empty() ? 0. : std::sqrt(squares/match.fPeaks.size());
+
+  return match.fPeaks.size();
+}
+
+//normal equations of the straight line with the positions scaled to [0,1] (the channels would make them badly conditioned)
+bool LineMatcher::Fit(LineMatch& match) {
+  const int n = 2;
+  if(match.fPeaks.size() < (size_t) n) {
+    return false;
+  }
+  double scale = 1.;
+  for(const auto& peak : match.fPeaks) {
+    scale = std::max(scale, std::fabs(peak.first));
+  }
+  std::vector<double> matrix(n*n, 0.);
+  std::vector<double> vector(n, 0.);
+  for(const auto& peak : match.fPeaks) {
+    double x = peak.first/scale;
+    matrix[0] += 1.;
+    matrix[1] += x;
+    matrix[3] += x*x;
+    vector[0] += peak.second;
+    vector[1] += x*peak.second;
+  }
+  matrix[2] = matrix[1];
+  if(!SolveLinearSystem(matrix, vector, n)) {
+    return false;
+  }
+  //back to channels
+  match.fCoefficients = { vector[0], vector[1]/scale };
+
+  return true;
+}
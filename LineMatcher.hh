@@ -0,0 +1,68 @@
+#ifndef __LINE_MATCHER_HH
+#define __LINE_MATCHER_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "PeakFinder.hh"
+
+//gamma line of a calibration source
+struct SourceLine {
+  double fEnergy;//keV
+  double fIntensity;//per 100 decays
+};
+
+//best mapping of the found peaks onto the source lines, energy = sum_i fCoefficients[i]*position^i
+struct LineMatch {
+  std::vector<double> fCoefficients;
+  std::vector<std::pair<double, double> > fPeaks;//position and energy of the matched peaks, ordered by position
+  double fResidual;//rms of the matched peaks (channels)
+  size_t fNofHypotheses;//number of mappings that were tried
+};
+
+//matches the peaks found in a spectrum to the lines of the calibration sources, so that no rough windows
+//have to be set by hand:
+//each pair of peaks and pair of lines (in the same order) defines a linear mapping, all of these with a gain within the limits are
+//scored by the number of lines that have a peak within the tolerance at their mapped position (a RANSAC search that tries all
+//minimal samples, which are few enough for the strongest peaks); the best mapping is refined by linear least squares fits of all
+//matched peaks (the calibration is linear as well) with the matches collected again after each fit
+class LineMatcher {
+public:
+  LineMatcher(Settings*);
+  ~LineMatcher(){};
+
+  //lines of a source from the built-in library (e.g. 152Eu, 60Co, 133Ba), returns false if the source is unknown
+  static bool SourceLines(const std::string&, std::vector<SourceLine>&);
+  static std::vector<std::string> KnownSources();
+
+  //sets the lines to match, lines below the minimum intensity are skipped, returns false if a source is unknown
+  bool Sources(const std::vector<std::string>&);
+  const std::vector<SourceLine>& Lines() {
+    return fLines;
+  }
+
+  //returns false if fewer than the minimum number of lines could be matched
+  bool Match(const std::vector<FoundPeak>&, LineMatch&);
+
+private:
+  //number of lines with a peak within the tolerance of their position given by a linear mapping (through a peak and a line),
+  //and the sum of the squared distances (channels)
+  size_t Score(const std::vector<double>&, double, double, double, double&);
+  //collects the peaks within the tolerance of a line for the mapping of the match, each line and each peak is matched at most once,
+  //returns the number of matched lines
+  size_t Collect(const std::vector<double>&, LineMatch&);
+  //least squares fit of a straight line to the matched peaks
+  bool Fit(LineMatch&);
+
+  Settings* fSettings;
+  std::vector<SourceLine> fLines;//ordered by energy
+  double fTolerance;//channels
+  double fMinGain;//keV/channel
+  double fMaxGain;
+  size_t fMinLines;
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __LINEAR_SYSTEM_HH
+#define __LINEAR_SYSTEM_HH
+
+#include <vector>
+#include <cmath>
+#include <utility>
+
+//solves the n x n system a*x = b (a is stored row by row) in place by gaussian elimination with partial pivoting,
+//b becomes x and a is destroyed; returns false if the matrix is singular
+inline bool SolveLinearSystem(std::vector<double>& a, std::vector<double>& b, int n) {
+  for(int column = 0; column < n; ++column) {
+    int pivot = column;
+    for(int row = column + 1; row < n; ++row) {
+      if(std::fabs(a[row*n + column]) > std::fabs(a[pivot*n + column])) {
+	pivot = row;
+      }
+    }
+    if(a[pivot*n + column] == 0.) {
+      return false;
+    }
+    if(pivot != column) {
+      for(int i = 0; i < n; ++i) {
+	std::swap(a[pivot*n + i], a[column*n + i]);
+      }
+      std::swap(b[pivot], b[column]);
+    }
+    for(int row = column + 1; row < n; ++row) {
+      double factor = a[row*n + column]/a[column*n + column];
+      for(int i = column; i < n; ++i) {
+	a[row*n + i] -= factor*a[column*n + i];
+      }
+      b[row] -= factor*b[column];
+    }
+  }
+  for(int row = n - 1; row >= 0; --row) {
+    for(int i = row + 1; i < n; ++i) {
+      b[row] -= a[row*n + i]*b[i];
+    }
+    b[row] /= a[row*n + row];
+  }
+  return true;
+}
+
+#endif
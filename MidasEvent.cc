@@ -0,0 +1,134 @@
+#include "MidasEvent.hh"
+
+#include <iomanip>
+#include <cassert>
+
+//---------------------------------------- Bank
+void Bank::Print(bool hexFormat, bool printBankContents) {
+  if(hexFormat) {
+    std::cout<<std::hex<<"Bank Number: 0x"<<fNumber<<", Bankname: "<<fName[0]<<fName[1]<<fName[2]<<fName[3]<<", Type: 0x"<<fType<<", Banksize: 0x"<<fData.size()<<", Number of Extra Bytes: 0x"<<fExtraBytes.size();
+    
+    if(printBankContents) {
+      for(size_t i = 0; i < fData.size(); i++) {
+	if(i%8 == 0) {
+	  std::cout<<std::endl<<"0x";
+	}
+	std::cout<<std::setw(8)<<std::setfill('0')<<fData[i]<<" ";
+      }
+    }
+    std::cout<<std::dec<<std::setfill(' ')<<std::endl;
+  } else {
+    std::cout<<"Bank Number: "<<fNumber<<", Bankname: "<<fName[0]<<fName[1]<<fName[2]<<fName[3]<<", Type: "<<fType<<", Banksize: "<<fData.size()<<", Number of Extra Bytes: "<<fExtraBytes.size()<<std::dec<<std::endl;
+
+    if(printBankContents) {
+      for(size_t i = 0; i < fData.size(); i++) {
+	if(i%8 == 0 && i != 0) {
+	  std::cout<<std::endl;
+	}
+	std::cout<<fData[i]<<" ";
+      }
+      std::cout<<std::endl;
+    }
+  }
+}
+
+bool Bank::Get(uint16_t& value) {
+  //peek at the value and then advance the read point
+  Peek(value);
+  ++fReadPoint;
+  return true;
+}
+
+bool Bank::Get(uint32_t& value) {
+  //peek at the value and then advance the read point
+  Peek(value);
+  fReadPoint += 2;
+  return true;
+}
+
+bool Bank::Get(float& value) {
+  //peek at the value and then advance the read point
+  Peek(value);
+  fReadPoint += 2;
+  return true;
+}
+
+bool Bank::Peek(uint16_t& value) {
+  //std::cout<<"Peeking 16bits at "<<fReadPoint<<std::endl;
+  //fReadPoint counts the 16bit values, but data contains 32bit values
+  if(fReadPoint/2 >= fData.size()) {
+    //std::cerr<<__PRETTY_FUNCTION__<<": end of buffer reached in event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words"<<std::endl;
+    //Print(true, true);
+    value = 0;
+    return false;
+  }
+  if(fReadPoint%2 == 0) {
+    value = fData[fReadPoint/2] >> 16;
+  } else {
+    value = fData[fReadPoint/2] & 0xffff;
+  }
+  return true;
+}
+
+bool Bank::Peek(uint32_t& value) {
+  //std::cout<<"Peeking 32bits at "<<fReadPoint<<std::endl;
+  //fReadPoint counts the 16bit values, but data contains 32bit values
+  if((fReadPoint+1)/2 >= fData.size()) {
+    //std::cerr<<__PRETTY_FUNCTION__<<": end of buffer reached in event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words"<<std::endl;
+    //Print(true, true);
+    value = 0;
+    return false;
+  }
+  if(fReadPoint%2 != 0) {
+    //std::cerr<<__PRETTY_FUNCTION__<<": trying to read 32bits after an odd number of 16bit words have been read! Event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words, fData[fReadPoint/2] 0x"<<std::hex<<fData[fReadPoint/2]<<", 0x"<<fData[(fReadPoint+1)/2];
+    //get the low word of fReadPoint/2 and the high word of (fReadPoint+1)/2
+    value = ((fData[fReadPoint/2] & 0xffff) << 16) | ((fData[(fReadPoint+1)/2] & 0xffff0000) >> 16);
+    //std::cerr<<", value 0x"<<value<<std::dec<<std::endl;
+  } else {
+    value = fData[fReadPoint/2];
+  }
+
+  return true;
+}
+
+bool Bank::Peek(float& value) {
+  assert(sizeof(float) == sizeof(uint32_t));
+  //fReadPoint counts the 16bit values, but data contains 32bit values
+  if(fReadPoint/2 >= fData.size()) {
+    //std::cerr<<__PRETTY_FUNCTION__<<": end of buffer reached in event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words"<<std::endl;
+    //Print(true, true);
+    value = 0;
+    return false;
+  }
+  memcpy(&value,&(fData[fReadPoint/2]),sizeof(float));
+  return true;
+}
+
+//---------------------------------------- Event
+void MidasEvent::Zero() {
+  fBanks.clear();
+  fType = 0;
+  fMask = 0;
+  fNumber = 0;
+  fTime = 0;
+  fNofBytes = 0;
+  
+  fTotalBankBytes = 0;
+  fFlags = 0;
+}
+
+void MidasEvent::Print(bool hexFormat, bool printBanks, bool printBankContents) {
+  if(hexFormat) {
+    std::cout<<std::hex<<"Eventtype: 0x"<<fType<<", Eventmask: 0x"<<fMask<<", Eventnumber: 0x"<<fNumber<<", Eventtime: 0x"<<fTime<<", Number of Event Bytes: "<<std::dec<<fNofBytes<<std::endl
+	<<std::hex<<"Total Bank Bytes: 0x"<<fTotalBankBytes<<", Flags: 0x"<<fFlags<<", Number of Banks: "<<std::dec<<fBanks.size()<<std::endl;
+  }  else {
+    std::cout<<"Eventtype: "<<fType<<", Eventmask: "<<fMask<<", Eventnumber: "<<fNumber<<", Eventtime: "<<fTime<<", Number of Event Bytes: "<<fNofBytes<<std::endl
+	<<"Total Bank Bytes: "<<fTotalBankBytes<<", Flags: "<<fFlags<<", Number of Banks: "<<fBanks.size()<<std::endl;
+  }
+  
+  if(printBanks) {
+    for(auto& bank : fBanks) {
+      bank.Print(hexFormat, printBankContents);
+    }
+  }
+}
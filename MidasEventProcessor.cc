@@ -2,12 +2,18 @@
 
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
 
 #include "TROOT.h"
 #include "TFile.h"
 #include "TDirectory.h"
 #include "TF1.h"
 #include "TList.h"
+#include "TH1D.h"
+#include "TH2I.h"
+#include "THnSparse.h"
 //#include "TStopwatch.h"
 
 #include "Utilities.hh"
@@ -16,34 +22,51 @@
 #include "MidasFileManager.hh"
 
 //make MidasEventProcessor a singleton???
-MidasEventProcessor::MidasEventProcessor(Settings* settings, TFile* file, TTree* tree, std::string statisticsFile, bool statusUpdate) {  
+MidasEventProcessor::MidasEventProcessor(Settings* settings, TFile* file, std::string statisticsFile, bool statusUpdate, SettingsManager* settingsManager)
+  : fDecoder(settings), fCalibration(settings), fTiming(settings), fDrift(settings), fBuilder(settings), fColumnarWriter(settings), fHitHistograms(settings) {
   fSettings = settings;
   fRootFile = file;
-  fTree = tree;
+  fSettingsManager = settingsManager;
+  //the given settings are the first snapshot (not owned)
+  fDecodeSettings.reset(settings, [](Settings*) {});
+  fDecodeGeneration = 0;
+  fBuildSettings = fDecodeSettings;
+  fBuildGeneration = 0;
   fStatus = kRun;
+  fCalibrate = false;
+  fTimed = false;
+  //this thread does the decoding, which isn't part of the steady state of the event building and output
+  AllocationCounter::ExcludeThread();
 
-  //attach leaf to tree
-  int BufferSize = 1024000;
-  fTree->Branch("Event",&fLeaf, BufferSize);
-  fTree->BranchRef();
-
-  //increase maximum tree size to 10GB
-  Long64_t GByte = 1073741824L;
-  fTree->SetMaxTreeSize(10*GByte);
-
-  fLastCycle = 0;
-  fEventsInCycle = 0;
+  //in histogram-only mode nothing is built or written besides the histograms
+  fWriter = nullptr;
+  if(!fSettings->HistogramsOnly()) {
+    fWriter = new TreeWriter(settings, file);
+    if(!fSettings->ColumnarFileName().empty()) {
+      fColumnarWriter.Open(fSettings->ColumnarFileName());
+    }
+  }
 
-  fNofReadDetectors = 0;
   fNofBuiltEvents = 0;
-
-  fTemperatureFile.open(fSettings->TemperatureFile());
-
-  //set size of circular buffer for read detectors
-  //fReadDetector.set_capacity(fSettings->ReadBufferSize());
+  fNofFilledEvents = 0;
+  fNofFinishedCycles = 0;
+  fSteady = false;
+  fSteadyAllocations = 0;
+  fSteadyEvents = 0;
+  fNofMergedHits = 0;
 
   //set size of circular buffer for built events
-  fBuiltEvents.set_capacity(fSettings->BuiltEventsSize());
+  fBuildBatch.Grow(fSettings->BuiltEventsSize());
+  fWriteBatch.Grow(fSettings->BuiltEventsSize());
+  fBuildBatchCycleEnds = 0;
+  fWriteBatchCycleEnds = 0;
+  fBatchReady = false;
+  fHandOverWait = std::chrono::high_resolution_clock::duration::zero();
+  fFillWait = std::chrono::high_resolution_clock::duration::zero();
+  fConvertTime = std::chrono::high_resolution_clock::duration::zero();
+  fFillTime = std::chrono::high_resolution_clock::duration::zero();
+  fColumnarTime = std::chrono::high_resolution_clock::duration::zero();
+  fWriteTime = std::chrono::high_resolution_clock::duration::zero();
 
   //for each detector type:
   uint8_t detType;
@@ -78,20 +101,34 @@ MidasEventProcessor::MidasEventProcessor(Settings* settings, TFile* file, TTree*
 						  fSettings->MaxBaF2Channel(),0.,(double)fSettings->MaxBaF2Channel());
   }
 
-  if(fSettings->VerbosityLevel() > 2) {
-    fDataFile.open("Data.dat");
+  //create tdc time, hit pattern, and multiplicity histograms with the same number of detectors
+  fTimingHistograms.resize(fRawEnergyHistograms.size());
+  fHitPatternHistograms.resize(fRawEnergyHistograms.size());
+  fMultiplicityHistograms.resize(fRawEnergyHistograms.size());
+  for(size_t type = 0; type < fRawEnergyHistograms.size(); ++type) {
+    int nofDetectors = fRawEnergyHistograms[type].size();
+    fTimingHistograms[type].resize(nofDetectors);
+    for(int det = 0; det < nofDetectors; ++det) {
+      fTimingHistograms[type][det] = new TH1I(Form("time%s_%d",fDetectorTypeNames[type],det),Form("time%s_%d",fDetectorTypeNames[type],det),
+					      fSettings->MaxTdcChannel(),0.,(double)fSettings->MaxTdcChannel());
+    }
+    fHitPatternHistograms[type] = new TH1I(Form("hitPattern%s",fDetectorTypeNames[type]),Form("%s hit pattern;detector;counts",fDetectorTypeNames[type]),
+					   nofDetectors,0.,(double)nofDetectors);
+    fMultiplicityHistograms[type] = new TH1I(Form("multiplicity%s",fDetectorTypeNames[type]),Form("%s hits per FIFO event;multiplicity;counts",fDetectorTypeNames[type]),
+					     nofDetectors+1,0.,(double)(nofDetectors+1));
   }
 
-
   //-------------------- the threads
   //is this done best with async and yield, or should I use threads and promises, or maybe condition variables
   //seems that ayncs lets some threads "disappear", i.e. they're not scheduled anymore
 
-  //start event building thread (takes events from input buffer and combines them into build events in the output buffer)
-  fThreads.push_back(std::make_pair(0,std::async(std::launch::async, &MidasEventProcessor::BuildEvents, this)));
-  //start output thread (writes event in the output buffer to file/tree)
-  fThreads.push_back(std::make_pair(1,std::async(std::launch::async, &MidasEventProcessor::FillTree, this)));
-  fThreads.push_back(std::make_pair(2,std::async(std::launch::async, &MidasEventProcessor::BufferStatus, this, statisticsFile)));
+  if(!fSettings->HistogramsOnly()) {
+    //start event building thread (takes events from input buffer and combines them into build events in the output buffer)
+    fThreads.push_back(std::make_pair(0,std::async(std::launch::async, &MidasEventProcessor::BuildEvents, this)));
+    //start output thread (writes event in the output buffer to file/tree)
+    fThreads.push_back(std::make_pair(1,std::async(std::launch::async, &MidasEventProcessor::FillTree, this)));
+    fThreads.push_back(std::make_pair(2,std::async(std::launch::async, &MidasEventProcessor::BufferStatus, this, statisticsFile)));
+  }
   if(statusUpdate) {
     fThreads.push_back(std::make_pair(3,std::async(std::launch::async, &MidasEventProcessor::StatusUpdate, this)));
   }
@@ -102,10 +139,22 @@ MidasEventProcessor::MidasEventProcessor(Settings* settings, TFile* file, TTree*
 }
 
 MidasEventProcessor::~MidasEventProcessor() {
-  fTemperatureFile.close();
-  if(fDataFile.is_open()) {
-    fDataFile.close();
+  delete fWriter;
+}
+
+void MidasEventProcessor::Run(int runNumber) {
+  if(!fSettings->TimingFileName().empty()) {
+    fTimed = fTiming.Load(EnergyCalibration::FileName(fSettings->TimingFileName(), runNumber));
+  }
+  if(fSettings->CalibrationFileName().empty()) {
+    if(fSettings->TrackDrift()) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"Drift tracking needs calibrated energies, no calibration file given"<<Attribs::Reset<<std::endl;
+    }
+  } else {
+    fCalibrate = fCalibration.Load(EnergyCalibration::FileName(fSettings->CalibrationFileName(), runNumber));
   }
+  //the matrices use the calibrated energies if there are any
+  fBuilder.CalibratedEnergies(fCalibrate);
 }
 
 bool MidasEventProcessor::Process(MidasEvent& event) {
@@ -128,9 +177,15 @@ bool MidasEventProcessor::Process(MidasEvent& event) {
     break;
 
   case CAMACSCALEREVENT:
-    CamacScalerEvent(event, fMcs);
-    //end of cycle
-    fClockState.Update(event.Time());
+    fDecoder.CamacScalerEvent(event);
+    //end of cycle, all hits of this cycle can be built now
+    fDecoder.EndOfCycle(event.Time());
+    if(fSettings->TrackDrift() && fDrift.SliceByCycle()) {
+      fDrift.EndOfSlice();
+    }
+    if(!fSettings->HistogramsOnly()) {
+      fBuilder.EndOfCycle();
+    }
     //#ifdef CYCLE_MODE
     //    //end
     //
@@ -148,7 +203,7 @@ bool MidasEventProcessor::Process(MidasEvent& event) {
     break;
 
   case SCALERSCALEREVENT:
-    CamacScalerEvent(event, fMcs);
+    fDecoder.CamacScalerEvent(event);
     break;
 
   case ISCALEREVENT:
@@ -162,12 +217,18 @@ bool MidasEventProcessor::Process(MidasEvent& event) {
     break;
 
   case EPICSEVENTTYPE:
-    EpicsEvent(event);
+    {
+      size_t nofTemperatures = fDecoder.NofTemperatures();
+      fDecoder.EpicsEvent(event);
+      if(fDecoder.NofTemperatures() > nofTemperatures) {
+	fDrift.Temperature(fDecoder.Temperature());
+      }
+    }
     break;
 
   case FILEEND:
     if(fSettings->VerbosityLevel() > 0) {
-      std::cout<<Show("Reached file end, got ",fClockState.NofStoredCycles()," cycles.")<<std::endl;
+      std::cout<<Show("Reached file end, got ",fDecoder.NofStoredCycles()," cycles.")<<std::endl;
     }
     Flush();
     break;
@@ -185,926 +246,358 @@ bool MidasEventProcessor::Process(MidasEvent& event) {
   return true;
 }
 
-//---------------------------------------- different midas event types ----------------------------------------
+//decode the FIFO event, fill the histograms, and pass the hits on to the event builder
 bool MidasEventProcessor::FifoEvent(MidasEvent& event) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Found FIFO event in midas event ",event.Number())<<std::endl;
+  if(fSettingsManager != nullptr && fSettingsManager->Generation() != fDecodeGeneration) {
+    SwitchDecodeSettings();
   }
-  uint32_t fifoStatus = 0;
-  uint32_t feraWords = 0;
-  uint32_t fifoSerial = 0;
-
-  size_t feraEnd = 0;
 
-  size_t currentFeraStart;
-
-  if(fSettings->VerbosityLevel() > 1) {
-    //check for missed events
-    if(event.Number() != (fLastEventNumber + 1)) {
-      std::cerr<<Show(Foreground::Red(),"Missed ",event.Number() - fLastEventNumber - 1," FIFO data events, between events ",fLastEventNumber," and ",event.Number(),Attribs::Reset())<<std::endl;
-    }
-
-    //Check if events are ordered by time
-    if(event.Time() < fLastEventTime) {
-      std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"FIFO event ",event.Number()," occured before the last event ",fLastEventNumber," (",event.Time()," < ",fLastEventTime,")",Attribs::Reset())<<std::endl;
-    }
+  if(!fDecoder.FifoEvent(event, fHits, fRecords)) {
+    return false;
   }
 
-  fLastEventNumber = event.Number();
-  fLastEventTime = event.Time();
-
-  //loop over banks
-  for(auto bank : event.Banks()) {
-    if(bank.Size() == 0) {
-      continue;
+  if(fCalibrate) {
+    fCalibration.Apply(fHits);
+    //the drift correction is applied on top of the calibration
+    if(fSettings->TrackDrift()) {
+      fDrift.Add(fHits);
     }
+  }
 
-    while(bank.GotData()) {
-      //Note: If there's multiple ferastreams in the bank, then this loop will run both of them.
-      //Further, in that case it will call the same event type multiple times, as the event type is in the bank header.
-      currentFeraStart = bank.ReadPoint();
-
-      //Check if it's a good FIFO event
-      bank.Get(fifoStatus);
-
-      //Check if this FIFO event is valid
-      if((fifoStatus != GOODFIFO1) && (fifoStatus != GOODFIFO2)) {
-	if(fSettings->VerbosityLevel() > 0) {
-	  std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid FIFO status ",std::hex,std::setw(8),std::setfill('0'),fifoStatus,std::dec," in event ",event.Number(),Attribs::Reset())<<std::endl;
-	}
-	//just continue???
-	continue;
-      }
-
-      bank.Get(feraWords);
-
-      //Check timeout and overflow bit in ferawords.
-      if(feraWords & 0x0000C000) {
-	if(fSettings->VerbosityLevel() > 1) {
-	  std::cerr<<Show(Foreground::Red(),"Event ",event.Number(),", bank ",bank.Number(),": FIFO overflow bit or timeout bit set: ",((feraWords>>14) & 0x3),Attribs::Reset())<<std::endl;
-	}
-      }
-
-      //get the number of fera words
-      feraWords = feraWords & FERAWORDS;
-
-      //Set feraEnd, need to account for the header words and the (not yet read) fifo serial
-      feraEnd = bank.ReadPoint()+2*feraWords + 4;
-
-      //Check if feraWords will fit in the buffer.
-      //feraEnd and readpoint count bytes, whereas size counts 32bit words!
-      if(feraEnd  > 2*bank.Size()) {
-	//Not enough room for ferawords in bankbuffer.
-	bank.SetReadPoint(2*bank.Size());
-	continue;
-      }
-
-      //Get fifoserial
-      bank.Get(fifoSerial);
-
-      //only the last byte contains information
-      fifoSerial = fifoSerial & 0xFF;
-
-      //increase counter and check serial for all banks
-      ++(fBankCounter[bank.IntName()]);
-      if(fifoSerial != ((fLastFifoSerial[bank.IntName()]+1) & 0xff)) {
-	if(fSettings->VerbosityLevel() > 0) {
-	  std::cerr<<Show(Foreground::Red(),"Missed a ",fSettings->DetectorType(bank.IntName())," FIFO serial in Event ",event.Number(),", Bank ",bank.Number(),", FIFO serial ",fifoSerial,", last FIFO serial ",fLastFifoSerial[bank.IntName()],Attribs::Reset())<<std::endl;
-	}
-      }
-      fLastFifoSerial[bank.IntName()] = fifoSerial;
-
-      //Now, do different things depending on the type of detector triggered.
-      switch(bank.IntName()) {
-      case FME_ZERO:
-	GermaniumEvent(bank, feraEnd, event.Time(), event.Number());
-	break;
-
-      case FME_ONE:
-	PlasticEvent(bank, feraEnd, event.Time(), event.Number());
-	break;
-
-      case FME_TWO:
-	BaF2Event(bank, feraEnd, event.Time(), event.Number());
-	break;
-
-      case FME_THREE:
-	SiliconEvent(bank, feraEnd, event.Time(), event.Number());
-	break;
-
-      default:
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Unknown bank name 0x",std::hex,bank.IntName(),std::dec," for bank ",bank.Number()," in midas event ",event.Number(),Attribs::Reset())<<std::endl;
-	break;
-      }
-
-      //Make sure that the readpoint is at the end of the fera data
-      //Readpoint should be offset by 12 bytes for the fera header, and 2 bytes per each fera word.
-      //If the number of fera words is odd, pad with an additional word.
-      bank.SetReadPoint(currentFeraStart + 2*(feraWords + (feraWords%2)) + 12);
+  if(fTimed) {
+    fTiming.Apply(fHits);
+  }
 
-      //If we're at the end of the bank, increment ferawords by 2 to bypass the junk.
-      if(bank.ReadPoint() == (bank.Size() - 2)) {
-	bank.SetReadPoint(bank.Size());
-      }
-    }//while(bank.GotData())
-  }//loop over banks
+  fHitHistograms.Fill(fHits);
 
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<"FIFO event done"<<std::endl;
+  if(!fSettings->HistogramsOnly()) {
+    fBuilder.Add(fHits, fRecords);
+  } else {
+    //the builder clears the hits it takes, without it they have to be dropped here
+    fHits.clear();
+    fRecords.Clear();
   }
 
-  //we've (hopefully) constructed a new event, so try and build an event from those we have stored, and fill the tree
-  BuildEvents();
-  FillTree();
-
   return true;
 }
 
-bool MidasEventProcessor::CamacScalerEvent(MidasEvent& event, std::vector<std::vector<uint16_t> > mcs) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Found Scaler event in midas event ",event.Number())<<std::endl;
-  }
-  uint32_t tmp;
-  //loop over banks
-  for(auto bank : event.Banks()) {
-    if(bank.IsBank("MCS0")) {
-      //reset mcs
-      mcs.resize(NOF_MCS_CHANNELS,std::vector<uint16_t>());
-      for(int i = 0; bank.GotBytes(2); ++i) {
-	bank.Get(tmp);
-	//tmp = ((tmp<<16)&0xffff0000) | ((tmp>>16)&0xffff);
-	mcs[i%NOF_MCS_CHANNELS].push_back(tmp);
-      }
-      //done (there shouldn't be another scaler bank)???
-      break;
-    }
-  }
-
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<"Scaler event done"<<std::endl;
+//the previous snapshot is freed once the other thread has switched as well (the calibration tables don't depend on the settings)
+void MidasEventProcessor::SwitchDecodeSettings() {
+  fDecodeGeneration = fSettingsManager->Generation();
+  std::shared_ptr<Settings> settings = fSettingsManager->Current();
+  fDecoder.SetSettings(settings.get());
+  fDecodeSettings = settings;
+  if(fSettings->VerbosityLevel() > 1) {
+    std::cout<<Show("Decoding with settings of generation ",fDecodeGeneration)<<std::endl;
   }
-
-  return true;
 }
 
-bool MidasEventProcessor::EpicsEvent(MidasEvent& event) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Found epics event in midas event ",event.Number())<<std::endl;
+void MidasEventProcessor::SwitchBuildSettings() {
+  fBuildGeneration = fSettingsManager->Generation();
+  std::shared_ptr<Settings> settings = fSettingsManager->Current();
+  fBuilder.SetSettings(settings.get());
+  fBuildSettings = settings;
+  if(fSettings->VerbosityLevel() > 1) {
+    std::cout<<Show("Building with settings of generation ",fBuildGeneration)<<std::endl;
   }
-  float tmp;
+}
 
-  //loop over banks or just get the right bank?
-  //for(auto& bank : event.Banks()) {
-  Bank bank = event.Banks()[1];
-  for(int j = 0; bank.GotData(); ++j) {
-    bank.Get(tmp);
-    //tmp = ((tmp<<16)&0xffff0000) | ((tmp>>16)&0xffff);
-    if(j==14) {
-      fTemperatureFile<<tmp<<std::endl;
-      break;
+//add the counts to the ROOT histograms and reset them, so they can be merged again later on
+void MidasEventProcessor::MergeHistograms() {
+  for(size_t type = 0; type < fRawEnergyHistograms.size(); ++type) {
+    for(size_t det = 0; det < fRawEnergyHistograms[type].size(); ++det) {
+      MergeCounts(fRawEnergyHistograms[type][det], fHitHistograms.Energy(type), det);
+      MergeCounts(fTimingHistograms[type][det], fHitHistograms.Time(type), det);
     }
+    MergeCounts(fHitPatternHistograms[type], fHitHistograms.HitPattern(type), 0);
+    MergeCounts(fMultiplicityHistograms[type], fHitHistograms.Multiplicity(type), 0);
   }
-  //}
-
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<"Epics event done"<<std::endl;
-  }
-
-  return true;
+  fNofMergedHits += fHitHistograms.NofHits();
+  fHitHistograms.Reset();
 }
 
-//---------------------------------------- different detector types ----------------------------------------
-
-void MidasEventProcessor::GermaniumEvent(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Starting on germanium event ",eventNumber)<<std::endl;
+//the bins of the histogram are the channels of the counts (bin 0 is the underflow)
+void MidasEventProcessor::MergeCounts(TH1I* histogram, const ChannelCounts& counts, size_t row) {
+  if(histogram == nullptr || row >= counts.NofRows()) {
+    return;
   }
-
-  uint16_t header;
-  uint16_t vsn;
-  uint16_t feraType;
-  uint16_t tmpEnergy;
-  std::vector<std::pair<uint16_t, uint16_t> > energy;
-  std::map<uint16_t, std::vector<uint16_t> > time;
-  Ulm ulm;
-
-  while(bank.ReadPoint() < feraEnd) {
-    bank.Get(header);
-
-    //skip all zeros
-    while(header == 0 && bank.ReadPoint() < feraEnd) {
-      //increment counter and get next word
-      ++fNofZeros[bank.IntName()];
-      bank.Get(header);
-    }
-
-    //get the module number
-    vsn = header & VHNMASK;
-
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA number = ",vsn)<<std::endl;
-    }
-
-    //get the module type (high bit has to be set)
-    if((header & 0x8000) != 0) {
-      feraType = header & VHTMASK;
-    } else {
-      feraType = BADFERA;
-    }
-
-    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
-    }
-
-    switch(feraType) {
-    case VHAD1141:
-      //Process the ADC, and check if it's followed immediately by a TDC
-      if(vsn >= fSettings->NofGermaniumDetectors()) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid detector number (",vsn,") in Event ",bank.EventNumber(),", Bank ",bank.Number(),Attribs::Reset())<<std::endl;
-      }
-      
-      if(GetAdc114(bank, feraEnd, tmpEnergy)) {
-	GetTdc3377(bank, feraEnd, time);
-	++fCounter[VH3377];
-      }
-      energy.push_back(std::make_pair(vsn, tmpEnergy));
-      ++fCounter[VHAD1141];
-      break;
-
-    case VHAD1142:
-      //Process the ADC, and check if it's followed immediately by a TDC
-      if((vsn + 16) >= fSettings->NofGermaniumDetectors()) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid detector number (",(vsn + 16),") in Event ",bank.EventNumber(),", Bank ",bank.Number(),Attribs::Reset())<<std::endl;
-      }
-
-      if(GetAdc114(bank, feraEnd, tmpEnergy)) {
-	GetTdc3377(bank, feraEnd, time);
-	++fCounter[VH3377];
-      }
-      energy.push_back(std::make_pair(vsn + 16, tmpEnergy));
-      ++fCounter[VHAD1142];
-      break;
-
-    case VH3377: /* 3377 TDC */
-      GetTdc3377(bank, feraEnd, time);
-      ++fCounter[VH3377];
-      break;
-
-    case VHFULM:  /* Universal Logic Module end of event marking, clocks, etc.. */
-      GetUlm(bank, ulm);
-      ++fCounter[VHFULM];
-      if(ulm.CycleNumber() != fLastCycle && fLastCycle != 0) {
-	if(fSettings->VerbosityLevel() > 0) {
-	  std::cout<<Show(ulm.CycleNumber(),". cycle: ",fEventsInCycle," events in last cycle")<<std::endl;
-	}
-	fEventsInCycle = 0;
-      } else {
-	++fEventsInCycle;
-      }
-      fLastCycle = ulm.CycleNumber();
-      break;
-
-    case BADFERA:
-      if(fSettings->VerbosityLevel() > 1) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Bad germanium fera",Attribs::Reset())<<std::endl;
-      }
-      ++fCounter[BADFERA];
-      bank.SetReadPoint(feraEnd);
-      break;
-
-    default: /* Unrecognized header */
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in germanium midas event ",eventNumber,", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
-      }
-      ++fNofUnkownFera[bank.IntName()];
-      //try and find the next header
-      bank.Get(header);
-      //skip all words until we find one with the high bit set
-      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
-	//increment counter and get next word
-	bank.Get(header);
-      }
-      //un-read the header (will be read again in the next iteration of the while-loop_
-      bank.ChangeReadPoint(-1);
-      break;
+  const uint32_t* bins = counts.Row(row);
+  for(size_t bin = 0; bin <= counts.NofBins(); ++bin) {
+    if(bins[bin] > 0) {
+      histogram->AddBinContent(bin+1, bins[bin]);
     }
   }
-
-  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
-    ConstructEvents(eventTime, eventNumber, EDetectorType::kGermanium, energy, time, ulm);
-  } else if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
-  }
+  //the statistics (entries, mean, ...) are recalculated from the bin contents
+  histogram->ResetStats();
 }
 
-void MidasEventProcessor::PlasticEvent(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Starting on plastic event ",eventNumber)<<std::endl;
-  }
-
-  uint16_t header;
-  uint16_t vsn;
-  uint16_t feraType;
-  std::vector<std::pair<uint16_t, uint16_t> > energy;
-  std::map<uint16_t, std::vector<uint16_t> > time;
-  Ulm ulm;
-
-  while(bank.ReadPoint() < feraEnd) {
-    bank.Get(header);
-
-    //skip all zeros
-    while(header == 0 && bank.ReadPoint() < feraEnd) {
-      //increment counter and get next word
-      ++fNofZeros[bank.IntName()];
-      bank.Get(header);
-    }
-
-    //get the module number
-    vsn = header & VHNMASK;
-
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA number = ",vsn)<<std::endl;
-    }
-
-    //get the module type (high bit has to be set)
-    if((header & 0x8000) != 0) {
-      feraType = header & VHTMASK;
-    } else {
-      feraType = BADFERA;
-    }
-
-    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
-    }
-
-    switch(feraType) {
-    case VH4300: //SCEPTAR ENERGY FERA
-      GetAdc4300(bank, header, vsn, energy);
-      ++fCounter[VH4300];
-      break;		    
-
-    case VH3377: // 3377 TDC
-      GetTdc3377(bank, feraEnd, time);
-      ++fCounter[VH3377];
-      break;
-
-    case VHFULM:  // Universal Logic Module end of event marking, clocks, etc..
-      GetUlm(bank, ulm);
-      ++fCounter[VHFULM];
-      break;
-
-    case BADFERA:
-      if(fSettings->VerbosityLevel() > 1) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Found bad fera event in plastic data stream",Attribs::Reset())<<std::endl;
-      }
-      ++fCounter[BADFERA];
-      bank.SetReadPoint(feraEnd);
-      break;
+//----------------------------------------
 
-    default: // Unrecognized header
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in plastic midas event ",bank.EventNumber(),", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
-      }
-      ++fNofUnkownFera[bank.IntName()];
-      //try and find the next header
-      bank.Get(header);
-      //skip all words until we find one with the high bit set
-      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
-	//increment counter and get next word
-	bank.Get(header);
+void MidasEventProcessor::Flush() {
+  //set status to flush (this triggers the flushing)
+  fStatus = kFlushRead;
+  //join all threads, i.e. wait for them to finish flushing
+  for(auto& thread : fThreads) {
+    //wait for the thread to be ready
+    if(thread.second.valid()) {
+      size_t nofWaits = 0;
+      while(thread.second.wait_for(std::chrono::milliseconds(STANDARD_WAIT_TIME))==std::future_status::timeout) {
+	if(nofWaits%10 == 0) {
+	  std::cout<<Attribs::Bright<<Foreground::Cyan<<Show("Waiting for thread ",thread.first," to finish: ",Status(),Attribs::Reset())<<std::endl;
+	}
+	++nofWaits;
       }
-      //un-read the header (will be read again in the next iteration of the while-loop_
-      bank.ChangeReadPoint(-1);
-      break;
+      std::cout<<Attribs::Bright<<Foreground::Cyan<<Show("Waited ",nofWaits*STANDARD_WAIT_TIME," ms for thread ",thread.first," to finish: ",Status(),Attribs::Reset())<<std::endl;
+    } else {
+      std::cout<<Show(Attribs::Bright(),Foreground::Blue(),"Thread ",thread.first," not valid",Attribs::Reset())<<std::endl;
+      continue;
     }
+    //check return status
+    std::cout<<Show(Attribs::Bright(),Foreground::Blue(),thread.second.get(),Attribs::Reset())<<std::endl;
   }
 
-  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
-    ConstructEvents(eventTime, eventNumber, EDetectorType::kPlastic, energy, time, ulm);
-  } else if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
-  }
-}
+  //without the builder and writer threads nobody else sets the status to done
+  fStatus = kDone;
 
-void MidasEventProcessor::SiliconEvent(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Starting on silicon event ",eventNumber)<<std::endl;
+  //this writes the tree(s) and the block index
+  if(fWriter != nullptr) {
+    fWriter->Close();
   }
+  fColumnarWriter.Close();
 
-  uint16_t header;
-  uint16_t vsn;
-  uint16_t feraType;
-  int nofAdcs = 0;
-  uint16_t tmpEnergy;
-  std::vector<std::pair<uint16_t, uint16_t> > energy;
-  std::map<uint16_t, std::vector<uint16_t> > time;
-  Ulm ulm;
-
-  while(bank.ReadPoint() < feraEnd) {
-    bank.Get(header);
-
-    //skip all zeros
-    while(header == 0 && bank.ReadPoint() < feraEnd) {
-      //increment counter and get next word
-      ++fNofZeros[bank.IntName()];
-      bank.Get(header);
-    }
-
-    //get the module number
-    vsn = header & VHNMASK;
-
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA number = ",vsn)<<std::endl;
-    }
-
-    //get the module type (high bit has to be set)
-    if((header & 0x8000) != 0) {
-      feraType = header & VHTMASK;
-    } else {
-      feraType = BADFERA;
-    }
-
-    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
-    }
-
-    switch(feraType) {
-    case VHAD413:
-      //vsn is 0xD or 0xE (13 or 14), so to get the module number we subtract 13
-      if(!GetAdc413(bank, vsn-13, (header&VHAD413_NUMBER_OF_DATA_WORDS_MASK)>>VHAD413_DATA_WORDS_OFFSET, energy)) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Same problem with something immediately after ADC 413 data in silicon data stream",Attribs::Reset())<<std::endl;
-      }
-      ++fCounter[VHAD413];
-      ++nofAdcs;
-      break;	
-    case VHAD114Si:
-      //Process the ADC, and check if it's followed immediately by a TDC
-      if(vsn > fSettings->NofSiliconDetectors()) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Invalid detector number (",vsn,") in Event ",bank.EventNumber(),", Bank ",bank.Number(),Attribs::Reset())<<std::endl;
-      }
-
-      if(GetAdc114(bank, feraEnd, tmpEnergy)) {
-	GetTdc3377(bank, feraEnd, time);
-	++fCounter[VH3377];
-      }
-      energy.push_back(std::make_pair(vsn, tmpEnergy));
-      ++fCounter[VHAD114Si];
-      break;		    
-
-    case VH3377:
-      GetTdc3377(bank, feraEnd, time);
-      ++fCounter[VH3377];
-      break;
-
-    case VHFULM:  /* Universal Logic Module end of event marking, clocks, etc.. */
-      GetUlm(bank, ulm);
-      ++fCounter[VHFULM];
-      break;
-
-    case BADFERA:
-      if(fSettings->VerbosityLevel() > 1) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Found bad fera event in silicon data stream",Attribs::Reset())<<std::endl;
-      }
-      ++fCounter[BADFERA];
-      bank.SetReadPoint(feraEnd);
-      break;
-		    
-    default: // Unrecognized header
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in silicon midas event ",bank.EventNumber(),", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
-      }
-      ++fNofUnkownFera[bank.IntName()];
-      //try and find the next header
-      bank.Get(header);
-      //skip all words until we find one with the high bit set
-      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
-	//increment counter and get next word
-	bank.Get(header);
-      }
-      //un-read the header (will be read again in the next iteration of the while-loop_
-      bank.ChangeReadPoint(-1);
-      break;
-    }//switch
+  //write histograms to file
+  MergeHistograms();
+  for(auto& detType : fRawEnergyHistograms) {
+    WriteHistograms(detType);
   }
-
-  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
-    ConstructEvents(eventTime, eventNumber, EDetectorType::kSilicon, energy, time, ulm);
-  } else if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
+  for(auto& detType : fTimingHistograms) {
+    WriteHistograms(detType);
   }
-}
+  WriteHistograms(fHitPatternHistograms);
+  WriteHistograms(fMultiplicityHistograms);
 
-void MidasEventProcessor::BaF2Event(Bank& bank, size_t feraEnd, uint32_t eventTime, uint32_t eventNumber) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Starting on barium fluoride event ",eventNumber)<<std::endl;
+  if(fSettings->TrackDrift()) {
+    fDrift.EndOfSlice();
+    WriteDrift();
   }
 
-  uint16_t header;
-  uint16_t vsn;
-  uint16_t feraType;
-  std::vector<std::pair<uint16_t, uint16_t> > energy;
-  std::map<uint16_t, std::vector<uint16_t> > time;
-  Ulm ulm;
-
-  while(bank.ReadPoint() < feraEnd) {
-    bank.Get(header);
-
-    //skip all zeros
-    while(header == 0 && bank.ReadPoint() < feraEnd) {
-      //increment counter and get next word
-      ++fNofZeros[bank.IntName()];
-      bank.Get(header);
-    }
-
-    //get the module number
-    vsn = header & VHNMASK;
-
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA number = ",vsn)<<std::endl;
-    }
-
-    //get the module type (high bit has to be set)
-    if((header & 0x8000) != 0) {
-      feraType = header & VHTMASK;
-    } else {
-      feraType = BADFERA;
-    }
-
-    //std::cout<<"FERA type = 0x"<<std::hex<<feraType<<" (from  0x"<<header<<")"<<std::dec<<std::endl;
-    if(fSettings->VerbosityLevel() > 4) {
-      std::cout<<Show("FERA type = 0x",std::hex,feraType," (from  0x",header,")",std::dec)<<std::endl;
-    }
-
-    switch(feraType) {
-    case VHAD413:
-      //vsn is 0-4
-      if(!GetAdc413(bank, vsn, (header&VHAD413_NUMBER_OF_DATA_WORDS_MASK)>>VHAD413_DATA_WORDS_OFFSET, energy)) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Same problem with something immediately after ADC 413 data in barium fluoride data stream",Attribs::Reset())<<std::endl;
-      }
-      ++fCounter[VHAD413];
-      break;	
-	
-    case VH3377:
-      GetTdc3377(bank, feraEnd, time);
-      ++fCounter[VH3377];
-      break;
-
-    case VHFULM:  /* Universal Logic Module end of event marking, clocks, etc.. */
-      GetUlm(bank, ulm);
-      ++fCounter[VHFULM];
-      break;
-
-    case BADFERA:
-      if(fSettings->VerbosityLevel() > 1) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Found bad fera event in barium fluoride data stream",Attribs::Reset())<<std::endl;
-      }
-      ++fCounter[BADFERA];
-      bank.SetReadPoint(feraEnd);
-      break;
-		    
-    default: // Unrecognized header
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to find FERA header in barium fluoride midas event ",bank.EventNumber(),", found 0x",std::hex,feraType," from header 0x",header,std::dec," instead",Attribs::Reset())<<std::endl;
-      }
-      ++fNofUnkownFera[bank.IntName()];
-      //try and find the next header
-      bank.Get(header);
-      //skip all words until we find one with the high bit set
-      while((header & 0x8000) == 0 && bank.ReadPoint() < feraEnd) {
-	//increment counter and get next word
-	bank.Get(header);
-      }
-      //un-read the header (will be read again in the next iteration of the while-loop_
-      bank.ChangeReadPoint(-1);
-      break;
+  //write the event building diagnostics (the builder doesn't run in histogram-only mode)
+  if(fSettings->BuildDiagnostics() && !fSettings->HistogramsOnly()) {
+    fRootFile->cd();
+    for(size_t detType = 0; detType < NOF_DETECTOR_TYPES; ++detType) {
+      TH1D* histogram = ToHistogram(fBuilder.Lateness(detType), Form("lateness_%s",fDetectorTypeNames[detType]),
+				    Form("%s hits behind the newest %s hit on arrival;lateness [100 ns];counts",fDetectorTypeNames[detType],fDetectorTypeNames[detType]));
+      histogram->Write("", TObject::kOverwrite);
+      delete histogram;
     }
+    TH1D* histogram = ToHistogram(fBuilder.TimeDifference(), "timeDifference", "time difference to the first hit of the event;time difference [ns];counts");
+    histogram->Write("", TObject::kOverwrite);
+    delete histogram;
   }
 
-  if(ulm.Clock() != 0 || ulm.CycleNumber() != 0) { 
-    ConstructEvents(eventTime, eventNumber, EDetectorType::kBaF2, energy, time, ulm);
-  } else if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Discarding event with ulm clock 0, ",energy.size()," adcs, and ",time.size()," tdcs")<<std::endl;
+  if(fSettings->Matrices() && !fSettings->HistogramsOnly()) {
+    WriteMatrices();
+  }
+  if(!fSettings->HistogramsOnly()) {
+    fBuilder.CloseCube();
   }
 }
 
-
-//---------------------------------------- different electronics modules ----------------------------------------
-
-//get energy from an Adc 114
-bool MidasEventProcessor::GetAdc114(Bank& bank, uint32_t feraEnd, uint16_t& energy) {
-  uint16_t tdc;
-
-  bank.Get(energy);
-
-  if(energy > VHAD114_ENERGY_MASK) {
-    std::cerr<<Show(Foreground::Red(),"ADC 114 energy ",energy," > ",VHAD114_ENERGY_MASK,Attribs::Reset())<<std::endl;
+//one entry per slice with the centroids and corrections of all germanium detectors, and one entry per detector with the
+//linear dependence of the correction on the temperature
+void MidasEventProcessor::WriteDrift() {
+  int nofDetectors = fDrift.NofDetectors();
+  if(nofDetectors == 0) {
+    return;
   }
-
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("Got Adc114 energy: 0x",std::hex,energy," = ",std::dec,energy)<<std::endl;
+  fRootFile->cd();
+
+  DriftSlice slice;
+  slice.fCentroid.resize(nofDetectors);
+  slice.fCounts.resize(nofDetectors);
+  slice.fFactor.resize(nofDetectors);
+  TTree drift("drift","gain drift correction per slice");
+  drift.Branch("Start",&slice.fStart,"Start/l");
+  drift.Branch("End",&slice.fEnd,"End/l");
+  drift.Branch("Temperature",&slice.fTemperature,"Temperature/F");
+  drift.Branch("NofTemperatures",&slice.fNofTemperatures,"NofTemperatures/i");
+  drift.Branch("Centroid",slice.fCentroid.data(),Form("Centroid[%d]/F",nofDetectors));
+  drift.Branch("Counts",slice.fCounts.data(),Form("Counts[%d]/i",nofDetectors));
+  drift.Branch("Factor",slice.fFactor.data(),Form("Factor[%d]/F",nofDetectors));
+  for(const auto& current : fDrift.Slices()) {
+    //copy into the buffers the branches point to
+    slice.fStart = current.fStart;
+    slice.fEnd = current.fEnd;
+    slice.fTemperature = current.fTemperature;
+    slice.fNofTemperatures = current.fNofTemperatures;
+    std::copy(current.fCentroid.begin(), current.fCentroid.end(), slice.fCentroid.begin());
+    std::copy(current.fCounts.begin(), current.fCounts.end(), slice.fCounts.begin());
+    std::copy(current.fFactor.begin(), current.fFactor.end(), slice.fFactor.begin());
+    drift.Fill();
+  }
+  drift.Write("", TObject::kOverwrite);
+
+  uint16_t detector;
+  DriftCorrelation correlation;
+  TTree temperature("driftTemperature","gain drift correction vs. temperature (factor = slope*temperature + intercept)");
+  temperature.Branch("Detector",&detector,"Detector/s");
+  temperature.Branch("Slope",&correlation.fSlope,"Slope/D");
+  temperature.Branch("Intercept",&correlation.fIntercept,"Intercept/D");
+  temperature.Branch("Correlation",&correlation.fCorrelation,"Correlation/D");
+  temperature.Branch("NofSlices",&correlation.fNofSlices,"NofSlices/l");
+  for(detector = 0; detector < nofDetectors; ++detector) {
+    correlation = fDrift.Correlation(detector);
+    temperature.Fill();
+  }
+  temperature.Write("", TObject::kOverwrite);
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Wrote gain drift corrections of "<<fDrift.Slices().size()<<" slices"<<std::endl;
   }
+}
 
-  if(bank.ReadPoint() < feraEnd) {
-    //check whether we have a tdc following this adc
-    bank.Peek(tdc);
-    if((tdc & 0x8000) == 0) {
-      return true;
+void MidasEventProcessor::WriteHistograms(std::vector<TH1I*>& histograms) {
+  for(auto& histogram : histograms) {
+    if(histogram == nullptr) {
+      std::cout<<Show(Attribs::Bright(),Foreground::Red(),"Got empty histogram, skipping it",Attribs::Reset())<<std::endl;
+      continue;
+    }
+    if(fSettings->VerbosityLevel() > 0) {
+      std::cout<<Show("Writing histogram ",std::hex,histogram,std::dec," = '",histogram->GetName(),"' to file '",fRootFile->GetName(),"'")<<std::endl;
     }
+    fRootFile->cd();
+    histogram->Write("", TObject::kOverwrite);
   }
-
-  return false;
 }
 
-//get energy from an Adc 413
-bool MidasEventProcessor::GetAdc413(Bank& bank, uint16_t module, uint16_t nofDataWords, std::vector<std::pair<uint16_t, uint16_t> >& energy) {
-  uint16_t data;
-  uint16_t subAddress;
-
-  //Header is followed by 1 to 4 data records, each with the following format:
-  //B16 	B15 . . . B14 	B13 . . . . . . . . . . . . . . . . . .  . . B1
-  //0 	SUBADDR 	DATA
+//add up the matrices of all slices of the event builder and write them
+void MidasEventProcessor::WriteMatrices() {
+  CoincidenceMatrices matrices(fSettings, fCalibrate);
+  fBuilder.AddMatrices(matrices);
 
-  for(uint16_t i = 0; i < nofDataWords; ++i) {
-    bank.Get(data);
-		
-    subAddress = (data&VHAD413_SUBADDRESS_MASK)>>VHAD413_SUBADDRESS_OFFSET;
-    if(subAddress > 3) {
-      return false;
+  const char* unit = matrices.Calibrated() ? "keV" : "channel";
+  const char* names[NOF_MATRICES] = { "GeGe", "GeBaF2", "GePlastic" };
+  std::string titles[NOF_MATRICES] = { Form("germanium-germanium (symmetrised);germanium [%s];germanium [%s]",unit,unit),
+				       Form("germanium-BaF2;germanium [%s];BaF2 [%s]",unit,unit),
+				       Form("germanium-plastic;germanium [%s];plastic [%s]",unit,unit) };
+  for(size_t matrix = 0; matrix < NOF_MATRICES; ++matrix) {
+    WriteMatrix(matrices.Prompt(static_cast<EMatrix>(matrix)), names[matrix], titles[matrix].c_str());
+    if(fSettings->MatrixTimeGates()) {
+      WriteMatrix(matrices.Random(static_cast<EMatrix>(matrix)), Form("%sRandom",names[matrix]), Form("random %s",titles[matrix].c_str()));
     }
-    energy.push_back(std::make_pair(module*4 + subAddress, data&VHAD413_ENERGY_MASK));
   }
-
-  return true;
 }
 
-//read high and low word from tdc (extracting time and sub-address) until no more tdc data is left
-bool MidasEventProcessor::GetTdc3377(Bank& bank, uint32_t feraEnd, std::map<uint16_t, std::vector<uint16_t> >& time) {
-  uint16_t highWord;
-  uint16_t lowWord;
-  uint16_t subAddress;
-
-  while(bank.ReadPoint() < feraEnd) {//???
-    if(!bank.Get(highWord)) {
-      return false;
-    }
-    if(!bank.Get(lowWord)) {
-      return false;
-    }
-    
-    if((highWord & 0x8000) || (lowWord & 0x8000)) {
-      bank.ChangeReadPoint(-2);
-      return false;
-    }
-    
-    if((highWord&TDC3377_IDENTIFIER) != (lowWord&TDC3377_IDENTIFIER)) {
-      //two words from two different tdcs? output error message
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Tdc identifier mismatch, event ",bank.EventNumber(),", bank ",bank.Number(),": ",(highWord&TDC3377_IDENTIFIER)," != ",(lowWord&TDC3377_IDENTIFIER),Attribs::Reset())<<std::endl;
-      }
-      return false;
-    }
-
-    subAddress = (highWord&TDC3377_IDENTIFIER) >> 10;
-    time[subAddress].push_back(((highWord&TDC3377_TIME) << 8) | (lowWord&TDC3377_TIME));
-    ++fSubAddress[subAddress];
-    if(fSettings->VerbosityLevel() > 3) {
-      std::cout<<Show("Got two tdc words: 0x",std::hex,highWord,", 0x",lowWord,std::dec)<<std::endl;
-    }
+//the ROOT histogram is only created for writing, the dense TH2I needs a lot more memory than the blocks
+void MidasEventProcessor::WriteMatrix(const CoincidenceMatrix& matrix, const char* name, const char* title) {
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<Show("Writing matrix '",name,"' with ",matrix.Entries()," entries (",matrix.Overflow()," overflow) from ",matrix.NofAllocatedBlocks()," blocks = ",matrix.AllocatedBytes()," bytes")<<std::endl;
+  }
+  fRootFile->cd();
+  if(fSettings->MatrixSparseOutput()) {
+    int nofBins[2] = { (int) matrix.NofBinsX(), (int) matrix.NofBinsY() };
+    double low[2] = { 0., 0. };
+    double high[2] = { matrix.NofBinsX()*matrix.BinWidthX(), matrix.NofBinsY()*matrix.BinWidthY() };
+    THnSparseI* sparse = new THnSparseI(name, title, 2, nofBins, low, high);
+    matrix.ForEach([sparse](size_t x, size_t y, uint32_t content) {
+	int bin[2] = { (int) x+1, (int) y+1 };
+	sparse->SetBinContent(bin, content);
+      });
+    sparse->SetEntries(matrix.Entries());
+    sparse->Write("", TObject::kOverwrite);
+    delete sparse;
+    return;
   }
-
-  return true;
+  TH2I* histogram = new TH2I(name, title, matrix.NofBinsX(), 0., matrix.NofBinsX()*matrix.BinWidthX(), matrix.NofBinsY(), 0., matrix.NofBinsY()*matrix.BinWidthY());
+  matrix.ForEach([histogram](size_t x, size_t y, uint32_t content) {
+      histogram->SetBinContent(x+1, y+1, content);
+    });
+  histogram->SetEntries(matrix.Entries());
+  histogram->Write("", TObject::kOverwrite);
+  delete histogram;
 }
 
-bool MidasEventProcessor::GetAdc4300(Bank& bank, uint16_t header, uint16_t vsn, std::vector<std::pair<uint16_t, uint16_t> >& energy) {
-  uint16_t tmp;
-  uint16_t subAddress;
-  uint16_t nofAdcWords = (header&PLASTIC_ADC_WORDS) >> PLASTIC_ADC_WORDS_OFFSET;
-
-  if(nofAdcWords == 0) {
-    //all channels fired.
-    nofAdcWords = PLASTIC_CHANNELS;
+//convert the histograms of the (ROOT-free) event builder
+TH1D* MidasEventProcessor::ToHistogram(const FixedHistogram& fixed, const char* name, const char* title) {
+  TH1D* histogram = new TH1D(name, title, fixed.NofBins(), (double) fixed.Low(), (double) fixed.High());
+  histogram->SetBinContent(0, fixed.Underflow());
+  for(size_t bin = 0; bin < fixed.NofBins(); ++bin) {
+    histogram->SetBinContent(bin+1, fixed.Bin(bin));
   }
+  histogram->SetBinContent(fixed.NofBins()+1, fixed.Overflow());
+  histogram->SetEntries(fixed.Entries());
 
-  for(uint16_t i = 0; i < nofAdcWords; ++i) {
-    bank.Get(tmp);
-    
-    if((tmp & 0x8000) != 0) {
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"reached premature end of adc 4300 data: i = ",i,", # adc words = ",nofAdcWords,Attribs::Reset())<<std::endl;
-      }
-      bank.ChangeReadPoint(-1);
-      break;
-    }
-
-    subAddress = (tmp&PLASTIC_IDENTIFIER) >> PLASTIC_IDENTIFIER_OFFSET;
+  return histogram;
+}
 
-    if(vsn*PLASTIC_CHANNELS + subAddress >= fSettings->NofPlasticDetectors()) {
-      if(fSettings->VerbosityLevel() > 1) {
-	std::cout<<Show("Found plastic detector #",vsn*PLASTIC_CHANNELS + subAddress," in event ",bank.EventNumber(),", bank ",bank.Number(),", but there should only be ",fSettings->NofPlasticDetectors())<<std::endl;
-      }
+//summarise the diagnostics: the largest lateness is the smallest safe waiting window,
+//the coincidence window should include the prompt peak of the time differences, i.e. everything above the random background
+void MidasEventProcessor::PrintBuildDiagnostics() {
+  std::cout<<"Lateness of hits behind the newest hit of their detector type (current waiting window "<<fBuildSettings->WaitingWindow()<<"):"<<std::endl;
+  uint64_t maximum = 0;
+  for(size_t detType = 0; detType < NOF_DETECTOR_TYPES; ++detType) {
+    const FixedHistogram& lateness = fBuilder.Lateness(detType);
+    if(lateness.Entries() == 0) {
       continue;
     }
-
-    energy.push_back(std::make_pair(vsn*PLASTIC_CHANNELS + subAddress, tmp&PLASTIC_ENERGY));
-  }
-  return true;
-}
-
-bool MidasEventProcessor::GetUlm(Bank& bank, Ulm& ulm) {
-  uint16_t header;
-  if(!bank.Get(header)) {
-    return false;
-  }
-
-  ulm.Header(header);
-
-  uint32_t tmp;
-  if(!bank.Get(tmp)) {
-    return false;
-  }
-  ulm.Clock(tmp);
-  if(!bank.Get(tmp)) {
-    return false;
-  }
-  ulm.LiveClock(tmp);
-  if(!bank.Get(tmp)) {
-    return false;
-  }
-  ulm.MasterCount(tmp);
-
-  if(fSettings->VerbosityLevel() > 3) {  
-    std::cout<<Show("Got ulm with header 0x",std::hex,header,", clock 0x",ulm.Clock(),", live clock 0x",ulm.LiveClock(),", and master count 0x",tmp,std::dec)<<std::endl;
+    std::cout<<Show(fDetectorTypeNames[detType],":\t99% = ",lateness.Quantile(0.99),", 99.99% = ",lateness.Quantile(0.9999),", max. = ",lateness.Maximum(),", ",lateness.Overflow()," outside of range")<<std::endl;
+    if(lateness.Maximum() > maximum) {
+      maximum = lateness.Maximum();
+    }
   }
-
-  return true;
-}
-
-//----------------------------------------
-
-void MidasEventProcessor::ConstructEvents(const uint32_t& eventTime, const uint32_t& eventNumber, const EDetectorType& detectorType, std::vector<std::pair<uint16_t, uint16_t> >& energy, std::map<uint16_t, std::vector<uint16_t> >& time, Ulm& ulm) {
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("starting to construct events from ",energy.size()," detectors with ",time.size()," times")<<std::endl;
+  if(maximum >= (uint64_t) fBuildSettings->WaitingWindow()) {
+    std::cout<<Show(Attribs::Bright(),Foreground::Red(),"Hits arrived up to ",maximum," behind the newest hit of their detector type, this is outside the waiting window of ",fBuildSettings->WaitingWindow(),"!",Attribs::Reset())<<std::endl;
+  } else {
+    std::cout<<"Smallest safe waiting window: "<<maximum+1<<std::endl;
   }
-  size_t nofEvents = 0;
 
-  //check that this is a known detector
-  if(detectorType == EDetectorType::kUnknown) {
-    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),energy.size()," unknown detectors passed on to ",__PRETTY_FUNCTION__,Attribs::Reset())<<std::endl;
+  const FixedHistogram& timeDifference = fBuilder.TimeDifference();
+  if(timeDifference.Entries() == 0) {
     return;
   }
-
-  //drop all deactivated adcs
-  energy.erase(std::remove_if(energy.begin(), energy.end(), [&](const std::pair<uint16_t, uint16_t> en) -> bool {return !fSettings->Active(detectorType,en.first);}),energy.end());
-
-  //drop all deactivated tdcs (this is a map, so we can't use remove_if)
-  auto it = time.begin();
-  while(it != time.end()) {
-    if(!fSettings->Active(detectorType, it->first)) {
-      time.erase(it++);//delete this map entry and then go to the next entry (post-increment)
-    } else {
-      ++it;//just go to the next entry
-    }
+  //the random background is estimated from the upper half of the range
+  size_t nofBins = timeDifference.NofBins();
+  double background = 0.;
+  for(size_t bin = nofBins/2; bin < nofBins; ++bin) {
+    background += timeDifference.Bin(bin);
   }
-
-  //stop if all detectors were deactivated
-  if(energy.size() == 0) {
-    if(time.size() != 0) {
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cout<<Show(Foreground::Red(),"No active adcs, but ",time.size()," active tdcs",Attribs::Reset())<<std::endl;
-      }
-    } else if(fSettings->VerbosityLevel() > 2) {
-      std::cout<<Show(Foreground::Red(),"No active adcs and no active tdcs",Attribs::Reset())<<std::endl;      
+  background /= nofBins - nofBins/2;
+  size_t lastPromptBin = 0;
+  for(size_t bin = 0; bin < nofBins/2; ++bin) {
+    if(timeDifference.Bin(bin) > background + 3.*std::sqrt(background) + 1.) {
+      lastPromptBin = bin;
     }
-    return;
   }
-
-  //need to take care of: clockstate, ulm overflows, live clock overflows, dead times
-  //correct ulm overflows
-  fClockState.CorrectOverflow(detectorType, eventTime, ulm);
-
-  //if the ulm is still zero, we need to check the ulm cycle number (might be screwed up)
-  if(ulm.Clock() == 0) {
-    if(ulm.CycleNumber() > fLastCycle && ulm.CycleNumber()-fLastCycle > 0xff) {
-      std::cout<<Show(Foreground::Red(),"ulm clock 0 and cycle number ",ulm.CycleNumber()," with last cycle number ",fLastCycle,": dropping detector",Attribs::Reset())<<std::endl;
-      return;
-    }
-  }
-
-  //now loop over all detectors, create the event, fill the detector number and energy, find the corresponding times, and fill them too
-  for(auto& en : energy) {
-    if(ulm.Clock() == 0) {
-      std::cout<<Show(Foreground::Red(),"Detector (type ",static_cast<uint16_t>(detectorType),", number ",en.first,") with ulm clock 0!",Attribs::Reset())<<std::endl;
-    } else if(fSettings->VerbosityLevel() > 3) {
-      std::cout<<Foreground::Green<<Show("Detector with ulm clock ",ulm.Clock(),Attribs::Reset())<<std::endl;
-    }
-    //create a temporary detector, so that we don't need to lock!
-    //we need to keep this lock until we're done with the creation of the detector (including filling in the tdc times) to prevent it being removed before we're done with it
-    Detector tmpDetector(eventTime, eventNumber, static_cast<uint8_t>(detectorType), en, ulm);
-    if(fDataFile.is_open()) {
-      fDataFile<<eventNumber<<" "<<eventTime<<" "<<static_cast<uint16_t>(detectorType)<<" "<<en.first<<" "<<en.second<<" "<<ulm.Clock()<<" "<<ulm.LiveClock()<<std::endl;
-    }
-    ++nofEvents;
-    //check that we have any times for this detector
-    if(time.find(en.first) != time.end() && time.at(en.first).size() > 0) {
-      tmpDetector.TdcHits(time[en.first].size());
-      //find the right tdc hit
-      //since any good tdc hit creates a deadtime w/o anymore tdc hits, we want the last one
-      //the tdcs are LIFO, so the last hit is the first coming out
-      //however in Greg's FIFO.c he uses the last time found within the coarse window or (if none is found) the very first time
-      for(const auto& thisTime : time[en.first]) {
-	if(fSettings->CoarseTdcWindow(detectorType,en.first,thisTime)) {
-	  tmpDetector.Time(thisTime);
-	}
-      }
-      if(tmpDetector.Time() == 0) {
-	tmpDetector.Time(time[en.first].front());
-      }
-    } else {
-      //no tdc hits found for this detector
-      if(fSettings->VerbosityLevel() > 2) {
-	std::cerr<<Show(Foreground::Red(),"Found no tdc hits for detector type ",std::hex,static_cast<uint16_t>(detectorType),std::dec,", number ",en.first,Attribs::Reset())<<std::endl;
-      }
-    }
-    //std::cout<<Show(Background::Blue(),"ConstructEvents acquiring read mutex 2",Attribs::Reset())<<std::endl;
-    fReadMutex.lock();
-    //std::cout<<Show(Background::Red(),"ConstructEvents acquired read mutex 2",Attribs::Reset())<<std::endl;
-    //try to insert the new element, if this fails, we release the lock and wait, hoping that the buffer gets emptied by buildevents()
-    try {
-      fReadDetector.insert(tmpDetector);
-    } catch(std::exception& exc) {
-      std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to insert detector into read buffer of size ",fReadDetector.size(),"!",Attribs::Reset())<<std::endl;
-      std::this_thread::sleep_for(std::chrono::milliseconds(STANDARD_WAIT_TIME));
-      fReadMutex.lock();
-      fReadDetector.insert(tmpDetector);
-    }
-    fReadMutex.unlock();
-    //std::cout<<Show(Background::Green(),"ConstructEvents released read mutex 2",Attribs::Reset())<<std::endl;
-    //fill histogram
-    if(static_cast<uint8_t>(detectorType) < fRawEnergyHistograms.size() && en.first < fRawEnergyHistograms[static_cast<uint8_t>(detectorType)].size()) {
-      fRawEnergyHistograms[static_cast<uint8_t>(detectorType)][en.first]->Fill(en.second);
-    }
-  }//for detector
-
-  fNofReadDetectors += nofEvents;
-
-  if(fSettings->VerbosityLevel() > 3) {
-    std::cout<<Show("done with creation of ",nofEvents," events (",fReadDetector.size()," read detectors in queue, ",fNofReadDetectors," in total)")<<std::endl;
+  //the time differences are in ns, as is the fine coincidence window (the coincidence window is in 100 ns)
+  double coincidenceWindow = fBuildSettings->FineCoincidenceWindow() > 0. ? fBuildSettings->FineCoincidenceWindow() : fBuildSettings->CoincidenceWindow()*100.;
+  uint64_t promptEnd = timeDifference.BinLow(lastPromptBin+1);
+  std::cout<<"Time differences to the first hit of an event (current coincidence window "<<coincidenceWindow<<" ns): "
+	   <<"random background "<<background<<" counts per bin, prompt peak ends at "<<promptEnd<<" ns"<<std::endl;
+  if(promptEnd > coincidenceWindow) {
+    std::cout<<Show(Attribs::Bright(),Foreground::Red(),"The prompt peak extends beyond the coincidence window of ",coincidenceWindow," ns!",Attribs::Reset())<<std::endl;
   }
 }
 
-//----------------------------------------
+void MidasEventProcessor::Print() {
+  fDecoder.Print();
 
-void MidasEventProcessor::Flush() {
-  //set status to flush (this triggers the flushing)
-  fStatus = kFlushRead;
-  //join all threads, i.e. wait for them to finish flushing
-  for(auto& thread : fThreads) {
-    //wait for the thread to be ready
-    if(thread.second.valid()) {
-      size_t nofWaits = 0;
-      while(thread.second.wait_for(std::chrono::milliseconds(STANDARD_WAIT_TIME))==std::future_status::timeout) {
-	if(nofWaits%10 == 0) {
-	  std::cout<<Attribs::Bright<<Foreground::Cyan<<Show("Waiting for thread ",thread.first," to finish: ",Status(),Attribs::Reset())<<std::endl;
-	}
-	++nofWaits;
-      }
-      std::cout<<Attribs::Bright<<Foreground::Cyan<<Show("Waited ",nofWaits*STANDARD_WAIT_TIME," ms for thread ",thread.first," to finish: ",Status(),Attribs::Reset())<<std::endl;
-    } else {
-      std::cout<<Show(Attribs::Bright(),Foreground::Blue(),"Thread ",thread.first," not valid",Attribs::Reset())<<std::endl;
-      continue;
+  if(fSettings->TrackDrift() && fDrift.NofDetectors() > 0) {
+    std::cout<<"Gain drift tracked in "<<fDrift.Slices().size()<<" slices, final corrections:"<<std::endl;
+    for(uint16_t detector = 0; detector < fDrift.NofDetectors(); ++detector) {
+      std::cout<<Show("Germanium ",std::setw(2),detector,":\t",std::setprecision(5),fDrift.Factor(detector))<<std::endl;
     }
-    //check return status
-    std::cout<<Show(Attribs::Bright(),Foreground::Blue(),thread.second.get(),Attribs::Reset())<<std::endl;
   }
 
-  //write histograms to file
-  for(auto& detType : fRawEnergyHistograms) {
-    for(auto& histogram : detType) {
-      if(histogram == nullptr) {
-	std::cout<<Show(Attribs::Bright(),Foreground::Red(),"Got empty histogram, skipping it",Attribs::Reset())<<std::endl;
-	continue;
-      }
-      if(fSettings->VerbosityLevel() > 0) {
-	std::cout<<Show("Writing histogram ",std::hex,histogram,std::dec," = '",histogram->GetName(),"' to file '",fRootFile->GetName(),"'")<<std::endl;
-      }
-      fRootFile->cd();
-      histogram->Write("", TObject::kOverwrite);
+  if(fTimed) {
+    std::cout<<"Timing: "<<fTiming.NofUntimed()<<" hits without a TDC time (at the untimed time of their detector), "
+	     <<fTiming.NofUncalibrated()<<" hits of detectors without timing calibration (ulm clock only)"<<std::endl;
+    if(fBuildSettings->FineCoincidenceWindow() > 0. && fTiming.NofUntimed() + fTiming.NofUncalibrated() > 0) {
+      std::cout<<Show(Attribs::Bright(),Foreground::Red(),"These hits have no fine timestamp, the fine coincidence window of ",fBuildSettings->FineCoincidenceWindow()," ns can separate them from their events",Attribs::Reset())<<std::endl;
     }
   }
-}
-
-void MidasEventProcessor::Print() {
-  std::cout<<"Zeros skipped:"<<std::endl;
-  for(auto it : fNofZeros) {
-    std::cout<<Show(it.first,": \t",std::setw(7),it.second)<<std::endl;
-  }
 
-  std::cout<<"Unknown FERA header:"<<std::endl;
-  for(auto it : fNofUnkownFera) {
-    std::cout<<Show(it.first,": \t",std::setw(7),it.second)<<std::endl;
+  if(fSettingsManager != nullptr) {
+    std::cout<<"Settings reloaded "<<fSettingsManager->NofReloads()<<" times, decoded with generation "<<fDecodeGeneration<<", built with generation "<<fBuildGeneration<<std::endl;
   }
 
   std::cout<<"Events found:"<<std::endl;
@@ -1141,190 +634,238 @@ void MidasEventProcessor::Print() {
     }
   }
 
+  if(fSettings->HistogramsOnly()) {
+    std::cout<<fNofMergedHits<<" hits histogrammed (no event building)"<<std::endl;
+    return;
+  }
+
   size_t totalBuiltDetectors = 0;
   for(auto multiplicity : fDetectorsPerEvent) {
     std::cout<<multiplicity.second<<" built events with "<<multiplicity.first<<" detectors"<<std::endl;
     totalBuiltDetectors += multiplicity.first*multiplicity.second;
   }
-  std::cout<<fNofBuiltEvents<<" built events with a total of "<<totalBuiltDetectors<<" detectors out of "<<fNofReadDetectors<<" read detectors"<<std::endl;
+  std::cout<<fNofBuiltEvents<<" built events with a total of "<<totalBuiltDetectors<<" detectors out of "<<fBuilder.NofAddedHits()<<" read detectors"<<std::endl;
+
+  const std::vector<size_t>& eventsPerCycle = fBuilder.EventsPerCycle();
+  if(!eventsPerCycle.empty()) {
+    auto minmax = std::minmax_element(eventsPerCycle.begin(), eventsPerCycle.end());
+    size_t total = std::accumulate(eventsPerCycle.begin(), eventsPerCycle.end(), (size_t) 0);
+    std::cout<<eventsPerCycle.size()<<" finished cycles with "<<*(minmax.first)<<" - "<<*(minmax.second)<<" events (average "<<total/eventsPerCycle.size()<<")"<<std::endl;
+    if(fSettings->VerbosityLevel() > 0) {
+      for(size_t cycle = 0; cycle < eventsPerCycle.size(); ++cycle) {
+	std::cout<<Show("Cycle ",cycle,":\t",std::setw(7),eventsPerCycle[cycle])<<std::endl;
+      }
+    }
+  }
+
+  if(fWriter->NofDroppedHits() > 0) {
+    std::cout<<Show(Attribs::Bright(),Foreground::Red(),"Dropped ",fWriter->NofDroppedHits()," hits from events above the maximum multiplicity of ",fSettings->MaxMultiplicity(),Attribs::Reset())<<std::endl;
+  }
+
+  if(fSettings->BuildDiagnostics()) {
+    PrintBuildDiagnostics();
+  }
+
+  //if the builder waits a lot for the writer, the output is the bottleneck
+  std::cout<<"Output: "<<std::chrono::duration_cast<std::chrono::milliseconds>(fWriteTime).count()<<" ms writing ("
+	   <<std::chrono::duration_cast<std::chrono::milliseconds>(fConvertTime).count()<<" ms converting the events, "
+	   <<std::chrono::duration_cast<std::chrono::milliseconds>(fFillTime).count()<<" ms filling the tree";
+  if(fColumnarWriter.IsOpen()) {
+    std::cout<<", "<<std::chrono::duration_cast<std::chrono::milliseconds>(fColumnarTime).count()<<" ms writing the columnar file";
+  }
+  std::cout<<"), "<<std::chrono::duration_cast<std::chrono::milliseconds>(fFillWait).count()<<" ms waiting for events, event building waited "
+	   <<std::chrono::duration_cast<std::chrono::milliseconds>(fHandOverWait).count()<<" ms for the output"<<std::endl;
+
+  if(AllocationCounter::Enabled()) {
+    std::cout<<"Steady state heap allocations: "<<fSteadyAllocations<<" while building and writing "<<fSteadyEvents<<" events"<<std::endl;
+  }
 }
 
-//start event building thread (takes events from read buffer and combines them into build events in the output buffer)
+//start event building thread (takes hits from the builder and combines them into build events in the output buffer)
 std::string MidasEventProcessor::BuildEvents() {
   //TStopwatch watch;
   auto start = std::chrono::high_resolution_clock::now();
-  std::vector<Detector> detectors;
 
-  if(fReadDetector.size() > 0) {
-    if(fSettings->VerbosityLevel() > 3) {
-      std::cout<<Show("Got ",fReadDetector.size()," read detectors to build event! Done ",fNofBuiltEvents)<<std::endl;
+  auto output = [this](BuiltEvent& event) { AddBuiltEvent(event); };
+  //all events of the cycle are in the batch, so we hand it over right away
+  auto endOfCycle = [this](size_t) {
+    ++fBuildBatchCycleEnds;
+    HandOverBatch();
+  };
+
+  while(fStatus == kRun || fBuilder.NofWaitingHits() > 0) {
+    bool flush = (fStatus != kRun);
+    if(fSettingsManager != nullptr && fSettingsManager->Generation() != fBuildGeneration) {
+      SwitchBuildSettings();
     }
-    //fReadDetector is a multiset, i.e. ordered values which can have the same value
-    //so we first want to check whether the time difference between begin and end is within the waiting window (unless we're flushing)
-    //std::cout<<Show(Background::Blue(),"BuiltEvents acquiring read mutex 1",Attribs::Reset())<<std::endl;
-    fReadMutex.lock();
-    //std::cout<<Show(Background::Red(),"BuiltEvents acquired read mutex 1",Attribs::Reset())<<std::endl;
-    if(fStatus != kFlushRead && fSettings->InWaitingWindow(fReadDetector.begin()->GetUlm().Clock(), std::prev(fReadDetector.end())->GetUlm().Clock())) {
-      //std::cout<<"Not flushing (fStatus = "<<fStatus<<"), "<<fReadDetector.size()<<" events between "<<fReadDetector.begin()->GetUlm().Clock()<<" and "<<std::prev(fReadDetector.end())->GetUlm().Clock()<<std::endl;
-      fReadMutex.unlock();
-      //std::cout<<Show(Background::Green(),"BuiltEvents released read mutex 1",Attribs::Reset())<<std::endl;
+    size_t nofBuilt = fBuilder.Build(flush, output, endOfCycle);
+
+    if(nofBuilt == 0) {
+      //nothing to build yet, wait a little bit (and continue to make sure we weren't told to flush in the mean time)
+      std::this_thread::yield();
       continue;
     }
-    fReadMutex.unlock();
-    //std::cout<<Show(Background::Green(),"BuiltEvents released read mutex 1",Attribs::Reset())<<std::endl;
-
-    size_t nofRemoved = 0;
-
-    //our oldest time is outside the waiting window, so we take that detector out of the list
-    //std::cout<<Show(Background::Blue(),"BuiltEvents trying to acquire read mutex 2",Attribs::Reset())<<std::endl;
-    fReadMutex.lock();
-    //std::cout<<Show(Background::Red(),"BuiltEvents acquired read mutex 2",Attribs::Reset())<<std::endl;
-    detectors.push_back(*(fReadDetector.begin()));
-    fReadDetector.erase(fReadDetector.begin());
-    ++nofRemoved;
-    //now we want to find all that are in coincidence with that detector
-    auto iterator = fReadDetector.begin(); 
-    while(iterator != fReadDetector.end()) {
-      //std::cout<<Show(Background::Yellow(),"Working on detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-      if(fSettings->Coincidence(detectors[0].GetUlm().Clock(), iterator->GetUlm().Clock())) {
-	//std::cout<<Show(Background::Yellow(),"Coincident detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-	detectors.push_back(*iterator);
-	//std::cout<<Show(Background::Yellow(),"Added detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-	//if this detector is also outside the waiting window or has the same time as the current detector (if we're flushing) we remove it as well
-	if(!fSettings->InWaitingWindow(iterator->GetUlm().Clock(), std::prev(fReadDetector.end())->GetUlm().Clock()) || iterator->GetUlm().Clock() == detectors[0].GetUlm().Clock()) {
-	  //std::cout<<Show(Background::Yellow(),"Removing detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-	  auto tmp = iterator++;//post-increment, i.e. we copy the original iterator, THEN increment the iterator, and finally erase the copy of the original iterator
-	  fReadDetector.erase(tmp);
-	  ++nofRemoved;
-	  //std::cout<<Show(Background::Yellow(),"Removed detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-	} else {
-	  //std::cout<<Show(Background::Yellow(),"Did not remove detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-	  ++iterator;
-	}
-      } else {
-	//the set is ordered, so if this detector is outside the coincidence window all followings will be outside as well
-	//std::cout<<Show(Background::Yellow(),"Break on detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-	break;
-      }
-      //std::cout<<Show(Background::Yellow(),"Done with detector ",std::distance(fReadDetector.begin(),iterator)," of ",fReadDetector.size(),Attribs::Reset())<<std::endl;
-    }
-    //std::cout<<Show(Background::Yellow(),"Done with all detectors",Attribs::Reset())<<std::endl;
-    fReadMutex.unlock();
-    //std::cout<<Show(Background::Green(),"BuiltEvents released read mutex 2",Attribs::Reset())<<std::endl;
-
-    //check whether the circular buffer is full
-    //if it is and we can't increase it's capacity, we try once(!) to wait for it to empty
-    bool slept = false;
-    while(fBuiltEvents.full() && !slept) {
-      try {
-	if(fSettings->VerbosityLevel() > 0) {
-	  std::cout<<Show("Trying to increase built events buffer capacity of ",fBuiltEvents.capacity()," by ",fSettings->BuiltEventsSize())<<std::endl;
-	}
-	//std::cout<<Show(Background::Blue(),"BuiltEvents acquiring built mutex 1",Attribs::Reset())<<std::endl;
-	fBuiltMutex.lock();
-	//std::cout<<Show(Background::Red(),"BuiltEvents acquired built mutex 1",Attribs::Reset())<<std::endl;
-	fBuiltEvents.set_capacity(fBuiltEvents.capacity() + fSettings->BuiltEventsSize());
-	fBuiltMutex.unlock();
-	//std::cout<<Show(Background::Green(),"BuiltEvents released built mutex 1",Attribs::Reset())<<std::endl;
-      } catch(std::exception& exc) {
-	std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to increase capacity (",fBuiltEvents.capacity(),") of built events buffer by ",fSettings->BuiltEventsSize(),Attribs::Reset())<<std::endl;
-	slept = true;
-	std::this_thread::sleep_for(std::chrono::milliseconds(STANDARD_WAIT_TIME));
-      }
-    }
-    //std::cout<<Show(Background::Blue(),"BuiltEvents acquiring built mutex 2",Attribs::Reset())<<std::endl;
-    fBuiltMutex.lock();
-    //std::cout<<Show(Background::Red(),"BuiltEvents acquired built mutex 2",Attribs::Reset())<<std::endl;
-    fBuiltEvents.push_back(Event(detectors));
-    fBuiltMutex.unlock();
-    //std::cout<<Show(Background::Green(),"BuiltEvents released built mutex 2",Attribs::Reset())<<std::endl;
-    ++fNofBuiltEvents;
-    ++fDetectorsPerEvent[detectors.size()];
-    if(fSettings->VerbosityLevel() > 1) {
-      std::cout<<Show("Built event with ",detectors.size()," detectors (removed ",nofRemoved,", flushing = ",kFlushRead,")")<<std::endl;
-    }
-    if(detectors.size() > 1000) {
-      if(kFlushRead) {
-	std::cout<<Show("Built event with ",detectors.size()," detectors from ",fReadDetector.begin()->GetUlm().Clock()," to ",std::prev(fReadDetector.end())->GetUlm().Clock()," => time difference of ",std::prev(fReadDetector.end())->GetUlm().Clock() - fReadDetector.begin()->GetUlm().Clock()," (removed ",nofRemoved,", flushing)")<<std::endl;
-      } else {
-	std::cout<<Show("Built event with ",detectors.size()," detectors from ",fReadDetector.begin()->GetUlm().Clock()," to ",std::prev(fReadDetector.end())->GetUlm().Clock()," => time difference of ",std::prev(fReadDetector.end())->GetUlm().Clock() - fReadDetector.begin()->GetUlm().Clock()," (removed ",nofRemoved,", not flushing)")<<std::endl;
-      }
+
+    if(fSettings->VerbosityLevel() > 3) {
+      std::cout<<Show("Built ",nofBuilt," hits! Done ",fNofBuiltEvents)<<std::endl;
     }
-    detectors.clear();
   }//while loop
 
+  //hand over the last (partial) batch and tell the writer we're done
+  HandOverBatch();
+  fBuiltMutex.lock();
   fStatus = kFlushBuilt;
+  fBuiltMutex.unlock();
+  fBatchCondition.notify_all();
 
   auto end = std::chrono::high_resolution_clock::now();
 
   std::stringstream result;
-  result<<"BuildEvents finished with status "<<fStatus<<", fReadDetector.size() = "<<fReadDetector.size()<<" after "<<std::chrono::duration_cast<std::chrono::seconds>(end-start).count()<<" seconds"<<std::endl;
+  result<<"BuildEvents finished with status "<<fStatus<<", "<<fBuilder.NofWaitingHits()<<" waiting hits after "<<std::chrono::duration_cast<std::chrono::seconds>(end-start).count()<<" seconds, "
+	<<std::chrono::duration_cast<std::chrono::milliseconds>(fHandOverWait).count()<<" ms waiting for the writer"<<std::endl;
   return result.str();
 }
 
-//start output thread (writes event in the output buffer to file/tree)
+void MidasEventProcessor::AddBuiltEvent(BuiltEvent& event) {
+  size_t nofHits = event.NofHits();
+  //this swaps the event into a free slot, the builder gets the storage of that slot to re-use
+  fBuildBatch.Push(event);
+  ++fNofBuiltEvents;
+  ++fDetectorsPerEvent[nofHits];
+  if(fSettings->VerbosityLevel() > 1) {
+    std::cout<<Show("Built event with ",nofHits," detectors (flushing = ",fStatus != kRun,")")<<std::endl;
+  }
+  if(fBuildBatch.Full()) {
+    HandOverBatch();
+  }
+}
+
+//wait for the writer to be done with its batch and swap the batches
+void MidasEventProcessor::HandOverBatch() {
+  if(fBuildBatch.Empty() && fBuildBatchCycleEnds == 0) {
+    return;
+  }
+  auto start = std::chrono::high_resolution_clock::now();
+  std::unique_lock<std::mutex> lock(fBuiltMutex);
+  fBatchCondition.wait(lock, [this]() { return !fBatchReady; });
+  fHandOverWait += std::chrono::high_resolution_clock::now() - start;
+  fBuildBatch.Swap(fWriteBatch);
+  fWriteBatchCycleEnds = fBuildBatchCycleEnds;
+  fBuildBatchCycleEnds = 0;
+  fBatchReady = true;
+  lock.unlock();
+  fBatchCondition.notify_all();
+}
+
+//start output thread (writes the batches of built events to file/tree)
 std::string MidasEventProcessor::FillTree() {
   //TStopwatch watch;
   auto start = std::chrono::high_resolution_clock::now();
 
-  while(fStatus != kFlushBuilt || fBuiltEvents.size() > 0) {
-    //if there are no built events we wait a little bit (and continue to make sure we weren't told to flush in the mean time)
-    if(fBuiltEvents.empty()) {
-//      if(fStatus != kRun) {
-//	std::cout<<Show(Attribs::Bright(),Foreground::Yellow(),ThreadStatus(),Attribs::Reset())<<std::endl;
-//      }
-      //std::this_thread::sleep_for(std::chrono::milliseconds(STANDARD_WAIT_TIME));
-      std::this_thread::yield();
-      continue;
+  while(true) {
+    //wait for the next batch (or the end of the event building)
+    auto waitStart = std::chrono::high_resolution_clock::now();
+    std::unique_lock<std::mutex> lock(fBuiltMutex);
+    fBatchCondition.wait(lock, [this]() { return fBatchReady || fStatus == kFlushBuilt; });
+    if(!fBatchReady) {
+      break;
     }
-    //make the leaf point to the first event
-    //std::cout<<Show(Background::Blue(),"FillTree acquiring built mutex",Attribs::Reset())<<std::endl;
-    fBuiltMutex.lock();
-    //std::cout<<Show(Background::Red(),"FillTree acquired built mutex",Attribs::Reset())<<std::endl;
-    fLeaf = &(fBuiltEvents.front());
-    //fill the tree (this writes the first event to file)
-    fTree->Fill();
-    //delete the first event
-    fBuiltEvents.pop_front();
-    fBuiltMutex.unlock();
-    //std::cout<<Show(Background::Green(),"FillTree released built mutex",Attribs::Reset())<<std::endl;
-    if(fSettings->VerbosityLevel() > 1) {
-      std::cout<<"Wrote one event to tree."<<std::endl;
+    lock.unlock();
+    auto writeStart = std::chrono::high_resolution_clock::now();
+    fFillWait += writeStart - waitStart;
+
+    //the allocations are counted from the first batch after all buffers had the chance to grow to their working size until the
+    //last batch is written, this covers the building (including its thread pool) and the output of all batches in between
+    if(!fSteady && fNofFilledEvents >= (size_t) fSettings->BuiltEventsSize()) {
+      fSteady = true;
+      fSteadyAllocations = AllocationCounter::Allocations();
+      fSteadyEvents = fNofFilledEvents;
+    }
+
+    //the batch is ours until we set fBatchReady to false, so no lock is needed while writing it
+    while(!fWriteBatch.Empty()) {
+      //the conversion to the tree variables only happens here, it is timed separately from the filling of the tree
+      auto convertStart = std::chrono::high_resolution_clock::now();
+      fWriter->Set(fWriteBatch.Front());
+      auto fillStart = std::chrono::high_resolution_clock::now();
+      fConvertTime += fillStart - convertStart;
+      //fill the tree (this writes the first event to file)
+      fWriter->Fill();
+      auto columnarStart = std::chrono::high_resolution_clock::now();
+      fFillTime += columnarStart - fillStart;
+      if(fColumnarWriter.IsOpen()) {
+	fColumnarWriter.Add(fWriteBatch.Front());
+	fColumnarTime += std::chrono::high_resolution_clock::now() - columnarStart;
+      }
+      //release the slot of the first event
+      fWriteBatch.Pop();
+      ++fNofFilledEvents;
+      if(fSettings->VerbosityLevel() > 1) {
+	std::cout<<"Wrote one event to tree."<<std::endl;
+      }
     }
+    //batches are handed over at the end of each cycle, so this batch finished these cycles
+    for(size_t cycle = 0; cycle < fWriteBatchCycleEnds; ++cycle) {
+      EndOfCycle(fNofFilledEvents);
+    }
+    fWriteTime += std::chrono::high_resolution_clock::now() - writeStart;
+
+    lock.lock();
+    fBatchReady = false;
+    lock.unlock();
+    fBatchCondition.notify_all();
   }//while loop
 
+  if(fSteady) {
+    fSteadyAllocations = AllocationCounter::Allocations() - fSteadyAllocations;
+    fSteadyEvents = fNofFilledEvents - fSteadyEvents;
+  }
   fStatus = kDone;
 
   auto end = std::chrono::high_resolution_clock::now();
 
   std::stringstream result;
-  result<<"FillTree finished with status "<<fStatus<<", fBuiltEvents.size() = "<<fBuiltEvents.size()<<" after "<<std::chrono::duration_cast<std::chrono::seconds>(end-start).count()<<" seconds"<<std::endl;
+  result<<"FillTree finished with status "<<fStatus<<" after "<<std::chrono::duration_cast<std::chrono::seconds>(end-start).count()<<" seconds, "
+	<<std::chrono::duration_cast<std::chrono::milliseconds>(fWriteTime).count()<<" ms writing ("
+	<<std::chrono::duration_cast<std::chrono::milliseconds>(fConvertTime).count()<<" ms converting, "
+	<<std::chrono::duration_cast<std::chrono::milliseconds>(fFillTime).count()<<" ms filling), "
+	<<std::chrono::duration_cast<std::chrono::milliseconds>(fFillWait).count()<<" ms waiting for events"<<std::endl;
   return result.str();
 }
 
+//all events of a cycle have been written to the tree, this is were per-cycle output can be finalised
+void MidasEventProcessor::EndOfCycle(size_t lastEvent) {
+  ++fNofFinishedCycles;
+  fWriter->EndOfCycle();
+  if(fSettings->VerbosityLevel() > 1) {
+    std::cout<<Show("Finished writing cycle ",fNofFinishedCycles,", ",lastEvent," events written so far")<<std::endl;
+  }
+}
+
 std::string MidasEventProcessor::BufferStatus(std::string fileName) {
+  AllocationCounter::ExcludeThread();
   //TStopwatch watch;
   auto start = std::chrono::high_resolution_clock::now();
 
   fBufferStatisticsFile.open(fileName.c_str());
 
-  size_t oldReadDetectorSize = 0;
+  size_t oldWaitingHits = 0;
   size_t oldBuiltEventsSize = 0;
   size_t oldTreeSize = 0;
 
-  fBufferStatisticsFile<<"#Time[ms] TimeDiff[ms] fReadDetector.size() oldReadDetectorSize fNofReadDetectors fBuiltEvents.size() oldBuiltEventsSize fNofBuiltEvents fTree->GetEntries() oldTreeSize"<<std::endl;
+  fBufferStatisticsFile<<"#Time[ms] TimeDiff[ms] fBuilder.NofWaitingHits() oldWaitingHits fBuilder.NofAddedHits() fBuildBatch.Size() oldBuiltEventsSize fNofBuiltEvents fWriter.NofEntries() oldTreeSize"<<std::endl;
 
   auto oldTime = start;
   while(fStatus != kDone) {
     auto now = std::chrono::high_resolution_clock::now();
     fBufferStatisticsFile<<std::chrono::duration_cast<std::chrono::milliseconds>(now-start).count()<<" "<<std::chrono::duration_cast<std::chrono::milliseconds>(now-oldTime).count()<<" "
-			 <<fReadDetector.size()<<" "<<oldReadDetectorSize<<" "<<fNofReadDetectors<<" "
-			 <<fBuiltEvents.size()<<" "<<oldBuiltEventsSize<<" "<<fNofBuiltEvents<<" "
-			 <<fTree->GetEntries()<<" "<<oldTreeSize<<std::endl;
+			 <<fBuilder.NofWaitingHits()<<" "<<oldWaitingHits<<" "<<fBuilder.NofAddedHits()<<" "
+			 <<fBuildBatch.Size()<<" "<<oldBuiltEventsSize<<" "<<fNofBuiltEvents<<" "
+			 <<fWriter->NofEntries()<<" "<<oldTreeSize<<std::endl;
 
-    oldReadDetectorSize = fReadDetector.size();
-    oldBuiltEventsSize  = fBuiltEvents.size();
-    oldTreeSize         = fTree->GetEntries();
+    oldWaitingHits      = fBuilder.NofWaitingHits();
+    oldBuiltEventsSize  = fBuildBatch.Size();
+    oldTreeSize         = fWriter->NofEntries();
     oldTime             = now;
 
     std::this_thread::sleep_for(std::chrono::seconds(1));
@@ -1338,6 +879,7 @@ std::string MidasEventProcessor::BufferStatus(std::string fileName) {
 }
 
 std::string MidasEventProcessor::StatusUpdate() {
+  AllocationCounter::ExcludeThread();
   //TStopwatch watch;
   auto start = std::chrono::high_resolution_clock::now();
 
@@ -1365,70 +907,13 @@ std::string MidasEventProcessor::Status() {
   } else {
     result<<"unknown status: ";
   }
-  result<<fReadDetector.size()<<"/"<<fNofReadDetectors<<" read detectors, "
-	<<fBuiltEvents.size()<<"/"<<fNofBuiltEvents<<" built events, "
-	<<fTree->GetEntries()<<" entries in tree";
+  if(fWriter == nullptr) {
+    result<<fHitHistograms.NofHits()<<" hits histogrammed";
+    return result.str();
+  }
+  result<<fBuilder.NofWaitingHits()<<"/"<<fBuilder.NofAddedHits()<<" read detectors, "
+	<<fBuildBatch.Size()<<"/"<<fNofBuiltEvents<<" built events, "
+	<<fWriter->NofEntries()<<" entries in tree";
 
   return result.str();
 }
-
-ClockState::ClockState(uint32_t startTime) {
-  fCycleStartTime = startTime;
-}
-
-void ClockState::Update(uint32_t time) {
-  //increment stored cycles
-  ++fNofStoredCycles;
-
-  //  //loop over all
-  //  for(i = 0; i < NUMBER_OF_DETECTOR_TYPES; i++) {
-  //
-  //    clockstate->firsteventtime[i] = 0;
-  //    clockstate->firsteventtimeset[i] = 0;
-  //
-  //    clockstate->cyclecorruptdeadtimes[i] = realloc(clockstate->cyclecorruptdeadtimes[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
-  //    clockstate->cycleulmclocks[i] = realloc(clockstate->cycleulmclocks[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
-  //    clockstate->cyclelivetimes[i] = realloc(clockstate->cyclelivetimes[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
-  //    clockstate->cycledeadtimes[i] = realloc(clockstate->cycledeadtimes[i], sizeof(unsigned long long)*clockstate->numberofstoredcycles);
-  //
-  //    if(clockstate->cyclelivetimes[i] == 0 || clockstate->cycledeadtimes[i] == 0) {
-  //      printf("Memory allocation error in updateClockStateForNewCycle()");
-  //      exit(-1);
-  //    }
-  //
-  //    clockstate->cyclecorruptdeadtimes[i][clockstate->numberofstoredcycles - 1] = clockstate->corruptdeadtime[i];
-  //    clockstate->cycleulmclocks[i][clockstate->numberofstoredcycles - 1] = clockstate->lastulmclock[i];
-  //    clockstate->cyclelivetimes[i][clockstate->numberofstoredcycles - 1] = clockstate->lastlivetime[i];
-  //    clockstate->cycledeadtimes[i][clockstate->numberofstoredcycles - 1] = clockstate->lastdeadtime[i];
-  //  }
-  //
-  //  clockstate->cyclestarttime = cyclestarttime;
-  //
-  //  //Reset the clock state.
-  //  for(i = 0; i < NUMBER_OF_DETECTOR_TYPES; i++) {
-  //    clockstate->corruptdeadtime[i] = 0;
-  //    clockstate->lastlivetime[i] = 0;
-  //    clockstate->numberoflivetimeoverflows[i] = 0;
-  //    clockstate->lastdeadtime[i] = 0;
-  //    clockstate->lastulmclock[i] = 0;
-  //  }
-}
-
-void ClockState::CorrectOverflow(const EDetectorType& detectorType, const uint32_t& eventTime, Ulm& ulm) {
-  uint8_t detType = static_cast<uint8_t>(detectorType);
-  if(fFirstEventTime.find(detType) == fFirstEventTime.end()) {
-    fFirstEventTime[detType] = eventTime - ulm.Clock()/ULM_CLOCK_IN_SECONDS;//all in seconds
-    return;
-  }
-  
-  uint32_t nofOverflows;
-  if(ulm.Clock() > ULM_CLOCK_OVERFLOW/2) {
-    nofOverflows = (uint32_t)(float(eventTime - fFirstEventTime[detType] - ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4)/(float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)));
-    std::cout<<"cyle number = "<<ulm.CycleNumber()<<", nofOverflows = (uint32_t)(float("<<eventTime<<" - "<<fFirstEventTime[detType]<<" - "<<ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<" = "<<eventTime - fFirstEventTime[detType] - ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<")/("<<float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)<<")) = "<<nofOverflows<<", ulm = "<<ulm.Clock()<<std::endl;
-  } else {
-    nofOverflows = (uint32_t)(float(eventTime - fFirstEventTime[detType] + ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4)/(float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)));
-    std::cout<<"cyle number = "<<ulm.CycleNumber()<<", nofOverflows = (uint32_t)(float("<<eventTime<<" - "<<fFirstEventTime[detType]<<" + "<<ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<" = "<<eventTime - fFirstEventTime[detType] + ULM_CLOCK_OVERFLOW/ULM_CLOCK_IN_SECONDS/4<<")/("<<float(ULM_CLOCK_OVERFLOW)/float(ULM_CLOCK_IN_SECONDS)<<")) = "<<nofOverflows<<", ulm = "<<ulm.Clock()<<std::endl;
-  }
-  
-  ulm.ClockOverflow(nofOverflows);
-}
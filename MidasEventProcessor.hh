@@ -4,44 +4,35 @@
 #include <future>
 #include <mutex>
 #include <fstream>
-#include <set>
-#include <boost/circular_buffer.hpp>
+#include <chrono>
+#include <condition_variable>
 
 #include "TTree.h"
+#include "TH1I.h"
+#include "TH1D.h"
 #include "Event.hh"
 
 #include "MidasFileManager.hh"
 #include "Settings.hh"
-#include "Calibration.hh"
+#include "SettingsManager.hh"
+#include "Hit.hh"
+#include "BuiltEvent.hh"
+#include "HitHistograms.hh"
+#include "FeraDecoder.hh"
+#include "EnergyCalibration.hh"
+#include "TimeCalibration.hh"
+#include "DriftTracker.hh"
+#include "EventBuilder.hh"
+#include "AllocationCounter.hh"
+#include "TreeWriter.hh"
+#include "ColumnarWriter.hh"
 
 #define STANDARD_WAIT_TIME 10
 
-class ClockState {
-public:
-  ClockState(uint32_t startTime = 0);
-  ~ClockState(){};
-
-  void Update(uint32_t);
-
-  uint32_t NofStoredCycles() {
-    return fNofStoredCycles;
-  }
-
-  void CorrectOverflow(const EDetectorType&, const uint32_t&, Ulm&);
- 
-private:
-  uint32_t fCycleStartTime;
-  uint32_t fNofStoredCycles;
-  std::map<uint32_t,uint32_t> fFirstEventTime;
-  std::map<uint32_t,uint32_t> fLastUlmClock;
-  std::map<uint32_t,uint32_t> fLastDeadTime;
-  std::map<uint32_t,uint32_t> fLastLiveTime;
-  std::map<uint32_t,uint32_t> fNofLiveTimeOverflows;
-};
-
 class MidasEventProcessor {
 public:
-  MidasEventProcessor(Settings*,TFile*,TTree*,std::string,bool);
+  //with a settings manager the decoding and building switch to the reloaded settings (the given settings are the first snapshot)
+  MidasEventProcessor(Settings*,TFile*,std::string,bool,SettingsManager* = nullptr);
   ~MidasEventProcessor();
   //use default moving constructor and assignment
   MidasEventProcessor(MidasEventProcessor&&) = default;
@@ -50,6 +41,8 @@ public:
   MidasEventProcessor(const MidasEventProcessor&) = delete;
   MidasEventProcessor& operator=(const MidasEventProcessor&) = delete;
 
+  //start of a new run (reads the calibration for this run)
+  void Run(int);
   bool Process(MidasEvent&);
 
   void Flush();
@@ -65,25 +58,33 @@ private:
 
   std::string Status();
 
-  //process the different midas event types
-  bool FifoEvent(MidasEvent&);
-  bool CamacScalerEvent(MidasEvent&, std::vector<std::vector<uint16_t> >);
-  bool EpicsEvent(MidasEvent&);
+  //event building diagnostics
+  TH1D* ToHistogram(const FixedHistogram&, const char*, const char*);
+  //coincidence matrices
+  void WriteMatrices();
+  void WriteMatrix(const CoincidenceMatrix&, const char*, const char*);
+  void PrintBuildDiagnostics();
+
+  //called once all events of a cycle have been written
+  void EndOfCycle(size_t);
 
-  //process the different detector types
-  void GermaniumEvent(Bank&, size_t, uint32_t, uint32_t);
-  void PlasticEvent(Bank&, size_t, uint32_t, uint32_t);
-  void SiliconEvent(Bank&, size_t, uint32_t, uint32_t);
-  void BaF2Event(Bank&, size_t, uint32_t, uint32_t);
+  //swaps the built event into the current batch
+  void AddBuiltEvent(BuiltEvent&);
+  //hands the current batch over to the writer
+  void HandOverBatch();
 
-  //process the different electronic modules
-  bool GetAdc114(Bank&, uint32_t, uint16_t&);
-  bool GetAdc413(Bank&, uint16_t, uint16_t, std::vector<std::pair<uint16_t, uint16_t> >&);
-  bool GetTdc3377(Bank&, uint32_t, std::map<uint16_t, std::vector<uint16_t> >&);
-  bool GetAdc4300(Bank&, uint16_t, uint16_t, std::vector<std::pair<uint16_t, uint16_t> >&);
-  bool GetUlm(Bank&, Ulm&);
+  //switch the decoding (and calibration) or the event building to the current snapshot of the settings
+  void SwitchDecodeSettings();
+  void SwitchBuildSettings();
 
-  void ConstructEvents(const uint32_t&, const uint32_t&, const EDetectorType&, std::vector<std::pair<uint16_t, uint16_t> >&, std::map<uint16_t, std::vector<uint16_t> >&, Ulm&);
+  //decodes the FIFO event, fills the histograms, and passes the hits on to the event builder
+  bool FifoEvent(MidasEvent&);
+  //adds the counts of the hit histograms to the ROOT histograms
+  void MergeHistograms();
+  void MergeCounts(TH1I*, const ChannelCounts&, size_t);
+  void WriteHistograms(std::vector<TH1I*>&);
+  //correction table and temperature correlation of the gain drift
+  void WriteDrift();
 
   enum EProcessStatus {
     kRun,
@@ -95,54 +96,80 @@ private:
 private:
   Settings* fSettings;
   TFile* fRootFile;
-  TTree* fTree;
+
+  //hot reload: snapshots of the settings used by the decoding and the building thread, and the generation they belong to
+  //(only compared at the start of each FIFO event and each build, so the snapshots don't change within a batch)
+  SettingsManager* fSettingsManager;
+  std::shared_ptr<Settings> fDecodeSettings;
+  uint64_t fDecodeGeneration;
+  std::shared_ptr<Settings> fBuildSettings;
+  uint64_t fBuildGeneration;
 
   EProcessStatus fStatus;
-  Event* fLeaf = nullptr;
 
   //variable to keep track of number of events per detector type
   std::map<uint16_t,uint32_t> fNofMidasEvents;
-  //keep track how often a bank has appeared in the data
-  std::map<uint32_t, uint32_t> fBankCounter;
-  //keep track how often a fera type has appeared in the data
-  std::map<uint16_t, uint32_t> fCounter;
-  //keep track how often a tdc sub-address has appeared in the data
-  std::map<uint16_t, uint32_t> fSubAddress;
-  //keep track of dropped detectors (marked as inactive)
-  std::map<uint8_t, std::map<uint16_t, uint32_t> > fDroppedDetector;
-  size_t fNofReadDetectors;
   size_t fNofBuiltEvents;
+  size_t fNofFilledEvents;
+  size_t fNofFinishedCycles;
   std::map<size_t,size_t> fDetectorsPerEvent;
-  //scaler data
-  std::vector<std::vector<uint16_t> > fMcs;
-
-  //buffers to store detectors/events
-  std::multiset<Detector, std::less<Detector> > fReadDetector;
-  boost::circular_buffer<Event> fBuiltEvents;
 
+  const char* fDetectorTypeNames[NOF_DETECTOR_TYPES] = { "Germanium", "Plastic", "Silicon", "BaF2", "Unknown" };
+
+  //decoding and event building (no ROOT involved)
+  FeraDecoder fDecoder;
+  EnergyCalibration fCalibration;
+  bool fCalibrate;
+  //fine timestamps from the calibrated TDC times
+  TimeCalibration fTiming;
+  bool fTimed;
+  DriftTracker fDrift;
+  EventBuilder fBuilder;
+  std::vector<Hit> fHits;
+  //FIFO event records and additional TDC times of the hits
+  FifoRecords fRecords;
+  //converts the built events for the output tree (not created in histogram-only mode)
+  TreeWriter* fWriter;
+  //optional columnar output
+  ColumnarWriter fColumnarWriter;
+
+  //double buffer of built events: the builder fills one batch while the writer writes the other one (the slots are recycled)
+  BuiltEventBuffer fBuildBatch;
+  BuiltEventBuffer fWriteBatch;
+  //number of cycles ending with each batch
+  size_t fBuildBatchCycleEnds;
+  size_t fWriteBatchCycleEnds;
+  //set by the builder when handing over a batch, reset by the writer when it's done with it
+  bool fBatchReady;
+  std::mutex fBuiltMutex;
+  std::condition_variable fBatchCondition;
+  //time the builder waited for the writer, time the writer waited for batches, and time it spent writing them;
+  //of the latter the time converting the events to the tree variables, filling the tree, and adding them to the columnar file
+  std::chrono::high_resolution_clock::duration fHandOverWait;
+  std::chrono::high_resolution_clock::duration fFillWait;
+  std::chrono::high_resolution_clock::duration fWriteTime;
+  std::chrono::high_resolution_clock::duration fConvertTime;
+  std::chrono::high_resolution_clock::duration fFillTime;
+  std::chrono::high_resolution_clock::duration fColumnarTime;
+
+  //heap allocations of all threads but the decoding and status threads in steady state, i.e. after the first BuiltEventsSize() events
+  //have been written (only counted if compiled with COUNT_ALLOCATIONS), set by the writer thread
+  bool fSteady;
+  size_t fSteadyAllocations;
+  size_t fSteadyEvents;
+
+  //counts of the decoded hits, only converted to the ROOT histograms when they are written
+  HitHistograms fHitHistograms;
   //calibration histograms
   std::vector<std::vector<TH1I*> > fRawEnergyHistograms;
   std::vector<std::vector<TH1I*> > fTimingHistograms;
+  //hit pattern and multiplicity per FIFO event for each detector type
+  std::vector<TH1I*> fHitPatternHistograms;
   std::vector<TH1I*> fMultiplicityHistograms;
-  //variables to keep track of last event
-  uint32_t fLastEventNumber;
-  uint32_t fLastEventTime;
-  std::map<uint32_t,uint32_t> fLastFifoSerial;
-  std::map<uint32_t,uint32_t> fNofZeros;
-  std::map<uint32_t,uint32_t> fNofUnkownFera;
+  size_t fNofMergedHits;
   //this hold the futures of the threads
   std::vector<std::pair<uint16_t, std::future<std::string> > > fThreads;
-  //clock state
-  ClockState fClockState;
-
-  //cycle statistics
-  size_t fNofCycles;
-  uint16_t fLastCycle;
-  size_t fEventsInCycle;
 
-  //temperature output file and other files
-  std::ofstream fTemperatureFile;
-  std::ofstream fDataFile;
   std::ofstream fBufferStatisticsFile;
 };
 
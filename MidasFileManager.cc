@@ -3,196 +3,8 @@
 #include <iomanip>
 #include <fstream>
 
-#include "TCollection.h"
-#include "TXMLDocument.h"
-#include "TXMLAttr.h"
-
 #include "TextAttributes.hh"
 
-void MidasFileHeader::ParseOdb() {
-  fParser->SetValidate(false);
-  fParser->ParseBuffer(reinterpret_cast<char*>(fInformation.data()),fInformation.size()*2);
-  TXMLDocument* doc = fParser->GetXMLDocument();
-  if(doc == nullptr) {
-    std::cerr<<"Malformed ODB dump: cannot get XML document"<<std::endl;
-    return;
-  }
-
-  fOdb = FindNode(doc->GetRootNode(),"odb");
-  
-  if(fOdb == nullptr) {
-    std::cerr<<"Malformed ODB dump: cannot find <odb> tag"<<std::endl;
-    return;
-  }
-}
-
-void MidasFileHeader::PrintOdb(TXMLNode* startNode, size_t level) {
-  if(startNode == nullptr) {
-    startNode = fOdb;
-  }
-  for(TXMLNode* node = startNode; node != nullptr; node = node->GetNextNode()) {
-    for(size_t i = 0; i < level; ++i) {
-      std::cout<<"  ";
-    }
-    if(node->GetText() != nullptr) {
-      for(size_t i = 0; i < level+1; ++i) {
-	std::cout<<"  ";
-      }
-      std::cout<<"Text: "<<node->GetText()<<std::endl;
-    }
-    TIter next((TCollection*)(node->GetAttributes()));
-    TXMLAttr* attribute;
-    while((attribute = (TXMLAttr*) next()) != nullptr) {
-      for(size_t i = 0; i < level+1; ++i) {
-	std::cout<<"  ";
-      }
-      std::cout<<"Attribute: "<<attribute->GetName()<<" = "<<attribute->GetValue()<<std::endl;
-    }
-    if(node->HasChildren()) {
-      PrintOdb(node->GetChildren(),level+1);
-    }
-  }
-}
-
-TXMLNode* MidasFileHeader::FindNode(TXMLNode* startNode, const char* name) {
-  for(TXMLNode* node = startNode; node != nullptr; node = node->GetNextNode()) {
-    if(strcmp(node->GetNodeName(),name) == 0) {
-      return node;
-    }
-    if(node->HasChildren()) {
-      TXMLNode* found = FindNode(node->GetChildren(),name);
-      if(found != nullptr) {
-	return found;
-      }
-    }
-  }
-  return nullptr;
-}
-
-const char* MidasFileHeader::GetAttribute(TXMLNode* node, const char* attributeName) {
-  return GetAttribute(node, std::string(attributeName));
-}
-
-const char* MidasFileHeader::GetAttribute(TXMLNode* node, std::string attributeName) {
-  TIter next((TCollection*)(node->GetAttributes()));
-  TXMLAttr* attribute;
-  while((attribute = (TXMLAttr*) next()) != nullptr) {
-    if(attributeName.compare(attribute->GetName()) == 0) {
-      return attribute->GetValue();
-    }
-  }
-  return nullptr;
-}
-
-TXMLNode* MidasFileHeader::FindArrayPath(TXMLNode* node, std::string path, std::string type, int index) {
-  if(fOdb == nullptr) {
-    return nullptr;
-  }
-
-  if(node == nullptr) {
-    node = fOdb->GetChildren();
-  }
-
-  std::transform(path.begin(), path.end(), path.begin(), tolower);
-  std::transform(type.begin(), type.end(), type.begin(), tolower);  
-
-  std::string element;
-
-  TXMLNode* tmpNode = node;
-  while(tmpNode != nullptr) {
-    //strip leading slashes
-    path.erase(0,path.find_first_not_of("/"));
-
-    if(path.length() == 0) {
-      node = tmpNode;
-      break;
-    }
-   
-    if(path.find('/') != std::string::npos) {
-      element = path.substr(0,path.find('/')-1);
-    } else {
-      element = path;
-    }
-
-    for(; tmpNode != nullptr; tmpNode = tmpNode->GetNextNode()) {
-      std::string nodeName = tmpNode->GetNodeName();
-      std::string nameValue = GetAttribute(tmpNode,"name");
-      
-      bool isDir = nodeName.compare("dir") == 0;
-      bool isKey = nodeName.compare("key") == 0;
-      bool isKeyArray = nodeName.compare("keyarray") == 0;
-      
-      if(!isKey && !isDir && !isKeyArray) {
-	continue;
-      }
-      
-      std::transform(nameValue.begin(), nameValue.end(), nameValue.begin(), tolower);
-      if(element.compare(nameValue) == 0) {
-	if(isDir) {
-	  // found the right subdirectory, descend into it
-	  tmpNode = tmpNode->GetChildren();
-	  break;
-	} else if(isKey || isKeyArray) {
-	  node = tmpNode;
-	  tmpNode = nullptr;
-	  break;
-	}
-      }
-    }
-  }
-
-  if(node == nullptr) {
-    return nullptr;
-  }
-
-  std::string nodeName = node->GetNodeName();
-  std::string numberValues = GetAttribute(node,"num_values");
-
-  std::string typeValue = GetAttribute(node,"type");
-  std::transform(typeValue.begin(), typeValue.end(), typeValue.begin(), tolower);
-
-  if(typeValue == nullptr || typeValue.compare(type) != 0) {
-    std::cerr<<__PRETTY_FUNCTION__<<": Type mismatch: we expected '"<<type<<"', but got '"<<typeValue<<"'"<<std::endl;
-    return nullptr;
-  }
-
-  if(numberValues != nullptr && nodeName.compare("keyarray") == 0) {
-    if(index != 0) {
-      std::cerr<<__PRETTY_FUNCTION__<<": Attempt to access array element "<<index<<", but this is not an array"<<std::endl;
-      return nullptr;
-    }
-
-    return node;
-  }
-
-  int maxIndex;
-  std::stringstream stream(numberValues);
-  stream>>maxIndex;
-
-  if(index < 0 || index >= maxIndex) {
-    std::cerr<<__PRETTY_FUNCTION__<<": Attempt to access array element "<<index<<", but size of array  is "<<maxIndex<<std::endl;
-    return nullptr;
-  }
-
-  TXMLNode* child = node->GetChildren();
-
-  for(int i = 0; child != nullptr; ) {
-    std::string name = child->GetNodeName();
-    std::string text = child->GetText();
-
-    if(name.compare("value") == 0) {
-      if(i == index) {
-	return child;
-	++i;
-      }
-      
-      child = child->GetNextNode();
-    }
-  }
-
-  return node;
-}
-
 MidasFileManager::~MidasFileManager() {
   if(fFile.is_open()) {
     fFile.close();
@@ -527,132 +339,3 @@ int MidasFileManager::SetRunStartTime(int& starttime) {
   return 0;
 }
 
-//---------------------------------------- Bank
-void Bank::Print(bool hexFormat, bool printBankContents) {
-  if(hexFormat) {
-    std::cout<<std::hex<<"Bank Number: 0x"<<fNumber<<", Bankname: "<<fName[0]<<fName[1]<<fName[2]<<fName[3]<<", Type: 0x"<<fType<<", Banksize: 0x"<<fData.size()<<", Number of Extra Bytes: 0x"<<fExtraBytes.size();
-    
-    if(printBankContents) {
-      for(size_t i = 0; i < fData.size(); i++) {
-	if(i%8 == 0) {
-	  std::cout<<std::endl<<"0x";
-	}
-	std::cout<<std::setw(8)<<std::setfill('0')<<fData[i]<<" ";
-      }
-    }
-    std::cout<<std::dec<<std::setfill(' ')<<std::endl;
-  } else {
-    std::cout<<"Bank Number: "<<fNumber<<", Bankname: "<<fName[0]<<fName[1]<<fName[2]<<fName[3]<<", Type: "<<fType<<", Banksize: "<<fData.size()<<", Number of Extra Bytes: "<<fExtraBytes.size()<<std::dec<<std::endl;
-
-    if(printBankContents) {
-      for(size_t i = 0; i < fData.size(); i++) {
-	if(i%8 == 0 && i != 0) {
-	  std::cout<<std::endl;
-	}
-	std::cout<<fData[i]<<" ";
-      }
-      std::cout<<std::endl;
-    }
-  }
-}
-
-bool Bank::Get(uint16_t& value) {
-  //peek at the value and then advance the read point
-  Peek(value);
-  ++fReadPoint;
-  return true;
-}
-
-bool Bank::Get(uint32_t& value) {
-  //peek at the value and then advance the read point
-  Peek(value);
-  fReadPoint += 2;
-  return true;
-}
-
-bool Bank::Get(float& value) {
-  //peek at the value and then advance the read point
-  Peek(value);
-  fReadPoint += 2;
-  return true;
-}
-
-bool Bank::Peek(uint16_t& value) {
-  //std::cout<<"Peeking 16bits at "<<fReadPoint<<std::endl;
-  //fReadPoint counts the 16bit values, but data contains 32bit values
-  if(fReadPoint/2 >= fData.size()) {
-    //std::cerr<<__PRETTY_FUNCTION__<<": end of buffer reached in event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words"<<std::endl;
-    //Print(true, true);
-    value = 0;
-    return false;
-  }
-  if(fReadPoint%2 == 0) {
-    value = fData[fReadPoint/2] >> 16;
-  } else {
-    value = fData[fReadPoint/2] & 0xffff;
-  }
-  return true;
-}
-
-bool Bank::Peek(uint32_t& value) {
-  //std::cout<<"Peeking 32bits at "<<fReadPoint<<std::endl;
-  //fReadPoint counts the 16bit values, but data contains 32bit values
-  if((fReadPoint+1)/2 >= fData.size()) {
-    //std::cerr<<__PRETTY_FUNCTION__<<": end of buffer reached in event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words"<<std::endl;
-    //Print(true, true);
-    value = 0;
-    return false;
-  }
-  if(fReadPoint%2 != 0) {
-    //std::cerr<<__PRETTY_FUNCTION__<<": trying to read 32bits after an odd number of 16bit words have been read! Event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words, fData[fReadPoint/2] 0x"<<std::hex<<fData[fReadPoint/2]<<", 0x"<<fData[(fReadPoint+1)/2];
-    //get the low word of fReadPoint/2 and the high word of (fReadPoint+1)/2
-    value = ((fData[fReadPoint/2] & 0xffff) << 16) | ((fData[(fReadPoint+1)/2] & 0xffff0000) >> 16);
-    //std::cerr<<", value 0x"<<value<<std::dec<<std::endl;
-  } else {
-    value = fData[fReadPoint/2];
-  }
-
-  return true;
-}
-
-bool Bank::Peek(float& value) {
-  assert(sizeof(float) == sizeof(uint32_t));
-  //fReadPoint counts the 16bit values, but data contains 32bit values
-  if(fReadPoint/2 >= fData.size()) {
-    //std::cerr<<__PRETTY_FUNCTION__<<": end of buffer reached in event "<<fEventNumber<<", bank "<<fNumber<<", location "<<fReadPoint<<", size "<<fData.size()<<"+1 16bit words"<<std::endl;
-    //Print(true, true);
-    value = 0;
-    return false;
-  }
-  memcpy(&value,&(fData[fReadPoint/2]),sizeof(float));
-  return true;
-}
-
-//---------------------------------------- Event
-void MidasEvent::Zero() {
-  fBanks.clear();
-  fType = 0;
-  fMask = 0;
-  fNumber = 0;
-  fTime = 0;
-  fNofBytes = 0;
-  
-  fTotalBankBytes = 0;
-  fFlags = 0;
-}
-
-void MidasEvent::Print(bool hexFormat, bool printBanks, bool printBankContents) {
-  if(hexFormat) {
-    std::cout<<std::hex<<"Eventtype: 0x"<<fType<<", Eventmask: 0x"<<fMask<<", Eventnumber: 0x"<<fNumber<<", Eventtime: 0x"<<fTime<<", Number of Event Bytes: "<<std::dec<<fNofBytes<<std::endl
-	<<std::hex<<"Total Bank Bytes: 0x"<<fTotalBankBytes<<", Flags: 0x"<<fFlags<<", Number of Banks: "<<std::dec<<fBanks.size()<<std::endl;
-  }  else {
-    std::cout<<"Eventtype: "<<fType<<", Eventmask: "<<fMask<<", Eventnumber: "<<fNumber<<", Eventtime: "<<fTime<<", Number of Event Bytes: "<<fNofBytes<<std::endl
-	<<"Total Bank Bytes: "<<fTotalBankBytes<<", Flags: "<<fFlags<<", Number of Banks: "<<fBanks.size()<<std::endl;
-  }
-  
-  if(printBanks) {
-    for(auto& bank : fBanks) {
-      bank.Print(hexFormat, printBankContents);
-    }
-  }
-}
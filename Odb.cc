@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
 void Odb::ParseInformation(std::vector<uint16_t> information) {
   pugi::xml_document doc;
@@ -62,6 +63,35 @@ void OdbDirectory::Print(std::string parents) {
   }
 }
 
+const OdbEntry* OdbDirectory::Find(std::string path) const {
+  //strip leading slashes
+  path.erase(0,path.find_first_not_of("/"));
+  std::string element = path.substr(0,path.find('/'));
+  bool last = (path.find('/') == std::string::npos);
+
+  //names in the odb are case-insensitive
+  auto equal = [](const std::string& a, const std::string& b) -> bool {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char c, char d) { return tolower(c) == tolower(d); });
+  };
+
+  if(last) {
+    for(const auto& entry : fEntries) {
+      if(equal(entry.Name(), element)) {
+	return &entry;
+      }
+    }
+    return nullptr;
+  }
+
+  for(const auto& subDirectory : fSubDirectories) {
+    if(equal(subDirectory.fName, element)) {
+      return subDirectory.Find(path.substr(path.find('/')+1));
+    }
+  }
+
+  return nullptr;
+}
+
 OdbEntry::OdbEntry(pugi::xml_node node) {
   //get attributes
   fName = node.attribute("name").value();
@@ -15,6 +15,13 @@ public:
 
   void Print(std::string);
 
+  const std::string& Name() const {
+    return fName;
+  }
+  const std::string& Value() const {
+    return fValue;
+  }
+
 private:
   std::string fName;
   std::string fType;
@@ -37,6 +44,8 @@ public:
     fSubDirectories.push_back(OdbDirectory(subDirectory));
   }
 
+  const OdbEntry* Find(std::string) const;
+
 private:
   std::string fName;
   std::vector<OdbDirectory> fSubDirectories;
@@ -54,6 +63,11 @@ public:
     fBase.Print(std::string(""));
   }
 
+  //find the entry with the given path (e.g. "/Runinfo/Run number"), returns nullptr if it doesn't exist
+  const OdbEntry* Find(std::string path) const {
+    return fBase.Find(path);
+  }
+
 private:
   OdbDirectory fBase;
 };
@@ -0,0 +1,92 @@
+#include "OutputBenchmark.hh"
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+#include "TreeWriter.hh"
+
+OutputBenchmark::OutputBenchmark(Settings* settings, size_t nofEvents) {
+  fSettings = settings;
+  fNofEvents = nofEvents;
+  fEvents.reserve(fNofEvents);
+
+  fConfigurations.push_back(std::make_pair("ZLIB", 0));
+  for(auto algorithm : { "ZLIB", "LZMA", "LZ4", "ZSTD" }) {
+    for(auto level : { 1, 4, 9 }) {
+      fConfigurations.push_back(std::make_pair(algorithm, level));
+    }
+  }
+}
+
+void OutputBenchmark::Add(BuiltEvent& event) {
+  if(Full()) {
+    return;
+  }
+  fEvents.emplace_back();
+  fEvents.back().Swap(event);
+  event.Clear();
+}
+
+void OutputBenchmark::Run(const std::string& fileName) {
+  std::cout<<"Benchmarking output of "<<fEvents.size()<<" events with "<<(fSettings->TreeSchema() == ETreeSchema::kFlat ? "flat" : "event")<<" schema, basket size "
+	   <<fSettings->BasketSize()<<", auto-flush "<<fSettings->AutoFlush()<<", "<<fSettings->NofOutputThreads()<<" thread(s):"<<std::endl
+	   <<std::setw(6)<<"algo."<<std::setw(7)<<"level"<<std::setw(14)<<"write [MB/s]"<<std::setw(14)<<"read [MB/s]"<<std::setw(12)<<"size [MB]"<<std::setw(8)<<"ratio"<<std::endl;
+
+  for(auto configuration : fConfigurations) {
+    fSettings->CompressionAlgorithm(configuration.first);
+    fSettings->CompressionLevel(configuration.second);
+
+    //-------------------- write
+    auto start = std::chrono::high_resolution_clock::now();
+    TFile* file = new TFile(fileName.c_str(), "recreate");
+    if(!file->IsOpen()) {
+      std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to open benchmark file '",fileName,"'",Attribs::Reset())<<std::endl;
+      delete file;
+      return;
+    }
+    file->SetCompressionSettings(fSettings->CompressionSettings());
+    double totalBytes;
+    {
+      //no rollover, the tree is written to the benchmark file
+      TreeWriter writer(fSettings, file, false);
+      for(const auto& event : fEvents) {
+	writer.Set(event);
+	writer.Fill();
+      }
+      writer.Close();
+      totalBytes = writer.TotalBytes();
+    }
+    file->Close();
+    delete file;
+    auto end = std::chrono::high_resolution_clock::now();
+    double writeTime = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count()/1e6;
+
+    //-------------------- read
+    start = std::chrono::high_resolution_clock::now();
+    file = new TFile(fileName.c_str());
+    double fileSize = file->GetSize();
+    TTree* tree = static_cast<TTree*>(file->Get("tree"));
+    if(tree != nullptr) {
+      Long64_t nofEntries = tree->GetEntries();
+      for(Long64_t entry = 0; entry < nofEntries; ++entry) {
+	tree->GetEntry(entry);
+      }
+    }
+    file->Close();
+    delete file;
+    end = std::chrono::high_resolution_clock::now();
+    double readTime = std::chrono::duration_cast<std::chrono::microseconds>(end-start).count()/1e6;
+
+    std::cout<<std::setw(6)<<configuration.first<<std::setw(7)<<configuration.second
+	     <<std::fixed<<std::setprecision(1)
+	     <<std::setw(14)<<totalBytes/1048576./writeTime<<std::setw(14)<<totalBytes/1048576./readTime
+	     <<std::setw(12)<<fileSize/1048576.<<std::setprecision(2)<<std::setw(8)<<totalBytes/fileSize<<std::endl;
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef __OUTPUT_BENCHMARK_HH
+#define __OUTPUT_BENCHMARK_HH
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include "Settings.hh"
+#include "BuiltEvent.hh"
+
+//writes the same built events with different compression settings and reports write speed, read speed, and file size
+class OutputBenchmark {
+public:
+  OutputBenchmark(Settings*, size_t);
+  ~OutputBenchmark(){};
+
+  //the event is swapped into the benchmark (same as BuiltEventBuffer::Push)
+  void Add(BuiltEvent&);
+  bool Full() {
+    return fEvents.size() >= fNofEvents;
+  }
+  size_t NofEvents() {
+    return fEvents.size();
+  }
+
+  //writes one file per configuration to the given file name (overwritten for each configuration)
+  void Run(const std::string&);
+
+private:
+  Settings* fSettings;
+  size_t fNofEvents;
+  std::vector<BuiltEvent> fEvents;
+  //algorithm names and levels to be tested
+  std::vector<std::pair<std::string, int> > fConfigurations;
+};
+
+#endif
@@ -0,0 +1,277 @@
+#include "PeakFinder.hh"
+
+#include <cmath>
+#include <algorithm>
+
+#include "LinearSystem.hh"
+
+PeakFinder::PeakFinder(double sigma, int rebin, double minSignificance) {
+  fSigma = (sigma > 0.) ? sigma : 1.;
+  fRebin = std::max(rebin, 1);
+  fMinSignificance = minSignificance;
+
+  //the filter needs to be at least a few bins wide to suppress the statistical fluctuations
+  double width = std::max(fSigma/fRebin, 1.);
+  fHalfWidth = static_cast<int>(std::ceil(3.*width));
+  fKernel.resize(2*fHalfWidth + 1);
+  double sum = 0.;
+  for(int i = -fHalfWidth; i <= fHalfWidth; ++i) {
+    double x = i/width;
+    fKernel[i + fHalfWidth] = (1. - x*x)*std::exp(-x*x/2.);
+    sum += fKernel[i + fHalfWidth];
+  }
+  //zero sum so that a linear background doesn't contribute
+  for(auto& value : fKernel) {
+    value -= sum/fKernel.size();
+  }
+}
+
+bool PeakFinder::Find(const std::vector<float>& spectrum, int low, int high, FoundPeak& peak) {
+  low = std::max(low, 0);
+  high = std::min(high, static_cast<int>(spectrum.size()) - 1);
+  if(high < low) {
+    return false;
+  }
+  int position;
+  peak.fSignificance = Candidate(spectrum, low, high, position);
+  if(peak.fSignificance < fMinSignificance) {
+    return false;
+  }
+  if(!Fit(spectrum, position, peak)) {
+    Centroid(spectrum, position, peak);
+  }
+
+  return true;
+}
+
+size_t PeakFinder::FindAll(const std::vector<float>& spectrum, int low, int high, size_t maxPeaks, std::vector<FoundPeak>& peaks) {
+  peaks.clear();
+  low = std::max(low, 0);
+  high = std::min(high, static_cast<int>(spectrum.size()) - 1);
+  if(high < low || maxPeaks == 0) {
+    return 0;
+  }
+  std::vector<double> significances;
+  int first = Significances(spectrum, low, high, significances);
+
+  //local maxima of the significance, neighbours closer than two sigma belong to the same peak
+  int distance = std::max(static_cast<int>(std::ceil(2.*fSigma/fRebin)), 1);
+  std::vector<std::pair<double, int> > candidates;
+  for(int i = 0; i < static_cast<int>(significances.size()); ++i) {
+    if(significances[i] < fMinSignificance) {
+      continue;
+    }
+    //of equal neighbours only the first one is a maximum
+    bool maximum = true;
+    for(int j = std::max(i - distance, 0); j <= std::min(i + distance, static_cast<int>(significances.size()) - 1); ++j) {
+      if((j < i && significances[j] >= significances[i]) || (j > i && significances[j] > significances[i])) {
+	maximum = false;
+	break;
+      }
+    }
+    if(maximum) {
+      candidates.push_back(std::make_pair(significances[i], first + i));
+    }
+  }
+  std::sort(candidates.begin(), candidates.end(), [](const std::pair<double, int>& a, const std::pair<double, int>& b) { return a.first > b.first; });
+  if(candidates.size() > maxPeaks) {
+    candidates.resize(maxPeaks);
+  }
+
+  FoundPeak peak;
+  for(const auto& candidate : candidates) {
+    int position = Maximum(spectrum, candidate.second, low, high);
+    peak.fSignificance = candidate.first;
+    if(!Fit(spectrum, position, peak)) {
+      Centroid(spectrum, position, peak);
+    }
+    peaks.push_back(peak);
+  }
+  std::sort(peaks.begin(), peaks.end(), [](const FoundPeak& a, const FoundPeak& b) { return a.fPosition < b.fPosition; });
+
+  return peaks.size();
+}
+
+double PeakFinder::Candidate(const std::vector<float>& spectrum, int low, int high, int& position) {
+  std::vector<double> significances;
+  int first = Significances(spectrum, low, high, significances);
+
+  double bestSignificance = 0.;
+  int best = -1;
+  for(size_t i = 0; i < significances.size(); ++i) {
+    if(significances[i] > bestSignificance) {
+      bestSignificance = significances[i];
+      best = first + i;
+    }
+  }
+  if(best < 0) {
+    return 0.;
+  }
+  position = Maximum(spectrum, best, low, high);
+
+  return bestSignificance;
+}
+
+int PeakFinder::Significances(const std::vector<float>& spectrum, int low, int high, std::vector<double>& significances) {
+  int nofBins = spectrum.size();
+  int nofCoarseBins = (nofBins + fRebin - 1)/fRebin;
+  //rebin the window plus the width of the filter on both sides
+  int coarseLow = std::max(low/fRebin - fHalfWidth, 0);
+  int coarseHigh = std::min(high/fRebin + fHalfWidth, nofCoarseBins - 1);
+  std::vector<double> coarse(coarseHigh - coarseLow + 1, 0.);
+  for(int bin = coarseLow*fRebin; bin < std::min((coarseHigh + 1)*fRebin, nofBins); ++bin) {
+    coarse[bin/fRebin - coarseLow] += spectrum[bin];
+  }
+
+  int first = std::max(low/fRebin, coarseLow + fHalfWidth);
+  int last = std::min(high/fRebin, coarseHigh - fHalfWidth);
+  significances.assign(std::max(last - first + 1, 0), 0.);
+  for(int i = first; i <= last; ++i) {
+    double response = 0.;
+    double variance = 0.;
+    for(int j = -fHalfWidth; j <= fHalfWidth; ++j) {
+      double content = coarse[i + j - coarseLow];
+      response += fKernel[j + fHalfWidth]*content;
+      variance += fKernel[j + fHalfWidth]*fKernel[j + fHalfWidth]*content;
+    }
+    if(response > 0. && variance > 0.) {
+      significances[i - first] = response/std::sqrt(variance);
+    }
+  }
+
+  return first;
+}
+
+int PeakFinder::Maximum(const std::vector<float>& spectrum, int coarseBin, int low, int high) {
+  int position = std::max(std::max(coarseBin - 1, 0)*fRebin, low);
+  int end = std::min((coarseBin + 2)*fRebin - 1, high);
+  for(int bin = position + 1; bin <= end; ++bin) {
+    if(spectrum[bin] > spectrum[position]) {
+      position = bin;
+    }
+  }
+
+  return position;
+}
+
+//gaussian on a linear background, fitted with Levenberg-Marquardt (Neyman chi-square)
+bool PeakFinder::Fit(const std::vector<float>& spectrum, int start, FoundPeak& peak) {
+  int halfRange = std::max(static_cast<int>(std::ceil(3.*fSigma)), 3);
+  int low = std::max(start - halfRange, 0);
+  int high = std::min(start + halfRange, static_cast<int>(spectrum.size()) - 1);
+  if(high - low < 6) {
+    return false;
+  }
+
+  //amplitude, position, sigma, background at the start, background slope
+  std::vector<double> parameters(5);
+  parameters[3] = (spectrum[low] + spectrum[high])/2.;
+  parameters[4] = (spectrum[high] - spectrum[low])/(high - low);
+  parameters[0] = spectrum[start] - parameters[3];
+  parameters[1] = start;
+  parameters[2] = fSigma;
+  if(parameters[0] <= 0.) {
+    return false;
+  }
+
+  auto chiSquare = [&](const std::vector<double>& p) {
+    double result = 0.;
+    for(int bin = low; bin <= high; ++bin) {
+      double x = bin - p[1];
+      double residual = spectrum[bin] - (p[0]*std::exp(-x*x/(2.*p[2]*p[2])) + p[3] + p[4]*(bin - start));
+      result += residual*residual/std::max(static_cast<double>(spectrum[bin]), 1.);
+    }
+    return result;
+  };
+
+  double chi2 = chiSquare(parameters);
+  double lambda = 1e-3;
+  std::vector<double> matrix(25);
+  std::vector<double> vector(5);
+  std::vector<double> derivatives(5);
+  std::vector<double> trial(5);
+  bool converged = false;
+  for(int iteration = 0; iteration < 100 && !converged; ++iteration) {
+    std::fill(matrix.begin(), matrix.end(), 0.);
+    std::fill(vector.begin(), vector.end(), 0.);
+    for(int bin = low; bin <= high; ++bin) {
+      double x = bin - parameters[1];
+      double gauss = std::exp(-x*x/(2.*parameters[2]*parameters[2]));
+      double residual = spectrum[bin] - (parameters[0]*gauss + parameters[3] + parameters[4]*(bin - start));
+      double weight = 1./std::max(static_cast<double>(spectrum[bin]), 1.);
+      derivatives[0] = gauss;
+      derivatives[1] = parameters[0]*gauss*x/(parameters[2]*parameters[2]);
+      derivatives[2] = parameters[0]*gauss*x*x/(parameters[2]*parameters[2]*parameters[2]);
+      derivatives[3] = 1.;
+      derivatives[4] = bin - start;
+      for(int i = 0; i < 5; ++i) {
+	vector[i] += weight*derivatives[i]*residual;
+	for(int j = 0; j < 5; ++j) {
+	  matrix[i*5 + j] += weight*derivatives[i]*derivatives[j];
+	}
+      }
+    }
+    //retry with larger damping until the step improves the chi-square
+    while(true) {
+      std::vector<double> damped = matrix;
+      std::vector<double> step = vector;
+      for(int i = 0; i < 5; ++i) {
+	damped[i*5 + i] *= 1. + lambda;
+      }
+      if(!SolveLinearSystem(damped, step, 5)) {
+	return false;
+      }
+      for(int i = 0; i < 5; ++i) {
+	trial[i] = parameters[i] + step[i];
+      }
+      double trialChi2 = (trial[2] > 0.) ? chiSquare(trial) : chi2 + 1.;
+      if(trialChi2 <= chi2) {
+	converged = (chi2 - trialChi2) <= 1e-6*chi2;
+	parameters.swap(trial);
+	chi2 = trialChi2;
+	lambda = std::max(lambda/10., 1e-10);
+	break;
+      }
+      lambda *= 10.;
+      if(lambda > 1e10) {
+	//no step improves the chi-square, so we are at the minimum
+	converged = true;
+	break;
+      }
+    }
+  }
+
+  if(!converged || parameters[0] <= 0. || parameters[1] < low || parameters[1] > high || parameters[2] < 0.2*fSigma || parameters[2] > 5.*fSigma) {
+    return false;
+  }
+  peak.fPosition = parameters[1];
+  peak.fAmplitude = parameters[0];
+  peak.fSigma = parameters[2];
+  peak.fBackground = parameters[3] + parameters[4]*(parameters[1] - start);
+  peak.fFitted = true;
+
+  return true;
+}
+
+//centroid within +- 2 sigma after subtracting a linear background through the edges
+void PeakFinder::Centroid(const std::vector<float>& spectrum, int start, FoundPeak& peak) {
+  int halfRange = std::max(static_cast<int>(std::ceil(2.*fSigma)), 1);
+  int low = std::max(start - halfRange, 0);
+  int high = std::min(start + halfRange, static_cast<int>(spectrum.size()) - 1);
+  double slope = (high > low) ? (spectrum[high] - spectrum[low])/(high - low) : 0.;
+
+  double sum = 0.;
+  double weightedSum = 0.;
+  for(int bin = low; bin <= high; ++bin) {
+    double content = spectrum[bin] - (spectrum[low] + slope*(bin - low));
+    if(content > 0.) {
+      sum += content;
+      weightedSum += content*bin;
+    }
+  }
+  peak.fPosition = (sum > 0.) ? weightedSum/sum : start;
+  peak.fBackground = spectrum[low] + slope*(peak.fPosition - low);
+  peak.fAmplitude = spectrum[start] - peak.fBackground;
+  peak.fSigma = fSigma;
+  peak.fFitted = false;
+}
@@ -0,0 +1,52 @@
+#ifndef __PEAK_FINDER_HH
+#define __PEAK_FINDER_HH
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+//peak found in a window of the spectrum, positions are in bins (same as TSpectrum, i.e. bin i is at position i)
+struct FoundPeak {
+  double fPosition;
+  double fAmplitude;
+  double fSigma;
+  double fBackground;//at the position of the peak
+  double fSignificance;//of the candidate on the rebinned spectrum
+  bool fFitted;//false if the local fit failed and the position is the centroid
+};
+
+//finds the strongest peak within a window of a spectrum:
+//candidates are searched on the spectrum rebinned by the given factor with a smoothed second derivative filter
+//(insensitive to linear backgrounds), the best candidate is refined at full resolution by a fit of a gaussian on a linear
+//background within +- 3 sigma, the fit falls back to the background-subtracted centroid if it doesn't converge
+class PeakFinder {
+public:
+  PeakFinder(double sigma, int rebin, double minSignificance);
+  ~PeakFinder(){};
+
+  //window limits are bins (inclusive), returns false if there is no candidate with the minimum significance
+  bool Find(const std::vector<float>&, int, int, FoundPeak&);
+  //all candidates in the window with the minimum significance that are at least two sigma apart, at most the given number
+  //of the most significant ones, ordered by position; returns the number of peaks found
+  size_t FindAll(const std::vector<float>&, int, int, size_t, std::vector<FoundPeak>&);
+
+private:
+  //position of the best candidate in the window in (full resolution) bins, returns the significance
+  double Candidate(const std::vector<float>&, int, int, int&);
+  //significance of the filter response for the coarse bins of the window (0 where the response isn't positive),
+  //returns the first coarse bin
+  int Significances(const std::vector<float>&, int, int, std::vector<double>&);
+  //maximum at full resolution around a coarse bin (the maximum can be in the neighbouring coarse bins)
+  int Maximum(const std::vector<float>&, int, int, int);
+  bool Fit(const std::vector<float>&, int, FoundPeak&);
+  void Centroid(const std::vector<float>&, int, FoundPeak&);
+
+  double fSigma;
+  int fRebin;
+  double fMinSignificance;
+  //second derivative of a gaussian with zero sum, for the rebinned spectrum
+  std::vector<double> fKernel;
+  int fHalfWidth;
+};
+
+#endif
@@ -2,20 +2,119 @@
 
 #include <iomanip>
 #include <sstream>
+#include <algorithm>
 
-#include "TEnv.h"
+#include "EnvFile.hh"
 
-Settings::Settings(std::string settingsFileName, int verbosityLevel) {
-  fVerbosityLevel = verbosityLevel;
+namespace {
+  //list separated by spaces or commas
+  std::vector<std::string> SplitList(const std::string& list) {
+    std::string copy = list;
+    std::replace(copy.begin(), copy.end(), ',', ' ');
+    std::istringstream stream(copy);
+    std::vector<std::string> result;
+    std::string item;
+    while(stream>>item) {
+      result.push_back(item);
+    }
+    return result;
+  }
+}
+
+Settings::Settings(std::string settingsFileName, int verbosityLevel)
+  : Settings(EnvFile(settingsFileName), verbosityLevel) {
+}
 
-  TEnv env;
-  env.ReadFile(settingsFileName.c_str(),kEnvLocal);
+Settings::Settings(const EnvFile& env, int verbosityLevel) {
+  fVerbosityLevel = verbosityLevel;
 
   uint8_t detType;
 
-  fBuiltEventsSize = env.GetValue("BuiltEventsSize", 1024);
+  fBuiltEventsSize = env.GetValue("BuiltEventsSize", 4096);
 
   fTemperatureFileName = env.GetValue("TemperatureFileName","temperature.dat");
+
+  //energy calibration of the hits, the file name can contain a format for the run number (e.g. calibration_%05d.dat)
+  fCalibrationFileName = env.GetValue("Calibration.FileName","");
+  fCalibrationDither = env.GetValue("Calibration.Dither",false);
+
+  //timing calibration of the TDC times (ns per channel, walk correction), used for the fine timestamps of the hits
+  fTimingFileName = env.GetValue("Timing.FileName","");
+
+  //automatic calibration: peak search and fit of the raw energy histograms, one detector per thread
+  fSigma = float(env.GetValue("Calibration.Sigma",2.));
+  fPeakThreshold = env.GetValue("Calibration.PeakThreshold",0.1);
+  fNofDeconvIterations = env.GetValue("Calibration.NofDeconvIterations",10000);
+  fNofFitIterations = env.GetValue("Calibration.NofFitIterations",1000);
+  fFitConvergenceCoeff = env.GetValue("Calibration.FitConvergenceCoeff",0.1);
+  fNofCalibrationThreads = env.GetValue("Calibration.NofThreads",4);
+  //"Fast" searches candidates on a rebinned spectrum inside the rough windows only and fits them locally,
+  //"TSpectrum" deconvolves the whole spectrum (SearchHighRes) and fits all peaks (TSpectrumFit)
+  if(!PeakFinder(env.GetValue("Calibration.PeakFinder","Fast"))) {
+    std::cerr<<"Unknown peak finder '"<<env.GetValue("Calibration.PeakFinder","Fast")<<"', using 'Fast'"<<std::endl;
+    PeakFinder("Fast");
+  }
+  fPeakFinderRebin = env.GetValue("Calibration.PeakFinder.Rebin",4);
+  fPeakFinderMinSignificance = env.GetValue("Calibration.PeakFinder.MinSignificance",5.);
+  //unchanged histograms are taken from the cache, otherwise the newest calibration of the detector is the starting point
+  fCalibrationCacheFileName = env.GetValue("Calibration.Cache.FileName","");
+  fCalibrationCacheDepth = env.GetValue("Calibration.Cache.Depth",8);
+  fCalibrationMaxShift = env.GetValue("Calibration.MaxShift",20);
+  //matching of the lines of calibration sources to the peaks of the whole spectrum (for detectors without peaks defined)
+  fMatchTolerance = env.GetValue("Calibration.Match.Tolerance",4.);
+  fMatchMinGain = env.GetValue("Calibration.Match.MinGain",0.05);
+  fMatchMaxGain = env.GetValue("Calibration.Match.MaxGain",5.);
+  fMatchMinLines = env.GetValue("Calibration.Match.MinLines",3);
+  fMatchMaxPeaks = env.GetValue("Calibration.Match.MaxPeaks",30);
+  fMatchMinChannel = env.GetValue("Calibration.Match.MinChannel",50);
+  fMatchMinIntensity = env.GetValue("Calibration.Match.MinIntensity",1.);
+
+  //gain drift of the germanium detectors, tracked with a reference line in the calibrated energies (default is the 40K line)
+  fTrackDrift = env.GetValue("Drift.Active",false);
+  fDriftEnergy = env.GetValue("Drift.Energy",1460.82);
+  fDriftWindow = env.GetValue("Drift.Window",10.);
+  fDriftBinWidth = env.GetValue("Drift.BinWidth",0.25);
+  fDriftMinCounts = env.GetValue("Drift.MinCounts",100);
+  fDriftSliceLength = env.GetValue("Drift.SliceLength",0);
+
+  //hot reload of this file, only the keys read per batch of hits change (see Reloadable)
+  fHotReload = env.GetValue("Reload.Active",false);
+  fReloadInterval = env.GetValue("Reload.Interval",1000);
+
+  //histograms only: no event building and no tree, the histograms are filled directly from the decoded hits
+  fHistogramsOnly = env.GetValue("Histograms.Only",false);
+  fMaxTdcChannel = env.GetValue("Histograms.MaxTdcChannel",16384);
+
+  //output tree: "Event" (Event/Detector classes) or "Flat" (one array per quantity)
+  std::string schema = env.GetValue("Output.Schema","Event");
+  if(schema == "Flat" || schema == "flat") {
+    fTreeSchema = ETreeSchema::kFlat;
+  } else {
+    if(schema != "Event" && schema != "event") {
+      std::cerr<<"Unknown output schema '"<<schema<<"', using 'Event'"<<std::endl;
+    }
+    fTreeSchema = ETreeSchema::kEvent;
+  }
+  fMaxMultiplicity = env.GetValue("Output.MaxMultiplicity",256);
+  //threads used by ROOT to compress the baskets of the tree (1 = no implicit multithreading)
+  fNofOutputThreads = env.GetValue("Output.NofThreads",1);
+  //compression of the output file and layout of the baskets
+  if(!CompressionAlgorithm(env.GetValue("Output.Compression","ZLIB"))) {
+    std::cerr<<"Unknown compression algorithm '"<<env.GetValue("Output.Compression","ZLIB")<<"', using ZLIB"<<std::endl;
+    CompressionAlgorithm("ZLIB");
+  }
+  fCompressionLevel = env.GetValue("Output.CompressionLevel",1);
+  fBasketSize = env.GetValue("Output.BasketSize",1024000);
+  //auto-flush: positive = number of entries, negative = number of bytes, 0 = ROOT default
+  fAutoFlush = env.GetValue("Output.AutoFlush",0);
+  fMaxTreeSize = ((long long) env.GetValue("Output.MaxTreeSize",10))*1073741824LL;//GB
+  //rollover to a new file (0 = off), the bytes are the compressed size of the tree
+  fRolloverEvents = env.GetValue("Output.Rollover.Events",0);
+  fRolloverBytes = ((long long) env.GetValue("Output.Rollover.MegaBytes",0))*1048576LL;
+  fRolloverCycle = env.GetValue("Output.Rollover.Cycle",false);
+  //columnar output: memory-mappable file with one block of columns per this many events
+  fColumnarFileName = env.GetValue("Output.Columnar.FileName","");
+  fColumnarBlockSize = env.GetValue("Output.Columnar.BlockSize",4096);
   
   fNofGermaniumDetectors = env.GetValue("Germanium.NofDetectors",20);
   fMaxGermaniumChannel = env.GetValue("Germanium.MaxChannel",16384);
@@ -29,46 +128,243 @@ Settings::Settings(std::string settingsFileName, int verbosityLevel) {
   //-------------------- detector settings
   if(fVerbosityLevel > 0) {
     std::cout<<"Settings are:"<<std::endl
-	     <<"built events buffer size: \t"<<fBuiltEventsSize<<std::endl;
-  }
-
-  //get the number of peaks, their rough location, and their energies for each detector
-  //germanium
-  detType = static_cast<uint8_t>(EDetectorType::kGermanium);
-  fActiveDetectors[detType].resize(fNofGermaniumDetectors,true);
-  fCoarseTdcWindows[detType].resize(fNofGermaniumDetectors);
-  for(int i = 0; i < fNofGermaniumDetectors; ++i) {
-    fActiveDetectors[detType][i] = env.GetValue(Form("Germanium.%d.Active",i),true);
-    fCoarseTdcWindows[detType][i] = std::make_pair(env.GetValue(Form("Germanium.%d.TDC.Low",i),0),env.GetValue(Form("Germanium.%d.TDC.High",i),16384));
-  }
-  //plastic
-  detType = static_cast<uint8_t>(EDetectorType::kPlastic);
-  fActiveDetectors[detType].resize(fNofPlasticDetectors,true);
-  fCoarseTdcWindows[detType].resize(fNofPlasticDetectors);
-  for(int i = 0; i < fNofPlasticDetectors; ++i) {
-    fActiveDetectors[detType][i] = env.GetValue(Form("Plastic.%d.Active",i),true);
-    fCoarseTdcWindows[detType][i] = std::make_pair(env.GetValue(Form("Plastic.%d.TDC.Low",i),0),env.GetValue(Form("Plastic.%d.TDC.High",i),16384));
-  }
-  //silicon
-  detType = static_cast<uint8_t>(EDetectorType::kSilicon);
-  fActiveDetectors[detType].resize(fNofSiliconDetectors,true);
-  fCoarseTdcWindows[detType].resize(fNofSiliconDetectors);
-  for(int i = 0; i < fNofSiliconDetectors; ++i) {
-    fActiveDetectors[detType][i] = env.GetValue(Form("Silicon.%d.Active",i),true);
-    fCoarseTdcWindows[detType][i] = std::make_pair(env.GetValue(Form("Silicon.%d.TDC.Low",i),0),env.GetValue(Form("Silicon.%d.TDC.High",i),16384));
-  }
-  //BaF2
-  detType = static_cast<uint8_t>(EDetectorType::kBaF2);
-  fActiveDetectors[detType].resize(fNofBaF2Detectors,true);
-  fCoarseTdcWindows[detType].resize(fNofBaF2Detectors);
-  for(int i = 0; i < fNofBaF2Detectors; ++i) {
-    fActiveDetectors[detType][i] = env.GetValue(Form("BaF2.%d.Active",i),true);
-    fCoarseTdcWindows[detType][i] = std::make_pair(env.GetValue(Form("BaF2.%d.TDC.Low",i),0),env.GetValue(Form("BaF2.%d.TDC.High",i),16384));
+	     <<"built events buffer size: \t"<<fBuiltEventsSize<<std::endl
+	     <<"calibration file: \t'"<<fCalibrationFileName<<"'"<<(fCalibrationDither ? " with dithering" : "")<<std::endl
+	     <<"timing file: \t'"<<fTimingFileName<<"'"<<std::endl
+	     <<"sigma: \t"<<fSigma<<std::endl
+	     <<"peak threshold: \t"<<fPeakThreshold<<std::endl
+	     <<"# deconv. iter.: \t"<<fNofDeconvIterations<<std::endl
+	     <<"# fit iter.: \t"<<fNofFitIterations<<std::endl
+	     <<"fit convergence coeff.: \t"<<fFitConvergenceCoeff<<std::endl
+	     <<"peak finder: \t"<<(fPeakFinder == EPeakFinder::kFast ? "fast" : "TSpectrum")<<", rebin "<<fPeakFinderRebin<<", min. significance "<<fPeakFinderMinSignificance<<std::endl
+	     <<"# calibration threads: \t"<<fNofCalibrationThreads<<std::endl
+	     <<"calibration cache: \t'"<<fCalibrationCacheFileName<<"', "<<fCalibrationCacheDepth<<" entries per detector, max. shift "<<fCalibrationMaxShift<<std::endl
+	     <<"line matching: \ttolerance "<<fMatchTolerance<<", gain "<<fMatchMinGain<<" - "<<fMatchMaxGain<<", min. "<<fMatchMinLines<<" lines"
+	     <<", max. "<<fMatchMaxPeaks<<" peaks above channel "<<fMatchMinChannel<<", min. intensity "<<fMatchMinIntensity<<std::endl
+	     <<"drift tracking: \t"<<(fTrackDrift ? "on" : "off")<<", line at "<<fDriftEnergy<<" +- "<<fDriftWindow<<" keV in bins of "<<fDriftBinWidth<<" keV, min. "<<fDriftMinCounts<<" counts, "
+	     <<(fDriftSliceLength > 0 ? std::to_string(fDriftSliceLength) + " s slices" : std::string("one slice per cycle"))<<std::endl
+	     <<"hot reload: \t"<<(fHotReload ? "on" : "off")<<", checked every "<<fReloadInterval<<" ms"<<std::endl
+	     <<"histograms only: \t"<<(fHistogramsOnly ? "yes" : "no")<<", max. TDC channel "<<fMaxTdcChannel<<std::endl
+	     <<"output schema: \t"<<(fTreeSchema == ETreeSchema::kFlat ? "flat" : "event")<<", max. multiplicity "<<fMaxMultiplicity<<std::endl
+	     <<"# output threads: \t"<<fNofOutputThreads<<std::endl
+	     <<"compression: \t"<<CompressionSettings()<<std::endl
+	     <<"basket size: \t"<<fBasketSize<<std::endl
+	     <<"auto-flush: \t"<<fAutoFlush<<std::endl
+	     <<"max. tree size: \t"<<fMaxTreeSize<<std::endl
+	     <<"rollover: \t"<<fRolloverEvents<<" events, "<<fRolloverBytes<<" bytes, "<<(fRolloverCycle ? "each cycle" : "not at cycles")<<std::endl
+	     <<"columnar file: \t'"<<fColumnarFileName<<"', "<<fColumnarBlockSize<<" events per block"<<std::endl;
+  }
+
+  //get the active detectors and their coarse tdc windows for each detector type,
+  //and the number of peaks, their rough location, and their energies for the calibration of each detector
+  std::vector<std::pair<EDetectorType, std::string> > names = { {EDetectorType::kGermanium, "Germanium"}, {EDetectorType::kPlastic, "Plastic"}, {EDetectorType::kSilicon, "Silicon"}, {EDetectorType::kBaF2, "BaF2"} };
+  std::vector<int> nofDetectors = { fNofGermaniumDetectors, fNofPlasticDetectors, fNofSiliconDetectors, fNofBaF2Detectors };
+  fFirstDetector.fill(0);
+  fNofDetectorsOfType.fill(0);
+  for(size_t type = 0; type < names.size(); ++type) {
+    detType = static_cast<uint8_t>(names[type].first);
+    fNofDetectorsOfType[detType] = std::max(nofDetectors[type], 0);
+  }
+  for(size_t type = 1; type < NOF_DETECTOR_TYPES; ++type) {
+    fFirstDetector[type] = fFirstDetector[type-1] + fNofDetectorsOfType[type-1];
+  }
+  fDetectors.assign(fFirstDetector[NOF_DETECTOR_TYPES-1] + fNofDetectorsOfType[NOF_DETECTOR_TYPES-1], DetectorConfig());
+  for(size_t type = 0; type < names.size(); ++type) {
+    detType = static_cast<uint8_t>(names[type].first);
+    fMinimumCounts[detType] = env.GetValue("Calibration." + names[type].second + ".MinCounts",10000);
+    fCalibrationSources[detType] = SplitList(env.GetValue("Calibration." + names[type].second + ".Sources",env.GetValue("Calibration.Sources","")));
+    fNofPeaks[detType].resize(nofDetectors[type]);
+    fRoughWindow[detType].resize(nofDetectors[type]);
+    fEnergy[detType].resize(nofDetectors[type]);
+    for(int i = 0; i < nofDetectors[type]; ++i) {
+      std::string prefix = names[type].second + "." + std::to_string(i);
+      DetectorConfig& detector = fDetectors[fFirstDetector[detType] + i];
+      detector.fActive = env.GetValue(prefix + ".Active",true);
+      detector.fTdcLow = env.GetValue(prefix + ".TDC.Low",0);
+      detector.fTdcHigh = env.GetValue(prefix + ".TDC.High",16384);
+      prefix = "Calibration." + prefix;
+      fNofPeaks[detType][i] = env.GetValue(prefix + ".NofPeaks",0);
+      fRoughWindow[detType][i].resize(fNofPeaks[detType][i]);
+      fEnergy[detType][i].resize(fNofPeaks[detType][i]);
+      for(int j = 0; j < fNofPeaks[detType][i]; ++j) {
+	std::string peak = prefix + "." + std::to_string(j);
+	fRoughWindow[detType][i][j] = std::make_pair(env.GetValue(peak + ".LowerLimit",0), env.GetValue(peak + ".UpperLimit",0));
+	fEnergy[detType][i][j] = env.GetValue(peak + ".Energy",0.);
+      }
+    }
+  }
+
+  //-------------------- selection of the tdc hits of each detector
+  if(!TdcSelection(env.GetValue("Tdc.Selection","LastInWindow"))) {
+    std::cerr<<"Unknown TDC selection '"<<env.GetValue("Tdc.Selection","LastInWindow")<<"', using 'LastInWindow'"<<std::endl;
+    TdcSelection("LastInWindow");
   }
 
   //-------------------- event building (times are in 100 ns)
   fWaitingWindow = env.GetValue("EventBuilding.WaitingWindow",10000000);//=1s
   fCoincidenceWindow = env.GetValue("EventBuilding.CoincidenceWindow",20);//=2us
+  //the hits are built on their timestamps (ps), with a timing calibration a coincidence window below 100 ns can be set (in ns)
+  fFineCoincidenceWindow = env.GetValue("EventBuilding.FineCoincidenceWindow",0.);
+  fWaitingWindowPs = std::max(fWaitingWindow, 0)*ULM_CLOCK_IN_PS;
+  if(fFineCoincidenceWindow > 0.) {
+    fCoincidenceWindowPs = static_cast<uint64_t>(fFineCoincidenceWindow*1000. + 0.5);
+  } else {
+    fCoincidenceWindowPs = std::max(fCoincidenceWindow, 0)*ULM_CLOCK_IN_PS;
+  }
+  //the hits are cut into independent time slices at gaps longer than the coincidence window, which are then built in parallel
+  fNofBuildThreads = env.GetValue("EventBuilding.NofThreads",4);
+  fMinSliceSize = env.GetValue("EventBuilding.MinSliceSize",1000);
+  //histograms of how late hits arrive and of the time differences within events
+  fBuildDiagnostics = env.GetValue("EventBuilding.Diagnostics",true);
+  fLatenessRange = env.GetValue("EventBuilding.LatenessRange",fWaitingWindow);
+  fLatenessBins = env.GetValue("EventBuilding.LatenessBins",1000);
+  //the time differences are in ns, by default ten coincidence windows (fine or not) in bins of a twentieth of the window
+  fTimeDifferenceRange = env.GetValue("EventBuilding.TimeDifferenceRange",static_cast<int>(10*fCoincidenceWindowPs/1000));
+  fTimeDifferenceBins = env.GetValue("EventBuilding.TimeDifferenceBins",200);
+
+  //-------------------- coincidence matrices of the built events (time gates are in ns on the timestamps)
+  fMatrices = env.GetValue("Matrix.Active",false);
+  fMatrixRebin.fill(1);
+  fMatrixRebin[static_cast<size_t>(EDetectorType::kGermanium)] = env.GetValue("Matrix.Germanium.Rebin",4);
+  fMatrixRebin[static_cast<size_t>(EDetectorType::kBaF2)] = env.GetValue("Matrix.BaF2.Rebin",16);
+  fMatrixRebin[static_cast<size_t>(EDetectorType::kPlastic)] = env.GetValue("Matrix.Plastic.Rebin",16);
+  //with an energy calibration the matrices are filled with the calibrated energies instead
+  fMatrixKeVPerBin.fill(1.);
+  fMatrixKeVPerBin[static_cast<size_t>(EDetectorType::kGermanium)] = env.GetValue("Matrix.Germanium.KeVPerBin",1.);
+  fMatrixKeVPerBin[static_cast<size_t>(EDetectorType::kBaF2)] = env.GetValue("Matrix.BaF2.KeVPerBin",8.);
+  fMatrixKeVPerBin[static_cast<size_t>(EDetectorType::kPlastic)] = env.GetValue("Matrix.Plastic.KeVPerBin",8.);
+  fMatrixMaxEnergy = env.GetValue("Matrix.MaxEnergy",4096.);
+  fMatrixBlockSize = env.GetValue("Matrix.BlockSize",64);
+  fMatrixSparseOutput = env.GetValue("Matrix.SparseOutput",false);
+  fMatrixTimeGates = env.GetValue("Matrix.TimeGates",false);
+  //the default gates are derived from the coincidence window (the fine one if it is set)
+  double coincidenceWindowNs = fCoincidenceWindowPs/1000.;
+  fMatrixPromptLow = env.GetValue("Matrix.Prompt.Low",0.);
+  fMatrixPromptHigh = env.GetValue("Matrix.Prompt.High",coincidenceWindowNs/4.);
+  fMatrixRandomLow = env.GetValue("Matrix.Random.Low",coincidenceWindowNs/2.);
+  fMatrixRandomHigh = env.GetValue("Matrix.Random.High",coincidenceWindowNs);
+
+  //-------------------- gamma-gamma-gamma cube of the germanium triples of the built events
+  fCubeFileName = env.GetValue("Cube.FileName","");
+  fCubeRebin = env.GetValue("Cube.Rebin",8);
+  fCubeKeVPerBin = env.GetValue("Cube.KeVPerBin",2.);
+  fCubeMaxEnergy = env.GetValue("Cube.MaxEnergy",4096.);
+  fCubeBlockSize = env.GetValue("Cube.BlockSize",16);
+  fCubeBufferSize = env.GetValue("Cube.BufferSize",4194304);
+
+  if(fVerbosityLevel > 0) {
+    const char* tdcSelections[] = { "last in window", "first in window", "all in window", "all" };
+    std::cout<<"TDC selection: \t"<<tdcSelections[static_cast<size_t>(fTdcSelection)]<<std::endl
+	     <<"waiting window: \t"<<fWaitingWindow<<std::endl
+	     <<"coincidence window: \t"<<fCoincidenceWindow<<(fFineCoincidenceWindow > 0. ? ", fine coincidence window " + std::to_string(fFineCoincidenceWindow) + " ns" : std::string())<<std::endl
+	     <<"# build threads: \t"<<fNofBuildThreads<<std::endl
+	     <<"min. slice size: \t"<<fMinSliceSize<<std::endl
+	     <<"diagnostics: \t"<<(fBuildDiagnostics ? "on" : "off")<<std::endl
+	     <<"lateness range: \t"<<fLatenessRange<<" ("<<fLatenessBins<<" bins)"<<std::endl
+	     <<"time difference range: \t"<<fTimeDifferenceRange<<" ns ("<<fTimeDifferenceBins<<" bins)"<<std::endl
+	     <<"matrices: \t"<<(fMatrices ? "on" : "off")<<", rebin Ge/BaF2/plastic "<<MatrixRebin(EDetectorType::kGermanium)<<"/"<<MatrixRebin(EDetectorType::kBaF2)<<"/"<<MatrixRebin(EDetectorType::kPlastic)
+	     <<" (calibrated "<<MatrixKeVPerBin(EDetectorType::kGermanium)<<"/"<<MatrixKeVPerBin(EDetectorType::kBaF2)<<"/"<<MatrixKeVPerBin(EDetectorType::kPlastic)<<" keV per bin up to "<<fMatrixMaxEnergy<<" keV)"
+	     <<", blocks of "<<fMatrixBlockSize<<" bins"<<(fMatrixSparseOutput ? ", sparse output" : "")<<std::endl;
+    if(!fCubeFileName.empty()) {
+      std::cout<<"cube file: \t'"<<fCubeFileName<<"', "<<fCubeKeVPerBin<<" keV per bin up to "<<fCubeMaxEnergy<<" keV (raw energies rebinned by "<<fCubeRebin<<"), blocks of "<<fCubeBlockSize<<" bins, "<<fCubeBufferSize<<" triples per thread buffer"<<std::endl;
+    }
+    if(fMatrixTimeGates) {
+      std::cout<<"matrix time gates: \tprompt "<<fMatrixPromptLow<<" - "<<fMatrixPromptHigh<<" ns, random "<<fMatrixRandomLow<<" - "<<fMatrixRandomHigh<<" ns"<<std::endl;
+    }
+  }
+}
+
+//the numbers are the ones used by ROOT
+bool Settings::CompressionAlgorithm(const std::string& algorithm) {
+  std::string name = algorithm;
+  std::transform(name.begin(), name.end(), name.begin(), ::toupper);
+  if(name == "ZLIB") {
+    fCompressionAlgorithm = 1;
+  } else if(name == "LZMA") {
+    fCompressionAlgorithm = 2;
+  } else if(name == "LZ4") {
+    fCompressionAlgorithm = 4;
+  } else if(name == "ZSTD") {
+    fCompressionAlgorithm = 5;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Settings::PeakFinder(const std::string& peakFinder) {
+  std::string name = peakFinder;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  if(name == "fast") {
+    fPeakFinder = EPeakFinder::kFast;
+  } else if(name == "tspectrum") {
+    fPeakFinder = EPeakFinder::kTSpectrum;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool Settings::TdcSelection(const std::string& selection) {
+  std::string name = selection;
+  std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+  if(name == "lastinwindow") {
+    fTdcSelection = ETdcSelection::kLastInWindow;
+  } else if(name == "firstinwindow") {
+    fTdcSelection = ETdcSelection::kFirstInWindow;
+  } else if(name == "allinwindow") {
+    fTdcSelection = ETdcSelection::kAllInWindow;
+  } else if(name == "all") {
+    fTdcSelection = ETdcSelection::kAll;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+void Settings::CalibrationSources(const std::string& sources) {
+  for(auto& types : fCalibrationSources) {
+    types.second = SplitList(sources);
+  }
+}
+
+bool Settings::Reloadable(const std::string& key) {
+  if(key == "Tdc.Selection" || key == "EventBuilding.WaitingWindow" || key == "EventBuilding.CoincidenceWindow" || key == "EventBuilding.FineCoincidenceWindow") {
+    return true;
+  }
+  //<type>.<number>.Active/TDC.Low/TDC.High
+  size_t first = key.find('.');
+  if(first == std::string::npos) {
+    return false;
+  }
+  std::string type = key.substr(0, first);
+  if(type != "Germanium" && type != "Plastic" && type != "Silicon" && type != "BaF2") {
+    return false;
+  }
+  size_t second = key.find_first_not_of("0123456789", first + 1);
+  if(second == first + 1 || second == std::string::npos || key[second] != '.') {
+    return false;
+  }
+  std::string name = key.substr(second + 1);
+  return name == "Active" || name == "TDC.Low" || name == "TDC.High";
+}
+
+void Settings::Update(const Settings& settings) {
+  if(settings.fDetectors.size() == fDetectors.size()) {
+    fDetectors = settings.fDetectors;
+  }
+  bool multiHit = (fTdcSelection == ETdcSelection::kAllInWindow || fTdcSelection == ETdcSelection::kAll);
+  bool newMultiHit = (settings.fTdcSelection == ETdcSelection::kAllInWindow || settings.fTdcSelection == ETdcSelection::kAll);
+  if(multiHit == newMultiHit) {
+    fTdcSelection = settings.fTdcSelection;
+  } else {
+    std::cerr<<"Switching the TDC selection between one and multiple times per hit needs a restart, keeping the current selection"<<std::endl;
+  }
+  fWaitingWindow = settings.fWaitingWindow;
+  fCoincidenceWindow = settings.fCoincidenceWindow;
+  fFineCoincidenceWindow = settings.fFineCoincidenceWindow;
+  fWaitingWindowPs = settings.fWaitingWindowPs;
+  fCoincidenceWindowPs = settings.fCoincidenceWindowPs;
 }
 
 //get detector type (as string) based on the bank name
@@ -99,10 +395,3 @@ std::string Settings::DetectorType(uint32_t bankName) {
   
   return result.str();
 }
-
-bool Settings::CoarseTdcWindow(const EDetectorType& detectorType, const uint16_t& detectorNumber, const uint16_t& channel) {
-  if(fCoarseTdcWindows.find(static_cast<uint8_t>(detectorType)) == fCoarseTdcWindows.end()) {
-    return false;
-  }
-  return (fCoarseTdcWindows[static_cast<uint8_t>(detectorType)][detectorNumber].first <= channel && channel <= fCoarseTdcWindows[static_cast<uint8_t>(detectorType)][detectorNumber].second);
-}
@@ -5,8 +5,11 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <array>
 #include <map>
 
+class EnvFile;
+
 #define ULM_CYCLE        0x03ff     //Mask used to extract ULM cycle number from fera stream
 #define ULM_BEAM_STATUS  0x0400   //Mask used to extract beam status. (0 = off, 1 = on)
 #define ULM_TRIGGER_MASK 0xf800 //Mask used to extract the trigger mask
@@ -17,6 +20,7 @@
 //#define ULM_CLOCK_OVERFLOW 0xffffffff
 #define ULM_CLOCK_OVERFLOW 0x1ffffff
 #define ULM_CLOCK_IN_SECONDS 10000000
+#define ULM_CLOCK_IN_PS 100000ULL
 
 #define FME_ZERO  0x464d4530 //FME0 in hex.
 #define FME_ONE   0x464d4531 //FME1
@@ -82,10 +86,46 @@ enum class EDetectorType : uint8_t {
   kBaF2,
   kUnknown
 };
+//layout of the output tree
+enum class ETreeSchema : uint8_t {
+  kEvent,
+  kFlat
+};
+
+//peak search of the automatic calibration
+enum class EPeakFinder : uint8_t {
+  kTSpectrum,
+  kFast
+};
+
+//which of the TDC hits of a detector are kept: the time of the hit is the last (or first) time within the coarse TDC window,
+//or the first time if none is within the window; the multi-hit policies keep the other times within the window (or all other times) as well
+enum class ETdcSelection : uint8_t {
+  kLastInWindow,
+  kFirstInWindow,
+  kAllInWindow,
+  kAll
+};
+
+//number of entries in EDetectorType, used for arrays indexed by the detector type
+#define NOF_DETECTOR_TYPES 5
+
+//maximum number of TDC times per hit kept besides the selected time (by the multi-hit TDC selections)
+#define MAX_TDC_TIMES 4
+
+//configuration of one detector as needed per hit, compiled from the settings when they are read and not changed afterwards:
+//8 bytes, so that eight detectors share a cache line and none straddles two
+struct alignas(8) DetectorConfig {
+  uint16_t fTdcLow;//coarse TDC window
+  uint16_t fTdcHigh;
+  bool fActive;
+};
+static_assert(sizeof(DetectorConfig) == 8, "DetectorConfig should fill 8 bytes");
 
 class Settings {
 public:
   Settings(std::string, int);
+  Settings(const EnvFile&, int);
   ~Settings(){};
 
   int VerbosityLevel() {
@@ -93,7 +133,28 @@ public:
   }
 
   std::string DetectorType(uint32_t);
-  bool CoarseTdcWindow(const EDetectorType&, const uint16_t&,const uint16_t&);
+
+  //dense table of all detectors (one bounds check and one load), nullptr for detectors that don't exist
+  const DetectorConfig* Detector(uint8_t detectorType, uint16_t detectorNumber) {
+    if(detectorType >= NOF_DETECTOR_TYPES || detectorNumber >= fNofDetectorsOfType[detectorType]) {
+      return nullptr;
+    }
+    return &fDetectors[fFirstDetector[detectorType] + detectorNumber];
+  }
+
+  bool CoarseTdcWindow(const EDetectorType& detectorType, const uint16_t& detectorNumber, const uint16_t& channel) {
+    const DetectorConfig* detector = Detector(static_cast<uint8_t>(detectorType), detectorNumber);
+    return detector != nullptr && detector->fTdcLow <= channel && channel <= detector->fTdcHigh;
+  }
+  ETdcSelection TdcSelection() {
+    return fTdcSelection;
+  }
+  //returns false if the policy is unknown (LastInWindow, FirstInWindow, AllInWindow, or All)
+  bool TdcSelection(const std::string&);
+  //whether more than one time per hit is kept
+  bool MultiHitTdc() {
+    return fTdcSelection == ETdcSelection::kAllInWindow || fTdcSelection == ETdcSelection::kAll;
+  }
   size_t MinimumCounts(const uint8_t& detectorType) {
     if(fMinimumCounts.find(detectorType) == fMinimumCounts.end()) {
       return 0;
@@ -102,13 +163,8 @@ public:
   }
 
   bool Active(const EDetectorType& detectorType, const uint16_t& detectorNumber) {
-    if(fActiveDetectors.find(static_cast<uint8_t>(detectorType)) == fActiveDetectors.end()) {
-      return false;
-    }
-    if(detectorNumber >= fActiveDetectors[static_cast<uint8_t>(detectorType)].size()) {
-      return false;
-    }
-    return fActiveDetectors[static_cast<uint8_t>(detectorType)][detectorNumber];
+    const DetectorConfig* detector = Detector(static_cast<uint8_t>(detectorType), detectorNumber);
+    return detector != nullptr && detector->fActive;
   }
 
   int NofGermaniumDetectors() {
@@ -136,19 +192,381 @@ public:
     return fMaxBaF2Channel;
   }
 
-  //-------------------- event building
-  bool InWaitingWindow(const uint32_t& firstTime, const uint32_t& secondTime) {
-    return int(secondTime - firstTime) < fWaitingWindow;
+  //-------------------- event building (on the timestamps of the hits in ps)
+  bool InWaitingWindow(const uint64_t& firstTime, const uint64_t& secondTime) {
+    return secondTime < firstTime + fWaitingWindowPs;
   }
 
-  bool Coincidence(const uint32_t& firstTime, const uint32_t& secondTime) {
+  bool Coincidence(const uint64_t& firstTime, const uint64_t& secondTime) {
     if(secondTime >= firstTime) {
-      return int(secondTime - firstTime) < fCoincidenceWindow;
+      return secondTime - firstTime < fCoincidenceWindowPs;
     }
     std::cout<<"second time "<<secondTime<<" not larger than first time "<<firstTime<<"!"<<std::endl;
     return false;
   }
 
+  int WaitingWindow() {
+    return fWaitingWindow;
+  }
+  int CoincidenceWindow() {
+    return fCoincidenceWindow;
+  }
+  //ns, 0 = not set
+  double FineCoincidenceWindow() {
+    return fFineCoincidenceWindow;
+  }
+  //the coincidence window in ps (the fine coincidence window if one is set)
+  uint64_t CoincidenceWindowPs() {
+    return fCoincidenceWindowPs;
+  }
+  int NofBuildThreads() {
+    return fNofBuildThreads;
+  }
+  int MinSliceSize() {
+    return fMinSliceSize;
+  }
+  //diagnostics to tune the waiting and coincidence window
+  bool BuildDiagnostics() {
+    return fBuildDiagnostics;
+  }
+  int LatenessRange() {
+    return fLatenessRange;
+  }
+  int LatenessBins() {
+    return fLatenessBins;
+  }
+  //ns (the time differences are taken from the timestamps)
+  int TimeDifferenceRange() {
+    return fTimeDifferenceRange;
+  }
+  int TimeDifferenceBins() {
+    return fTimeDifferenceBins;
+  }
+
+  //-------------------- output
+  ETreeSchema TreeSchema() {
+    return fTreeSchema;
+  }
+  void TreeSchema(ETreeSchema schema) {
+    fTreeSchema = schema;
+  }
+  int MaxMultiplicity() {
+    return fMaxMultiplicity;
+  }
+  int NofOutputThreads() {
+    return fNofOutputThreads;
+  }
+  //compression as used by TFile::SetCompressionSettings (100*algorithm + level)
+  int CompressionSettings() {
+    return 100*fCompressionAlgorithm + fCompressionLevel;
+  }
+  //returns false if the algorithm is unknown (ZLIB, LZMA, LZ4, or ZSTD)
+  bool CompressionAlgorithm(const std::string&);
+  void CompressionLevel(int level) {
+    fCompressionLevel = level;
+  }
+  int BasketSize() {
+    return fBasketSize;
+  }
+  void BasketSize(int basketSize) {
+    fBasketSize = basketSize;
+  }
+  long long AutoFlush() {
+    return fAutoFlush;
+  }
+  void AutoFlush(long long autoFlush) {
+    fAutoFlush = autoFlush;
+  }
+  long long MaxTreeSize() {
+    return fMaxTreeSize;
+  }
+  //rollover to a new output file after a number of events, bytes, or at the end of each cycle
+  bool Rollover() {
+    return fRolloverEvents > 0 || fRolloverBytes > 0 || fRolloverCycle;
+  }
+  long long RolloverEvents() {
+    return fRolloverEvents;
+  }
+  void RolloverEvents(long long nofEvents) {
+    fRolloverEvents = nofEvents;
+  }
+  long long RolloverBytes() {
+    return fRolloverBytes;
+  }
+  void RolloverBytes(long long nofBytes) {
+    fRolloverBytes = nofBytes;
+  }
+  bool RolloverCycle() {
+    return fRolloverCycle;
+  }
+  void RolloverCycle(bool rollover) {
+    fRolloverCycle = rollover;
+  }
+  //columnar output (only written if a file name is given)
+  std::string ColumnarFileName() {
+    return fColumnarFileName;
+  }
+  void ColumnarFileName(const std::string& fileName) {
+    fColumnarFileName = fileName;
+  }
+  int ColumnarBlockSize() {
+    return fColumnarBlockSize;
+  }
+  void NofOutputThreads(int nofThreads) {
+    fNofOutputThreads = nofThreads;
+  }
+
+  //-------------------- energy calibration (only applied if a file name is given)
+  std::string CalibrationFileName() {
+    return fCalibrationFileName;
+  }
+  void CalibrationFileName(const std::string& fileName) {
+    fCalibrationFileName = fileName;
+  }
+  bool CalibrationDither() {
+    return fCalibrationDither;
+  }
+
+  //-------------------- timing calibration of the TDC times (only applied if a file name is given)
+  std::string TimingFileName() {
+    return fTimingFileName;
+  }
+  void TimingFileName(const std::string& fileName) {
+    fTimingFileName = fileName;
+  }
+
+  //-------------------- automatic calibration (peak search and fit of the raw energy histograms)
+  float Sigma() {
+    return fSigma;
+  }
+  double PeakThreshold() {
+    return fPeakThreshold;
+  }
+  int NofDeconvIterations() {
+    return fNofDeconvIterations;
+  }
+  int NofFitIterations() {
+    return fNofFitIterations;
+  }
+  double FitConvergenceCoeff() {
+    return fFitConvergenceCoeff;
+  }
+  EPeakFinder PeakFinder() {
+    return fPeakFinder;
+  }
+  //returns false if the peak finder is unknown (TSpectrum or Fast)
+  bool PeakFinder(const std::string&);
+  //channels per bin of the candidate search and minimum significance of a candidate for the fast peak finder
+  int PeakFinderRebin() {
+    return fPeakFinderRebin;
+  }
+  double PeakFinderMinSignificance() {
+    return fPeakFinderMinSignificance;
+  }
+  //cache of calibrations (only used if a file name is given), number of calibrations kept per detector,
+  //and how far (in channels) the peaks are searched around the positions of the previous calibration
+  std::string CalibrationCacheFileName() {
+    return fCalibrationCacheFileName;
+  }
+  void CalibrationCacheFileName(const std::string& fileName) {
+    fCalibrationCacheFileName = fileName;
+  }
+  int CalibrationCacheDepth() {
+    return fCalibrationCacheDepth;
+  }
+  int CalibrationMaxShift() {
+    return fCalibrationMaxShift;
+  }
+  //number of detectors calibrated in parallel
+  int NofCalibrationThreads() {
+    return fNofCalibrationThreads;
+  }
+  void NofCalibrationThreads(int nofThreads) {
+    fNofCalibrationThreads = nofThreads;
+  }
+  int NofPeaks(uint8_t detectorType, uint16_t detectorNumber) {
+    if(fNofPeaks.find(detectorType) == fNofPeaks.end() || detectorNumber >= fNofPeaks[detectorType].size()) {
+      return 0;
+    }
+    return fNofPeaks[detectorType][detectorNumber];
+  }
+  int InRoughWindow(uint8_t detectorType, uint16_t detectorNumber, double channel) {
+    if(fRoughWindow.find(detectorType) != fRoughWindow.end() && detectorNumber < fRoughWindow[detectorType].size()) {
+      for(int i = 0; i < (int) (fRoughWindow[detectorType][detectorNumber].size()); ++i) {
+	if(fRoughWindow[detectorType][detectorNumber][i].first <= channel && channel <= fRoughWindow[detectorType][detectorNumber][i].second) {
+	  return i;
+	}
+      }
+    }
+    return -1;
+  }
+  std::pair<uint16_t, uint16_t> RoughWindow(uint8_t detectorType, uint16_t detectorNumber, size_t index) {
+    return fRoughWindow[detectorType][detectorNumber][index];
+  }
+  std::string PrintWindow(uint8_t detectorType, uint16_t detectorNumber, size_t index) {
+    std::stringstream res;
+    res<<fRoughWindow[detectorType][detectorNumber][index].first<<" - "<<fRoughWindow[detectorType][detectorNumber][index].second;
+    return res.str();
+  }
+  double Energy(uint8_t detectorType, uint16_t detectorNumber, size_t index) {
+    return fEnergy[detectorType][detectorNumber][index];
+  }
+  //calibration sources (e.g. 152Eu, 60Co) whose lines are matched to the peaks found in the whole spectrum,
+  //used for all detectors of the type that have no peaks defined
+  std::vector<std::string> CalibrationSources(uint8_t detectorType) {
+    if(fCalibrationSources.find(detectorType) == fCalibrationSources.end()) {
+      return std::vector<std::string>();
+    }
+    return fCalibrationSources[detectorType];
+  }
+  //sets the sources of all detector types (list separated by spaces or commas)
+  void CalibrationSources(const std::string&);
+  //a line is matched if a peak is within the tolerance (channels) of its position; only mappings with a gain (keV/channel) within the
+  //limits are tried, and at least the minimum number of lines has to be matched; the strongest peaks above the minimum channel and
+  //lines above the minimum intensity (per 100 decays) are used
+  double MatchTolerance() {
+    return fMatchTolerance;
+  }
+  double MatchMinGain() {
+    return fMatchMinGain;
+  }
+  double MatchMaxGain() {
+    return fMatchMaxGain;
+  }
+  int MatchMinLines() {
+    return fMatchMinLines;
+  }
+  int MatchMaxPeaks() {
+    return fMatchMaxPeaks;
+  }
+  int MatchMinChannel() {
+    return fMatchMinChannel;
+  }
+  double MatchMinIntensity() {
+    return fMatchMinIntensity;
+  }
+
+  //-------------------- gain drift tracking of the germanium detectors (needs the energy calibration)
+  bool TrackDrift() {
+    return fTrackDrift;
+  }
+  void TrackDrift(bool trackDrift) {
+    fTrackDrift = trackDrift;
+  }
+  //reference line and the range around it (keV)
+  double DriftEnergy() {
+    return fDriftEnergy;
+  }
+  double DriftWindow() {
+    return fDriftWindow;
+  }
+  double DriftBinWidth() {
+    return fDriftBinWidth;
+  }
+  //net counts in the line needed to update the correction
+  int DriftMinCounts() {
+    return fDriftMinCounts;
+  }
+  //seconds, 0 = one slice per tape cycle
+  int DriftSliceLength() {
+    return fDriftSliceLength;
+  }
+
+  //-------------------- hot reload of the settings file while unpacking
+  bool HotReload() {
+    return fHotReload;
+  }
+  void HotReload(bool hotReload) {
+    fHotReload = hotReload;
+  }
+  //milliseconds between the checks of the file
+  int ReloadInterval() {
+    return fReloadInterval;
+  }
+  //whether a key of the settings file takes effect when the file is reloaded: the active flags and coarse TDC windows of the
+  //detectors, the TDC selection, and the waiting and coincidence windows; all other keys are only read at the start
+  static bool Reloadable(const std::string&);
+  //takes the reloadable settings from the reread file (same numbers of detectors), the TDC selection only if it keeps the
+  //same number of times per hit (the output has been set up for it); used on a copy of the current snapshot before it is published
+  void Update(const Settings&);
+
+  //-------------------- coincidence matrices
+  bool Matrices() {
+    return fMatrices;
+  }
+  void Matrices(bool matrices) {
+    fMatrices = matrices;
+  }
+  //number of channels per bin for each detector type (only used without energy calibration)
+  int MatrixRebin(EDetectorType detectorType) {
+    return fMatrixRebin[static_cast<size_t>(detectorType)];
+  }
+  //keV per bin for each detector type and the range of the calibrated energies (keV)
+  double MatrixKeVPerBin(EDetectorType detectorType) {
+    return fMatrixKeVPerBin[static_cast<size_t>(detectorType)];
+  }
+  double MatrixMaxEnergy() {
+    return fMatrixMaxEnergy;
+  }
+  int MatrixBlockSize() {
+    return fMatrixBlockSize;
+  }
+  bool MatrixSparseOutput() {
+    return fMatrixSparseOutput;
+  }
+  //gates on the timestamp difference of the two hits (in ns)
+  bool MatrixTimeGates() {
+    return fMatrixTimeGates;
+  }
+  double MatrixPromptLow() {
+    return fMatrixPromptLow;
+  }
+  double MatrixPromptHigh() {
+    return fMatrixPromptHigh;
+  }
+  double MatrixRandomLow() {
+    return fMatrixRandomLow;
+  }
+  double MatrixRandomHigh() {
+    return fMatrixRandomHigh;
+  }
+
+  //-------------------- gamma-gamma-gamma cube (only written if a file name is given)
+  std::string CubeFileName() {
+    return fCubeFileName;
+  }
+  void CubeFileName(const std::string& fileName) {
+    fCubeFileName = fileName;
+  }
+  //channels per bin of the raw energies (only used without energy calibration), keV per bin and range of the calibrated energies
+  int CubeRebin() {
+    return fCubeRebin;
+  }
+  double CubeKeVPerBin() {
+    return fCubeKeVPerBin;
+  }
+  double CubeMaxEnergy() {
+    return fCubeMaxEnergy;
+  }
+  int CubeBlockSize() {
+    return fCubeBlockSize;
+  }
+  //number of triples each thread collects before they are sorted and written to disk
+  int CubeBufferSize() {
+    return fCubeBufferSize;
+  }
+
+  //-------------------- histograms
+  bool HistogramsOnly() {
+    return fHistogramsOnly;
+  }
+  void HistogramsOnly(bool histogramsOnly) {
+    fHistogramsOnly = histogramsOnly;
+  }
+  int MaxTdcChannel() {
+    return fMaxTdcChannel;
+  }
+
   //-------------------- misc
   const char* TemperatureFile() {
     return fTemperatureFileName.c_str();
@@ -164,6 +582,80 @@ private:
 
   int fBuiltEventsSize;
 
+  bool fHistogramsOnly;
+  int fMaxTdcChannel;
+
+  std::string fCalibrationFileName;
+  std::string fTimingFileName;
+  bool fCalibrationDither;
+
+  float fSigma;
+  double fPeakThreshold;
+  int fNofDeconvIterations;
+  int fNofFitIterations;
+  double fFitConvergenceCoeff;
+  EPeakFinder fPeakFinder;
+  int fPeakFinderRebin;
+  double fPeakFinderMinSignificance;
+  std::string fCalibrationCacheFileName;
+  int fCalibrationCacheDepth;
+  int fCalibrationMaxShift;
+  int fNofCalibrationThreads;
+  std::map<uint8_t, std::vector<uint16_t> > fNofPeaks;
+  std::map<uint8_t, std::vector<std::vector<std::pair<uint16_t,uint16_t> > > > fRoughWindow;
+  std::map<uint8_t, std::vector<std::vector<double> > > fEnergy;
+  std::map<uint8_t, std::vector<std::string> > fCalibrationSources;
+  double fMatchTolerance;
+  double fMatchMinGain;
+  double fMatchMaxGain;
+  int fMatchMinLines;
+  int fMatchMaxPeaks;
+  int fMatchMinChannel;
+  double fMatchMinIntensity;
+
+  bool fTrackDrift;
+  double fDriftEnergy;
+  double fDriftWindow;
+  double fDriftBinWidth;
+  int fDriftMinCounts;
+  int fDriftSliceLength;
+
+  bool fHotReload;
+  int fReloadInterval;
+
+  bool fMatrices;
+  std::array<int, NOF_DETECTOR_TYPES> fMatrixRebin;
+  std::array<double, NOF_DETECTOR_TYPES> fMatrixKeVPerBin;
+  double fMatrixMaxEnergy;
+  int fMatrixBlockSize;
+  bool fMatrixSparseOutput;
+  bool fMatrixTimeGates;
+  double fMatrixPromptLow;
+  double fMatrixPromptHigh;
+  double fMatrixRandomLow;
+  double fMatrixRandomHigh;
+
+  std::string fCubeFileName;
+  int fCubeRebin;
+  double fCubeKeVPerBin;
+  double fCubeMaxEnergy;
+  int fCubeBlockSize;
+  int fCubeBufferSize;
+
+  ETreeSchema fTreeSchema;
+  int fMaxMultiplicity;
+  int fNofOutputThreads;
+  int fCompressionAlgorithm;
+  int fCompressionLevel;
+  int fBasketSize;
+  long long fAutoFlush;
+  long long fMaxTreeSize;
+  long long fRolloverEvents;
+  long long fRolloverBytes;
+  bool fRolloverCycle;
+  std::string fColumnarFileName;
+  int fColumnarBlockSize;
+
   int fNofGermaniumDetectors;
   int fMaxGermaniumChannel;
   int fNofPlasticDetectors;
@@ -173,13 +665,26 @@ private:
   int fNofBaF2Detectors;
   int fMaxBaF2Channel;
 
-  std::map<uint8_t, std::vector<bool> > fActiveDetectors;
-  std::map<uint8_t, std::vector<std::pair<uint16_t, uint16_t> > > fCoarseTdcWindows;
+  //all detectors ordered by type and number, the detectors of each type start at fFirstDetector
+  std::vector<DetectorConfig> fDetectors;
+  std::array<uint32_t, NOF_DETECTOR_TYPES> fFirstDetector;
+  std::array<uint32_t, NOF_DETECTOR_TYPES> fNofDetectorsOfType;
+  ETdcSelection fTdcSelection;
   std::map<uint8_t, size_t> fMinimumCounts;
 
   //-------------------- event building
   int fWaitingWindow;
   int fCoincidenceWindow;
+  double fFineCoincidenceWindow;
+  uint64_t fWaitingWindowPs;
+  uint64_t fCoincidenceWindowPs;
+  int fNofBuildThreads;
+  int fMinSliceSize;
+  bool fBuildDiagnostics;
+  int fLatenessRange;
+  int fLatenessBins;
+  int fTimeDifferenceRange;
+  int fTimeDifferenceBins;
 };
 
 #endif
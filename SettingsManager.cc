@@ -0,0 +1,102 @@
+#include "SettingsManager.hh"
+
+#include <iostream>
+#include <chrono>
+#include <sys/stat.h>
+
+#include "TextAttributes.hh"
+#include "AllocationCounter.hh"
+
+SettingsManager::SettingsManager(Settings* settings, const std::string& fileName, const std::function<void(Settings&)>& overrides)
+  : fFileName(fileName), fOverrides(overrides), fVerbosityLevel(settings->VerbosityLevel()),
+    fCurrent(settings, [](Settings*) {}), fGeneration(0), fStop(false) {
+  fLoadedTime = ModificationTime();
+  fLoadedFile.ReadFile(fFileName);
+}
+
+SettingsManager::~SettingsManager() {
+  if(fWatcher.joinable()) {
+    fWatchMutex.lock();
+    fStop = true;
+    fWatchMutex.unlock();
+    fWatchCondition.notify_all();
+    fWatcher.join();
+  }
+}
+
+void SettingsManager::Watch(int interval) {
+  if(fWatcher.joinable() || interval <= 0) {
+    return;
+  }
+  fWatcher = std::thread(&SettingsManager::Run, this, interval);
+}
+
+//the file is only read once its modification time hasn't changed for one interval, so that we don't read it while it's being written
+void SettingsManager::Run(int interval) {
+  //the new snapshots aren't part of the steady state of the event building and output
+  AllocationCounter::ExcludeThread();
+  uint64_t previous = fLoadedTime;
+  std::unique_lock<std::mutex> lock(fWatchMutex);
+  while(!fWatchCondition.wait_for(lock, std::chrono::milliseconds(interval), [this]() { return fStop; })) {
+    uint64_t current = ModificationTime();
+    if(current != 0 && current == previous && current != fLoadedTime) {
+      Reload();
+    }
+    previous = current;
+  }
+}
+
+bool SettingsManager::Reload() {
+  std::lock_guard<std::mutex> lock(fReloadMutex);
+  uint64_t modificationTime = ModificationTime();
+  if(modificationTime == 0) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to find settings file '"<<fFileName<<"', keeping the current settings"<<Attribs::Reset<<std::endl;
+    return false;
+  }
+  fLoadedTime = modificationTime;
+
+  EnvFile file;
+  if(!file.ReadFile(fFileName)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"Failed to read settings file '"<<fFileName<<"', keeping the current settings"<<Attribs::Reset<<std::endl;
+    return false;
+  }
+  std::shared_ptr<Settings> current = Current();
+  Settings reread(file, 0);
+  fOverrides(reread);
+  if(!SameLayout(*current, reread)) {
+    std::cerr<<Attribs::Bright<<Foreground::Red<<"The number of detectors or channels in '"<<fFileName<<"' changed, this needs a restart, keeping the current settings"<<Attribs::Reset<<std::endl;
+    return false;
+  }
+  for(const auto& key : fLoadedFile.Changed(file)) {
+    if(!Settings::Reloadable(key)) {
+      std::cerr<<Attribs::Bright<<Foreground::Red<<"'"<<key<<"' changed in '"<<fFileName<<"', this only takes effect at the next start"<<Attribs::Reset<<std::endl;
+    }
+  }
+  fLoadedFile = file;
+
+  //the new snapshot is complete before anyone can see it
+  std::shared_ptr<Settings> fresh = std::make_shared<Settings>(*current);
+  fresh->Update(reread);
+  std::atomic_store(&fCurrent, fresh);
+  fGeneration.fetch_add(1, std::memory_order_release);
+  if(fVerbosityLevel > 0) {
+    std::cout<<Attribs::Bright<<Foreground::Cyan<<"Reloaded settings from '"<<fFileName<<"' ("<<NofReloads()<<". reload)"<<Attribs::Reset<<std::endl;
+  }
+
+  return true;
+}
+
+uint64_t SettingsManager::ModificationTime() {
+  struct stat status;
+  if(stat(fFileName.c_str(), &status) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(status.st_mtim.tv_sec)*1000000000ULL + status.st_mtim.tv_nsec;
+}
+
+bool SettingsManager::SameLayout(Settings& first, Settings& second) {
+  return first.NofGermaniumDetectors() == second.NofGermaniumDetectors() && first.MaxGermaniumChannel() == second.MaxGermaniumChannel() &&
+    first.NofPlasticDetectors() == second.NofPlasticDetectors() && first.MaxPlasticChannel() == second.MaxPlasticChannel() &&
+    first.NofSiliconDetectors() == second.NofSiliconDetectors() && first.MaxSiliconChannel() == second.MaxSiliconChannel() &&
+    first.NofBaF2Detectors() == second.NofBaF2Detectors() && first.MaxBaF2Channel() == second.MaxBaF2Channel();
+}
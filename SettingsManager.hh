@@ -0,0 +1,70 @@
+#ifndef __SETTINGS_MANAGER_HH
+#define __SETTINGS_MANAGER_HH
+
+#include <string>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "EnvFile.hh"
+
+//hot reload of the settings file, RCU-style:
+//a watcher thread checks the modification time of the file and publishes a new snapshot of the settings through an atomic pointer,
+//the snapshots are complete before they are published and never changed afterwards; the stages only read the atomic generation
+//counter at their batch boundaries and take the new snapshot if it changed, the old one is freed once the last stage has moved on
+//a new snapshot is a copy of the current one with only the reloadable keys taken from the file (see Settings::Reloadable: active
+//detectors, coarse TDC windows, TDC selection, waiting and coincidence windows), these are the ones the decoding and building
+//read per batch; changes of all other keys (output, threads, histograms, file names, calibration, ...) only take effect at the
+//next start and are reported as such, and the numbers of detectors and channels have to stay the same
+class SettingsManager {
+public:
+  //the first snapshot are the given settings (not owned), the function applies the command line overrides to each new snapshot
+  SettingsManager(Settings*, const std::string&, const std::function<void(Settings&)>&);
+  ~SettingsManager();
+
+  //starts the watcher thread, checking the file every given number of milliseconds
+  void Watch(int);
+  //reads the file now, returns false (and keeps the current snapshot) if it can't be read or the number of detectors or channels changed
+  bool Reload();
+
+  //lock-free check for a new snapshot
+  uint64_t Generation() const {
+    return fGeneration.load(std::memory_order_acquire);
+  }
+  std::shared_ptr<Settings> Current() const {
+    return std::atomic_load(&fCurrent);
+  }
+  size_t NofReloads() const {
+    return fGeneration.load(std::memory_order_relaxed);
+  }
+
+private:
+  //modification time of the file (ns), 0 if it doesn't exist
+  uint64_t ModificationTime();
+  bool SameLayout(Settings&, Settings&);
+  void Run(int);
+
+  std::string fFileName;
+  std::function<void(Settings&)> fOverrides;
+  int fVerbosityLevel;
+
+  std::shared_ptr<Settings> fCurrent;
+  std::atomic<uint64_t> fGeneration;
+  std::mutex fReloadMutex;
+  uint64_t fLoadedTime;
+  //the file as it was last loaded, to find the keys that changed
+  EnvFile fLoadedFile;
+
+  //watcher thread
+  std::thread fWatcher;
+  std::mutex fWatchMutex;
+  std::condition_variable fWatchCondition;
+  bool fStop;
+};
+
+#endif
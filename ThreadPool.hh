@@ -0,0 +1,78 @@
+#ifndef __THREAD_POOL_HH
+#define __THREAD_POOL_HH
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+//simple fixed size pool of worker threads, jobs are queued and the result can be retrieved via the returned future
+class ThreadPool {
+public:
+  ThreadPool(size_t nofThreads) {
+    fStop = false;
+    if(nofThreads == 0) {
+      nofThreads = 1;
+    }
+    for(size_t i = 0; i < nofThreads; ++i) {
+      fWorkers.emplace_back(&ThreadPool::Work, this);
+    }
+  }
+  ~ThreadPool() {
+    fMutex.lock();
+    fStop = true;
+    fMutex.unlock();
+    fCondition.notify_all();
+    for(auto& worker : fWorkers) {
+      worker.join();
+    }
+  }
+  //disallow copying and moving (the workers hold a pointer to this pool)
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t NofThreads() const {
+    return fWorkers.size();
+  }
+
+  template<class Function> std::future<typename std::result_of<Function()>::type> Enqueue(Function function) {
+    //packaged_task is move-only, but std::function needs to be copyable, so we wrap it in a shared pointer
+    auto task = std::make_shared<std::packaged_task<typename std::result_of<Function()>::type()> >(function);
+    auto result = task->get_future();
+    fMutex.lock();
+    fJobs.push([task]() { (*task)(); });
+    fMutex.unlock();
+    fCondition.notify_one();
+    return result;
+  }
+
+private:
+  void Work() {
+    std::function<void()> job;
+    while(true) {
+      {
+	std::unique_lock<std::mutex> lock(fMutex);
+	fCondition.wait(lock, [this]() { return fStop || !fJobs.empty(); });
+	//when stopping we still finish all queued jobs
+	if(fJobs.empty()) {
+	  return;
+	}
+	job = std::move(fJobs.front());
+	fJobs.pop();
+      }
+      job();
+    }
+  }
+
+  std::vector<std::thread> fWorkers;
+  std::queue<std::function<void()> > fJobs;
+  std::mutex fMutex;
+  std::condition_variable fCondition;
+  bool fStop;
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include "TimeCalibration.hh"
+
+#include <cmath>
+#include <algorithm>
+
+#include "EnvFile.hh"
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+TimeCalibration::TimeCalibration(Settings* settings) {
+  fSettings = settings;
+
+  std::array<int, NOF_DETECTOR_TYPES> nofDetectors = {{ fSettings->NofGermaniumDetectors(), fSettings->NofPlasticDetectors(), fSettings->NofSiliconDetectors(), fSettings->NofBaF2Detectors(), 0 }};
+  std::array<int, NOF_DETECTOR_TYPES> maxChannel = {{ fSettings->MaxGermaniumChannel(), fSettings->MaxPlasticChannel(), fSettings->MaxSiliconChannel(), fSettings->MaxBaF2Channel(), 0 }};
+  TdcCalibration uncalibrated = { 0.f, 0.f, nullptr, 0.f, false };
+  for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+    fNofChannels[type] = maxChannel[type];
+    fDetectors[type].resize(nofDetectors[type], uncalibrated);
+    fWalkTables[type].resize(nofDetectors[type]*(maxChannel[type]+1), 0.f);
+  }
+  fNofUntimed = 0;
+  fNofUncalibrated = 0;
+}
+
+bool TimeCalibration::Load(const std::string& fileName) {
+  TdcCalibration uncalibrated = { 0.f, 0.f, nullptr, 0.f, false };
+  for(auto& detectors : fDetectors) {
+    std::fill(detectors.begin(), detectors.end(), uncalibrated);
+  }
+
+  EnvFile env;
+  if(!env.ReadFile(fileName)) {
+    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to read timing file '",fileName,"', hits will only have the ulm clock as timestamp",Attribs::Reset())<<std::endl;
+    return false;
+  }
+
+  const char* names[NOF_DETECTOR_TYPES] = { "Germanium", "Plastic", "Silicon", "BaF2", "Unknown" };
+  for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+    size_t nofChannels = fNofChannels[type];
+    for(size_t det = 0; det < fDetectors[type].size(); ++det) {
+      std::string prefix = std::string(names[type]) + "." + std::to_string(det);
+      if(!env.Defined(prefix + ".Slope")) {
+	continue;
+      }
+      TdcCalibration& detector = fDetectors[type][det];
+      detector.fOffset = 1000.*env.GetValue(prefix + ".Offset", 0.);
+      detector.fSlope = 1000.*env.GetValue(prefix + ".Slope", 1.);
+      detector.fUntimed = 1000.*env.GetValue(prefix + ".Untimed", env.GetValue(prefix + ".Offset", 0.));
+      detector.fCalibrated = true;
+      double walk = 1000.*env.GetValue(prefix + ".Walk", 0.);
+      if(walk == 0.) {
+	continue;
+      }
+      double exponent = env.GetValue(prefix + ".WalkExponent", 0.5);
+      float* row = fWalkTables[type].data() + det*(nofChannels+1);
+      //channel 0 has no energy, it gets the correction of channel 1
+      for(size_t channel = 0; channel <= nofChannels; ++channel) {
+	row[channel] = walk*std::pow(static_cast<double>(std::max(channel, (size_t) 1)), -exponent);
+      }
+      detector.fWalk = row;
+    }
+  }
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Read timing calibration of "<<NofCalibrated()<<" detectors from '"<<fileName<<"'"<<std::endl;
+  }
+
+  return true;
+}
+
+//the timestamp is calculated in integer ps from the clock (the uncalibrated timestamp), only the TDC time (a few microseconds at most) is a float
+void TimeCalibration::Apply(std::vector<Hit>& hits) {
+  for(auto& hit : hits) {
+    if(!Calibrated(hit.fDetectorType, hit.fDetectorNumber)) {
+      ++fNofUncalibrated;
+      continue;
+    }
+    const TdcCalibration& detector = fDetectors[hit.fDetectorType][hit.fDetectorNumber];
+    float time = detector.fUntimed;
+    if(hit.fTdcHits == 0) {
+      ++fNofUntimed;
+    } else {
+      time = detector.fOffset + detector.fSlope*hit.fTime;
+      if(detector.fWalk != nullptr) {
+	size_t nofChannels = fNofChannels[hit.fDetectorType];
+	time -= detector.fWalk[(hit.fRawEnergy < nofChannels) ? hit.fRawEnergy : nofChannels];
+      }
+    }
+    int64_t timestamp = static_cast<int64_t>(hit.fTimestamp) + std::llround(time);
+    hit.fTimestamp = (timestamp > 0) ? timestamp : 0;
+  }
+}
+
+size_t TimeCalibration::NofCalibrated() const {
+  size_t result = 0;
+  for(size_t type = 0; type < NOF_DETECTOR_TYPES; ++type) {
+    for(size_t det = 0; det < fDetectors[type].size(); ++det) {
+      if(Calibrated(type, det)) {
+	++result;
+      }
+    }
+  }
+  return result;
+}
@@ -0,0 +1,67 @@
+#ifndef __TIME_CALIBRATION_HH
+#define __TIME_CALIBRATION_HH
+
+#include <string>
+#include <vector>
+#include <array>
+#include <stdint.h>
+
+#include "Settings.hh"
+#include "Hit.hh"
+
+//forms the fine timestamps of the decoded hits from the ulm clock and the calibrated TDC time
+//the calibration files use the TEnv format, time = offset + slope*TDC channel - walk*(raw energy)^-exponent in ns:
+//  Germanium.0.Offset:        -350.
+//  Germanium.0.Slope:         0.5
+//  Germanium.0.Walk:          40.
+//  Germanium.0.WalkExponent:  0.5
+//  Germanium.0.Untimed:       -300.
+//the walk correction is a lookup table over the raw energy channels; hits without a TDC time get the untimed time of their detector
+//(default is the offset), so that they stay on the same time origin as the timed hits, and detectors without a slope in the file keep
+//the timestamp of the ulm clock; both kinds of hits are counted, since they can't be built with a coincidence window below 100 ns
+class TimeCalibration {
+public:
+  TimeCalibration(Settings*);
+  ~TimeCalibration(){};
+
+  //reads the calibration file and rebuilds the tables, can be called again at any time (e.g. for each run)
+  //returns false if the file couldn't be read, in which case all hits keep the timestamps of the ulm clock
+  bool Load(const std::string&);
+
+  //sets the timestamp of all hits of the batch
+  void Apply(std::vector<Hit>&);
+
+  bool Calibrated(uint8_t detectorType, uint16_t detectorNumber) const {
+    return detectorType < NOF_DETECTOR_TYPES && detectorNumber < fDetectors[detectorType].size() && fDetectors[detectorType][detectorNumber].fCalibrated;
+  }
+  size_t NofCalibrated() const;
+  //hits of calibrated detectors without a TDC time, and hits of detectors without a timing calibration
+  size_t NofUntimed() const {
+    return fNofUntimed;
+  }
+  size_t NofUncalibrated() const {
+    return fNofUncalibrated;
+  }
+
+private:
+  //coefficients of one detector in ps
+  struct TdcCalibration {
+    float fOffset;
+    float fSlope;//per TDC channel
+    const float* fWalk;//per raw energy channel, nullptr without walk correction
+    float fUntimed;//time of hits without a TDC time
+    bool fCalibrated;
+  };
+
+  Settings* fSettings;
+
+  std::array<std::vector<TdcCalibration>, NOF_DETECTOR_TYPES> fDetectors;
+  //for each detector type one row per detector with the walk correction of the raw energy channels 0 - fNofChannels
+  std::array<size_t, NOF_DETECTOR_TYPES> fNofChannels;
+  std::array<std::vector<float>, NOF_DETECTOR_TYPES> fWalkTables;
+
+  size_t fNofUntimed;
+  size_t fNofUncalibrated;
+};
+
+#endif
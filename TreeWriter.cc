@@ -0,0 +1,251 @@
+#include "TreeWriter.hh"
+
+#include <iomanip>
+#include <sstream>
+#include <limits>
+#include <algorithm>
+
+#include "Utilities.hh"
+#include "TextAttributes.hh"
+
+TreeWriter::TreeWriter(Settings* settings, TFile* file, bool allowRollover) {
+  fSettings = settings;
+  fMainFile = file;
+  fFile = nullptr;
+  fTree = nullptr;
+  fSchema = fSettings->TreeSchema();
+  fRollover = allowRollover && fSettings->Rollover();
+  fMultiHitTdc = fSettings->MultiHitTdc();
+  fTimestamps = !fSettings->TimingFileName().empty();
+  fNofDroppedHits = 0;
+  fFileNumber = 0;
+  fFirstEntry = 0;
+  fNofEntries = 0;
+  fTotalBytes = 0.;
+
+  //the arrays of the flat schema are allocated once with the maximum multiplicity, so their addresses stay valid
+  fLeaf = &fEvent;
+  if(fSchema == ETreeSchema::kFlat) {
+    fType.resize(fSettings->MaxMultiplicity());
+    fNumber.resize(fSettings->MaxMultiplicity());
+    fRawEnergy.resize(fSettings->MaxMultiplicity());
+    fEnergy.resize(fSettings->MaxMultiplicity());
+    fTime.resize(fSettings->MaxMultiplicity());
+    fClock.resize(fSettings->MaxMultiplicity());
+    if(fTimestamps) {
+      fTimestamp.resize(fSettings->MaxMultiplicity());
+    }
+    fMultiplicity = 0;
+    if(fMultiHitTdc) {
+      fNofTdcTimes.resize(fSettings->MaxMultiplicity());
+      fTdcTimes.resize(fSettings->MaxMultiplicity()*MAX_TDC_TIMES);
+    }
+    fTotalTdcTimes = 0;
+  }
+
+  if(fRollover) {
+    //the files are named after the main file: <name>_000.root, <name>_001.root, ...
+    fBaseName = fMainFile->GetName();
+    if(fBaseName.size() > 5 && fBaseName.compare(fBaseName.size()-5, 5, ".root") == 0) {
+      fBaseName.erase(fBaseName.size()-5);
+    }
+    fManifest.open((fBaseName + ".manifest").c_str());
+    fManifest<<"#file first-entry nof-entries first-clock last-clock"<<std::endl;
+    NextFile();
+  } else {
+    fFile = fMainFile;
+    CreateTree();
+  }
+
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Writing tree with "<<(fSchema == ETreeSchema::kFlat ? "flat" : "event")<<" schema using "<<fSettings->NofOutputThreads()<<" thread(s)";
+    if(fRollover) {
+      std::cout<<", rolling over after "<<fSettings->RolloverEvents()<<" events/"<<fSettings->RolloverBytes()<<" bytes"<<(fSettings->RolloverCycle() ? "/each cycle" : "");
+    }
+    std::cout<<std::endl;
+  }
+}
+
+TreeWriter::~TreeWriter() {
+  Close();
+}
+
+void TreeWriter::CreateTree() {
+  fFile->cd();
+  fTree = new TTree("tree","gsort tree");
+  fFirstClock = std::numeric_limits<uint64_t>::max();
+  fLastClock = 0;
+
+  int basketSize = fSettings->BasketSize();
+  switch(fSchema) {
+  case ETreeSchema::kEvent:
+    fTree->Branch("Event",&fLeaf, basketSize);
+    fTree->BranchRef();
+    break;
+
+  case ETreeSchema::kFlat:
+    fTree->Branch("Multiplicity", &fMultiplicity, "Multiplicity/i", basketSize);
+    fTree->Branch("Type", fType.data(), "Type[Multiplicity]/b", basketSize);
+    fTree->Branch("Number", fNumber.data(), "Number[Multiplicity]/s", basketSize);
+    fTree->Branch("RawEnergy", fRawEnergy.data(), "RawEnergy[Multiplicity]/s", basketSize);
+    fTree->Branch("Energy", fEnergy.data(), "Energy[Multiplicity]/F", basketSize);
+    fTree->Branch("Time", fTime.data(), "Time[Multiplicity]/s", basketSize);
+    fTree->Branch("Clock", fClock.data(), "Clock[Multiplicity]/l", basketSize);
+    if(fTimestamps) {
+      fTree->Branch("Timestamp", fTimestamp.data(), "Timestamp[Multiplicity]/l", basketSize);
+    }
+    if(fMultiHitTdc) {
+      //the additional times of hit i follow the ones of hit i-1
+      fTree->Branch("NofTdcTimes", fNofTdcTimes.data(), "NofTdcTimes[Multiplicity]/b", basketSize);
+      fTree->Branch("TotalTdcTimes", &fTotalTdcTimes, "TotalTdcTimes/i", basketSize);
+      fTree->Branch("TdcTimes", fTdcTimes.data(), "TdcTimes[TotalTdcTimes]/s", basketSize);
+    }
+    break;
+  }
+
+  if(fSettings->AutoFlush() != 0) {
+    fTree->SetAutoFlush(fSettings->AutoFlush());
+  }
+  //with rollover we start the new files ourselves, ROOT switching files on its own would leave them out of the manifest
+  if(fRollover) {
+    fTree->SetMaxTreeSize(std::numeric_limits<Long64_t>::max());
+  } else {
+    fTree->SetMaxTreeSize(fSettings->MaxTreeSize());
+  }
+
+#ifdef R__USE_IMT
+  //with implicit multithreading enabled, Fill() compresses the baskets of the branches in parallel
+  //the entries are still filled in order by a single thread, so the order stays deterministic
+  fTree->SetImplicitMT(fSettings->NofOutputThreads() > 1);
+#endif
+}
+
+void TreeWriter::Set(const BuiltEvent& event) {
+  fEventFirstClock = std::numeric_limits<uint64_t>::max();
+  fEventLastClock = 0;
+  const FifoRecords& records = event.Records();
+  for(const auto& hit : event.Hits()) {
+    fEventFirstClock = std::min(fEventFirstClock, records.Record(hit).fClock);
+    fEventLastClock = std::max(fEventLastClock, records.Record(hit).fClock);
+  }
+
+  if(fSchema == ETreeSchema::kEvent) {
+    fEvent.Set(event.Hits(), records);
+    return;
+  }
+
+  fMultiplicity = event.NofHits();
+  if(fMultiplicity > fType.size()) {
+    fNofDroppedHits += fMultiplicity - fType.size();
+    if(fSettings->VerbosityLevel() > 0) {
+      std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Event with ",fMultiplicity," hits exceeds the maximum multiplicity of ",fType.size(),", dropping the remaining hits",Attribs::Reset())<<std::endl;
+    }
+    fMultiplicity = fType.size();
+  }
+  const std::vector<Hit>& hits = event.Hits();
+  for(UInt_t i = 0; i < fMultiplicity; ++i) {
+    fType[i] = hits[i].fDetectorType;
+    fNumber[i] = hits[i].fDetectorNumber;
+    fRawEnergy[i] = hits[i].fRawEnergy;
+    fEnergy[i] = hits[i].fEnergy;
+    fTime[i] = hits[i].fTime;
+    fClock[i] = records.Record(hits[i]).fClock;
+  }
+  if(fTimestamps) {
+    for(UInt_t i = 0; i < fMultiplicity; ++i) {
+      fTimestamp[i] = hits[i].fTimestamp;
+    }
+  }
+  if(fMultiHitTdc) {
+    fTotalTdcTimes = 0;
+    for(UInt_t i = 0; i < fMultiplicity; ++i) {
+      fNofTdcTimes[i] = hits[i].fNofTdcTimes;
+      const uint16_t* times = records.TdcTimes(hits[i]);
+      for(uint8_t j = 0; j < hits[i].fNofTdcTimes; ++j) {
+	fTdcTimes[fTotalTdcTimes++] = times[j];
+      }
+    }
+  }
+}
+
+Int_t TreeWriter::Fill() {
+  if(fTree == nullptr) {
+    return 0;
+  }
+  Int_t result = fTree->Fill();
+  ++fNofEntries;
+  fFirstClock = std::min(fFirstClock, fEventFirstClock);
+  fLastClock = std::max(fLastClock, fEventLastClock);
+
+  if(fRollover && ((fSettings->RolloverEvents() > 0 && fTree->GetEntries() >= fSettings->RolloverEvents()) ||
+		   (fSettings->RolloverBytes() > 0 && fTree->GetZipBytes() >= fSettings->RolloverBytes()))) {
+    NextFile();
+  }
+
+  return result;
+}
+
+void TreeWriter::EndOfCycle() {
+  if(fRollover && fSettings->RolloverCycle() && fTree != nullptr && fTree->GetEntries() > 0) {
+    NextFile();
+  }
+}
+
+//writes the tree to its current file (without rollover ROOT might have switched the file because of the maximum tree size)
+//and adds the file to the manifest
+void TreeWriter::CloseFile() {
+  if(fTree == nullptr) {
+    return;
+  }
+  TFile* file = fTree->GetCurrentFile();
+  if(file == nullptr) {
+    file = fFile;
+  }
+  file->cd();
+  fTree->Write();
+  fTotalBytes += fTree->GetTotBytes();
+
+  if(fRollover) {
+    Long64_t nofEntries = fTree->GetEntries();
+    fManifest<<file->GetName()<<" "<<fFirstEntry<<" "<<nofEntries<<" ";
+    if(nofEntries > 0) {
+      fManifest<<fFirstClock<<" "<<fLastClock<<std::endl;
+    } else {
+      fManifest<<"0 0"<<std::endl;
+    }
+    fFirstEntry += nofEntries;
+    //this also deletes the tree
+    file->Close();
+    delete file;
+  } else {
+    fFirstEntry += fTree->GetEntries();
+  }
+  fTree = nullptr;
+  fFile = nullptr;
+}
+
+void TreeWriter::NextFile() {
+  CloseFile();
+
+  std::ostringstream fileName;
+  fileName<<fBaseName<<"_"<<std::setw(3)<<std::setfill('0')<<fFileNumber++<<".root";
+  fFile = new TFile(fileName.str().c_str(), "recreate");
+  if(!fFile->IsOpen()) {
+    std::cerr<<Show(Attribs::Bright(),Foreground::Red(),"Failed to open output file '",fileName.str(),"'",Attribs::Reset())<<std::endl;
+    delete fFile;
+    fFile = nullptr;
+    return;
+  }
+  fFile->SetCompressionSettings(fSettings->CompressionSettings());
+  if(fSettings->VerbosityLevel() > 0) {
+    std::cout<<"Writing tree to '"<<fileName.str()<<"'"<<std::endl;
+  }
+  CreateTree();
+}
+
+void TreeWriter::Close() {
+  CloseFile();
+  if(fManifest.is_open()) {
+    fManifest.close();
+  }
+}
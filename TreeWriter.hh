@@ -0,0 +1,98 @@
+#ifndef __TREE_WRITER_HH
+#define __TREE_WRITER_HH
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+#include "TFile.h"
+#include "TTree.h"
+
+#include "Settings.hh"
+#include "BuiltEvent.hh"
+#include "Event.hh"
+
+//writes the built events to the tree using the schema selected in the settings:
+//kEvent - one "Event" branch with the Event/Detector classes (incl. the additional TDC times of a multi-hit TDC selection)
+//kFlat  - flat, split branches: the multiplicity and one variable-length array per hit quantity, with a multi-hit TDC selection
+//         also the number of additional TDC times per hit and all additional TDC times of the event in one packed array,
+//         and with a timing calibration the fine timestamps (ps)
+//the branches are set up once for the settings at the start: a reload of the settings never switches the TDC selection between
+//one and multiple times per hit, and the timing file is only read at the start (see Settings::Reloadable)
+//without rollover the tree is written to the main file, otherwise a new file is started after a number of events,
+//a number of bytes, or at the end of each cycle, and a manifest of all files with their event and clock ranges is written
+class TreeWriter {
+public:
+  TreeWriter(Settings*, TFile*, bool allowRollover = true);
+  ~TreeWriter();
+
+  //converts the built event into the branch variables
+  void Set(const BuiltEvent&);
+  //writes the branch variables to the tree (and starts a new file if necessary)
+  Int_t Fill();
+  //end of a cycle has been reached (starts a new file if we roll over at each cycle)
+  void EndOfCycle();
+  //writes the tree, closes the current file, and writes the manifest
+  void Close();
+
+  //number of entries written in all files
+  Long64_t NofEntries() {
+    return fNofEntries;
+  }
+  //uncompressed bytes of all trees written so far
+  double TotalBytes() {
+    return fTotalBytes + (fTree != nullptr ? fTree->GetTotBytes() : 0);
+  }
+  //number of hits dropped because an event had more than the maximum multiplicity (flat schema only)
+  size_t NofDroppedHits() {
+    return fNofDroppedHits;
+  }
+
+private:
+  void CreateTree();
+  void CloseFile();
+  void NextFile();
+
+  Settings* fSettings;
+  TFile* fMainFile;
+  TFile* fFile;
+  TTree* fTree;
+  ETreeSchema fSchema;
+  bool fRollover;
+
+  //event schema, the leaf always points to the same (refilled) event
+  Event fEvent;
+  Event* fLeaf;
+
+  //flat schema
+  UInt_t fMultiplicity;
+  std::vector<UChar_t> fType;
+  std::vector<UShort_t> fNumber;
+  std::vector<UShort_t> fRawEnergy;
+  std::vector<Float_t> fEnergy;
+  std::vector<UShort_t> fTime;
+  std::vector<ULong64_t> fClock;
+  bool fTimestamps;
+  std::vector<ULong64_t> fTimestamp;
+  bool fMultiHitTdc;
+  std::vector<UChar_t> fNofTdcTimes;
+  UInt_t fTotalTdcTimes;
+  std::vector<UShort_t> fTdcTimes;
+  size_t fNofDroppedHits;
+
+  //clock range of the current event and of the current file
+  uint64_t fEventFirstClock;
+  uint64_t fEventLastClock;
+  uint64_t fFirstClock;
+  uint64_t fLastClock;
+
+  //rollover
+  std::string fBaseName;
+  size_t fFileNumber;
+  Long64_t fFirstEntry;
+  Long64_t fNofEntries;
+  double fTotalBytes;
+  std::ofstream fManifest;
+};
+
+#endif